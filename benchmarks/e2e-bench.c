@@ -0,0 +1,179 @@
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+/* End-to-end benchmark: ping-pong over muQuinet
+ *
+ * Run under the interceptor against `muquinetd --loopback` (see
+ * run-e2e-bench.sh): every message goes through the RPC layer, Socket,
+ * Tcp/Udp, Ip and the Interface layer, is echoed back by the loopback
+ * peer and comes all the way up again.
+ *
+ * usage: e2e-bench [-p tcp|udp] [-a addr] [-P port] [-s size] [-n count]
+ *                  [-w warmup]
+ */
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <time.h>
+#include <unistd.h>
+
+static uint64_t
+now_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static int
+cmp_u64(const void* a, const void* b)
+{
+    uint64_t x = *(const uint64_t*)a, y = *(const uint64_t*)b;
+    return x < y ? -1 : (x > y);
+}
+
+static double
+percentile_us(const uint64_t* sorted, int n, double p)
+{
+    int idx = (int)(p / 100.0 * (n - 1) + 0.5);
+    return sorted[idx] / 1000.0;
+}
+
+/* send one message, wait for the whole echo */
+static int
+round_trip(int sockfd, const char* msg, char* buf, int size)
+{
+    if (send(sockfd, msg, size, 0) != size) {
+        perror("send");
+        return -1;
+    }
+
+    int received = 0;
+    while (received < size) {
+        int n = recv(sockfd, buf + received, size - received, 0);
+        if (n <= 0) {
+            perror("recv");
+            return -1;
+        }
+        received += n;
+    }
+    return 0;
+}
+
+int
+main(int argc, char* argv[])
+{
+    const char* proto = "tcp";
+    const char* dest_ipaddr = "10.0.0.1";
+    int dest_port = 7;
+    int size = 64;
+    int count = 10000;
+    int warmup = 100;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "p:a:P:s:n:w:")) != -1) {
+        switch (opt) {
+            case 'p':
+                proto = optarg;
+                break;
+            case 'a':
+                dest_ipaddr = optarg;
+                break;
+            case 'P':
+                dest_port = atoi(optarg);
+                break;
+            case 's':
+                size = atoi(optarg);
+                break;
+            case 'n':
+                count = atoi(optarg);
+                break;
+            case 'w':
+                warmup = atoi(optarg);
+                break;
+            default:
+                fprintf(stderr, "usage: %s [-p tcp|udp] [-a addr] [-P port] "
+                                "[-s size] [-n count] [-w warmup]\n",
+                        argv[0]);
+                return 1;
+        }
+    }
+    if (size <= 0 || size > 1400 || count <= 0) {
+        fprintf(stderr, "size must be in [1, 1400], count > 0\n");
+        return 1;
+    }
+
+    /* 1. socket & connect */
+
+    int is_tcp = strcmp(proto, "udp") != 0;
+    int sockfd = socket(AF_INET, is_tcp ? SOCK_STREAM : SOCK_DGRAM, 0);
+    if (sockfd == -1) {
+        perror("socket");
+        return 1;
+    }
+
+    struct sockaddr_in remote;
+    memset(&remote, 0, sizeof(remote));
+    remote.sin_family = AF_INET;
+    inet_pton(AF_INET, dest_ipaddr, &remote.sin_addr);
+    remote.sin_port = htons(dest_port);
+    if (connect(sockfd, (struct sockaddr*)&remote, sizeof(remote)) == -1) {
+        perror("connect");
+        return 1;
+    }
+
+    /* 2. warm up, then measure every round trip */
+
+    char* msg = malloc(size);
+    char* buf = malloc(size);
+    uint64_t* rtts = malloc(sizeof(uint64_t) * count);
+    memset(msg, 'm', size);
+
+    for (int i = 0; i < warmup; ++i) {
+        if (round_trip(sockfd, msg, buf, size) < 0)
+            return 1;
+    }
+
+    uint64_t begin = now_ns();
+    for (int i = 0; i < count; ++i) {
+        uint64_t t0 = now_ns();
+        if (round_trip(sockfd, msg, buf, size) < 0)
+            return 1;
+        rtts[i] = now_ns() - t0;
+    }
+    double elapsed = (now_ns() - begin) / 1e9;
+
+    /* 3. report
+     *
+     * Each round trip is 2 packets through the stack (request + echo),
+     * both counted for packets/s and Gbit/s (payload only).
+     */
+
+    qsort(rtts, count, sizeof(uint64_t), cmp_u64);
+
+    double rtt_per_s = count / elapsed;
+    double pkt_per_s = 2 * rtt_per_s;
+    double gbit_per_s = pkt_per_s * size * 8 / 1e9;
+
+    printf("proto=%s size=%d count=%d elapsed=%.3fs\n", is_tcp ? "tcp" : "udp",
+           size, count, elapsed);
+    printf("round_trips/s=%.0f packets/s=%.0f Gbit/s=%.4f\n", rtt_per_s,
+           pkt_per_s, gbit_per_s);
+    printf("rtt_us p50=%.1f p90=%.1f p99=%.1f p99.9=%.1f max=%.1f\n",
+           percentile_us(rtts, count, 50), percentile_us(rtts, count, 90),
+           percentile_us(rtts, count, 99), percentile_us(rtts, count, 99.9),
+           rtts[count - 1] / 1000.0);
+
+    free(msg);
+    free(buf);
+    free(rtts);
+    close(sockfd);
+    return 0;
+}
@@ -0,0 +1,436 @@
+/* Microbenchmarks for muQuinetd hot primitives
+ *
+ * Each benchmark is calibrated (iterations doubled) until it runs for at
+ * least --min-time ms, results go to stdout (or --out FILE) as JSON so
+ * that runs can be diffed for regressions.
+ *
+ * usage: micro-bench [--filter SUBSTR] [--min-time MS] [--out FILE]
+ */
+
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/utsname.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <cassert>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <list>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "muquinetd/Conf.h"
+#include "muquinetd/Logging.h"
+#include "muquinetd/Pcb.h"
+#include "muquinetd/SocketBuffer.h"
+#include "muquinetd/base/InternetChecksum.h"
+#include "muquinetd/ip/Defrager.h"
+#include "muquinetd/ip/IpHeader.h"
+#include "muquinetd/mux/EventLoop.h"
+#include "muquinetd/mux/SelectableChannel.h"
+#include "muquinetd/mux/Socket.h"
+#include "muquinetd/mux/req-resp-channel/ReqRespChannel.h"
+#include "rpc/cpp_out/request.pb.h"
+#include "rpc/cpp_out/response.pb.h"
+#include "rpc/rpc.h"
+
+using std::shared_ptr;
+using std::string;
+using std::vector;
+
+namespace {
+
+/*  Harness */
+
+struct Result
+{
+    string name;
+    long iterations;
+    double nsPerOp;
+    long bytesPerOp; // 0 if not meaningful
+};
+
+vector<Result> results;
+string filter;
+double minTimeNs = 200 * 1e6;
+
+uint64_t
+nowNs()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+template <typename T>
+inline void
+doNotOptimize(const T& v)
+{
+    asm volatile("" : : "r,m"(v) : "memory");
+}
+
+// body(n) runs the operation n times
+void
+bench(const string& name, const std::function<void(long)>& body,
+      long bytesPerOp = 0)
+{
+    if (!filter.empty() && name.find(filter) == string::npos)
+        return;
+
+    body(1); // warm up caches and pools
+
+    long n = 1;
+    uint64_t elapsed = 0;
+    for (;;) {
+        uint64_t begin = nowNs();
+        body(n);
+        elapsed = nowNs() - begin;
+        if (elapsed >= minTimeNs || n >= (1L << 30))
+            break;
+        n *= 2;
+    }
+
+    Result r{ name, n, (double)elapsed / n, bytesPerOp };
+    fprintf(stderr, "%-36s %12ld iters %12.1f ns/op\n", name.c_str(), n,
+            r.nsPerOp);
+    results.push_back(r);
+}
+
+void
+writeJson(FILE* out)
+{
+    struct utsname uts;
+    uname(&uts);
+
+    fprintf(out, "{\n");
+    fprintf(out, "  \"context\": {\n");
+    fprintf(out, "    \"timestamp\": %ld,\n", (long)time(nullptr));
+    fprintf(out, "    \"host\": \"%s\",\n", uts.nodename);
+    fprintf(out, "    \"kernel\": \"%s\",\n", uts.release);
+    fprintf(out, "    \"num_cpus\": %ld\n", sysconf(_SC_NPROCESSORS_ONLN));
+    fprintf(out, "  },\n");
+    fprintf(out, "  \"benchmarks\": [");
+    for (size_t i = 0; i < results.size(); ++i) {
+        const Result& r = results[i];
+        fprintf(out, "%s\n    {\"name\": \"%s\", \"iterations\": %ld, "
+                     "\"ns_per_op\": %.2f, \"ops_per_second\": %.0f",
+                i ? "," : "", r.name.c_str(), r.iterations, r.nsPerOp,
+                1e9 / r.nsPerOp);
+        if (r.bytesPerOp) {
+            fprintf(out, ", \"bytes_per_second\": %.0f",
+                    r.bytesPerOp * 1e9 / r.nsPerOp);
+        }
+        fprintf(out, "}");
+    }
+    fprintf(out, "\n  ]\n}\n");
+}
+
+/*  InternetChecksum */
+
+void
+benchChecksum()
+{
+    for (int len : { 20, 64, 1500, 9000, 65535 }) {
+        vector<char> buf(len);
+        for (int i = 0; i < len; ++i)
+            buf[i] = (char)i;
+
+        bench("checksum/" + std::to_string(len),
+              [&](long n) {
+                  for (long i = 0; i < n; ++i) {
+                      doNotOptimize(
+                          InternetChecksum::checksum(buf.data(), len, 0));
+                  }
+              },
+              len);
+    }
+}
+
+/*  Pcbs::find */
+
+class BenchPcb : public Pcb
+{
+public:
+    __be16 nextAvailLocalPort() override { return 0; }
+};
+
+void
+benchPcbsFind()
+{
+    for (int npcbs : { 10, 1000, 100000 }) {
+        vector<shared_ptr<Pcb>> owners;
+        std::list<std::weak_ptr<Pcb>> pcbs;
+
+        struct in_addr faddr, laddr;
+        inet_pton(AF_INET, "10.0.0.1", &faddr);
+        inet_pton(AF_INET, "10.0.0.2", &laddr);
+
+        for (int i = 0; i < npcbs; ++i) {
+            auto pcb = std::make_shared<BenchPcb>();
+            pcb->faddr = faddr;
+            pcb->fport = htons(80);
+            pcb->laddr = laddr;
+            pcb->lport = htons(10000 + i % 50000);
+            owners.push_back(pcb);
+            pcbs.push_back(pcb);
+        }
+
+        // look up the one in the middle
+        __be16 lport = htons(10000 + (npcbs / 2) % 50000);
+        bench("pcbs_find/" + std::to_string(npcbs), [&](long n) {
+            for (long i = 0; i < n; ++i) {
+                doNotOptimize(
+                    Pcbs::find(pcbs, faddr, htons(80), laddr, lport));
+            }
+        });
+    }
+}
+
+/*  Defrager::defrag */
+
+const int fragPayload = 1480;
+
+SocketBufferPtr
+makeFragment(int idx, int nfrags, __be16 id)
+{
+    SocketBufferPtr skbuf = SocketBuffers::alloc(20 + fragPayload);
+    skbuf->reserve(0);
+    IpHeader* iphdr = (IpHeader*)skbuf->put(20 + fragPayload);
+    memset(iphdr, 0, 20);
+    iphdr->version = 4;
+    iphdr->ihl = 5;
+    iphdr->tot_len = htons(20 + fragPayload);
+    iphdr->id = id;
+    iphdr->frag_off = htons((idx * fragPayload / 8) |
+                            (idx == nfrags - 1 ? 0 : IP_MF_MASK));
+    iphdr->ttl = 64;
+    iphdr->protocol = IPPROTO_UDP;
+    iphdr->saddr = htonl(0x0a000001);
+    iphdr->daddr = htonl(0x0a000002);
+    skbuf->network_hdr = (char*)iphdr;
+    return skbuf;
+}
+
+void
+benchDefrag()
+{
+    Defrager defrager;
+    __be16 id = 0;
+
+    for (int nfrags : { 2, 8, 44 }) {
+        for (bool reversed : { false, true }) {
+            string name = string("defrag/") +
+                          (reversed ? "reversed/" : "in_order/") +
+                          std::to_string(nfrags);
+            // one op = one datagram reassembled from nfrags fragments
+            bench(name,
+                  [&](long n) {
+                      for (long i = 0; i < n; ++i) {
+                          ++id;
+                          SocketBufferPtr packet;
+                          for (int f = 0; f < nfrags; ++f) {
+                              int idx = reversed ? nfrags - 1 - f : f;
+                              packet = defrager.defrag(
+                                  makeFragment(idx, nfrags, id));
+                          }
+                          assert(packet);
+                      }
+                  },
+                  (long)nfrags * fragPayload);
+        }
+    }
+}
+
+/*  IpIdGenerator::next */
+
+void
+benchIpId()
+{
+    IpIdGenerator idgen;
+    bench("ipid_next", [&](long n) {
+        for (long i = 0; i < n; ++i) {
+            doNotOptimize(idgen.next());
+        }
+    });
+}
+
+/*  Request/Response round trip through ReqRespChannel
+ *
+ *  The "interceptor" end of a SOCK_SEQPACKET socketpair serializes a
+ *  Sendto Request, the ReqRespChannel end parses it, calls the handler,
+ *  serializes the Response back; then the interceptor end parses it.
+ */
+
+void
+benchReqRespChannel()
+{
+    for (int payload : { 64, 1400 }) {
+        int fds[2];
+        if (socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_NONBLOCK, 0, fds) ==
+            -1) {
+            perror("socketpair");
+            return;
+        }
+
+        auto rrChannel = std::make_shared<ReqRespChannel>(fds[0]);
+        rrChannel->setOnNewRequestCB(
+            [](const shared_ptr<ReqRespChannel>&,
+               const shared_ptr<const Request>& req) {
+                auto resp = std::make_shared<Response>();
+                resp->set_retcode(Response::RetCode::Response_RetCode_OK);
+                resp->mutable_sendtocall()->set_ret(
+                    req->sendtocall().buf().size());
+                return resp;
+            });
+        SelectableChannel* sChannel = rrChannel->getSelectableChannel();
+
+        Request req;
+        req.set_pid(getpid());
+        req.mutable_sendtocall()->set_buf(string(payload, 'm'));
+        req.mutable_sendtocall()->set_flags(0);
+
+        static char buf[RPC_MESSAGE_MAX_SIZE];
+        bench("rpc_roundtrip/sendto/" + std::to_string(payload),
+              [&](long n) {
+                  for (long i = 0; i < n; ++i) {
+                      int len = req.ByteSize();
+                      req.SerializeToArray(buf, sizeof(buf));
+                      if (::write(fds[1], buf, len) != len)
+                          abort();
+
+                      sChannel->setEventsReceived(EPOLLIN);
+                      sChannel->handleEventsReceived();
+
+                      int nread = ::read(fds[1], buf, sizeof(buf));
+                      Response resp;
+                      resp.ParseFromArray(buf, nread);
+                      doNotOptimize(resp.retcode());
+                  }
+              },
+              payload);
+
+        ::close(fds[1]);
+    }
+}
+
+/*  Socket::putToRecvQ / takeFromRecvQ */
+
+void
+benchSocketRecvQ()
+{
+    Socket sock(Socket::UDP, false);
+    struct sockaddr_in peer;
+    memset(&peer, 0, sizeof(peer));
+
+    bench("socket_recvq/put_take", [&](long n) {
+        for (long i = 0; i < n; ++i) {
+            sock.putToRecvQ(peer, SocketBuffers::alloc(256));
+            SocketBufferPtr skbuf;
+            sock.takeFromRecvQ(peer, skbuf);
+            doNotOptimize(skbuf.get());
+        }
+    });
+
+    const int batch = 64;
+    bench("socket_recvq/put_take_batch64", [&](long n) {
+        for (long i = 0; i < n; ++i) {
+            for (int b = 0; b < batch; ++b)
+                sock.putToRecvQ(peer, SocketBuffers::alloc(256));
+            for (int b = 0; b < batch; ++b) {
+                SocketBufferPtr skbuf;
+                sock.takeFromRecvQ(peer, skbuf);
+                doNotOptimize(skbuf.get());
+            }
+        }
+    });
+}
+
+/*  EventLoop add/remove churn, with 0 / 1000 other channels registered */
+
+void
+benchEventLoopChurn()
+{
+    for (int nidle : { 0, 1000 }) {
+        EventLoop loop;
+
+        vector<int> fds;
+        vector<std::unique_ptr<SelectableChannel>> idle;
+        for (int i = 0; i < nidle; ++i) {
+            int fd = eventfd(0, EFD_NONBLOCK);
+            fds.push_back(fd);
+            idle.emplace_back(new SelectableChannel(fd));
+            idle.back()->enableReading();
+            loop.addChannel(idle.back().get());
+        }
+
+        int fd = eventfd(0, EFD_NONBLOCK);
+        SelectableChannel churn(fd);
+        churn.enableReading();
+
+        bench("eventloop_churn/" + std::to_string(nidle), [&](long n) {
+            for (long i = 0; i < n; ++i) {
+                loop.addChannel(&churn);
+                loop.removeChannel(&churn);
+            }
+        });
+
+        for (auto& c : idle)
+            loop.removeChannel(c.get());
+        for (int f : fds)
+            ::close(f);
+        ::close(fd);
+    }
+}
+
+} // namespace {
+
+int
+main(int argc, char* argv[])
+{
+    const char* outPath = nullptr;
+    for (int i = 1; i < argc; ++i) {
+        if (!strcmp(argv[i], "--filter") && i + 1 < argc) {
+            filter = argv[++i];
+        } else if (!strcmp(argv[i], "--min-time") && i + 1 < argc) {
+            minTimeNs = atof(argv[++i]) * 1e6;
+        } else if (!strcmp(argv[i], "--out") && i + 1 < argc) {
+            outPath = argv[++i];
+        } else {
+            fprintf(stderr, "usage: %s [--filter SUBSTR] [--min-time MS] "
+                            "[--out FILE]\n",
+                    argv[0]);
+            return 1;
+        }
+    }
+
+    // What is measured is the code path, not the logging backend
+    Conf::get()->logging.level = "warning";
+    Conf::get()->logging.to_stdout = true;
+    LoggingInitializer logging;
+    logging.run();
+
+    benchChecksum();
+    benchPcbsFind();
+    benchDefrag();
+    benchIpId();
+    benchReqRespChannel();
+    benchSocketRecvQ();
+    benchEventLoopChurn();
+
+    FILE* out = outPath ? fopen(outPath, "w") : stdout;
+    if (!out) {
+        perror("fopen");
+        return 1;
+    }
+    writeJson(out);
+    if (out != stdout)
+        fclose(out);
+    return 0;
+}
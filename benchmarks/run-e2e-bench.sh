@@ -0,0 +1,27 @@
+#!/bin/bash
+#
+# End-to-end baseline: muquinetd with the in-memory loopback peer, no root
+# or TUN device needed. Extra arguments go to e2e-bench (e.g. -s 1024).
+#
+#   bin/bench/run-e2e-bench.sh [-n count] [-s size]
+
+HERE=$( cd $(dirname $0) && pwd )
+MUQUINETD="${HERE}/../muquinetd"
+INTERCEPTOR_DSO="${HERE}/../../lib/libmuquinet_interceptor.so"
+BENCH="${HERE}/muquinet_e2e_bench"
+
+export MUQUINET_RUN_DIR=$(mktemp -d)
+trap 'kill ${daemon_pid} 2>/dev/null; rm -rf ${MUQUINET_RUN_DIR}' EXIT
+
+"${MUQUINETD}" --loopback -T -l warning > "${MUQUINET_RUN_DIR}/muquinetd.log" 2>&1 &
+daemon_pid=$!
+
+# wait for the RPC socket
+for i in $(seq 50); do
+    [ -S "${MUQUINET_RUN_DIR}/master.socket" ] && break
+    sleep 0.1
+done
+
+for proto in udp tcp; do
+    LD_PRELOAD="${INTERCEPTOR_DSO}" "${BENCH}" -p ${proto} "$@" || exit 1
+done
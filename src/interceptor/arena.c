@@ -0,0 +1,185 @@
+/*
+ * muQuinet, an userspace TCP/IP network stack.
+ * Copyright (C) 2018 rtdarwin
+ *
+ * This program is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+
+ * You should have received a copy of the GNU General Public
+ * License along with this program.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include "arena.h"
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "interceptor.h"
+#include "logging.h"
+#include "rpc/arena.h"
+
+#if RPC_ARENA_CHUNKS > 64
+#error "chunks of the arena are tracked by one uint64_t"
+#endif
+#define CHUNKS_MASK                                                            \
+    (RPC_ARENA_CHUNKS == 64 ? ~0ull : (1ull << (RPC_ARENA_CHUNKS % 64)) - 1)
+
+static int g_memfd = -1;
+static char* g_base;
+static bool g_enabled;
+
+// bit i set: chunk i is owned by a thread
+static uint64_t g_chunks;
+static pthread_key_t g_chunk_key;
+// chunk + 1, 0 for none yet
+static __thread int t_chunk;
+
+static void
+release_chunk(void* value)
+{
+    int chunk = (int)(intptr_t)value - 1;
+    __atomic_fetch_and(&g_chunks, ~(1ull << chunk), __ATOMIC_RELEASE);
+}
+
+// fork() 之后子进程与父进程共享同一个 arena，子进程不再使用它
+static void
+at_fork_child()
+{
+    g_enabled = false;
+}
+
+void
+arena_module_init()
+{
+    g_memfd =
+        memfd_create("muquinet-arena", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+    if (g_memfd == -1 || ftruncate(g_memfd, RPC_ARENA_SIZE) == -1 ||
+        fcntl(g_memfd, F_ADD_SEALS, RPC_ARENA_SEALS) == -1) {
+        goto e_unavailable;
+    }
+    // 只映射不写入，用到的页才占内存
+    void* addr = mmap(NULL, RPC_ARENA_SIZE, PROT_READ | PROT_WRITE,
+                      MAP_SHARED, g_memfd, 0);
+    if (addr == MAP_FAILED) {
+        goto e_unavailable;
+    }
+    g_base = (char*)addr;
+
+    pthread_key_create(&g_chunk_key, release_chunk);
+    pthread_atfork(NULL, NULL, at_fork_child);
+    return;
+
+e_unavailable:
+    INTERCEPTOR_LOG(WARNING, "no payload arena, payloads are sent inline");
+    if (g_memfd != -1) {
+        glibc_funcs.close(g_memfd);
+        g_memfd = -1;
+    }
+}
+
+int
+arena_fd_to_pass()
+{
+    return g_base ? g_memfd : -1;
+}
+
+void
+arena_fd_passed()
+{
+    if (g_memfd != -1) {
+        glibc_funcs.close(g_memfd);
+        g_memfd = -1;
+    }
+}
+
+void
+arena_enable(const ProtobufCMessage* atstart)
+{
+    if (!g_base)
+        return;
+
+    uint64_t size;
+    if (rpc_field_get(atstart, RPC_ARENA_LENGTH, &size) &&
+        size == RPC_ARENA_SIZE) {
+        g_enabled = true;
+        INTERCEPTOR_LOG(INFO, "payload arena of %d MB mapped by muQuinetd",
+                        RPC_ARENA_SIZE >> 20);
+        return;
+    }
+
+    INTERCEPTOR_LOG(WARNING, "muQuinetd did not map the payload arena");
+    munmap(g_base, RPC_ARENA_SIZE);
+    g_base = NULL;
+}
+
+bool
+arena_span_begin(struct arena_span* span)
+{
+    if (!g_enabled)
+        return false;
+
+    /*  1. 每个线程第一次用时占一个 chunk，线程退出时归还 */
+
+    if (t_chunk == 0) {
+        uint64_t bits = __atomic_load_n(&g_chunks, __ATOMIC_RELAXED);
+        for (;;) {
+            uint64_t avail = ~bits & CHUNKS_MASK;
+            if (avail == 0)
+                return false;
+            int chunk = __builtin_ctzll(avail);
+            if (__atomic_compare_exchange_n(&g_chunks, &bits,
+                                            bits | (1ull << chunk), true,
+                                            __ATOMIC_ACQUIRE,
+                                            __ATOMIC_RELAXED)) {
+                t_chunk = chunk + 1;
+                pthread_setspecific(g_chunk_key, (void*)(intptr_t)t_chunk);
+                break;
+            }
+        }
+    }
+
+    /*  2. 本次调用从 chunk 头开始用 */
+
+    span->offset = (uint64_t)(t_chunk - 1) * RPC_ARENA_CHUNK_SIZE;
+    span->base = g_base + span->offset;
+    span->size = RPC_ARENA_CHUNK_SIZE;
+    span->used = 0;
+    return true;
+}
+
+char*
+arena_span_take(struct arena_span* span, size_t len, uint64_t* offset)
+{
+    if (len > span->size - span->used)
+        return NULL;
+
+    char* p = span->base + span->used;
+    *offset = span->offset + span->used;
+    span->used += len;
+    return p;
+}
+
+void
+arena_ref_attach(struct arena_ref* ref, ProtobufCMessage* msg,
+                 uint64_t offset, uint64_t length)
+{
+    rpc_field_set(&ref->fields[0], ref->varints[0], RPC_ARENA_OFFSET, offset);
+    rpc_field_set(&ref->fields[1], ref->varints[1], RPC_ARENA_LENGTH, length);
+    msg->n_unknown_fields = 2;
+    msg->unknown_fields = ref->fields;
+}
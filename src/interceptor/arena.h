@@ -0,0 +1,67 @@
+/*
+ * muQuinet, an userspace TCP/IP network stack.
+ * Copyright (C) 2018 rtdarwin
+ *
+ * This program is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+
+ * You should have received a copy of the GNU General Public
+ * License along with this program.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef INTERCEPTOR_ARENA_H
+#define INTERCEPTOR_ARENA_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <protobuf-c/protobuf-c.h>
+
+#include "rpc-field.h"
+
+/*
+ * Payload arena shared with muQuinetd (see rpc/arena.h): bulk payloads
+ * are written in place, Requests only carry their offset and length.
+ */
+
+void arena_module_init();
+// memfd to pass with the first Atstart, -1 if unavailable
+int arena_fd_to_pass();
+// after passing it, the memfd is not needed any more
+void arena_fd_passed();
+// Response.atstartAction: the arena is used once muQuinetd mapped it
+void arena_enable(const ProtobufCMessage* atstart);
+
+// The calling thread's chunk of the arena, carved up by one call
+struct arena_span
+{
+    char* base;
+    uint64_t offset;
+    size_t size;
+    size_t used;
+};
+// false when the arena can't be used: not enabled, or no chunk left
+bool arena_span_begin(struct arena_span* span);
+// len bytes of the span, NULL if they don't fit
+char* arena_span_take(struct arena_span* span, size_t len, uint64_t* offset);
+
+// {offset, length} of a region, attached to msg as unknown fields. Lives
+// as long as msg is packed.
+struct arena_ref
+{
+    ProtobufCMessageUnknownField fields[2];
+    uint8_t varints[2][RPC_FIELD_VARINT_MAX];
+};
+void arena_ref_attach(struct arena_ref* ref, ProtobufCMessage* msg,
+                      uint64_t offset, uint64_t length);
+
+#endif // INTERCEPTOR_ARENA_H
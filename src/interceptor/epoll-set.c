@@ -0,0 +1,234 @@
+/*
+ * muQuinet, an userspace TCP/IP network stack.
+ * Copyright (C) 2018 rtdarwin
+ *
+ * This program is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+
+ * You should have received a copy of the GNU General Public
+ * License along with this program.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include "epoll-set.h"
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "readiness.h"
+
+struct epoll_entry
+{
+    int epfd;
+    int fd;
+    struct epoll_event event;
+    uint32_t last;  // EPOLLET: readiness last reported
+    uint32_t gen;   // EPOLLET: readiness_gen() when last looked
+    bool disabled;  // EPOLLONESHOT: reported, until EPOLL_CTL_MOD
+};
+
+static pthread_mutex_t g_mutex = PTHREAD_MUTEX_INITIALIZER;
+static struct epoll_entry* g_entries;
+static int g_nentries; // read without the lock for the fast path
+static int g_capacity;
+static unsigned g_rotor; // fairness when more are ready than maxevents
+
+static struct epoll_entry*
+find_locked(int epfd, int fd)
+{
+    for (int i = 0; i < g_nentries; ++i) {
+        if (g_entries[i].epfd == epfd && g_entries[i].fd == fd)
+            return &g_entries[i];
+    }
+    return NULL;
+}
+
+static int
+count_locked(int epfd)
+{
+    int n = 0;
+    for (int i = 0; i < g_nentries; ++i) {
+        if (g_entries[i].epfd == epfd)
+            ++n;
+    }
+    return n;
+}
+
+static void
+remove_locked(struct epoll_entry* e)
+{
+    int last = g_nentries - 1;
+    *e = g_entries[last];
+    __atomic_store_n(&g_nentries, last, __ATOMIC_RELEASE);
+}
+
+int
+epoll_set_ctl(int epfd, int op, int fd, struct epoll_event* event,
+              int* transition)
+{
+    int ret = 0;
+    *transition = 0;
+
+    pthread_mutex_lock(&g_mutex);
+
+    struct epoll_entry* e = find_locked(epfd, fd);
+    switch (op) {
+        case EPOLL_CTL_ADD:
+            if (e) {
+                errno = EEXIST;
+                ret = -1;
+                break;
+            }
+            if (g_nentries == g_capacity) {
+                int cap = g_capacity ? g_capacity * 2 : 64;
+                void* p = realloc(g_entries, cap * sizeof(*g_entries));
+                if (!p) {
+                    errno = ENOMEM;
+                    ret = -1;
+                    break;
+                }
+                g_entries = (struct epoll_entry*)p;
+                g_capacity = cap;
+            }
+            *transition = count_locked(epfd) == 0 ? 1 : 0;
+            e = &g_entries[g_nentries];
+            e->epfd = epfd;
+            e->fd = fd;
+            e->event = *event;
+            e->last = 0;
+            e->gen = 0;
+            e->disabled = false;
+            __atomic_store_n(&g_nentries, g_nentries + 1, __ATOMIC_RELEASE);
+            break;
+        case EPOLL_CTL_MOD:
+            if (!e) {
+                errno = ENOENT;
+                ret = -1;
+                break;
+            }
+            e->event = *event;
+            e->last = 0;
+            e->gen = 0;
+            e->disabled = false;
+            break;
+        case EPOLL_CTL_DEL:
+            if (!e) {
+                errno = ENOENT;
+                ret = -1;
+                break;
+            }
+            remove_locked(e);
+            *transition = count_locked(epfd) == 0 ? -1 : 0;
+            break;
+        default:
+            errno = EINVAL;
+            ret = -1;
+            break;
+    }
+
+    pthread_mutex_unlock(&g_mutex);
+    return ret;
+}
+
+int
+epoll_set_count(int epfd)
+{
+    if (__atomic_load_n(&g_nentries, __ATOMIC_ACQUIRE) == 0)
+        return 0;
+
+    pthread_mutex_lock(&g_mutex);
+    int n = count_locked(epfd);
+    pthread_mutex_unlock(&g_mutex);
+    return n;
+}
+
+bool
+epoll_set_edge_triggered(int epfd)
+{
+    if (__atomic_load_n(&g_nentries, __ATOMIC_ACQUIRE) == 0)
+        return false;
+
+    bool edge = false;
+    pthread_mutex_lock(&g_mutex);
+    for (int i = 0; i < g_nentries && !edge; ++i) {
+        edge = g_entries[i].epfd == epfd &&
+               (g_entries[i].event.events & EPOLLET);
+    }
+    pthread_mutex_unlock(&g_mutex);
+    return edge;
+}
+
+int
+epoll_set_collect(int epfd, struct epoll_event* events, int maxevents)
+{
+    int n = 0;
+
+    pthread_mutex_lock(&g_mutex);
+
+    int first = g_nentries ? g_rotor++ % g_nentries : 0;
+    for (int k = 0; k < g_nentries && n < maxevents; ++k) {
+        struct epoll_entry* e = &g_entries[(first + k) % g_nentries];
+        if (e->epfd != epfd || e->disabled)
+            continue;
+
+        uint32_t interested = e->event.events | EPOLLERR | EPOLLHUP;
+        uint32_t gen = readiness_gen(e->fd); // 先于 readiness_of() 读
+        uint32_t ready = readiness_of(e->fd) & interested;
+        uint32_t report = ready;
+        if (e->event.events & EPOLLET) {
+            // 上次之后 muQuinetd 又置过位（如又来一个包），位没变也是新边沿
+            report = gen != e->gen ? ready : ready & ~e->last;
+            e->last = ready;
+            e->gen = gen;
+        }
+        if (!report)
+            continue;
+
+        events[n].events = report;
+        events[n].data = e->event.data;
+        ++n;
+        if (e->event.events & EPOLLONESHOT)
+            e->disabled = true;
+    }
+
+    pthread_mutex_unlock(&g_mutex);
+    return n;
+}
+
+void
+epoll_set_forget(int fd, void (*emptied)(int epfd))
+{
+    if (__atomic_load_n(&g_nentries, __ATOMIC_ACQUIRE) == 0)
+        return;
+
+    pthread_mutex_lock(&g_mutex);
+    for (int i = 0; i < g_nentries;) {
+        int epfd = g_entries[i].epfd;
+        if (epfd == fd) {
+            remove_locked(&g_entries[i]);
+        } else if (g_entries[i].fd == fd) {
+            // 一个 fd 在同一 epfd 里只有一项
+            remove_locked(&g_entries[i]);
+            if (count_locked(epfd) == 0)
+                emptied(epfd);
+        } else {
+            ++i;
+        }
+    }
+    pthread_mutex_unlock(&g_mutex);
+}
@@ -0,0 +1,52 @@
+/*
+ * muQuinet, an userspace TCP/IP network stack.
+ * Copyright (C) 2018 rtdarwin
+ *
+ * This program is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+
+ * You should have received a copy of the GNU General Public
+ * License along with this program.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef INTERCEPTOR_EPOLLSET_H
+#define INTERCEPTOR_EPOLLSET_H
+
+#include <stdbool.h>
+#include <sys/epoll.h>
+
+/*
+ * muQuinet fds registered into the application's epoll instances. The
+ * kernel can't watch them, so they are kept here and checked against
+ * the readiness region; the epoll instance itself only gets the
+ * readiness eventfd, once, for all of them.
+ *
+ * EPOLLET: an fd is reported again once muQuinetd set one of its bits
+ * since it was last looked at (rpc/readiness.h), even a bit already set.
+ */
+
+// transition: +1 when epfd got its first muQuinet fd, -1 when it lost the
+// last one, 0 otherwise. -1 and errno on error, like epoll_ctl().
+int epoll_set_ctl(int epfd, int op, int fd, struct epoll_event* event,
+                  int* transition);
+// muQuinet fds registered in epfd
+int epoll_set_count(int epfd);
+// whether any of them is EPOLLET
+bool epoll_set_edge_triggered(int epfd);
+// Ready ones into events[0, maxevents), their count
+int epoll_set_collect(int epfd, struct epoll_event* events, int maxevents);
+// fd is being closed, as an epoll instance or as a registered fd.
+// emptied(epfd) is called (lock held) for each epoll instance that lost
+// its last muQuinet fd that way, like a transition of -1.
+void epoll_set_forget(int fd, void (*emptied)(int epfd));
+
+#endif // INTERCEPTOR_EPOLLSET_H
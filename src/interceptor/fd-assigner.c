@@ -24,33 +24,178 @@
 #include "fd-assigner.h"
 
 #include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <sys/resource.h>
 #include <unistd.h>
 
+#include "arena.h"
 #include "fd2channel.h"
 #include "interceptor.h"
+#include "logging.h"
+#include "readiness.h"
 #include "req-resp-channel.h"
 
+/*
+ * fd 区间 [g_startfd, g_startfd + g_fd_count) 由 muQuinetd 分配，
+ *
+ *  - 区间里的每个 fd 都被 dup 成同一个 /dev/null，内核不会再把它们分配
+ *    给应用自己的 open()/socket()
+ *  - 哪些 fd 正在使用记在 bitmap 里，分配/回收都是 CAS，不加锁
+ *  - 用完时再向 muQuinetd 要（区间翻倍），bitmap 与 fd2channel vector
+ *    一开始就按 RPC_FD_RANGE_MAX 分配，扩大区间时不需要搬动
+ */
+
 extern int* g_fd2channelVector;
 
 int g_startfd;
-int g_fd_count;
-// FIXME 回收利用已经 close 的 fd
-static int last_fd_assigned;
+int g_fd_count; // only grows, read with acquire
+
+static uint64_t* g_fd_bitmap;
+static unsigned g_fd_hint; // word to look at first
+static pthread_mutex_t g_grow_mutex = PTHREAD_MUTEX_INITIALIZER;
+static int g_placeholder_fd = -1;
 
-static void reserve_fd_range();
+static bool request_fd_range(channel ch, int* startfd, int* count,
+                             bool first);
+static void reserve_fd_range(int from, int to);
 
 void
 ask_muquientd_fd_range()
 {
-    channel ch = get_proc_channel();
+    g_fd_bitmap = (uint64_t*)calloc(RPC_FD_RANGE_MAX / 64, sizeof(uint64_t));
+    g_fd2channelVector = (int*)calloc(RPC_FD_RANGE_MAX, sizeof(int));
+    assert(g_fd_bitmap && g_fd2channelVector);
+
+    INTERCEPTOR_LOG(INFO, "asking muQuinetd file descriptors range...");
+
+    int startfd, count;
+    request_fd_range(get_proc_channel(), &startfd, &count, true);
+
     {
-        // FIXME: logging
-        printf("-- %s:%d: [INFO] asking muQuinetd file descriptors range...\n",
-               __FILENAME__, __LINE__);
+        // DEBUG
+        assert(startfd != 0);
+        assert(count != 0);
+        INTERCEPTOR_LOG(INFO, "fd range response from muQuientd: %d+%d",
+                        startfd, count);
     }
 
+    g_startfd = startfd;
+    reserve_fd_range(startfd, startfd + count);
+    __atomic_store_n(&g_fd_count, count, __ATOMIC_RELEASE);
+}
+
+bool
+is_assigned_by_muquinet(int fd)
+{
+    int count = __atomic_load_n(&g_fd_count, __ATOMIC_ACQUIRE);
+    if (fd < g_startfd || fd >= g_startfd + count)
+        return false;
+
+    // 区间内但没有 channel：空闲的，或者应用自己占着的
+    return g_fd2channelVector[fd - g_startfd] != 0;
+}
+
+// 区间用完，向 muQuinetd 要一个更大的
+static bool
+grow_fd_range(int seen_count)
+{
+    bool grown = true;
+
+    pthread_mutex_lock(&g_grow_mutex);
+
+    // 别的线程已经扩大过了的话，什么都不用做
+    if (__atomic_load_n(&g_fd_count, __ATOMIC_ACQUIRE) == seen_count) {
+        int startfd, count;
+        grown = request_fd_range(get_proc_channel(), &startfd, &count,
+                                 false) &&
+                startfd == g_startfd &&
+                count > seen_count && count <= RPC_FD_RANGE_MAX;
+        if (grown) {
+            reserve_fd_range(g_startfd + seen_count, g_startfd + count);
+            __atomic_store_n(&g_fd_count, count, __ATOMIC_RELEASE);
+            INTERCEPTOR_LOG(INFO, "fd range grown to %d+%d", g_startfd, count);
+        } else {
+            INTERCEPTOR_LOG(WARNING, "fd range %d+%d can't grow any more",
+                            g_startfd, seen_count);
+        }
+    }
+
+    pthread_mutex_unlock(&g_grow_mutex);
+    return grown;
+}
+
+int
+next_avail_fd()
+{
+    for (;;) {
+        int count = __atomic_load_n(&g_fd_count, __ATOMIC_ACQUIRE);
+        unsigned nwords = (count + 63) / 64;
+        unsigned first = __atomic_load_n(&g_fd_hint, __ATOMIC_RELAXED);
+
+        /*  1. 从上次分配的位置开始找一个空位，CAS 占住 */
+
+        for (unsigned k = 0; k < nwords; ++k) {
+            unsigned w = (first + k) % nwords;
+            uint64_t bits = __atomic_load_n(&g_fd_bitmap[w], __ATOMIC_RELAXED);
+
+            while (~bits) {
+                int b = __builtin_ctzll(~bits);
+                int idx = w * 64 + b;
+                if (idx >= count)
+                    break;
+                if (__atomic_compare_exchange_n(&g_fd_bitmap[w], &bits,
+                                                bits | (1ull << b), true,
+                                                __ATOMIC_ACQUIRE,
+                                                __ATOMIC_RELAXED)) {
+                    __atomic_store_n(&g_fd_hint, w, __ATOMIC_RELAXED);
+                    return g_startfd + idx;
+                }
+                // bits 已被 CAS 更新为当前值，重试
+            }
+        }
+
+        /*  2. 满了 */
+
+        if (!grow_fd_range(count)) {
+            errno = EMFILE;
+            return -1;
+        }
+    }
+}
+
+void
+recycle_fd(int fd)
+{
+    unsigned idx = fd - g_startfd;
+    __atomic_fetch_and(&g_fd_bitmap[idx / 64], ~(1ull << (idx % 64)),
+                       __ATOMIC_RELEASE);
+}
+
+void
+rejoin_fd_range(channel ch)
+{
+    // 新 channel 的区间从 RPC_FD_RANGE_INITIAL 起，每次 Atstart 翻倍
+    int want = __atomic_load_n(&g_fd_count, __ATOMIC_ACQUIRE);
+    int startfd, count = 0;
+    while (count < want) {
+        int last = count;
+        if (!request_fd_range(ch, &startfd, &count, false) ||
+            startfd != g_startfd || count <= last) {
+            INTERCEPTOR_LOG(WARNING, "fd range %d+%d not taken over by the "
+                                     "child process",
+                            g_startfd, want);
+            return;
+        }
+    }
+}
+
+static bool
+request_fd_range(channel ch, int* startfd, int* count, bool first)
+{
     /*  1. 组装 request */
 
     Request req = REQUEST__INIT;
@@ -63,9 +208,23 @@ ask_muquientd_fd_range()
     req.atstartaction = &atstart;
     req.calling_case = REQUEST__CALLING_ATSTART_ACTION;
 
-    /*  2. 发送 request */
+    /*  2. 发送 request，第一次时带上 readiness memfd 与 eventfd，
+     *     以及 arena memfd（rpc/arena.h）
+     */
 
-    channel_send(ch, &req);
+    int fds[3];
+    int nfds = 0;
+    if (first) {
+        nfds = readiness_fds_to_pass(fds);
+        if ((fds[nfds] = arena_fd_to_pass()) != -1) {
+            ++nfds;
+        }
+    }
+    channel_send_fds(ch, &req, fds, nfds);
+    if (first) {
+        readiness_fds_passed();
+        arena_fd_passed();
+    }
 
     /*  3. 接收 response */
 
@@ -74,40 +233,54 @@ ask_muquientd_fd_range()
 
     /*  4. 处理 response */
 
-    g_startfd = resp->atstartaction->startfd;
-    g_fd_count = resp->atstartaction->count;
-    last_fd_assigned = g_startfd - 1;
-
-    {
-        // DEBUG
-        assert(g_startfd != 0);
-        assert(g_fd_count != 0);
-        // FIXME logging
-        printf("-- %s:%d: [INFO] fd range response from muQuientd: %d+%d\n",
-               __FILENAME__, __LINE__, g_startfd, g_fd_count);
+    bool ok = resp->retcode == RESPONSE__RET_CODE__OK && resp->atstartaction;
+    if (ok) {
+        *startfd = resp->atstartaction->startfd;
+        *count = resp->atstartaction->count;
+        if (first) {
+            arena_enable(&resp->atstartaction->base);
+        }
     }
 
     response__free_unpacked(resp, NULL);
-
-    reserve_fd_range();
+    return ok;
 }
 
-bool
-is_assigned_by_muquinet(int fd)
+static void
+reserve_fd_range(int from, int to)
 {
-    return (fd >= g_startfd && fd < g_startfd + g_fd_count);
-}
+    /*  1. RLIMIT_NOFILE 以上的 fd，dup 会失败 */
 
-int
-next_avail_fd()
-{
-    // FIXME
-    return last_fd_assigned + 1;
-}
+    struct rlimit rl;
+    if (getrlimit(RLIMIT_NOFILE, &rl) == 0 && rl.rlim_cur < (rlim_t)to) {
+        rl.rlim_cur = rl.rlim_max < (rlim_t)to ? rl.rlim_max : (rlim_t)to;
+        setrlimit(RLIMIT_NOFILE, &rl);
+    }
 
-static void
-reserve_fd_range()
-{
-    g_fd2channelVector = (int*)malloc(sizeof(int) * g_fd_count);
-    // TODO
+    /*  2. 都 dup 成同一个 /dev/null */
+
+    if (g_placeholder_fd == -1) {
+        g_placeholder_fd = open("/dev/null", O_RDONLY | O_CLOEXEC);
+    }
+
+    int nreserved = 0;
+    for (int fd = from; fd < to; ++fd) {
+        unsigned idx = fd - g_startfd;
+
+        // 应用自己已经在用了：永远不分配出去
+        if (glibc_funcs.fcntl(fd, F_GETFD) != -1) {
+            g_fd_bitmap[idx / 64] |= 1ull << (idx % 64);
+            continue;
+        }
+        if (g_placeholder_fd != -1 &&
+            dup3(g_placeholder_fd, fd, O_CLOEXEC) == fd) {
+            ++nreserved;
+        }
+    }
+
+    if (nreserved != to - from) {
+        INTERCEPTOR_LOG(WARNING, "reserved %d of fds [%d, %d), the kernel "
+                                 "may hand out the others too",
+                        nreserved, from, to);
+    }
 }
@@ -22,10 +22,17 @@
 
 #include <stdbool.h>
 
+#include "fd2channel.h"
+
 void ask_muquientd_fd_range();
+// fork() child: Atstart on its own process channel ch until muQuinetd
+// gives it the range inherited from the parent
+void rejoin_fd_range(channel ch);
 
 // for interceptor use
 bool is_assigned_by_muquinet(int fd);
+// -1 and errno = EMFILE when the range can't grow any more
 int next_avail_fd();
+void recycle_fd(int fd);
 
 #endif
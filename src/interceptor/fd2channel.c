@@ -17,9 +17,15 @@
  * <http://www.gnu.org/licenses/>.
  */
 
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
 #include "fd2channel.h"
 
 #include <errno.h>
+#include <pthread.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -28,24 +34,62 @@
 
 #include "fd-assigner.h"
 #include "interceptor.h"
+#include "logging.h"
 #include "req-resp-channel.h"
+#include "rpc/rpc.h"
 
 int* g_fd2channelVector;
 extern int g_startfd;
 extern int g_fd_count;
 
 static channel g_proc_channel;
+static pthread_mutex_t g_proc_channel_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static bool g_shared_channels;
+static uint64_t* g_fd2socketid;
+static pthread_key_t g_thread_channel_key;
+static __thread channel t_thread_channel;
+
+static void
+release_thread_channel(void* ch)
+{
+    close_channel((channel)(intptr_t)ch);
+}
+
+// the parent's channels are no use to the child, which gets its own
+//
+// 子进程的 shared socket 随子进程自己的 process channel 关闭（muQuinetd 按
+// SO_PEERCRED 的 pid 认），它在第一次用到时再建
+static void
+at_fork_child()
+{
+    if (t_thread_channel) {
+        close_channel(t_thread_channel);
+        t_thread_channel = 0;
+        pthread_setspecific(g_thread_channel_key, NULL);
+    }
+    if (g_proc_channel) {
+        close_channel(g_proc_channel);
+        g_proc_channel = 0;
+    }
+    pthread_mutex_init(&g_proc_channel_mutex, NULL);
+}
 
 void
 fd2channel_module_init()
 {
+    const char* channels = getenv("MUQUINET_CHANNELS");
+    g_shared_channels = !(channels && strcmp(channels, "socket") == 0);
+    g_fd2socketid = (uint64_t*)calloc(RPC_FD_RANGE_MAX, sizeof(uint64_t));
+    pthread_key_create(&g_thread_channel_key, release_thread_channel);
+    pthread_atfork(NULL, NULL, at_fork_child);
+
     // process 级 channel
     channel ch = new_channel();
     g_proc_channel = ch;
     {
-        // FIXME: logging
-        printf("-- %s:%d: [INFO] create process channel {channel = %lld}\n",
-               __FILENAME__, __LINE__, (long long)ch);
+        INTERCEPTOR_LOG(INFO, "create process channel {channel = %lld}",
+                        (long long)ch);
     }
 
     // reserve fd range
@@ -55,7 +99,8 @@ fd2channel_module_init()
 channel
 fd2channel(int fd)
 {
-    return g_fd2channelVector[fd - g_startfd];
+    channel ch = g_fd2channelVector[fd - g_startfd];
+    return ch == SHARED_CHANNEL ? thread_channel() : ch;
 }
 
 void
@@ -68,10 +113,73 @@ void
 unset_fd2channel(int fd, channel ch)
 {
     g_fd2channelVector[fd - g_startfd] = 0;
+    g_fd2socketid[fd - g_startfd] = 0;
 }
 
 channel
 get_proc_channel()
 {
-    return g_proc_channel;
+    channel ch = __atomic_load_n(&g_proc_channel, __ATOMIC_ACQUIRE);
+    if (ch)
+        return ch;
+
+    // fork() 之后
+    pthread_mutex_lock(&g_proc_channel_mutex);
+    if (!g_proc_channel) {
+        ch = new_channel();
+        rejoin_fd_range(ch);
+        __atomic_store_n(&g_proc_channel, ch, __ATOMIC_RELEASE);
+    }
+    ch = g_proc_channel;
+    pthread_mutex_unlock(&g_proc_channel_mutex);
+    return ch;
+}
+
+bool
+shared_channels()
+{
+    return g_shared_channels;
+}
+
+channel
+thread_channel()
+{
+    if (!t_thread_channel) {
+        // the process channel first: the shared sockets go with it
+        get_proc_channel();
+        t_thread_channel = new_channel();
+        pthread_setspecific(g_thread_channel_key,
+                            (void*)(intptr_t)t_thread_channel);
+    }
+    return t_thread_channel;
+}
+
+uint64_t
+fd2socketid(int fd)
+{
+    return g_fd2socketid[fd - g_startfd];
+}
+
+void
+set_fd2socketid(int fd, uint64_t id)
+{
+    g_fd2socketid[fd - g_startfd] = id;
+}
+
+void
+channel_route_attach(struct channel_route* route, Request* req, uint64_t id)
+{
+    rpc_field_set(&route->field, route->varint, RPC_SOCKET_ID, id);
+    req->base.n_unknown_fields = 1;
+    req->base.unknown_fields = &route->field;
+}
+
+channel
+fd2channel_route(int fd, Request* req, struct channel_route* route)
+{
+    uint64_t id = fd2socketid(fd);
+    if (id) {
+        channel_route_attach(route, req, id);
+    }
+    return fd2channel(fd);
 }
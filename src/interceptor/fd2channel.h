@@ -21,12 +21,24 @@
 #define INTERCEPTOR_FD2CHANNEL_H
 
 #include <stdbool.h>
+#include <stdint.h>
 
+#include "rpc-field.h"
 #include "rpc/c_out/request.pb-c.h"
 #include "rpc/c_out/response.pb-c.h"
 
 typedef int channel;
 
+/*
+ * A socket has a channel of its own, or shares the channel of the calling
+ * thread with the other sockets of the process (rpc/rpc.h), which saves a
+ * connection to muQuinetd per socket. Sockets are shared unless
+ * MUQUINET_CHANNELS=socket.
+ */
+
+// fd2channel() of a shared socket
+#define SHARED_CHANNEL (-1)
+
 void fd2channel_module_init();
 
 // for interceptor use
@@ -35,4 +47,22 @@ void set_fd2channel(int fd, channel ch);
 void unset_fd2channel(int fd, channel ch);
 channel get_proc_channel();
 
+bool shared_channels();
+// created on first use, closed when the thread exits
+channel thread_channel();
+// RPC_SOCKET_ID of a shared socket, 0 for one with its own channel
+uint64_t fd2socketid(int fd);
+void set_fd2socketid(int fd, uint64_t id);
+
+struct channel_route
+{
+    ProtobufCMessageUnknownField field;
+    uint8_t varint[RPC_FIELD_VARINT_MAX];
+};
+// Marks req as a call on socket `id' (0: a new one)
+void channel_route_attach(struct channel_route* route, Request* req,
+                          uint64_t id);
+// The channel to call on fd with; req is routed to the socket if shared
+channel fd2channel_route(int fd, Request* req, struct channel_route* route);
+
 #endif // INTERCEPTOR_FD2CHANNEL_H
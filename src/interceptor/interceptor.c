@@ -25,6 +25,7 @@
 
 #include <dlfcn.h>
 #include <errno.h>
+#include <fcntl.h>
 #include <netinet/in.h>
 #include <pthread.h>
 #include <stdbool.h>
@@ -32,15 +33,27 @@
 #include <stdlib.h>
 #include <sys/epoll.h>
 #include <sys/poll.h>
+#include <sys/sendfile.h>
 #include <sys/socket.h>
 #include <sys/types.h>
+#include <sys/uio.h>
+#include <time.h>
 #include <unistd.h>
 
+#include "arena.h"
+#include "epoll-set.h"
 #include "fd-assigner.h"
 #include "fd2channel.h"
+#include "logging.h"
+#include "readiness.h"
 #include "req-resp-channel.h"
+#include "rpc-field.h"
+#include "rpc/arena.h"
+#include "rpc/readiness.h"
+#include "rpc/splice.h"
 #include "rpc/c_out/request.pb-c.h"
 #include "rpc/c_out/response.pb-c.h"
+#include "splice.h"
 
 #undef INTERCEPTOR_RETURN__RET_AND_ERRNO
 #define INTERCEPTOR_RETURN__RET_AND_ERRNO(callname)                                    \
@@ -66,11 +79,24 @@
 
 struct glibc_socket_funcs glibc_funcs;
 
+extern int g_startfd;
+
 ////////////////////////////////////////////////////////////////////////////////
 // muQuinet 提供的实现
 
 /* 1. Socket 创建/连接/关闭 */
 
+// RPC_SOCKET_ID of a new shared socket (rpc/rpc.h)
+static uint64_t
+socket_id_of(const Response__Socket* r)
+{
+    uint64_t id = 0;
+    bool found = rpc_field_get(&r->base, RPC_SOCKET_ID, &id);
+    assert(found && "no RPC_SOCKET_ID in Response.socketCall");
+    (void)found;
+    return id;
+}
+
 int
 socket(int domain, int type, int protocol)
 {
@@ -79,47 +105,43 @@ socket(int domain, int type, int protocol)
      */
 
     if (domain != AF_INET) {
-        // FIXME: logging
-        printf("-- %s:%d: [INFO] pass [non-AF_INET] socket\n", __FILENAME__,
-               __LINE__);
+        INTERCEPTOR_LOG(DEBUG, "pass [non-AF_INET] socket");
         return glibc_funcs.socket(domain, type, protocol);
     }
 
     if (!(type & SOCK_STREAM) && !(type & SOCK_DGRAM)) {
-        // FIXME: logging
-        printf("-- %s:%d: [INFO] pass [non-AF_INET/TCP, non-AF_INET/UDP] "
-               "socket\n",
-               __FILENAME__, __LINE__);
+        INTERCEPTOR_LOG(DEBUG,
+                        "pass [non-AF_INET/TCP, non-AF_INET/UDP] socket");
         return glibc_funcs.socket(domain, type, protocol);
     }
 
     /*  2. 请求 muQuinetd */
 
     {
-        // FIXME: logging
-        printf("-- %s:%d: [INFO] calling interceptor/socket {domain: AF_INET, "
-               "type: %s}\n",
-               __FILENAME__, __LINE__,
-               (type & SOCK_STREAM) ? "SOCK_STREAM" : "SOCK_DGRAM");
+        INTERCEPTOR_LOG(DEBUG, "calling interceptor/socket {domain: AF_INET, "
+                               "type: %s}",
+                        (type & SOCK_STREAM) ? "SOCK_STREAM" : "SOCK_DGRAM");
     }
 
     Request req = REQUEST__INIT;
     Request__Socket sockCall = REQUEST__SOCKET__INIT;
+    struct channel_route route;
     Response* resp;
 
     int connfd;
     channel connCh;
+    bool shared = shared_channels();
 
     {
         connfd = next_avail_fd();
-        connCh = new_channel();
-        set_fd2channel(connfd, connCh);
+        if (connfd == -1)
+            return -1;
+        connCh = shared ? thread_channel() : new_channel();
+        set_fd2channel(connfd, shared ? SHARED_CHANNEL : connCh);
 
         {
-            // FIXME: logging
-            printf(
-                "-- %s:%d: [INFO] assigned fd %d to conncection channel %lld\n",
-                __FILENAME__, __LINE__, connfd, (long long)connCh);
+            INTERCEPTOR_LOG(INFO, "assigned fd %d to conncection channel %lld",
+                            connfd, (long long)connCh);
         }
     }
 
@@ -132,6 +154,9 @@ socket(int domain, int type, int protocol)
 
         req.socketcall = &sockCall;
         req.calling_case = REQUEST__CALLING_SOCKET_CALL;
+        if (shared) {
+            channel_route_attach(&route, &req, 0);
+        }
     }
 
     {
@@ -146,7 +171,11 @@ socket(int domain, int type, int protocol)
 
         // happy path
         if (ret != -1) {
+            if (shared) {
+                set_fd2socketid(connfd, socket_id_of(resp->socketcall));
+            }
             response__free_unpacked(resp, NULL);
+            readiness_bind(connfd, ret - 1); // see rpc/readiness.h
             return connfd;
         }
 
@@ -154,6 +183,11 @@ socket(int domain, int type, int protocol)
         assert(resp->socketcall->has_errno_);
         int errno_ = resp->socketcall->errno_;
         response__free_unpacked(resp, NULL);
+        unset_fd2channel(connfd, connCh);
+        if (!shared) {
+            close_channel(connCh);
+        }
+        recycle_fd(connfd);
         errno = errno_;
         return -1;
     }
@@ -169,14 +203,14 @@ connect(int sockfd, const struct sockaddr* addr, socklen_t addrlen)
     assert(addrlen == sizeof(struct sockaddr_in));
 
     {
-        // FIXME: logging
-        printf("-- %s:%d: [INFO] calling interceptor/connect {fd = %d, channel "
-               "= %lld}\n",
-               __FILENAME__, __LINE__, sockfd, (long long)fd2channel(sockfd));
+        INTERCEPTOR_LOG(DEBUG, "calling interceptor/connect {fd = %d, "
+                               "channel = %lld}",
+                        sockfd, (long long)fd2channel(sockfd));
     }
 
     Request req = REQUEST__INIT;
     Request__Connect connCall = REQUEST__CONNECT__INIT;
+    struct channel_route route;
     Response* resp;
 
     {
@@ -190,8 +224,9 @@ connect(int sockfd, const struct sockaddr* addr, socklen_t addrlen)
     }
 
     {
-        channel_send(fd2channel(sockfd), &req);
-        channel_recv(fd2channel(sockfd), &resp);
+        channel ch = fd2channel_route(sockfd, &req, &route);
+        channel_send(ch, &req);
+        channel_recv(ch, &resp);
     }
 
     {
@@ -201,21 +236,25 @@ connect(int sockfd, const struct sockaddr* addr, socklen_t addrlen)
     }
 }
 
+static void readiness_epoll_del(int epfd);
+
 int
 close(int fd)
 {
+    epoll_set_forget(fd, readiness_epoll_del);
+
     if (!is_assigned_by_muquinet(fd))
         return glibc_funcs.close(fd);
 
     {
-        // FIXME: logging
-        printf("-- %s:%d: [INFO] calling interceptor/close {fd = %d, channel = "
-               "%lld}\n",
-               __FILENAME__, __LINE__, fd, (long long)fd2channel(fd));
+        INTERCEPTOR_LOG(DEBUG, "calling interceptor/close {fd = %d, "
+                               "channel = %lld}",
+                        fd, (long long)fd2channel(fd));
     }
 
     Request req = REQUEST__INIT;
     Request__Close closeCall = REQUEST__CLOSE__INIT;
+    struct channel_route route;
     Response* resp;
 
     {
@@ -224,24 +263,405 @@ close(int fd)
         req.calling_case = REQUEST__CALLING_CLOSE_CALL;
     }
 
+    channel ch = fd2channel_route(fd, &req, &route);
     {
-        channel_send(fd2channel(fd), &req);
-        channel_recv(fd2channel(fd), &resp);
+        channel_send(ch, &req);
+        channel_recv(ch, &resp);
     }
 
     {
         assert(resp->returning_case == RESPONSE__RETURNING_CLOSE_CALL);
 
-        // close coresponding channel
-        channel ch = fd2channel(fd);
-        unset_fd2channel(fd, fd2channel(fd));
-        close_channel(ch);
+        // close coresponding channel, a shared one stays
+        bool shared = fd2socketid(fd) != 0;
+        unset_fd2channel(fd, ch);
+        if (!shared) {
+            close_channel(ch);
+        }
+        readiness_unbind(fd);
+        recycle_fd(fd);
 
         INTERCEPTOR_RETURN__RET_AND_ERRNO(closecall);
     }
 }
 
-/* 2. Socket reading/writing */
+/* 2. Socket reading/writing
+ *
+ * Payloads stay iovecs down to the channel (channel_payload), *mmsg calls
+ * are one batch, i.e. one round trip (rpc.h). Bulk payloads go through
+ * the arena instead (arena.h), the bulkiest sends through a pipe
+ * (splice.h), like sendfile() and splice() to a socket do.
+ *
+ * Small sends within the socket's credits do not wait for muQuinetd at
+ * all (rpc/readiness.h); their failures are reported by the next call.
+ * Receives are served from the payload muQuinetd prefetched, if any.
+ */
+
+// so that channel_send_batch() never cuts an asynchronous send
+#define SEND_ASYNC_IOV_MAX 64
+
+static uint8_t g_send_async_true = 1;
+static ProtobufCMessageUnknownField g_send_async = {
+    .tag = RPC_SEND_ASYNC,
+    .wire_type = PROTOBUF_C_WIRE_TYPE_VARINT,
+    .len = 1,
+    .data = &g_send_async_true,
+};
+
+// errno of a failed asynchronous send on sockfd, if any, is set
+static bool
+async_send_failed(int sockfd)
+{
+    int errno_ = readiness_take_error(sockfd);
+    if (errno_) {
+        errno = errno_;
+    }
+    return errno_ != 0;
+}
+
+static size_t
+iov_length(const struct iovec* iov, int iovcnt)
+{
+    size_t len = 0;
+    for (int i = 0; i < iovcnt; ++i) {
+        len += iov[i].iov_len;
+    }
+    return len;
+}
+
+// Gathers the first len bytes of iov into dst
+static void
+iov_gather(char* dst, const struct iovec* iov, int iovcnt, size_t len)
+{
+    for (int i = 0; i < iovcnt && len > 0; ++i) {
+        size_t n = iov[i].iov_len < len ? iov[i].iov_len : len;
+        memcpy(dst, iov[i].iov_base, n);
+        dst += n;
+        len -= n;
+    }
+}
+
+// Scatters src over iov, returns the bytes copied
+static size_t
+iov_scatter(const char* src, size_t len, const struct iovec* iov, int iovcnt)
+{
+    size_t copied = 0;
+    for (int i = 0; i < iovcnt && copied < len; ++i) {
+        size_t n = iov[i].iov_len < len - copied ? iov[i].iov_len : len - copied;
+        memcpy(iov[i].iov_base, src + copied, n);
+        copied += n;
+    }
+    return copied;
+}
+
+// The payload of a Sendto in the arena, when it is large enough and fits.
+// A stream socket may send less than asked, so the first one is cut to
+// RPC_ARENA_SEND_MAX and to fit the span (*len is updated).
+static bool
+sendto_via_arena(struct arena_span* span, struct arena_ref* ref,
+                 Request__Sendto* call, const struct iovec* iov, int iovcnt,
+                 size_t* len, bool first)
+{
+    if (*len < RPC_ARENA_THRESHOLD)
+        return false;
+
+    size_t n = *len;
+    if (n > RPC_ARENA_SEND_MAX) {
+        if (!first)
+            return false;
+        n = RPC_ARENA_SEND_MAX;
+    }
+    if (first && n > span->size - span->used) {
+        n = span->size - span->used;
+    }
+    uint64_t offset;
+    char* region = arena_span_take(span, n, &offset);
+    if (!region)
+        return false;
+
+    iov_gather(region, iov, iovcnt, n);
+    arena_ref_attach(ref, &call->base, offset, n);
+    *len = n;
+    return true;
+}
+
+// The region of the arena a Recvfrom payload goes to, NULL for inline.
+// The first one is cut to fit the span, like sendto_via_arena().
+static char*
+recvfrom_via_arena(struct arena_span* span, struct arena_ref* ref,
+                   Request__Recvfrom* call, size_t len, bool first)
+{
+    if (len < RPC_ARENA_THRESHOLD)
+        return NULL;
+
+    if (first && len > span->size - span->used) {
+        len = span->size - span->used;
+    }
+    uint64_t offset;
+    char* region = arena_span_take(span, len, &offset);
+    if (region) {
+        arena_ref_attach(ref, &call->base, offset, len);
+    }
+    return region;
+}
+
+static void
+fill_sendto(Request* req, Request__Sendto* call, int flags,
+            const struct sockaddr* dest_addr, socklen_t addrlen)
+{
+    req->pid = getpid();
+
+    // buf is left empty, the payload follows the Request or is in the arena
+    call->flags = flags;
+    if (dest_addr) {
+        assert(addrlen == sizeof(struct sockaddr_in));
+        call->has_addr = true;
+        call->addr.data = (uint8_t*)dest_addr;
+        call->addr.len = addrlen;
+    }
+
+    req->sendtocall = call;
+    req->calling_case = REQUEST__CALLING_SENDTO_CALL;
+}
+
+static void
+fill_recvfrom(Request* req, Request__Recvfrom* call, size_t len, int flags,
+              bool requireaddr)
+{
+    req->pid = getpid();
+
+    call->len = len;
+    call->flags = flags;
+    call->requireaddr = requireaddr;
+
+    req->recvfromcall = call;
+    req->calling_case = REQUEST__CALLING_RECVFROM_CALL;
+}
+
+// Scatters the returned payload, inline or in the arena region of the
+// call, over iov. *errno_ is set when -1 is returned, *msg_flags (if any)
+// gets MSG_TRUNC when the payload did not fit.
+static ssize_t
+recvfrom_result(const Response__Recvfrom* r, const char* region,
+                const struct iovec* iov, int iovcnt,
+                struct sockaddr* src_addr, socklen_t* addrlen, int* msg_flags,
+                int* errno_)
+{
+    if (r->ret < 0) {
+        assert(r->has_errno_);
+        *errno_ = r->errno_;
+        return -1;
+    }
+
+    // 有没有返回数据
+    size_t len = 0;
+    size_t copied = 0;
+    if (r->ret > 0 && r->buf.len > 0) {
+        len = r->buf.len;
+        copied = iov_scatter((const char*)r->buf.data, len, iov, iovcnt);
+    } else if (r->ret > 0 && region) {
+        len = r->ret;
+        copied = iov_scatter(region, len, iov, iovcnt);
+    }
+    if (msg_flags) {
+        uint64_t trunc;
+        bool cut = rpc_field_get(&r->base, RPC_RECV_TRUNC, &trunc);
+        *msg_flags = (cut || copied < len) ? MSG_TRUNC : 0;
+    }
+
+    // 要不要 & 有没有返回 peer 地址
+    if (src_addr) {
+        assert(r->has_addr);
+        // AF_INET only, sockaddr_in only
+        memcpy(src_addr, r->addr.data, sizeof(struct sockaddr_in));
+        *addrlen = sizeof(struct sockaddr_in);
+    }
+
+    return copied;
+}
+
+// A prefetched record (readiness.h) instead of a Recvfrom
+static bool
+recv_prefetched(int sockfd, const struct iovec* iov, int iovcnt, int flags,
+                struct sockaddr* src_addr, socklen_t* addrlen, int* msg_flags,
+                ssize_t* ret)
+{
+    struct sockaddr_in addr;
+    size_t len;
+    if (!readiness_take_prefetched(sockfd, iov, iovcnt, flags, &addr, &len,
+                                   msg_flags)) {
+        return false;
+    }
+
+    if (src_addr) {
+        memcpy(src_addr, &addr, sizeof(struct sockaddr_in));
+        *addrlen = sizeof(struct sockaddr_in);
+    }
+    *ret = len;
+    return true;
+}
+
+// muQuinetd prefetched records after we looked, they come first
+static bool
+is_prefetched(const Response__Recvfrom* r)
+{
+    uint64_t prefetched;
+    return rpc_field_get(&r->base, RPC_RECV_PREFETCHED, &prefetched);
+}
+
+// The len bytes in the thread's pipe (splice.h), as one Sendto
+static ssize_t
+send_spliced(int sockfd, int pipefd, size_t len, int flags,
+             const struct sockaddr* dest_addr, socklen_t addrlen)
+{
+    Request req = REQUEST__INIT;
+    Request__Sendto sendtoCall = REQUEST__SENDTO__INIT;
+    struct splice_ref sref;
+    struct channel_route route;
+    Response* resp;
+
+    fill_sendto(&req, &sendtoCall, flags, dest_addr, addrlen);
+    channel ch = fd2channel_route(sockfd, &req, &route);
+    splice_ref_attach(&sref, &sendtoCall.base, len);
+
+    {
+        channel_send_fds(ch, &req, &pipefd, 1);
+        channel_recv(ch, &resp);
+    }
+
+    {
+        assert(resp->returning_case == RESPONSE__RETURNING_SENDTO_CALL);
+
+        // 失败或 short write 时 pipe 里可能还留着 payload
+        if (resp->sendtocall->ret < (ssize_t)len) {
+            splice_pipe_drop();
+        }
+        INTERCEPTOR_RETURN__RET_AND_ERRNO(sendtocall);
+    }
+}
+
+static ssize_t
+send_iov(int sockfd, const struct iovec* iov, int iovcnt, int flags,
+         const struct sockaddr* dest_addr, socklen_t addrlen)
+{
+    size_t len = iov_length(iov, iovcnt);
+    if (async_send_failed(sockfd)) {
+        return -1;
+    }
+    if (!len) {
+        return 0;
+    }
+
+    {
+        INTERCEPTOR_LOG(DEBUG, "calling interceptor/sendto {fd = %d, "
+                               "channel = %lld, iovcnt = %d}",
+                        sockfd, (long long)fd2channel(sockfd), iovcnt);
+    }
+
+    Request req = REQUEST__INIT;
+    Request__Sendto sendtoCall = REQUEST__SENDTO__INIT;
+    const Request* reqp = &req;
+    struct channel_payload payload = {.iov = iov, .iovcnt = iovcnt };
+    struct arena_span span;
+    struct arena_ref ref;
+    struct channel_route route;
+    int pipefd;
+    Response* resp;
+
+    fill_sendto(&req, &sendtoCall, flags, dest_addr, addrlen);
+    channel ch = fd2channel_route(sockfd, &req, &route);
+    if (len <= RPC_SEND_ASYNC_MAX && iovcnt <= SEND_ASYNC_IOV_MAX &&
+        readiness_take_credits(sockfd, len)) {
+        // 异步: inline payload，不等 Response
+        sendtoCall.base.n_unknown_fields = 1;
+        sendtoCall.base.unknown_fields = &g_send_async;
+        channel_send_batch(ch, &reqp, &payload, 1);
+        return len;
+    }
+    if (len >= RPC_SPLICE_THRESHOLD &&
+        (pipefd = splice_payload(iov, iovcnt, &len)) != -1) {
+        // 零拷贝: payload 的页经 pipe 交给 muQuinetd
+        return send_spliced(sockfd, pipefd, len, flags, dest_addr, addrlen);
+    }
+    if (arena_span_begin(&span) &&
+        sendto_via_arena(&span, &ref, &sendtoCall, iov, iovcnt, &len, true)) {
+        payload.iovcnt = 0;
+    }
+
+    {
+        channel_send_batch(ch, &reqp, &payload, 1);
+        channel_recv(ch, &resp);
+    }
+
+    {
+        assert(resp->returning_case == RESPONSE__RETURNING_SENDTO_CALL);
+
+        INTERCEPTOR_RETURN__RET_AND_ERRNO(sendtocall);
+    }
+}
+
+static ssize_t
+recv_iov(int sockfd, const struct iovec* iov, int iovcnt, int flags,
+         struct sockaddr* src_addr, socklen_t* addrlen, int* msg_flags)
+{
+    size_t len = iov_length(iov, iovcnt);
+    if (async_send_failed(sockfd)) {
+        return -1;
+    }
+    if (!len) {
+        return 0;
+    }
+
+    {
+        INTERCEPTOR_LOG(DEBUG, "calling interceptor/recvfrom {fd = %d, "
+                               "channel = %lld, iovcnt = %d}",
+                        sockfd, (long long)fd2channel(sockfd), iovcnt);
+    }
+
+    ssize_t ret;
+read_ring:
+    if (recv_prefetched(sockfd, iov, iovcnt, flags, src_addr, addrlen,
+                        msg_flags, &ret)) {
+        return ret;
+    }
+
+    Request req = REQUEST__INIT;
+    Request__Recvfrom recvfromCall = REQUEST__RECVFROM__INIT;
+    struct arena_span span;
+    struct arena_ref ref;
+    struct channel_route route;
+    char* region = NULL;
+    Response* resp;
+
+    fill_recvfrom(&req, &recvfromCall, len, flags, src_addr != NULL);
+    channel ch = fd2channel_route(sockfd, &req, &route);
+    if (arena_span_begin(&span)) {
+        region = recvfrom_via_arena(&span, &ref, &recvfromCall, len, true);
+    }
+
+    {
+        channel_send(ch, &req);
+        channel_recv(ch, &resp);
+    }
+
+    {
+        assert(resp->returning_case == RESPONSE__RETURNING_RECVFROM_CALL);
+
+        if (is_prefetched(resp->recvfromcall)) {
+            response__free_unpacked(resp, NULL);
+            goto read_ring;
+        }
+
+        int errno_ = 0;
+        ret = recvfrom_result(resp->recvfromcall, region, iov, iovcnt,
+                              src_addr, addrlen, msg_flags, &errno_);
+        response__free_unpacked(resp, NULL);
+        if (ret == -1) {
+            errno = errno_;
+        }
+        return ret;
+    }
+}
 
 ssize_t
 read(int fd, void* buf, size_t count)
@@ -263,6 +683,24 @@ write(int fd, const void* buf, size_t count)
     return sendto(fd, buf, count, 0, NULL, 0);
 }
 
+ssize_t
+readv(int fd, const struct iovec* iov, int iovcnt)
+{
+    if (!is_assigned_by_muquinet(fd))
+        return glibc_funcs.readv(fd, iov, iovcnt);
+
+    return recv_iov(fd, iov, iovcnt, 0, NULL, NULL, NULL);
+}
+
+ssize_t
+writev(int fd, const struct iovec* iov, int iovcnt)
+{
+    if (!is_assigned_by_muquinet(fd))
+        return glibc_funcs.writev(fd, iov, iovcnt);
+
+    return send_iov(fd, iov, iovcnt, 0, NULL, 0);
+}
+
 ssize_t
 send(int sockfd, const void* buf, size_t len, int flags)
 {
@@ -284,53 +722,225 @@ sendto(int sockfd, const void* buf, size_t len, int flags,
         return 0;
     }
 
+    struct iovec iov = {.iov_base = (void*)buf, .iov_len = len };
+    return send_iov(sockfd, &iov, 1, flags, dest_addr, addrlen);
+}
+
+// msg_control (ancillary data) is not supported and ignored
+ssize_t
+sendmsg(int sockfd, const struct msghdr* msg, int flags)
+{
+    if (!is_assigned_by_muquinet(sockfd))
+        return glibc_funcs.sendmsg(sockfd, msg, flags);
+
+    const struct sockaddr* dest_addr =
+        msg->msg_namelen ? (const struct sockaddr*)msg->msg_name : NULL;
+    return send_iov(sockfd, msg->msg_iov, msg->msg_iovlen, flags, dest_addr,
+                    msg->msg_namelen);
+}
+
+// At most RPC_BATCH_MAX messages, and as many of them as fit in one
+// channel message: like the kernel's, it may send less than vlen.
+int
+sendmmsg(int sockfd, struct mmsghdr* msgvec, unsigned int vlen, int flags)
+{
+    if (!is_assigned_by_muquinet(sockfd))
+        return glibc_funcs.sendmmsg(sockfd, msgvec, vlen, flags);
+
+    if (async_send_failed(sockfd)) {
+        return -1;
+    }
+    if (vlen == 0) {
+        return 0;
+    }
+    if (vlen > RPC_BATCH_MAX) {
+        vlen = RPC_BATCH_MAX;
+    }
+
     {
-        // FIXME: logging
-        printf("-- %s:%d: [INFO] calling interceptor/sendto {fd = %d, channel "
-               "= %lld}\n",
-               __FILENAME__, __LINE__, sockfd, (long long)fd2channel(sockfd));
+        INTERCEPTOR_LOG(DEBUG, "calling interceptor/sendmmsg {fd = %d, "
+                               "channel = %lld, vlen = %u}",
+                        sockfd, (long long)fd2channel(sockfd), vlen);
     }
 
-    Request req = REQUEST__INIT;
-    Request__Sendto sendtoCall = REQUEST__SENDTO__INIT;
-    ProtobufCBinaryData bufData;
-    ProtobufCBinaryData addrData;
-    Response* resp;
+    Request reqs[RPC_BATCH_MAX];
+    Request__Sendto calls[RPC_BATCH_MAX];
+    const Request* reqps[RPC_BATCH_MAX];
+    struct channel_payload payloads[RPC_BATCH_MAX];
+    struct arena_ref refs[RPC_BATCH_MAX];
+    struct channel_route routes[RPC_BATCH_MAX];
+    Response* resps[RPC_BATCH_MAX];
+
+    channel ch = 0;
+    struct arena_span span;
+    bool arena = arena_span_begin(&span);
+    for (unsigned int i = 0; i < vlen; ++i) {
+        const struct msghdr* msg = &msgvec[i].msg_hdr;
+        const struct sockaddr* dest_addr =
+            msg->msg_namelen ? (const struct sockaddr*)msg->msg_name : NULL;
+
+        request__init(&reqs[i]);
+        request__sendto__init(&calls[i]);
+        fill_sendto(&reqs[i], &calls[i], flags, dest_addr, msg->msg_namelen);
+        ch = fd2channel_route(sockfd, &reqs[i], &routes[i]);
+        reqps[i] = &reqs[i];
+        payloads[i].iov = msg->msg_iov;
+        payloads[i].iovcnt = msg->msg_iovlen;
+
+        size_t len = iov_length(msg->msg_iov, msg->msg_iovlen);
+        if (arena && sendto_via_arena(&span, &refs[i], &calls[i], msg->msg_iov,
+                                      msg->msg_iovlen, &len, i == 0)) {
+            payloads[i].iovcnt = 0;
+        }
+    }
 
+    int n;
     {
-        req.pid = getpid();
+        n = channel_send_batch(ch, reqps, payloads, vlen);
+        channel_recv_batch(ch, resps, n);
+    }
 
-        bufData.data = (uint8_t*)buf;
-        bufData.len = len;
+    // muQuinetd stops a batch at its first failed call (rpc.h)
+    int nsent = 0;
+    int errno_ = 0;
+    for (int i = 0; i < n; ++i) {
+        assert(resps[i]->returning_case == RESPONSE__RETURNING_SENDTO_CALL);
+
+        const Response__Sendto* r = resps[i]->sendtocall;
+        if (nsent == i && r->ret >= 0) {
+            msgvec[i].msg_len = r->ret;
+            ++nsent;
+        } else if (nsent == i) {
+            assert(r->has_errno_);
+            errno_ = r->errno_;
+        }
+        response__free_unpacked(resps[i], NULL);
+    }
 
-        sendtoCall.buf = bufData;
-        sendtoCall.flags = flags;
+    if (nsent == 0) {
+        errno = errno_;
+        return -1;
+    }
+    return nsent;
+}
 
-        if (dest_addr) {
-            addrData.data = (uint8_t*)dest_addr;
-            assert(addrlen == sizeof(struct sockaddr_in));
-            addrData.len = addrlen;
-            sendtoCall.has_addr = true;
-            sendtoCall.addr = addrData;
+// Up to RPC_SPLICE_MAX bytes of in_fd: spliced into the thread's pipe
+// (splice.h), or copied when in_fd can't be spliced from
+static ssize_t
+send_from_fd(int sockfd, int in_fd, loff_t* offset, size_t count,
+             unsigned int flags)
+{
+    if (async_send_failed(sockfd)) {
+        return -1;
+    }
+    if (!count) {
+        return 0;
+    }
+
+    {
+        INTERCEPTOR_LOG(DEBUG, "calling interceptor/sendfile {fd = %d, "
+                               "in_fd = %d, count = %zu}",
+                        sockfd, in_fd, count);
+    }
+
+    /*  1. 零拷贝: 文件的页经 pipe 交给 muQuinetd */
+
+    size_t len = count;
+    int pipefd = splice_from_fd(in_fd, offset, &len, flags);
+    if (pipefd != -1) {
+        if (!len) {
+            return 0;
+        }
+        ssize_t nsent = send_spliced(sockfd, pipefd, len, 0, NULL, 0);
+        // 没发出去的部分留给下一次：退回 *offset 或文件位置
+        ssize_t unsent = len - (nsent > 0 ? nsent : 0);
+        if (unsent) {
+            int errno_ = errno;
+            if (offset) {
+                *offset -= unsent;
+            } else {
+                lseek(in_fd, -unsent, SEEK_CUR);
+            }
+            errno = errno_;
         }
+        return nsent;
+    }
+    if (errno != ENOSYS) {
+        return -1;
+    }
 
-        req.sendtocall = &sendtoCall;
-        req.calling_case = REQUEST__CALLING_SENDTO_CALL;
+    /*  2. 拷贝一次 */
+
+    char buf[RPC_SPLICE_THRESHOLD];
+    size_t n = count < sizeof(buf) ? count : sizeof(buf);
+    ssize_t nread = offset ? pread(in_fd, buf, n, *offset)
+                           : glibc_funcs.read(in_fd, buf, n);
+    if (nread <= 0) {
+        return nread;
     }
 
-    {
-        channel_send(fd2channel(sockfd), &req);
-        channel_recv(fd2channel(sockfd), &resp);
+    struct iovec iov = {.iov_base = buf, .iov_len = nread };
+    ssize_t nsent = send_iov(sockfd, &iov, 1, 0, NULL, 0);
+    ssize_t unsent = nread - (nsent > 0 ? nsent : 0);
+    if (offset) {
+        *offset += nread - unsent;
+    } else if (unsent) {
+        // 没发出去的部分留给下一次，文件位置退回去
+        lseek(in_fd, -unsent, SEEK_CUR);
     }
+    return nsent;
+}
 
-    {
-        assert(resp->returning_case == RESPONSE__RETURNING_SENDTO_CALL);
+// Like the kernel's, it may send less than count
+ssize_t
+sendfile(int out_fd, int in_fd, off_t* offset, size_t count)
+{
+    if (!is_assigned_by_muquinet(out_fd))
+        return glibc_funcs.sendfile(out_fd, in_fd, offset, count);
 
-        INTERCEPTOR_RETURN__RET_AND_ERRNO(recvfromcall);
+    loff_t off = offset ? *offset : 0;
+    ssize_t ret = send_from_fd(out_fd, in_fd, offset ? &off : NULL, count, 0);
+    if (offset) {
+        *offset = off;
     }
+    return ret;
 }
 
-// sendmsg
+// What sendfile() is with _FILE_OFFSET_BITS=64
+ssize_t
+sendfile64(int out_fd, int in_fd, off64_t* offset, size_t count)
+{
+    if (!is_assigned_by_muquinet(out_fd))
+        return glibc_funcs.sendfile64(out_fd, in_fd, offset, count);
+
+    loff_t off = offset ? *offset : 0;
+    ssize_t ret = send_from_fd(out_fd, in_fd, offset ? &off : NULL, count, 0);
+    if (offset) {
+        *offset = off;
+    }
+    return ret;
+}
+
+// Splicing to a muQuinet socket only, not from one
+ssize_t
+splice(int fd_in, loff_t* off_in, int fd_out, loff_t* off_out, size_t len,
+       unsigned int flags)
+{
+    bool in = is_assigned_by_muquinet(fd_in);
+    bool out = is_assigned_by_muquinet(fd_out);
+    if (!in && !out)
+        return glibc_funcs.splice(fd_in, off_in, fd_out, off_out, len, flags);
+
+    if (in) {
+        errno = EINVAL;
+        return -1;
+    }
+    if (off_out) {
+        errno = ESPIPE;
+        return -1;
+    }
+    return send_from_fd(fd_out, fd_in, off_in, len, flags);
+}
 
 ssize_t
 recv(int sockfd, void* buf, size_t len, int flags)
@@ -353,72 +963,495 @@ recvfrom(int sockfd, void* buf, size_t len, int flags,
         return 0;
     }
 
-    {
-        // FIXME: logging
-        printf("-- %s:%d: [INFO] calling interceptor/recvfrom {fd = %d, "
-               "channel = %lld}\n",
-               __FILENAME__, __LINE__, sockfd, (long long)fd2channel(sockfd));
-    }
+    struct iovec iov = {.iov_base = buf, .iov_len = len };
+    return recv_iov(sockfd, &iov, 1, flags, src_addr, addrlen, NULL);
+}
 
-    Request req = REQUEST__INIT;
-    Request__Recvfrom recvfromCall = REQUEST__RECVFROM__INIT;
-    Response* resp;
+// msg_control (ancillary data) is not supported, msg_controllen is set to 0
+ssize_t
+recvmsg(int sockfd, struct msghdr* msg, int flags)
+{
+    if (!is_assigned_by_muquinet(sockfd))
+        return glibc_funcs.recvmsg(sockfd, msg, flags);
 
-    {
-        req.pid = getpid();
+    msg->msg_controllen = 0;
+    return recv_iov(sockfd, msg->msg_iov, msg->msg_iovlen, flags,
+                    msg->msg_name ? (struct sockaddr*)msg->msg_name : NULL,
+                    &msg->msg_namelen, &msg->msg_flags);
+}
 
-        recvfromCall.len = len;
-        recvfromCall.flags = flags;
-        if (src_addr) {
-            recvfromCall.requireaddr = true;
-        }
+// What is queued already comes in one round trip, as with MSG_WAITFORONE.
+// Only when nothing is, the first message is waited for (unless the
+// socket is nonblocking). timeout is ignored.
+int
+recvmmsg(int sockfd, struct mmsghdr* msgvec, unsigned int vlen, int flags,
+         struct timespec* timeout)
+{
+    if (!is_assigned_by_muquinet(sockfd))
+        return glibc_funcs.recvmmsg(sockfd, msgvec, vlen, flags, timeout);
 
-        req.recvfromcall = &recvfromCall;
-        req.calling_case = REQUEST__CALLING_RECVFROM_CALL;
+    if (async_send_failed(sockfd)) {
+        return -1;
     }
+    if (vlen == 0) {
+        return 0;
+    }
+    if (vlen > RPC_BATCH_MAX) {
+        vlen = RPC_BATCH_MAX;
+    }
+    flags &= ~MSG_WAITFORONE;
 
     {
-        channel_send(fd2channel(sockfd), &req);
-        channel_recv(fd2channel(sockfd), &resp);
+        INTERCEPTOR_LOG(DEBUG, "calling interceptor/recvmmsg {fd = %d, "
+                               "channel = %lld, vlen = %u}",
+                        sockfd, (long long)fd2channel(sockfd), vlen);
     }
 
+    unsigned int nlocal;
+read_ring:
+    for (nlocal = 0; nlocal < vlen; ++nlocal) {
+        struct msghdr* msg = &msgvec[nlocal].msg_hdr;
+        ssize_t ret;
+        if (!recv_prefetched(sockfd, msg->msg_iov, msg->msg_iovlen, flags,
+                             msg->msg_name, &msg->msg_namelen,
+                             &msg->msg_flags, &ret)) {
+            break;
+        }
+        msg->msg_controllen = 0;
+        msgvec[nlocal].msg_len = ret;
+        if (flags & MSG_PEEK) {
+            ++nlocal;
+            break;
+        }
+    }
+    if (nlocal > 0) {
+        return nlocal;
+    }
+
+    Request reqs[RPC_BATCH_MAX];
+    Request__Recvfrom calls[RPC_BATCH_MAX];
+    const Request* reqps[RPC_BATCH_MAX];
+    struct arena_ref refs[RPC_BATCH_MAX];
+    char* regions[RPC_BATCH_MAX];
+    struct channel_route routes[RPC_BATCH_MAX];
+    Response* resps[RPC_BATCH_MAX];
+
+    channel ch = 0;
+    struct arena_span span;
+    bool arena = arena_span_begin(&span);
+    for (unsigned int i = 0; i < vlen; ++i) {
+        const struct msghdr* msg = &msgvec[i].msg_hdr;
+        size_t len = iov_length(msg->msg_iov, msg->msg_iovlen);
+
+        request__init(&reqs[i]);
+        request__recvfrom__init(&calls[i]);
+        fill_recvfrom(&reqs[i], &calls[i], len, flags | MSG_DONTWAIT,
+                      msg->msg_name != NULL);
+        ch = fd2channel_route(sockfd, &reqs[i], &routes[i]);
+        reqps[i] = &reqs[i];
+        regions[i] = arena ? recvfrom_via_arena(&span, &refs[i], &calls[i],
+                                                len, i == 0)
+                           : NULL;
+    }
+
+    int n;
     {
-        assert(resp->returning_case == RESPONSE__RETURNING_RECVFROM_CALL);
+        n = channel_send_batch(ch, reqps, NULL, vlen);
+        channel_recv_batch(ch, resps, n);
+    }
 
-        // 有没有返回数据
-        if (resp->recvfromcall->ret > 0) {
-            ProtobufCBinaryData buf_bytes = resp->recvfromcall->buf;
-            memcpy(buf, buf_bytes.data, buf_bytes.len);
+    // muQuinetd stops a batch at its first failed call (rpc.h)
+    int nrecv = 0;
+    int errno_ = 0;
+    bool prefetched = false;
+    for (int i = 0; i < n; ++i) {
+        assert(resps[i]->returning_case == RESPONSE__RETURNING_RECVFROM_CALL);
+
+        struct msghdr* msg = &msgvec[i].msg_hdr;
+        if (nrecv == i && errno_ == 0 && !prefetched &&
+            is_prefetched(resps[i]->recvfromcall)) {
+            prefetched = true;
         }
-
-        // 要不要 & 有没有返回 peer 地址
-        if (src_addr && resp->recvfromcall->ret >= 0) {
-            assert(resp->recvfromcall->has_addr);
-            // AF_INET only, sockaddr_in only
-            ProtobufCBinaryData addr_bytes = resp->recvfromcall->addr;
-            memcpy(src_addr, addr_bytes.data, sizeof(struct sockaddr_in));
-            *addrlen = sizeof(struct sockaddr_in);
+        if (nrecv == i && errno_ == 0 && !prefetched) {
+            ssize_t ret = recvfrom_result(
+                resps[i]->recvfromcall, regions[i], msg->msg_iov,
+                msg->msg_iovlen, msg->msg_name, &msg->msg_namelen,
+                &msg->msg_flags, &errno_);
+            if (ret >= 0) {
+                msg->msg_controllen = 0;
+                msgvec[i].msg_len = ret;
+                ++nrecv;
+            }
         }
+        response__free_unpacked(resps[i], NULL);
+    }
 
-        INTERCEPTOR_RETURN__RET_AND_ERRNO(recvfromcall);
+    if (nrecv > 0) {
+        return nrecv;
+    }
+    if (prefetched) {
+        goto read_ring;
+    }
+    if (errno_ == EAGAIN && !(flags & MSG_DONTWAIT)) {
+        ssize_t ret = recvmsg(sockfd, &msgvec[0].msg_hdr, flags);
+        if (ret == -1) {
+            return -1;
+        }
+        msgvec[0].msg_len = ret;
+        return 1;
     }
+    errno = errno_;
+    return -1;
 }
 
-// recvmsg
+/* 3. Socket polling
+ *
+ * muQuinet fds are never polled by the kernel: their readiness is read
+ * from the region muQuinetd keeps up to date (readiness.h), and when none
+ * is ready the readiness eventfd is waited on together with kernel fds.
+ */
+
+// epoll_data of the readiness eventfd in the application's epoll sets
+#define READINESS_EPOLL_MAGIC 0x6d75517569ffffffULL
 
-/* 3. Socket polling */
+static int64_t
+now_ms()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+// timeout left in ms, -1 for infinite
+static int
+remaining_ms(int timeout, int64_t deadline)
+{
+    if (timeout < 0)
+        return -1;
+    int64_t left = deadline - now_ms();
+    return left > 0 ? (int)left : 0;
+}
+
+// revents of muQuinet fds, the count of ready ones
+static int
+poll_muquinet(struct pollfd* fds, nfds_t nfds)
+{
+    int nready = 0;
+    for (nfds_t i = 0; i < nfds; ++i) {
+        if (!is_assigned_by_muquinet(fds[i].fd))
+            continue;
+        fds[i].revents =
+            readiness_of(fds[i].fd) & (fds[i].events | POLLERR | POLLHUP);
+        if (fds[i].revents)
+            ++nready;
+    }
+    return nready;
+}
 
 int
 poll(struct pollfd* fds, nfds_t nfds, int timeout)
 {
-    // TODO
+    /*  1. 没有 muQuinet fd 时交给 glibc */
+
+    nfds_t i;
+    for (i = 0; i < nfds; ++i) {
+        if (is_assigned_by_muquinet(fds[i].fd))
+            break;
+    }
+    if (i == nfds)
+        return glibc_funcs.poll(fds, nfds, timeout);
+
+    /*  2. 给 kernel 的 pollfd：muQuinet fd 换成 -1（kernel 忽略），
+     *     末尾加上 readiness eventfd
+     */
+
+    struct pollfd stackfds[64];
+    struct pollfd* kfds = stackfds;
+    if (nfds + 1 > sizeof(stackfds) / sizeof(stackfds[0])) {
+        kfds = (struct pollfd*)malloc((nfds + 1) * sizeof(struct pollfd));
+        if (!kfds) {
+            errno = ENOMEM;
+            return -1;
+        }
+    }
+    for (i = 0; i < nfds; ++i) {
+        kfds[i] = fds[i];
+        if (is_assigned_by_muquinet(fds[i].fd))
+            kfds[i].fd = -1;
+    }
+    kfds[nfds].fd = readiness_eventfd();
+    kfds[nfds].events = POLLIN;
+
+    /*  3. 等到有 fd 就绪或超时 */
+
+    int64_t deadline = timeout > 0 ? now_ms() + timeout : 0;
+    int nkernel;
+    int nready;
+    for (;;) {
+        nready = poll_muquinet(fds, nfds);
+        if (nready > 0 || timeout == 0) {
+            nkernel = glibc_funcs.poll(kfds, nfds, 0);
+            break;
+        }
+
+        readiness_wait_begin(false);
+        nready = poll_muquinet(fds, nfds);
+        nkernel = glibc_funcs.poll(kfds, nfds + 1,
+                                   nready > 0 ? 0 : remaining_ms(timeout,
+                                                                 deadline));
+        readiness_wait_end(false);
+        if (nkernel > 0 && kfds[nfds].revents) {
+            readiness_drain();
+            --nkernel;
+        }
+
+        nready = poll_muquinet(fds, nfds);
+        if (nkernel != 0 || nready > 0 ||
+            remaining_ms(timeout, deadline) == 0) {
+            break;
+        }
+    }
+
+    /*  4. kernel fd 的 revents */
+
+    for (i = 0; i < nfds; ++i) {
+        if (kfds[i].fd != -1 || fds[i].fd < 0)
+            fds[i].revents = kfds[i].revents;
+    }
+    if (kfds != stackfds) {
+        free(kfds);
+    }
+
+    return nkernel == -1 ? -1 : nkernel + nready;
 }
 
+// muQuinet fds are beyond FD_SETSIZE: no FD_ISSET(), which may abort
+#define FDSET_BITS (8 * sizeof(unsigned long))
+#define FDSET_ISSET(fd, set)                                                   \
+    ((set) && (((unsigned long*)(set))[(fd) / FDSET_BITS] >>                  \
+                   ((fd) % FDSET_BITS) &                                       \
+               1))
+#define FDSET_SET(fd, set)                                                     \
+    (((unsigned long*)(set))[(fd) / FDSET_BITS] |= 1UL << ((fd) % FDSET_BITS))
+
 int
 select(int nfds, fd_set* readfds, fd_set* writefds, fd_set* exceptfds,
        struct timeval* timeout)
 {
-    // TODO
+    /*  1. 没有 muQuinet fd 时交给 glibc */
+
+    int fd;
+    for (fd = g_startfd > 0 ? g_startfd : nfds; fd < nfds; ++fd) {
+        if ((FDSET_ISSET(fd, readfds) || FDSET_ISSET(fd, writefds) ||
+             FDSET_ISSET(fd, exceptfds)) &&
+            is_assigned_by_muquinet(fd)) {
+            break;
+        }
+    }
+    if (fd >= nfds)
+        return glibc_funcs.select(nfds, readfds, writefds, exceptfds, timeout);
+
+    /*  2. 转成 poll */
+
+    struct pollfd* pfds = (struct pollfd*)malloc(nfds * sizeof(struct pollfd));
+    if (!pfds) {
+        errno = ENOMEM;
+        return -1;
+    }
+
+    int n = 0;
+    for (fd = 0; fd < nfds; ++fd) {
+        short events = (FDSET_ISSET(fd, readfds) ? POLLIN : 0) |
+                       (FDSET_ISSET(fd, writefds) ? POLLOUT : 0) |
+                       (FDSET_ISSET(fd, exceptfds) ? POLLPRI : 0);
+        if (events) {
+            pfds[n].fd = fd;
+            pfds[n].events = events;
+            pfds[n].revents = 0;
+            ++n;
+        }
+    }
+
+    int ms = timeout ? timeout->tv_sec * 1000 + (timeout->tv_usec + 999) / 1000
+                     : -1;
+    int ret = poll(pfds, n, ms);
+
+    /*  3. 转回 fd_set */
+
+    if (ret >= 0) {
+        for (int i = 0; i < n; ++i) {
+            if (pfds[i].revents & POLLNVAL) {
+                free(pfds);
+                errno = EBADF;
+                return -1;
+            }
+        }
+
+        size_t setbytes = (nfds + FDSET_BITS - 1) / FDSET_BITS *
+                          sizeof(unsigned long);
+        if (readfds)
+            memset(readfds, 0, setbytes);
+        if (writefds)
+            memset(writefds, 0, setbytes);
+        if (exceptfds)
+            memset(exceptfds, 0, setbytes);
+
+        ret = 0;
+        for (int i = 0; i < n; ++i) {
+            short r = pfds[i].revents;
+            if (readfds && (pfds[i].events & POLLIN) &&
+                (r & (POLLIN | POLLHUP | POLLERR))) {
+                FDSET_SET(pfds[i].fd, readfds);
+                ++ret;
+            }
+            if (writefds && (pfds[i].events & POLLOUT) &&
+                (r & (POLLOUT | POLLERR))) {
+                FDSET_SET(pfds[i].fd, writefds);
+                ++ret;
+            }
+            if (exceptfds && (pfds[i].events & POLLPRI) && (r & POLLPRI)) {
+                FDSET_SET(pfds[i].fd, exceptfds);
+                ++ret;
+            }
+        }
+    }
+
+    free(pfds);
+    return ret;
+}
+
+int
+epoll_ctl(int epfd, int op, int fd, struct epoll_event* event)
+{
+    if (!is_assigned_by_muquinet(fd))
+        return glibc_funcs.epoll_ctl(epfd, op, fd, event);
+
+    INTERCEPTOR_LOG(DEBUG, "calling interceptor/epoll_ctl {epfd = %d, op = "
+                           "%d, fd = %d}",
+                    epfd, op, fd);
+
+    int transition;
+    if (epoll_set_ctl(epfd, op, fd, event, &transition) == -1)
+        return -1;
+
+    // 一个 readiness eventfd 代表 epfd 里所有的 muQuinet fd
+    int efd = readiness_eventfd();
+    if (efd != -1 && transition > 0) {
+        struct epoll_event ev;
+        ev.events = EPOLLIN;
+        ev.data.u64 = READINESS_EPOLL_MAGIC;
+        glibc_funcs.epoll_ctl(epfd, EPOLL_CTL_ADD, efd, &ev);
+    } else if (transition < 0) {
+        readiness_epoll_del(epfd);
+    }
+    return 0;
+}
+
+// epfd lost its last muQuinet fd (EPOLL_CTL_DEL, or close())
+static void
+readiness_epoll_del(int epfd)
+{
+    int efd = readiness_eventfd();
+    if (efd != -1)
+        glibc_funcs.epoll_ctl(epfd, EPOLL_CTL_DEL, efd, NULL);
+}
+
+// Kernel events without the readiness eventfd's, which is drained
+static int
+strip_readiness_event(struct epoll_event* events, int n)
+{
+    int kept = 0;
+    for (int i = 0; i < n; ++i) {
+        if (events[i].data.u64 == READINESS_EPOLL_MAGIC) {
+            readiness_drain();
+            continue;
+        }
+        events[kept++] = events[i];
+    }
+    return kept;
+}
+
+static int
+epoll_wait_muquinet(int epfd, struct epoll_event* events, int maxevents,
+                    int timeout, const sigset_t* sigmask)
+{
+    int64_t deadline = timeout > 0 ? now_ms() + timeout : 0;
+    bool edge = epoll_set_edge_triggered(epfd);
+
+    for (;;) {
+        /*  1. 有 muQuinet fd 就绪：kernel fd 只看一眼 */
+
+        readiness_wait_begin(edge);
+        int n = epoll_set_collect(epfd, events, maxevents);
+        if (n > 0 || timeout == 0) {
+            readiness_wait_end(edge);
+            if (n < maxevents) {
+                int k = glibc_funcs.epoll_pwait(epfd, events + n,
+                                                maxevents - n, 0, sigmask);
+                if (k > 0)
+                    n += strip_readiness_event(events + n, k);
+            }
+            return n;
+        }
+
+        /*  2. 否则与 kernel fd 一起等 */
+
+        int k = glibc_funcs.epoll_pwait(epfd, events, maxevents,
+                                        remaining_ms(timeout, deadline),
+                                        sigmask);
+        readiness_wait_end(edge);
+        if (k == -1)
+            return -1;
+
+        k = strip_readiness_event(events, k);
+        n = k + epoll_set_collect(epfd, events + k, maxevents - k);
+        if (n > 0 || remaining_ms(timeout, deadline) == 0)
+            return n;
+    }
+}
+
+// No muQuinet fd in epfd: the readiness eventfd may still be in it (it
+// just lost the last one), it is never reported
+static int
+epoll_wait_kernel(int epfd, struct epoll_event* events, int maxevents,
+                  int timeout, const sigset_t* sigmask)
+{
+    int64_t deadline = timeout > 0 ? now_ms() + timeout : 0;
+
+    for (;;) {
+        int n = glibc_funcs.epoll_pwait(epfd, events, maxevents,
+                                        remaining_ms(timeout, deadline),
+                                        sigmask);
+        if (n <= 0)
+            return n;
+        n = strip_readiness_event(events, n);
+        if (n > 0 || remaining_ms(timeout, deadline) == 0)
+            return n;
+    }
+}
+
+int
+epoll_wait(int epfd, struct epoll_event* events, int maxevents, int timeout)
+{
+    if (maxevents <= 0)
+        return glibc_funcs.epoll_wait(epfd, events, maxevents, timeout);
+    if (epoll_set_count(epfd) == 0)
+        return epoll_wait_kernel(epfd, events, maxevents, timeout, NULL);
+
+    return epoll_wait_muquinet(epfd, events, maxevents, timeout, NULL);
+}
+
+int
+epoll_pwait(int epfd, struct epoll_event* events, int maxevents, int timeout,
+            const sigset_t* sigmask)
+{
+    if (maxevents <= 0)
+        return glibc_funcs.epoll_pwait(epfd, events, maxevents, timeout,
+                                       sigmask);
+    if (epoll_set_count(epfd) == 0)
+        return epoll_wait_kernel(epfd, events, maxevents, timeout, sigmask);
+
+    return epoll_wait_muquinet(epfd, events, maxevents, timeout, sigmask);
 }
 
 /* 4. Socket options */
@@ -431,6 +1464,7 @@ getpeername(int sockfd, struct sockaddr* addr, socklen_t* addrlen)
 
     Request req = REQUEST__INIT;
     Request__Getpeername getpeernameCall = REQUEST__GETPEERNAME__INIT;
+    struct channel_route route;
     Response* resp;
 
     {
@@ -441,8 +1475,9 @@ getpeername(int sockfd, struct sockaddr* addr, socklen_t* addrlen)
     }
 
     {
-        channel_send(fd2channel(sockfd), &req);
-        channel_recv(fd2channel(sockfd), &resp);
+        channel ch = fd2channel_route(sockfd, &req, &route);
+        channel_send(ch, &req);
+        channel_recv(ch, &resp);
     }
 
     {
@@ -463,6 +1498,7 @@ getsockname(int sockfd, struct sockaddr* addr, socklen_t* addrlen)
 
     Request req = REQUEST__INIT;
     Request__Getsockname getsocknameCall = REQUEST__GETSOCKNAME__INIT;
+    struct channel_route route;
     Response* resp;
 
     {
@@ -473,8 +1509,9 @@ getsockname(int sockfd, struct sockaddr* addr, socklen_t* addrlen)
     }
 
     {
-        channel_send(fd2channel(sockfd), &req);
-        channel_recv(fd2channel(sockfd), &resp);
+        channel ch = fd2channel_route(sockfd, &req, &route);
+        channel_send(ch, &req);
+        channel_recv(ch, &resp);
     }
 
     {
@@ -529,13 +1566,25 @@ interceptor_init()
     /* 2. read/write */
     glibc_funcs.read = dlsym(RTLD_NEXT, "read");
     glibc_funcs.write = dlsym(RTLD_NEXT, "write");
+    glibc_funcs.readv = dlsym(RTLD_NEXT, "readv");
+    glibc_funcs.writev = dlsym(RTLD_NEXT, "writev");
     glibc_funcs.send = dlsym(RTLD_NEXT, "send");
     glibc_funcs.sendto = dlsym(RTLD_NEXT, "sendto");
+    glibc_funcs.sendmsg = dlsym(RTLD_NEXT, "sendmsg");
+    glibc_funcs.sendmmsg = dlsym(RTLD_NEXT, "sendmmsg");
     glibc_funcs.recv = dlsym(RTLD_NEXT, "recv");
     glibc_funcs.recvfrom = dlsym(RTLD_NEXT, "recvfrom");
+    glibc_funcs.recvmsg = dlsym(RTLD_NEXT, "recvmsg");
+    glibc_funcs.recvmmsg = dlsym(RTLD_NEXT, "recvmmsg");
+    glibc_funcs.sendfile = dlsym(RTLD_NEXT, "sendfile");
+    glibc_funcs.sendfile64 = dlsym(RTLD_NEXT, "sendfile64");
+    glibc_funcs.splice = dlsym(RTLD_NEXT, "splice");
     /* 3. poll */
     glibc_funcs.poll = dlsym(RTLD_NEXT, "poll");
     glibc_funcs.select = dlsym(RTLD_NEXT, "select");
+    glibc_funcs.epoll_ctl = dlsym(RTLD_NEXT, "epoll_ctl");
+    glibc_funcs.epoll_wait = dlsym(RTLD_NEXT, "epoll_wait");
+    glibc_funcs.epoll_pwait = dlsym(RTLD_NEXT, "epoll_pwait");
     /* 4. options */
     glibc_funcs.getpeername = dlsym(RTLD_NEXT, "getpeername");
     glibc_funcs.getsockname = dlsym(RTLD_NEXT, "getsockname");
@@ -543,6 +1592,10 @@ interceptor_init()
     glibc_funcs.setsockopt = dlsym(RTLD_NEXT, "setsockopt");
     glibc_funcs.fcntl = dlsym(RTLD_NEXT, "fcntl");
 
+    interceptor_log_init();
+    readiness_module_init();
+    arena_module_init();
+    splice_module_init();
     fd2channel_module_init();
 }
 
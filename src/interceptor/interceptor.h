@@ -20,10 +20,13 @@
 #ifndef MUQUINET_INTERCEPTOR_H
 #define MUQUINET_INTERCEPTOR_H
 
+#include <signal.h>
 #include <string.h>
+#include <sys/epoll.h>
 #include <sys/poll.h>
 #include <sys/socket.h>
 #include <sys/types.h>
+#include <sys/uio.h>
 
 #define __FILENAME__                                                           \
     (strrchr(__FILE__, '/') ? strrchr(__FILE__, '/') + 1 : __FILE__)
@@ -40,20 +43,36 @@ struct glibc_socket_funcs
 
     ssize_t (*read)(int fd, void* buf, size_t count);
     ssize_t (*write)(int fd, const void* buf, size_t count);
+    ssize_t (*readv)(int fd, const struct iovec* iov, int iovcnt);
+    ssize_t (*writev)(int fd, const struct iovec* iov, int iovcnt);
     ssize_t (*send)(int sockfd, const void* buf, size_t len, int flags);
     ssize_t (*sendto)(int sockfd, const void* buf, size_t len, int flags,
                       const struct sockaddr* dest_addr, socklen_t addrlen);
-    // sendmsg
+    ssize_t (*sendmsg)(int sockfd, const struct msghdr* msg, int flags);
+    int (*sendmmsg)(int sockfd, struct mmsghdr* msgvec, unsigned int vlen,
+                    int flags);
     ssize_t (*recv)(int sockfd, void* buf, size_t len, int flags);
     ssize_t (*recvfrom)(int sockfd, void* buf, size_t len, int flags,
                         struct sockaddr* src_addr, socklen_t* addrlen);
-    // recvmsg
+    ssize_t (*recvmsg)(int sockfd, struct msghdr* msg, int flags);
+    int (*recvmmsg)(int sockfd, struct mmsghdr* msgvec, unsigned int vlen,
+                    int flags, struct timespec* timeout);
+    ssize_t (*sendfile)(int out_fd, int in_fd, off_t* offset, size_t count);
+    ssize_t (*sendfile64)(int out_fd, int in_fd, off64_t* offset,
+                          size_t count);
+    ssize_t (*splice)(int fd_in, loff_t* off_in, int fd_out, loff_t* off_out,
+                      size_t len, unsigned int flags);
 
     /* 3. poll */
 
     int (*poll)(struct pollfd* fds, nfds_t nfds, int timeout);
     int (*select)(int nfds, fd_set* readfds, fd_set* writefds,
                   fd_set* exceptfds, struct timeval* timeout);
+    int (*epoll_ctl)(int epfd, int op, int fd, struct epoll_event* event);
+    int (*epoll_wait)(int epfd, struct epoll_event* events, int maxevents,
+                      int timeout);
+    int (*epoll_pwait)(int epfd, struct epoll_event* events, int maxevents,
+                       int timeout, const sigset_t* sigmask);
 
     /* 4. options */
 
@@ -0,0 +1,215 @@
+/*
+ * muQuinet, an userspace TCP/IP network stack.
+ * Copyright (C) 2018 rtdarwin
+ *
+ * This program is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+
+ * You should have received a copy of the GNU General Public
+ * License along with this program.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include "logging.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <strings.h>
+#include <unistd.h>
+
+#define LOG_QUEUE_SIZE (64 * 1024)
+#define LOG_LINE_MAX 512
+
+int g_interceptor_log_level = INTERCEPTOR_LOG_OFF;
+
+static const char* level_names[] = { "DEBUG", "INFO", "WARNING", "ERROR" };
+
+static struct
+{
+    int fd;
+
+    pthread_mutex_t mutex;
+    pthread_cond_t nonempty;
+    bool writer_started;
+
+    char buf[LOG_QUEUE_SIZE];
+    size_t len;
+    unsigned long dropped;
+} g_log = {.fd = -1,
+           .mutex = PTHREAD_MUTEX_INITIALIZER,
+           .nonempty = PTHREAD_COND_INITIALIZER };
+
+static void
+write_all(const char* p, size_t len)
+{
+    while (len > 0) {
+        ssize_t n = glibc_funcs.write(g_log.fd, p, len);
+        if (n == -1) {
+            if (errno == EINTR)
+                continue;
+            return; // nowhere to report it
+        }
+        p += n;
+        len -= n;
+    }
+}
+
+// 调用者持有 g_log.mutex
+static void
+flush_locked()
+{
+    static char out[LOG_QUEUE_SIZE + LOG_LINE_MAX];
+    size_t len = g_log.len;
+
+    memcpy(out, g_log.buf, len);
+    g_log.len = 0;
+    if (g_log.dropped) {
+        len += snprintf(out + len, LOG_LINE_MAX,
+                        "-- %d: [WARNING] %lu log line(s) dropped\n",
+                        (int)getpid(), g_log.dropped);
+        g_log.dropped = 0;
+    }
+
+    // Writing with the mutex released, producers keep queueing meanwhile
+    pthread_mutex_unlock(&g_log.mutex);
+    write_all(out, len);
+    pthread_mutex_lock(&g_log.mutex);
+}
+
+static void*
+writer_main(void* arg)
+{
+    (void)arg;
+
+    pthread_mutex_lock(&g_log.mutex);
+    for (;;) {
+        while (g_log.len == 0 && g_log.dropped == 0)
+            pthread_cond_wait(&g_log.nonempty, &g_log.mutex);
+        flush_locked();
+    }
+    return NULL;
+}
+
+static void
+at_exit_flush()
+{
+    pthread_mutex_lock(&g_log.mutex);
+    if (g_log.len > 0 || g_log.dropped > 0)
+        flush_locked();
+    pthread_mutex_unlock(&g_log.mutex);
+}
+
+// fork() 之后子进程里没有 writer 线程，用到时再创建
+static void
+at_fork_child()
+{
+    pthread_mutex_init(&g_log.mutex, NULL);
+    pthread_cond_init(&g_log.nonempty, NULL);
+    g_log.writer_started = false;
+    g_log.len = 0;
+    g_log.dropped = 0;
+}
+
+void
+interceptor_log_init()
+{
+    /*  1. level */
+
+    const char* level = getenv("MUQUINET_LOG_LEVEL");
+    g_interceptor_log_level = INTERCEPTOR_LOG_WARNING;
+    if (level) {
+        if (!strcasecmp(level, "debug"))
+            g_interceptor_log_level = INTERCEPTOR_LOG_DEBUG;
+        else if (!strcasecmp(level, "info"))
+            g_interceptor_log_level = INTERCEPTOR_LOG_INFO;
+        else if (!strcasecmp(level, "error"))
+            g_interceptor_log_level = INTERCEPTOR_LOG_ERROR;
+        else if (!strcasecmp(level, "off"))
+            g_interceptor_log_level = INTERCEPTOR_LOG_OFF;
+    }
+    if (g_interceptor_log_level == INTERCEPTOR_LOG_OFF)
+        return;
+
+    /*  2. fd, never one of the application's */
+
+    const char* file = getenv("MUQUINET_LOG_FILE");
+    if (file && *file) {
+        g_log.fd = open(file, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    } else {
+        g_log.fd = glibc_funcs.fcntl(STDERR_FILENO, F_DUPFD_CLOEXEC, 0);
+    }
+    if (g_log.fd == -1) {
+        g_interceptor_log_level = INTERCEPTOR_LOG_OFF;
+        return;
+    }
+
+    atexit(at_exit_flush);
+    pthread_atfork(NULL, NULL, at_fork_child);
+}
+
+void
+interceptor_log_write(int level, const char* file, int line, const char* fmt,
+                      ...)
+{
+    /*  1. format, outside of the lock */
+
+    char msg[LOG_LINE_MAX];
+    int n = snprintf(msg, sizeof(msg), "-- %d %s:%d: [%s] ", (int)getpid(),
+                     file, line, level_names[level]);
+
+    va_list ap;
+    va_start(ap, fmt);
+    n += vsnprintf(msg + n, sizeof(msg) - n, fmt, ap);
+    va_end(ap);
+    if (n > LOG_LINE_MAX - 2)
+        n = LOG_LINE_MAX - 2; // truncated
+    msg[n++] = '\n';
+
+    /*  2. queue */
+
+    pthread_mutex_lock(&g_log.mutex);
+
+    if (!g_log.writer_started) {
+        pthread_t writer;
+        sigset_t all, old;
+        sigfillset(&all);
+        // the application's signals are not for us
+        pthread_sigmask(SIG_SETMASK, &all, &old);
+        if (pthread_create(&writer, NULL, writer_main, NULL) == 0) {
+            pthread_detach(writer);
+            g_log.writer_started = true;
+        }
+        pthread_sigmask(SIG_SETMASK, &old, NULL);
+    }
+
+    if (g_log.len + n <= LOG_QUEUE_SIZE) {
+        memcpy(g_log.buf + g_log.len, msg, n);
+        g_log.len += n;
+    } else {
+        ++g_log.dropped;
+    }
+    if (!g_log.writer_started) {
+        flush_locked(); // no thread, e.g. out of resources
+    }
+
+    pthread_cond_signal(&g_log.nonempty);
+    pthread_mutex_unlock(&g_log.mutex);
+}
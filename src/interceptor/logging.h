@@ -0,0 +1,74 @@
+/*
+ * muQuinet, an userspace TCP/IP network stack.
+ * Copyright (C) 2018 rtdarwin
+ *
+ * This program is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+
+ * You should have received a copy of the GNU General Public
+ * License along with this program.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef INTERCEPTOR_LOGGING_H
+#define INTERCEPTOR_LOGGING_H
+
+#include "interceptor.h"
+
+/*
+ * Leveled logging of the interceptor, which runs inside the application:
+ *
+ *  - MUQUINET_LOG_LEVEL = debug | info | warning | error | off
+ *    (warning on default)
+ *  - MUQUINET_LOG_FILE  = file to append to (a dup of stderr on default)
+ *
+ * A line is formatted in the calling thread and queued, a background
+ * thread writes it out, so the hot send/recv path never blocks on the log
+ * fd. Lines are dropped, and counted, when the queue is full.
+ *
+ * Compiled out in release (NDEBUG) builds unless INTERCEPTOR_LOGGING is
+ * defined.
+ */
+
+enum interceptor_log_level
+{
+    INTERCEPTOR_LOG_DEBUG,
+    INTERCEPTOR_LOG_INFO,
+    INTERCEPTOR_LOG_WARNING,
+    INTERCEPTOR_LOG_ERROR,
+    INTERCEPTOR_LOG_OFF,
+};
+
+extern int g_interceptor_log_level;
+
+void interceptor_log_init();
+void interceptor_log_write(int level, const char* file, int line,
+                           const char* fmt, ...)
+    __attribute__((format(printf, 4, 5)));
+
+#if !defined(NDEBUG) || defined(INTERCEPTOR_LOGGING)
+#define INTERCEPTOR_LOG(level, ...)                                            \
+    do {                                                                       \
+        if (INTERCEPTOR_LOG_##level >= g_interceptor_log_level)                \
+            interceptor_log_write(INTERCEPTOR_LOG_##level, __FILENAME__,       \
+                                  __LINE__, __VA_ARGS__);                      \
+    } while (0)
+#else
+// Arguments are still type-checked, no code is generated
+#define INTERCEPTOR_LOG(level, ...)                                            \
+    do {                                                                       \
+        if (0)                                                                 \
+            interceptor_log_write(INTERCEPTOR_LOG_##level, __FILENAME__,       \
+                                  __LINE__, __VA_ARGS__);                      \
+    } while (0)
+#endif
+
+#endif
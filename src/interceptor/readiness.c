@@ -0,0 +1,283 @@
+/*
+ * muQuinet, an userspace TCP/IP network stack.
+ * Copyright (C) 2018 rtdarwin
+ *
+ * This program is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+
+ * You should have received a copy of the GNU General Public
+ * License along with this program.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include "readiness.h"
+
+#include <fcntl.h>
+#include <poll.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "interceptor.h"
+#include "logging.h"
+#include "rpc/readiness.h"
+
+extern int g_startfd;
+
+static int g_memfd = -1;
+static int g_eventfd = -1;
+static struct rpc_readiness* g_shm;
+// fd - g_startfd -> slot + 1
+static int* g_fd2slot;
+
+void
+readiness_module_init()
+{
+    g_fd2slot = (int*)calloc(RPC_FD_RANGE_MAX, sizeof(int));
+
+    /*  1. memfd */
+
+    g_memfd =
+        memfd_create("muquinet-readiness", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+    if (g_memfd == -1 ||
+        ftruncate(g_memfd, sizeof(struct rpc_readiness)) == -1 ||
+        fcntl(g_memfd, F_ADD_SEALS, RPC_READINESS_SEALS) == -1) {
+        goto e_unavailable;
+    }
+    void* addr = mmap(NULL, sizeof(struct rpc_readiness),
+                      PROT_READ | PROT_WRITE, MAP_SHARED, g_memfd, 0);
+    if (addr == MAP_FAILED) {
+        goto e_unavailable;
+    }
+    g_shm = (struct rpc_readiness*)addr;
+
+    /*  2. eventfd */
+
+    g_eventfd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (g_eventfd == -1) {
+        goto e_unavailable;
+    }
+    return;
+
+e_unavailable:
+    INTERCEPTOR_LOG(WARNING, "no readiness region, muQuinet fds are "
+                             "always reported ready");
+    if (g_shm) {
+        munmap(g_shm, sizeof(struct rpc_readiness));
+        g_shm = NULL;
+    }
+    if (g_memfd != -1) {
+        glibc_funcs.close(g_memfd);
+        g_memfd = -1;
+    }
+}
+
+int
+readiness_fds_to_pass(int fds[2])
+{
+    if (!g_shm || g_memfd == -1)
+        return 0;
+
+    fds[0] = g_memfd;
+    fds[1] = g_eventfd;
+    return 2;
+}
+
+void
+readiness_fds_passed()
+{
+    if (g_memfd != -1) {
+        glibc_funcs.close(g_memfd);
+        g_memfd = -1;
+    }
+}
+
+int
+readiness_eventfd()
+{
+    return g_shm ? g_eventfd : -1;
+}
+
+void
+readiness_bind(int fd, int slot)
+{
+    g_fd2slot[fd - g_startfd] = slot + 1;
+}
+
+void
+readiness_unbind(int fd)
+{
+    g_fd2slot[fd - g_startfd] = 0;
+}
+
+static struct rpc_prefetch*
+prefetch_ring(int slot)
+{
+    int ring = __atomic_load_n(&g_shm->prefetch[slot], __ATOMIC_ACQUIRE) - 1;
+    return ring < 0 ? NULL : &g_shm->rings[ring];
+}
+
+static bool
+prefetch_empty(struct rpc_prefetch* r)
+{
+    return __atomic_load_n(&r->head, __ATOMIC_ACQUIRE) ==
+           __atomic_load_n(&r->tail, __ATOMIC_ACQUIRE);
+}
+
+uint32_t
+readiness_of(int fd)
+{
+    int slot = g_fd2slot[fd - g_startfd] - 1;
+    if (!g_shm || slot < 0)
+        return POLLIN | POLLOUT;
+
+    // muQuinetd clears POLLIN once it moved the receive queue to the ring,
+    // after publishing the records
+    uint32_t events = __atomic_load_n(&g_shm->events[slot], __ATOMIC_SEQ_CST);
+    struct rpc_prefetch* r = prefetch_ring(slot);
+    if (r && !prefetch_empty(r)) {
+        events |= POLLIN;
+    }
+    return events;
+}
+
+uint32_t
+readiness_gen(int fd)
+{
+    int slot = g_fd2slot[fd - g_startfd] - 1;
+    if (!g_shm || slot < 0)
+        return 0;
+
+    return __atomic_load_n(&g_shm->gens[slot], __ATOMIC_SEQ_CST);
+}
+
+bool
+readiness_take_credits(int fd, size_t len)
+{
+    int slot = g_fd2slot[fd - g_startfd] - 1;
+    if (!g_shm || slot < 0 || len > RPC_SEND_ASYNC_MAX)
+        return false;
+
+    int32_t* credits = &g_shm->credits[slot];
+    int32_t have = __atomic_load_n(credits, __ATOMIC_ACQUIRE);
+    do {
+        if (have < (int32_t)len)
+            return false;
+    } while (!__atomic_compare_exchange_n(credits, &have, have - (int32_t)len,
+                                          false, __ATOMIC_ACQ_REL,
+                                          __ATOMIC_ACQUIRE));
+    return true;
+}
+
+int
+readiness_take_error(int fd)
+{
+    int slot = g_fd2slot[fd - g_startfd] - 1;
+    if (!g_shm || slot < 0)
+        return 0;
+
+    int32_t* error = &g_shm->errors[slot];
+    if (__atomic_load_n(error, __ATOMIC_RELAXED) == 0)
+        return 0;
+    return __atomic_exchange_n(error, 0, __ATOMIC_ACQ_REL);
+}
+
+static void
+ring_read(const struct rpc_prefetch* r, uint32_t pos, void* dst, size_t n)
+{
+    uint32_t at = pos & (RPC_PREFETCH_SIZE - 1);
+    size_t first = RPC_PREFETCH_SIZE - at < n ? RPC_PREFETCH_SIZE - at : n;
+    memcpy(dst, r->data + at, first);
+    memcpy((char*)dst + first, r->data, n - first);
+}
+
+bool
+readiness_take_prefetched(int fd, const struct iovec* iov, int iovcnt,
+                          int flags, struct sockaddr_in* addr, size_t* len,
+                          int* msg_flags)
+{
+    int slot = g_fd2slot[fd - g_startfd] - 1;
+    if (!g_shm || slot < 0)
+        return false;
+    struct rpc_prefetch* r = prefetch_ring(slot);
+    if (!r)
+        return false;
+
+    // threads racing on the same fd: the record goes to who moves tail
+    uint32_t tail = __atomic_load_n(&r->tail, __ATOMIC_ACQUIRE);
+    for (;;) {
+        if (__atomic_load_n(&r->head, __ATOMIC_ACQUIRE) == tail)
+            return false;
+
+        struct rpc_prefetch_record rec;
+        ring_read(r, tail, &rec, sizeof(rec));
+        uint32_t pos = tail + sizeof(rec);
+        size_t copied = 0;
+        for (int i = 0; i < iovcnt && copied < rec.len; ++i) {
+            size_t n = rec.len - copied < iov[i].iov_len ? rec.len - copied
+                                                         : iov[i].iov_len;
+            ring_read(r, pos + copied, iov[i].iov_base, n);
+            copied += n;
+        }
+
+        if (!(flags & MSG_PEEK) &&
+            !__atomic_compare_exchange_n(&r->tail, &tail, pos + rec.len, false,
+                                         __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+            continue;
+        }
+
+        if (addr) {
+            *addr = rec.addr;
+        }
+        *len = copied;
+        if (msg_flags) {
+            *msg_flags = copied < rec.len ? MSG_TRUNC : 0;
+        }
+        return true;
+    }
+}
+
+void
+readiness_wait_begin(bool edge)
+{
+    if (!g_shm)
+        return;
+
+    __atomic_fetch_add(&g_shm->waiters, 1, __ATOMIC_SEQ_CST);
+    if (edge)
+        __atomic_fetch_add(&g_shm->edge_waiters, 1, __ATOMIC_SEQ_CST);
+}
+
+void
+readiness_wait_end(bool edge)
+{
+    if (!g_shm)
+        return;
+
+    if (edge)
+        __atomic_fetch_sub(&g_shm->edge_waiters, 1, __ATOMIC_SEQ_CST);
+    __atomic_fetch_sub(&g_shm->waiters, 1, __ATOMIC_SEQ_CST);
+}
+
+void
+readiness_drain()
+{
+    uint64_t n;
+    while (glibc_funcs.read(g_eventfd, &n, sizeof(n)) > 0)
+        ;
+}
@@ -0,0 +1,70 @@
+/*
+ * muQuinet, an userspace TCP/IP network stack.
+ * Copyright (C) 2018 rtdarwin
+ *
+ * This program is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+
+ * You should have received a copy of the GNU General Public
+ * License along with this program.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef INTERCEPTOR_READINESS_H
+#define INTERCEPTOR_READINESS_H
+
+#include <netinet/in.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/uio.h>
+
+/*
+ * Readiness of muQuinet fds, written by muQuinetd into shared memory
+ * (see rpc/readiness.h). poll()/select()/epoll_wait() read it, and block
+ * on the eventfd next to the kernel fds.
+ */
+
+void readiness_module_init();
+// memfd and eventfd to pass with the first Atstart, 0 if unavailable
+int readiness_fds_to_pass(int fds[2]);
+// after passing them, the memfd is not needed any more
+void readiness_fds_passed();
+int readiness_eventfd();
+
+// slot: Response.socketCall.ret - 1, -1 for none
+void readiness_bind(int fd, int slot);
+void readiness_unbind(int fd);
+// POLL* bits. fds without a slot are always readable and writable,
+// prefetched payload makes a fd readable.
+uint32_t readiness_of(int fd);
+// Changes whenever muQuinetd sets a bit of the fd, see rpc/readiness.h
+uint32_t readiness_gen(int fd);
+
+// Asynchronous sends: take `len' bytes of the fd's credits, false if it
+// has not enough (the send then waits for its Response)
+bool readiness_take_credits(int fd, size_t len);
+// errno of a failed asynchronous send, 0 for none. Clears it.
+int readiness_take_error(int fd);
+
+// Takes the next prefetched record of the fd (kept with MSG_PEEK) into
+// iov, like a Response.recvfromCall. false if there is none.
+bool readiness_take_prefetched(int fd, const struct iovec* iov, int iovcnt,
+                               int flags, struct sockaddr_in* addr,
+                               size_t* len, int* msg_flags);
+
+// Around blocking on the eventfd: muQuinetd only writes it in between.
+// edge: also woken by sets of bits already set (EPOLLET)
+void readiness_wait_begin(bool edge);
+void readiness_wait_end(bool edge);
+void readiness_drain();
+
+#endif // INTERCEPTOR_READINESS_H
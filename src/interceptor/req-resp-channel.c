@@ -17,11 +17,17 @@
  * <http://www.gnu.org/licenses/>.
  */
 
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
 #include "req-resp-channel.h"
 
 #include <assert.h>
 #include <errno.h>
 #include <fcntl.h>
+#include <stdbool.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <sys/socket.h>
@@ -31,6 +37,8 @@
 #include <unistd.h>
 
 #include "interceptor.h"
+#include "logging.h"
+#include "rpc-field.h"
 
 #define WHILE_EINTR(expr)                                                      \
     while ((expr) == -1) {                                                     \
@@ -49,9 +57,8 @@ new_channel()
     struct sockaddr_un addr;
     memset(&addr, 0, sizeof(addr));
     addr.sun_family = AF_UNIX;
-    const char* master_listener_path =
-        RPC_MASTER_LISTENER_SOCKET_DIR "/" RPC_MASTER_LISTENER_SOCKET_NAME;
-    strncpy(addr.sun_path, master_listener_path, sizeof(addr.sun_path) - 1);
+    snprintf(addr.sun_path, sizeof(addr.sun_path), "%s/%s",
+             rpc_master_listener_socket_dir(), RPC_MASTER_LISTENER_SOCKET_NAME);
 
     /* 2. 创建 socket 并 connect */
 
@@ -68,9 +75,7 @@ new_channel()
     }
 
     {
-        // FIXME: logging
-        printf("-- %s:%d: [INFO] new req-resp-channel {fd = %d}\n",
-               __FILENAME__, __LINE__, sockfd);
+        INTERCEPTOR_LOG(INFO, "new req-resp-channel {fd = %d}", sockfd);
     }
 
     /* 3. return */
@@ -80,29 +85,218 @@ new_channel()
 
 void
 channel_send(channel ch, const Request* req)
+{
+    channel_send_fds(ch, req, NULL, 0);
+}
+
+void
+channel_send_fds(channel ch, const Request* req, const int* fds, int nfds)
 {
     static __thread char buf[RPC_MESSAGE_MAX_SIZE];
 
     size_t bufsize = request__get_packed_size(req);
     assert(bufsize <= RPC_MESSAGE_MAX_SIZE);
     {
-        // FIXME: logging
-        printf("-- %s:%d: [DEBUG] Request bytes count = %ld\n", __FILENAME__,
-               __LINE__, bufsize);
+        INTERCEPTOR_LOG(DEBUG, "Request bytes count = %zu", bufsize);
     }
 
     request__pack(req, (uint8_t*)buf);
 
-    ssize_t nwritten = glibc_funcs.write(ch, buf, bufsize);
+    ssize_t nwritten;
+    if (nfds == 0) {
+        nwritten = glibc_funcs.write(ch, buf, bufsize);
+    } else {
+        union
+        {
+            char buf[CMSG_SPACE(sizeof(int) * 4)];
+            struct cmsghdr align;
+        } cmsgbuf;
+        assert(nfds <= 4);
+
+        struct iovec iov = {.iov_base = buf, .iov_len = bufsize };
+        struct msghdr msg;
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_iov = &iov;
+        msg.msg_iovlen = 1;
+        msg.msg_control = cmsgbuf.buf;
+        msg.msg_controllen = CMSG_SPACE(sizeof(int) * nfds);
+
+        struct cmsghdr* c = CMSG_FIRSTHDR(&msg);
+        c->cmsg_level = SOL_SOCKET;
+        c->cmsg_type = SCM_RIGHTS;
+        c->cmsg_len = CMSG_LEN(sizeof(int) * nfds);
+        memcpy(CMSG_DATA(c), fds, sizeof(int) * nfds);
+
+        nwritten = glibc_funcs.sendmsg(ch, &msg, 0);
+    }
     {
-        // FIXME: logging
-        printf("-- %s:%d: [DEBUG] nwritten = %lld\n", __FILENAME__, __LINE__,
-               (long long)nwritten);
+        INTERCEPTOR_LOG(DEBUG, "nwritten = %lld", (long long)nwritten);
     }
 
     assert((long long)nwritten == (long long)bufsize);
 }
 
+// Field numbers of Request.sendtoCall and Request.Sendto.buf, see
+// rpc/proto/request.proto
+#define SENDTO_CALL_FIELD 5
+#define SENDTO_BUF_FIELD 1
+#define LEN_DELIMITED_TAG(field) ((uint8_t)((field) << 3 | 2))
+
+// A packed Request without its payload, with the length and the payload
+// field headers around it
+#define BATCH_HDR_MAX 256
+// UIO_MAXIOV of the kernel
+#define BATCH_IOV_MAX 1024
+
+static size_t
+varint_size(uint32_t v)
+{
+    size_t n = 1;
+    while (v >= 0x80) {
+        v >>= 7;
+        ++n;
+    }
+    return n;
+}
+
+// returns the bytes consumed, 0 if truncated
+static size_t
+get_varint(const uint8_t* in, size_t len, uint32_t* v)
+{
+    size_t n = 0;
+    *v = 0;
+    while (n < len && n < 5) {
+        *v |= (uint32_t)(in[n] & 0x7f) << (7 * n);
+        if (!(in[n++] & 0x80))
+            return n;
+    }
+    return 0;
+}
+
+static size_t
+iov_length(const struct iovec* iov, int iovcnt)
+{
+    size_t len = 0;
+    for (int i = 0; i < iovcnt; ++i) {
+        len += iov[i].iov_len;
+    }
+    return len;
+}
+
+// Appends iov[0, iovcnt) to out[*nout, BATCH_IOV_MAX), at most maxlen
+// bytes, and returns the bytes appended
+static size_t
+append_iov(struct iovec* out, int* nout, const struct iovec* iov, int iovcnt,
+           size_t maxlen)
+{
+    size_t len = 0;
+    for (int i = 0; i < iovcnt && *nout < BATCH_IOV_MAX && len < maxlen; ++i) {
+        size_t l = iov[i].iov_len;
+        if (l == 0)
+            continue;
+        if (l > maxlen - len)
+            l = maxlen - len;
+        out[*nout].iov_base = iov[i].iov_base;
+        out[*nout].iov_len = l;
+        ++*nout;
+        len += l;
+    }
+    return len;
+}
+
+int
+channel_send_batch(channel ch, const Request* const* reqs,
+                   const struct channel_payload* payloads, int n)
+{
+    static __thread uint8_t hdrs[RPC_BATCH_MAX][BATCH_HDR_MAX];
+    static __thread struct iovec iovs[BATCH_IOV_MAX];
+    static const uint8_t marker = RPC_BATCH_MARKER;
+
+    assert(n >= 1 && n <= RPC_BATCH_MAX);
+
+    bool batch = n > 1;
+    int niov = 0;
+    size_t total = 0;
+    if (batch) {
+        iovs[niov].iov_base = (void*)&marker;
+        iovs[niov].iov_len = 1;
+        ++niov;
+        total = 1;
+    }
+
+    int i;
+    for (i = 0; i < n; ++i) {
+        /*  1. the payload, as much of it as fits for reqs[0] */
+
+        const Request* req = reqs[i];
+        size_t reqlen = request__get_packed_size(req);
+        // length + payload field headers
+        size_t hdrmax = reqlen + 17;
+        assert(hdrmax <= BATCH_HDR_MAX);
+        if (total + hdrmax > RPC_MESSAGE_MAX_SIZE || niov + 1 >= BATCH_IOV_MAX)
+            break;
+
+        int hdriov = niov++;
+        size_t plen = 0;
+        if (payloads) {
+            const struct channel_payload* p = &payloads[i];
+            size_t room = RPC_MESSAGE_MAX_SIZE - total - hdrmax;
+            assert(req->calling_case == REQUEST__CALLING_SENDTO_CALL);
+            if (i > 0 && (iov_length(p->iov, p->iovcnt) > room ||
+                          niov + p->iovcnt > BATCH_IOV_MAX)) {
+                --niov;
+                break;
+            }
+            plen = append_iov(iovs, &niov, p->iov, p->iovcnt, room);
+        }
+
+        /*  2. [length] Request [sendtoCall { buf }] */
+
+        uint8_t* h = hdrs[i];
+        size_t hlen = 0;
+        size_t inner = 0;
+        size_t msglen = reqlen;
+        if (plen > 0) {
+            inner = 1 + varint_size(plen) + plen;
+            msglen += 1 + varint_size(inner) + inner;
+        }
+        if (batch) {
+            hlen += rpc_varint_encode(h, msglen);
+        }
+        hlen += request__pack(req, h + hlen);
+        if (plen > 0) {
+            h[hlen++] = LEN_DELIMITED_TAG(SENDTO_CALL_FIELD);
+            hlen += rpc_varint_encode(h + hlen, inner);
+            h[hlen++] = LEN_DELIMITED_TAG(SENDTO_BUF_FIELD);
+            hlen += rpc_varint_encode(h + hlen, plen);
+        }
+        iovs[hdriov].iov_base = h;
+        iovs[hdriov].iov_len = hlen;
+        total += hlen + plen;
+    }
+    assert(i > 0);
+
+    {
+        INTERCEPTOR_LOG(DEBUG, "Request batch {count = %d, bytes = %zu}", i,
+                        total);
+    }
+
+    /*  3. one message, the kernel gathers it */
+
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = iovs;
+    msg.msg_iovlen = niov;
+
+    ssize_t nwritten = glibc_funcs.sendmsg(ch, &msg, 0);
+    {
+        INTERCEPTOR_LOG(DEBUG, "nwritten = %lld", (long long)nwritten);
+    }
+
+    assert((long long)nwritten == (long long)total);
+    return i;
+}
+
 void
 channel_recv(channel ch, Response** response)
 {
@@ -112,8 +306,7 @@ channel_recv(channel ch, Response** response)
     do {
         if (resp != NULL) {
             response__free_unpacked(resp, NULL);
-            printf("-- %s:%d: [DEBUG] recv WAIT_NEXT\n", __FILENAME__,
-                   __LINE__);
+            INTERCEPTOR_LOG(DEBUG, "recv WAIT_NEXT");
         }
 
         int nread;
@@ -126,9 +319,7 @@ channel_recv(channel ch, Response** response)
         assert(nread != 0);
 
         {
-            // FIXME: logging
-            printf("-- %s:%d: [DEBUG] nread = %lld\n", __FILENAME__, __LINE__,
-                   (long long)nread);
+            INTERCEPTOR_LOG(DEBUG, "nread = %lld", (long long)nread);
         }
 
         resp = response__unpack(NULL, nread, (uint8_t*)buf);
@@ -138,6 +329,40 @@ channel_recv(channel ch, Response** response)
     *response = resp;
 }
 
+void
+channel_recv_batch(channel ch, Response** resps, int n)
+{
+    static __thread uint8_t buf[RPC_MESSAGE_MAX_SIZE];
+
+    if (n == 1) {
+        channel_recv(ch, resps);
+        return;
+    }
+
+    ssize_t nread;
+    // clang-format off
+    WHILE_EINTR
+    (
+        nread = glibc_funcs.read(ch, buf, RPC_MESSAGE_MAX_SIZE)
+    );
+    // clang-format on
+    assert(nread > 0 && buf[0] == RPC_BATCH_MARKER);
+
+    {
+        INTERCEPTOR_LOG(DEBUG, "batch nread = %lld", (long long)nread);
+    }
+
+    size_t off = 1;
+    for (int i = 0; i < n; ++i) {
+        uint32_t len;
+        size_t vlen = get_varint(buf + off, nread - off, &len);
+        assert(vlen != 0 && off + vlen + len <= (size_t)nread);
+        off += vlen;
+        resps[i] = response__unpack(NULL, len, buf + off);
+        off += len;
+    }
+}
+
 void
 close_channel(channel ch)
 {
@@ -20,6 +20,8 @@
 #ifndef INTERCEPTOR_REQRESPCHANNEL_H
 #define INTERCEPTOR_REQRESPCHANNEL_H
 
+#include <sys/uio.h>
+
 #include "rpc/c_out/request.pb-c.h"
 #include "rpc/c_out/response.pb-c.h"
 #include "rpc/rpc.h"
@@ -28,10 +30,31 @@ typedef int channel;
 
 channel new_channel();
 void channel_send(channel ch, const Request* req);
+// fds passed along with the Request (SCM_RIGHTS)
+void channel_send_fds(channel ch, const Request* req, const int* fds,
+                      int nfds);
+
+// Payload of a Sendto Request, gathered by the kernel straight from the
+// caller's buffers: the Request is packed with an empty Sendto.buf and
+// followed by a second sendtoCall field holding buf only, which the
+// daemon's parser merges into the first one.
+struct channel_payload
+{
+    const struct iovec* iov;
+    int iovcnt;
+};
+// Sends reqs[0, n) in one message (a batch when n > 1, see rpc.h) and
+// returns how many of them went out. A batch stops before the first
+// Request whose payload no longer fits, while the payload of reqs[0] is
+// cut to fit. payloads may be NULL.
+int channel_send_batch(channel ch, const Request* const* reqs,
+                       const struct channel_payload* payloads, int n);
 // 由于 unpack 的时候 protobuf-c 自己帮你创建 Response,
 // 这里只能用参数 Response** 来将 protobuf-c 创建的 Response 返回，
 // 而不能用参数 Response* 来更改调用者的 Response
 void channel_recv(channel ch, Response** resp);
+// Responses of the n Requests sent by channel_send_batch()
+void channel_recv_batch(channel ch, Response** resps, int n);
 void close_channel(channel);
 
 #endif
@@ -0,0 +1,62 @@
+/*
+ * muQuinet, an userspace TCP/IP network stack.
+ * Copyright (C) 2018 rtdarwin
+ *
+ * This program is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+
+ * You should have received a copy of the GNU General Public
+ * License along with this program.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#include "rpc-field.h"
+
+size_t
+rpc_varint_encode(uint8_t* out, uint64_t v)
+{
+    size_t n = 0;
+    while (v >= 0x80) {
+        out[n++] = (uint8_t)(v | 0x80);
+        v >>= 7;
+    }
+    out[n++] = (uint8_t)v;
+    return n;
+}
+
+void
+rpc_field_set(ProtobufCMessageUnknownField* f, uint8_t* varint,
+              uint32_t tag, uint64_t value)
+{
+    f->tag = tag;
+    f->wire_type = PROTOBUF_C_WIRE_TYPE_VARINT;
+    f->len = rpc_varint_encode(varint, value);
+    f->data = varint;
+}
+
+bool
+rpc_field_get(const ProtobufCMessage* msg, uint32_t tag, uint64_t* value)
+{
+    for (unsigned i = 0; i < msg->n_unknown_fields; ++i) {
+        const ProtobufCMessageUnknownField* f = &msg->unknown_fields[i];
+        if (f->tag != tag || f->wire_type != PROTOBUF_C_WIRE_TYPE_VARINT)
+            continue;
+
+        uint64_t v = 0;
+        for (size_t k = 0; k < f->len && k < RPC_FIELD_VARINT_MAX; ++k) {
+            v |= (uint64_t)(f->data[k] & 0x7f) << (7 * k);
+            if (!(f->data[k] & 0x80))
+                break;
+        }
+        *value = v;
+        return true;
+    }
+    return false;
+}
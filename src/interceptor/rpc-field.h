@@ -0,0 +1,48 @@
+/*
+ * muQuinet, an userspace TCP/IP network stack.
+ * Copyright (C) 2018 rtdarwin
+ *
+ * This program is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+
+ * You should have received a copy of the GNU General Public
+ * License along with this program.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef INTERCEPTOR_RPC_FIELD_H
+#define INTERCEPTOR_RPC_FIELD_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <protobuf-c/protobuf-c.h>
+
+/*
+ * RPC fields outside of the .proto files (see rpc/rpc.h): varint unknown
+ * fields to the generated code.
+ */
+
+// bytes of the longest varint
+#define RPC_FIELD_VARINT_MAX 10
+
+// v as a varint into out, returns its length
+size_t rpc_varint_encode(uint8_t* out, uint64_t v);
+
+// f becomes field `tag' = value, encoded into varint (RPC_FIELD_VARINT_MAX
+// bytes). Both must live as long as the message they go with is packed.
+void rpc_field_set(ProtobufCMessageUnknownField* f, uint8_t* varint,
+                   uint32_t tag, uint64_t value);
+// false if msg has no varint field `tag'
+bool rpc_field_get(const ProtobufCMessage* msg, uint32_t tag,
+                   uint64_t* value);
+
+#endif // INTERCEPTOR_RPC_FIELD_H
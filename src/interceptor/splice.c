@@ -0,0 +1,172 @@
+/*
+ * muQuinet, an userspace TCP/IP network stack.
+ * Copyright (C) 2018 rtdarwin
+ *
+ * This program is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+
+ * You should have received a copy of the GNU General Public
+ * License along with this program.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include "splice.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "interceptor.h"
+#include "logging.h"
+#include "rpc/splice.h"
+
+static bool g_disabled;
+static pthread_key_t g_pipe_key;
+// {read end, write end}, -1 for none yet
+static __thread int t_pipe[2] = { -1, -1 };
+
+static void
+close_pipe()
+{
+    if (t_pipe[0] != -1) {
+        glibc_funcs.close(t_pipe[0]);
+        glibc_funcs.close(t_pipe[1]);
+        t_pipe[0] = t_pipe[1] = -1;
+    }
+}
+
+// 线程退出时关闭它的 pipe
+static void
+release_pipe(void* value)
+{
+    (void)value;
+    close_pipe();
+}
+
+// fork() 之后子进程与父进程共享同一个 pipe，子进程另建一个
+static void
+at_fork_child()
+{
+    close_pipe();
+    pthread_setspecific(g_pipe_key, NULL);
+}
+
+void
+splice_module_init()
+{
+    const char* splice = getenv("MUQUINET_SPLICE");
+    g_disabled = splice && strcmp(splice, "off") == 0;
+    pthread_key_create(&g_pipe_key, release_pipe);
+    pthread_atfork(NULL, NULL, at_fork_child);
+}
+
+// 每个线程第一次用时建一个 pipe，线程退出时关闭
+static bool
+thread_pipe()
+{
+    if (t_pipe[0] == -1) {
+        if (pipe2(t_pipe, O_CLOEXEC | O_NONBLOCK) == -1) {
+            t_pipe[0] = t_pipe[1] = -1;
+            return false;
+        }
+        // 默认 16 页，未按页对齐的 RPC_SPLICE_MAX 字节可能装不下
+        fcntl(t_pipe[1], F_SETPIPE_SZ, 2 * RPC_SPLICE_MAX);
+        pthread_setspecific(g_pipe_key, (void*)1);
+    }
+    return true;
+}
+
+int
+splice_payload(const struct iovec* iov, int iovcnt, size_t* len)
+{
+    if (g_disabled || !thread_pipe())
+        return -1;
+
+    /*  1. 最多 RPC_SPLICE_MAX 字节，装不下的留给下一次 send */
+
+    struct iovec spliced[IOV_MAX];
+    size_t want = *len < RPC_SPLICE_MAX ? *len : RPC_SPLICE_MAX;
+    size_t n = 0;
+    int cnt = 0;
+    for (int i = 0; i < iovcnt && cnt < IOV_MAX && n < want; ++i) {
+        if (!iov[i].iov_len)
+            continue;
+        spliced[cnt] = iov[i];
+        if (spliced[cnt].iov_len > want - n) {
+            spliced[cnt].iov_len = want - n;
+        }
+        n += spliced[cnt++].iov_len;
+    }
+
+    /*  2. 只移交页的引用，不拷贝 */
+
+    ssize_t nspliced = vmsplice(t_pipe[1], spliced, cnt, SPLICE_F_NONBLOCK);
+    if (nspliced <= 0) {
+        int errno_ = errno;
+        if (nspliced == -1 && errno_ != EAGAIN) {
+            INTERCEPTOR_LOG(WARNING, "vmsplice: %s, bulk sends are copied",
+                            strerror(errno_));
+            g_disabled = true;
+        }
+        // 不应该发生：pipe 在调用之间总是空的
+        splice_pipe_drop();
+        return -1;
+    }
+
+    *len = nspliced;
+    return t_pipe[0];
+}
+
+int
+splice_from_fd(int fd, loff_t* offset, size_t* len, unsigned int flags)
+{
+    if (g_disabled || !thread_pipe()) {
+        errno = ENOSYS;
+        return -1;
+    }
+
+    size_t want = *len < RPC_SPLICE_MAX ? *len : RPC_SPLICE_MAX;
+    ssize_t nspliced = glibc_funcs.splice(fd, offset, t_pipe[1], NULL, want,
+                                          flags & SPLICE_F_NONBLOCK);
+    if (nspliced == -1) {
+        // fd 不支持 splice
+        if (errno == EINVAL) {
+            errno = ENOSYS;
+        }
+        return -1;
+    }
+
+    *len = nspliced;
+    return t_pipe[0];
+}
+
+void
+splice_pipe_drop()
+{
+    close_pipe();
+}
+
+void
+splice_ref_attach(struct splice_ref* ref, ProtobufCMessage* msg,
+                  uint64_t length)
+{
+    rpc_field_set(&ref->field, ref->varint, RPC_SPLICE_LENGTH, length);
+    msg->n_unknown_fields = 1;
+    msg->unknown_fields = &ref->field;
+}
@@ -0,0 +1,59 @@
+/*
+ * muQuinet, an userspace TCP/IP network stack.
+ * Copyright (C) 2018 rtdarwin
+ *
+ * This program is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+
+ * You should have received a copy of the GNU General Public
+ * License along with this program.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef INTERCEPTOR_SPLICE_H
+#define INTERCEPTOR_SPLICE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+
+#include <protobuf-c/protobuf-c.h>
+
+#include "rpc-field.h"
+
+/*
+ * Bulk sends vmsplice()d into a pipe of the calling thread, muQuinetd
+ * reads them out of it (see rpc/splice.h).
+ */
+
+void splice_module_init();
+// Splices the first bytes of iov, *len is cut to what the pipe took.
+// Returns the read end of the pipe to pass, -1 if splicing is unavailable.
+int splice_payload(const struct iovec* iov, int iovcnt, size_t* len);
+// Splices up to *len bytes of fd (from *offset if not NULL, which is
+// moved on), *len is set to what the pipe took: 0 at end of file.
+// Returns the read end of the pipe to pass; -1 and errno otherwise, ENOSYS
+// if fd can't be spliced from.
+int splice_from_fd(int fd, loff_t* offset, size_t* len, unsigned int flags);
+// The call failed, the pipe may not be empty any more
+void splice_pipe_drop();
+
+// RPC_SPLICE_LENGTH, attached to msg as an unknown field. Lives as long
+// as msg is packed.
+struct splice_ref
+{
+    ProtobufCMessageUnknownField field;
+    uint8_t varint[RPC_FIELD_VARINT_MAX];
+};
+void splice_ref_attach(struct splice_ref* ref, ProtobufCMessage* msg,
+                       uint64_t length);
+
+#endif // INTERCEPTOR_SPLICE_H
@@ -42,8 +42,46 @@ struct Conf : public Singleton<Conf>
     {
         string name = "";
         string addr_cidr = "192.168.168.8/24";
+        int mtu = 1500;
+        int txqlen = 1024;
+        string io_engine = "io_uring"; // io_uring, sync
+        string mirror = "";            // pcap of every packet if set
+        int mirror_size_mb = 64;       // mirror + mirror.1, a ring on disk
     } tundev;
 
+    struct PacketDev
+    {
+        string ifname = "";        // use it instead of TUN if set
+        string engine = "tpacket"; // tpacket, af_xdp
+        bool busy_poll = false;    // af_xdp only
+    } pktdev;
+
+    struct Loopback
+    {
+        bool enabled = false; // in-memory echo peer, no real device
+    } loopback;
+
+    struct PcapDev
+    {
+        string replay = "";          // use it instead of TUN if set
+        string capture = "";         // transmitted packets, dropped if unset
+        string timing = "line_rate"; // line_rate, original
+        bool loop = false;           // start over at the end of the file
+    } pcapdev;
+
+    struct Mux
+    {
+        int send_credits_kb = 256; // async sends in flight per socket,
+                                   // 0: every send waits for its Response
+        int prefetch_kb = 64;      // payload pushed to the interceptor ahead
+                                   // of recv(), per socket, 0: none
+    } mux;
+
+    struct Trace
+    {
+        bool enabled = false; // packet-path trace rings, see base/Trace.h
+    } trace;
+
     struct Stack
     {
         string addr = "192.168.168.10";
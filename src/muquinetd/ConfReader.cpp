@@ -54,6 +54,50 @@ ConfReader::readCmdLine(int argc, const char* const argv[])
              ". If present, logging to file will be disabled")
           ("tundev-name", po::value<string>())
           ("tundev-addr", po::value<string>())
+          ("tundev-mtu", po::value<int>(),
+             "set TUN device MTU (1500 on default, up to 65535)")
+          ("tundev-txqlen", po::value<int>(),
+             "packets queued for TUN device before senders block "
+             "(1024 on default)")
+          ("tundev-io-engine", po::value<string>(),
+             "io_uring or sync (io_uring on default, falls back to sync "
+             "when io_uring is not available)")
+          ("tundev-mirror", po::value<string>(),
+             "write every packet received from / transmitted to the TUN "
+             "device into this pcap file")
+          ("tundev-mirror-size-mb", po::value<int>(),
+             "rotate the mirror file into <file>.1 beyond this size "
+             "(64 on default, 0 for no limit)")
+          ("pktdev-ifname", po::value<string>(),
+             "run on an existing Ethernet interface (e.g. veth) "
+             "instead of a TUN device")
+          ("pktdev-engine", po::value<string>(),
+             "tpacket (AF_PACKET mmap rings) or af_xdp (tpacket on default)")
+          ("pktdev-busy-poll",
+             "busy poll the AF_XDP socket instead of sleeping in poll()")
+          ("loopback",
+             "run without any network device: an in-memory echo peer "
+             "reflects every packet (for tests and benchmarks)")
+          ("pcapdev-replay", po::value<string>(),
+             "run without any network device: packets of this pcap file "
+             "are received, instead of those of a TUN device")
+          ("pcapdev-capture", po::value<string>(),
+             "write packets transmitted by the stack into this pcap file "
+             "(with --pcapdev-replay)")
+          ("pcapdev-timing", po::value<string>(),
+             "line_rate or original (line_rate on default): how fast the "
+             "replayed packets are received")
+          ("pcapdev-loop",
+             "replay the pcap file again and again")
+          ("mux-send-credits-kb", po::value<int>(),
+             "payload a socket may have in flight without waiting for "
+             "muQuinetd (256 on default, 0 for synchronous sends only)")
+          ("mux-prefetch-kb", po::value<int>(),
+             "received payload pushed to a socket's process ahead of its "
+             "recv() calls (64 on default and at most, 0 to disable)")
+          ("trace",
+             "record packet-path events into <run dir>/trace.buf, "
+             "read it with muquinetd-trace-dump")
           ("stack-addr", po::value<string>())
           ;
     // clang-format on
@@ -97,6 +141,78 @@ ConfReader::readCmdLine(int argc, const char* const argv[])
         Conf::get()->tundev.addr_cidr = addr;
     }
     //
+    if (options.count("tundev-mtu")) {
+        Conf::get()->tundev.mtu = options["tundev-mtu"].as<int>();
+    }
+    //
+    if (options.count("tundev-txqlen")) {
+        Conf::get()->tundev.txqlen = options["tundev-txqlen"].as<int>();
+    }
+    //
+    if (options.count("tundev-io-engine")) {
+        const string& engine = options["tundev-io-engine"].as<string>();
+        Conf::get()->tundev.io_engine = engine;
+    }
+    //
+    if (options.count("tundev-mirror")) {
+        const string& mirror = options["tundev-mirror"].as<string>();
+        Conf::get()->tundev.mirror = mirror;
+    }
+    //
+    if (options.count("tundev-mirror-size-mb")) {
+        Conf::get()->tundev.mirror_size_mb =
+            options["tundev-mirror-size-mb"].as<int>();
+    }
+    //
+    if (options.count("pktdev-ifname")) {
+        const string& ifname = options["pktdev-ifname"].as<string>();
+        Conf::get()->pktdev.ifname = ifname;
+    }
+    //
+    if (options.count("pktdev-engine")) {
+        const string& engine = options["pktdev-engine"].as<string>();
+        Conf::get()->pktdev.engine = engine;
+    }
+    //
+    if (options.count("pktdev-busy-poll")) {
+        Conf::get()->pktdev.busy_poll = true;
+    }
+    //
+    if (options.count("loopback")) {
+        Conf::get()->loopback.enabled = true;
+    }
+    //
+    if (options.count("pcapdev-replay")) {
+        const string& replay = options["pcapdev-replay"].as<string>();
+        Conf::get()->pcapdev.replay = replay;
+    }
+    //
+    if (options.count("pcapdev-capture")) {
+        const string& capture = options["pcapdev-capture"].as<string>();
+        Conf::get()->pcapdev.capture = capture;
+    }
+    //
+    if (options.count("pcapdev-timing")) {
+        const string& timing = options["pcapdev-timing"].as<string>();
+        Conf::get()->pcapdev.timing = timing;
+    }
+    //
+    if (options.count("pcapdev-loop")) {
+        Conf::get()->pcapdev.loop = true;
+    }
+    //
+    if (options.count("mux-send-credits-kb")) {
+        Conf::get()->mux.send_credits_kb =
+            options["mux-send-credits-kb"].as<int>();
+    }
+    if (options.count("mux-prefetch-kb")) {
+        Conf::get()->mux.prefetch_kb = options["mux-prefetch-kb"].as<int>();
+    }
+    //
+    if (options.count("trace")) {
+        Conf::get()->trace.enabled = true;
+    }
+    //
     if (options.count("stack-addr")) {
         const string& addr = options["stack-addr"].as<string>();
         Conf::get()->stack.addr = addr;
@@ -24,7 +24,7 @@
 
 #include "muquinetd/base/Singleton.h"
 
-class SocketBuffer;
+class SocketBufferPtr;
 
 class Interface : public Singleton<Interface>
 {
@@ -36,7 +36,13 @@ public:
     void stop();
 
     // For Ip layer use
-    void tx(const std::shared_ptr<SocketBuffer>& skbuf);
+    //
+    // Queue the packet for the tx_flush_thread and return; blocks while
+    // the TX queue is full. The packet must not reference any memory
+    // owned by the caller (copy the payload into the SocketBuffer).
+    void tx(SocketBufferPtr skbuf);
+    // Largest IP packet tx() can send, that of the NetDev
+    int mtu();
 
 private:
     Interface();
@@ -21,10 +21,11 @@
 #define MUQUINETD_IP_H
 
 #include <memory>
+#include <string>
 
 #include "muquinetd/base/Singleton.h"
 
-class SocketBuffer;
+class SocketBufferPtr;
 
 class Ip : public Singleton<Ip>
 {
@@ -36,11 +37,12 @@ public:
     void stop();
 
     // For Transport layer use
-    void tx(const std::shared_ptr<SocketBuffer>& skbuf,
-            const std::string& user_payload);
+    void tx(SocketBufferPtr skbuf, const std::string& user_payload);
+    // user payload already in [user_payload_begin, user_payload_end)
+    void tx(SocketBufferPtr skbuf);
 
     // For Interface layer use
-    void enRxQue(const std::shared_ptr<SocketBuffer>& skbuf);
+    void enRxQue(SocketBufferPtr skbuf);
 
 private:
     Ip();
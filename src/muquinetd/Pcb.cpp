@@ -20,12 +20,14 @@
 #include "muquinetd/Pcb.h"
 
 #include <arpa/inet.h>
+#include <errno.h>
 #include <strings.h>
 #include <sys/socket.h>
 #include <unistd.h>
 
 #include "muquinetd/Conf.h"
 #include "muquinetd/Logging.h"
+#include "muquinetd/SocketBuffer.h"
 
 using std::weak_ptr;
 using std::shared_ptr;
@@ -110,14 +112,43 @@ Pcb::send(const struct in_addr& faddr, __be16 fport, const std::string& buf)
     return 0;
 }
 
+int
+Pcb::sendFromPipe(int pipefd, int len, const struct sockaddr_in* dest)
+{
+    // 默认拷贝出来走普通的 send，TcpPcb 直接读进 SocketBuffer
+    std::string buf(len, '\0');
+    if (!readPipe(pipefd, &buf[0], len)) {
+        return -1;
+    }
+    return dest ? send(dest->sin_addr, dest->sin_port, buf) : send(buf);
+}
+
+bool
+Pcb::readPipe(int pipefd, char* to, int len)
+{
+    int got = 0;
+    while (got < len) {
+        ssize_t n = ::read(pipefd, to + got, len - got);
+        if (n == -1 && errno == EINTR)
+            continue;
+        if (n <= 0) {
+            MUQUINETD_LOG(error) << "Pipe of a bulk send held " << got
+                                 << " of its " << len << " bytes";
+            return false;
+        }
+        got += n;
+    }
+    return true;
+}
+
 void
-Pcb::recv(const std::shared_ptr<SocketBuffer>&)
+Pcb::recv(SocketBufferPtr)
 {
     // nothing need to do
 }
 
 void
-Pcb::recv(sockaddr_in& peeraddr, const std::shared_ptr<SocketBuffer>&)
+Pcb::recv(sockaddr_in& peeraddr, SocketBufferPtr)
 {
     // TODO
 }
@@ -27,9 +27,10 @@
 #include <algorithm>
 #include <functional>
 #include <memory>
+#include <string>
 
 class Socket;
-class SocketBuffer;
+class SocketBufferPtr;
 class SelectableChannel;
 
 class Pcb : public std::enable_shared_from_this<Pcb>
@@ -57,15 +58,22 @@ public:
     virtual int send(const std::string& buf);
     virtual int send(const struct in_addr& faddr, __be16 fport,
                      const std::string& buf);
-    virtual void recv(const std::shared_ptr<SocketBuffer>&);
-    virtual void recv(struct sockaddr_in& peeraddr,
-                      const std::shared_ptr<SocketBuffer>&);
+    // Payload of len bytes read out of a pipe (see rpc/splice.h), to dest
+    // if not null. -1 if the pipe held less.
+    virtual int sendFromPipe(int pipefd, int len,
+                             const struct sockaddr_in* dest = nullptr);
+    virtual void recv(SocketBufferPtr);
+    virtual void recv(struct sockaddr_in& peeraddr, SocketBufferPtr);
     virtual __be16 nextAvailLocalPort() = 0; // each protocol implements
     // void bind(struct in_addr laddr, __be16 lport);
 
     std::weak_ptr<Socket> socket();
     void setSocket(const std::weak_ptr<Socket>&);
 
+protected:
+    // false if the pipe held less than len bytes
+    static bool readPipe(int pipefd, char* to, int len);
+
 private:
     std::weak_ptr<Socket> _socket;
 };
@@ -0,0 +1,136 @@
+/*
+ * muQuinet, an userspace TCP/IP network stack.
+ * Copyright (C) 2018 rtdarwin
+ *
+ * This program is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+
+ * You should have received a copy of the GNU General Public
+ * License along with this program.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#include "muquinetd/SocketBuffer.h"
+
+#include <new>
+
+#include "third-party/concurrentqueue/concurrentqueue.h"
+
+using moodycamel::ConcurrentQueue;
+
+namespace {
+
+// 一个 block = SocketBuffer 对象 + rawBytes，一次分配
+struct SizeClass
+{
+    SizeClass(int size, int max)
+        : rawBytesSize(size)
+        , maxPooled(max)
+    {
+    }
+
+    int rawBytesSize;
+    int maxPooled;
+    ConcurrentQueue<void*> freeBlocks;
+};
+
+// clang-format off
+SizeClass sizeClasses[] = {
+    { 256,         4096 }, // ACK-only, UDP headers
+    { 2048,        2048 }, // ethernet MTU
+    { 9216,         256 }, // jumbo MTU
+    { 65536 + 256,   32 }, // GRO/GSO
+};
+// clang-format on
+const int nSizeClasses = sizeof(sizeClasses) / sizeof(sizeClasses[0]);
+
+// SocketBuffer objects only, for SocketBuffers::attach()
+SizeClass extHdrsClass{ 0, 4096 };
+
+const int blockHdrSize = (sizeof(SocketBuffer) + 63) / 64 * 64;
+
+SizeClass*
+sizeClassOf(int size)
+{
+    for (int i = 0; i < nSizeClasses; ++i) {
+        if (size <= sizeClasses[i].rawBytesSize)
+            return &sizeClasses[i];
+    }
+    return nullptr; // too large, not pooled
+}
+
+void
+freeBlock(SocketBuffer* skbuf, SizeClass* sc)
+{
+    void* block = skbuf;
+    skbuf->~SocketBuffer();
+
+    if (sc && sc->freeBlocks.size_approx() < (size_t)sc->maxPooled &&
+        sc->freeBlocks.enqueue(block)) {
+        return;
+    }
+    ::operator delete(block);
+}
+
+} // namespace {
+
+SocketBufferPtr
+SocketBuffers::alloc(int size)
+{
+    SizeClass* sc = sizeClassOf(size);
+    int rawBytesSize = sc ? sc->rawBytesSize : size;
+
+    void* block = nullptr;
+    if (!sc || !sc->freeBlocks.try_dequeue(block)) {
+        block = ::operator new(blockHdrSize + rawBytesSize);
+    }
+
+    SocketBuffer* skbuf = new (block) SocketBuffer;
+    skbuf->rawBytes = (char*)block + blockHdrSize;
+    skbuf->rawBytesSize = rawBytesSize;
+    skbuf->sizeClass = sc;
+
+    return SocketBufferPtr(skbuf);
+}
+
+SocketBufferPtr
+SocketBuffers::attach(char* rawBytes, int size,
+                      void (*extRelease)(void*, char*), void* ctx)
+{
+    void* block = nullptr;
+    if (!extHdrsClass.freeBlocks.try_dequeue(block)) {
+        block = ::operator new(blockHdrSize);
+    }
+
+    SocketBuffer* skbuf = new (block) SocketBuffer;
+    skbuf->rawBytes = rawBytes;
+    skbuf->rawBytesSize = size;
+    skbuf->sizeClass = &extHdrsClass;
+    skbuf->extRelease = extRelease;
+    skbuf->extCtx = ctx;
+
+    return SocketBufferPtr(skbuf);
+}
+
+void
+SocketBuffers::release(SocketBuffer* skbuf)
+{
+    // Sole owner (the common case): nobody else can share() it any more,
+    // so the atomic RMW can be skipped.
+    if (skbuf->refcnt.load(std::memory_order_acquire) != 1 &&
+        skbuf->refcnt.fetch_sub(1, std::memory_order_acq_rel) != 1) {
+        return;
+    }
+
+    if (skbuf->extRelease) {
+        skbuf->extRelease(skbuf->extCtx, skbuf->rawBytes);
+    }
+    freeBlock(skbuf, (SizeClass*)skbuf->sizeClass);
+}
@@ -20,12 +20,68 @@
 #ifndef MUQUINETD_SOCKETBUFFER_H
 #define MUQUINETD_SOCKETBUFFER_H
 
-#include <memory>
+#include <atomic>
+#include <cstdint>
+
+class SocketBuffer;
+
+/** Move-only handle to a SocketBuffer
+ *
+ * The reference count lives in the SocketBuffer itself. Passing a
+ * SocketBuffer down the pipeline is a move and touches no atomic; only
+ * share() (a second owner) and dropping a shared SocketBuffer do.
+ */
+class SocketBufferPtr
+{
+public:
+    SocketBufferPtr() = default;
+    explicit SocketBufferPtr(SocketBuffer* p)
+        : _p(p)
+    {
+    }
+    ~SocketBufferPtr() { reset(); }
+    // Non-copyable, but Moveable
+    SocketBufferPtr(const SocketBufferPtr&) = delete;
+    SocketBufferPtr& operator=(const SocketBufferPtr&) = delete;
+    SocketBufferPtr(SocketBufferPtr&& other) noexcept
+        : _p(other._p)
+    {
+        other._p = nullptr;
+    }
+    SocketBufferPtr& operator=(SocketBufferPtr&& other) noexcept
+    {
+        if (this != &other) {
+            reset();
+            _p = other._p;
+            other._p = nullptr;
+        }
+        return *this;
+    }
+
+    // Another owner of the same SocketBuffer
+    SocketBufferPtr share() const;
+    void reset();
+
+    SocketBuffer* get() const { return _p; }
+    SocketBuffer* operator->() const { return _p; }
+    SocketBuffer& operator*() const { return *_p; }
+    explicit operator bool() const { return _p != nullptr; }
+
+private:
+    SocketBuffer* _p = nullptr;
+};
 
 class SocketBuffer
 {
 public:
-    std::shared_ptr<SocketBuffer> next;
+    SocketBuffer() = default;
+    // Non-copyable, Non-moveable
+    SocketBuffer(const SocketBuffer&) = delete;
+    SocketBuffer& operator=(const SocketBuffer&) = delete;
+    SocketBuffer(SocketBuffer&&) = delete;
+    SocketBuffer& operator=(SocketBuffer&&) = delete;
+
+    SocketBufferPtr next;
 
     char* transport_hdr = nullptr; // length in [8, 60]
     char* network_hdr = nullptr;   // length in [20, 60]
@@ -34,10 +90,89 @@ public:
     char* user_payload_begin = nullptr; // user payload in [begin, end)
     char* user_payload_end = nullptr;
 
-    // 1522 = 18 (ethernet frame headoff 6+6+2+4) + 1500 (ethernet mtu)
+    // Raw storage in [rawBytes, rawBytes + rawBytesSize), carved out of
+    // the same pooled block as this SocketBuffer (see SocketBuffers::alloc)
+    char* rawBytes = nullptr;
+    int rawBytesSize = 0;
+
+    // Latency::now() when the Interface layer got it from the NetDev
+    uint64_t rxTimestamp = 0;
+
+    // For SocketBufferPtr/SocketBuffers use
+    std::atomic<int> refcnt{ 1 };
+    void* sizeClass = nullptr;
+    void (*extRelease)(void* ctx, char* rawBytes) = nullptr;
+    void* extCtx = nullptr;
+
+    // 138 = 18 (ethernet frame headoff 6+6+2+4) + 60 (IP) + 60 (TCP)
     // 18 bytes is reserved for TAP device, TUN device don't need these.
-    static const int maxRawBytesSize = 1518;
-    char rawBytes[maxRawBytesSize];
+    static const int maxHdrsSize = 138;
+
+    /*  headroom/tailroom
+     *
+     *   rawBytes      hdrs_begin          hdrs_end        rawBytes + size
+     *      |-- headroom --|---- headers ----|---- tailroom ----|
+     *
+     *  Each layer push() its header in front of the ones already there,
+     *  so no layer has to know how much the layers below it need.
+     */
+    void reserve(int headroom)
+    {
+        hdrs_begin = hdrs_end = rawBytes + headroom;
+    }
+    char* push(int len)
+    {
+        hdrs_begin -= len;
+        return hdrs_begin;
+    }
+    char* put(int len)
+    {
+        char* tail = hdrs_end;
+        hdrs_end += len;
+        return tail;
+    }
+    int headroom() const { return hdrs_begin - rawBytes; }
+    int tailroom() const { return rawBytes + rawBytesSize - hdrs_end; }
+};
+
+class SocketBuffers
+{
+public:
+    // Allocate a SocketBuffer holding at least `size` raw bytes.
+    //
+    // SocketBuffers come from per size-class pools (small for ACK-only
+    // segments, MTU-sized, jumbo, 64K for GRO/GSO), and go back to
+    // their pool when the last reference is dropped.
+    static SocketBufferPtr alloc(int size);
+
+    // A SocketBuffer over memory owned by a NetDev (mmap'ed ring, UMEM),
+    // received packets need not be copied out of it.
+    //
+    // extRelease(ctx, rawBytes) is called, in whichever thread drops the
+    // last reference, to give the memory back to the NetDev.
+    static SocketBufferPtr attach(char* rawBytes, int size,
+                                  void (*extRelease)(void*, char*),
+                                  void* ctx);
+
+    // For SocketBufferPtr use
+    static void release(SocketBuffer*);
 };
 
+inline SocketBufferPtr
+SocketBufferPtr::share() const
+{
+    _p->refcnt.fetch_add(1, std::memory_order_relaxed);
+    return SocketBufferPtr(_p);
+}
+
+inline void
+SocketBufferPtr::reset()
+{
+    if (_p) {
+        SocketBuffer* p = _p;
+        _p = nullptr;
+        SocketBuffers::release(p);
+    }
+}
+
 #endif // MUQUINETD_SOCKETBUFFER_H
@@ -0,0 +1,56 @@
+/*
+ * muQuinet, an userspace TCP/IP network stack.
+ * Copyright (C) 2018 rtdarwin
+ *
+ * This program is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+
+ * You should have received a copy of the GNU General Public
+ * License along with this program.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef MUQUINETD_STATS_H
+#define MUQUINETD_STATS_H
+
+#include <memory>
+
+#include "muquinetd/base/Singleton.h"
+
+#define MUQUINETD_STATS_SOCKET_NAME "stats.socket"
+
+/** Exports Counters and Latency histograms over a unix socket
+ *
+ * <run dir>/stats.socket (SOCK_STREAM), next to the RPC master socket.
+ * A client connects, optionally writes "json" or "text" (the default),
+ * reads the dump until EOF:
+ *
+ *   echo json | socat - UNIX-CONNECT:/run/muquinetd/stats.socket
+ *
+ * Served by its own thread, so a slow client never stalls the EventLoop.
+ */
+class Stats : public Singleton<Stats>
+{
+    friend class Singleton<Stats>;
+
+public:
+    void init();
+    void start();
+    void stop();
+
+private:
+    Stats();
+    ~Stats();
+    struct Impl;
+    std::unique_ptr<Impl> _pImpl;
+};
+
+#endif // MUQUINETD_STATS_H
@@ -23,7 +23,7 @@
 #include "muquinetd/base/Singleton.h"
 #include <memory>
 
-class SocketBuffer;
+class SocketBufferPtr;
 class Pcb;
 
 class Tcp : public Singleton<Tcp>
@@ -38,7 +38,7 @@ public:
     std::shared_ptr<Pcb> newPcb();
     void removePcb(const std::shared_ptr<const Pcb>&);
 
-    void rx(const std::shared_ptr<SocketBuffer>&);
+    void rx(SocketBufferPtr);
     void tx();
 
 private:
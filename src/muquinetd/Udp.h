@@ -24,7 +24,7 @@
 #include <netinet/in.h>
 #include <memory>
 
-class SocketBuffer;
+class SocketBufferPtr;
 class Pcb;
 
 class Udp : public Singleton<Udp>
@@ -40,7 +40,7 @@ public:
     void removePcb(const std::shared_ptr<const Pcb>&);
 
     // For IP Layer use
-    void rx(const std::shared_ptr<SocketBuffer>&);
+    void rx(SocketBufferPtr);
 
 private:
     Udp();
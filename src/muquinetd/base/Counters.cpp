@@ -0,0 +1,158 @@
+/*
+ * muQuinet, an userspace TCP/IP network stack.
+ * Copyright (C) 2018 rtdarwin
+ *
+ * This program is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+
+ * You should have received a copy of the GNU General Public
+ * License along with this program.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+
+#include "muquinetd/base/Counters.h"
+
+#include <stdlib.h>
+
+#include <new>
+#include <sstream>
+#include <vector>
+
+#include "muquinetd/base/MutexLock.h"
+
+namespace {
+
+// clang-format off
+const char* const names[] = {
+    "interface.rx_packets",
+    "interface.rx_bytes",
+    "interface.tx_packets",
+    "interface.tx_bytes",
+    "interface.txq_depth",
+    "interface.tx_drop_no_room",
+
+    "ip.rx_packets",
+    "ip.rx_drop_not_ipv4",
+    "ip.rx_drop_bad_header",
+    "ip.rx_fragments",
+    "ip.rx_reassembled",
+    "ip.rxq_depth",
+    "ip.defrag_backlog",
+    "ip.tx_packets",
+    "ip.tx_bytes",
+
+    "tcp.rx_packets",
+    "tcp.rx_drop_no_receiver",
+    "udp.rx_packets",
+    "udp.rx_drop_no_receiver",
+
+    "socket.recvq_enqueued",
+    "socket.recvq_drop_full",
+    "socket.recvq_depth",
+    "socket.recvq_prefetched",
+
+    "rpc.requests",
+    // field numbers of Request.calling (see rpc/proto/request.proto)
+    "rpc.calls.unknown",
+    "rpc.calls.socket",
+    "rpc.calls.connect",
+    "rpc.calls.close",
+    "rpc.calls.recvfrom",
+    "rpc.calls.sendto",
+    "rpc.calls.poll",
+    "rpc.calls.select",
+    "rpc.calls.getpeername",
+    "rpc.calls.getsockname",
+    "rpc.calls.getsockopt",
+    "rpc.calls.setsockopt",
+    "rpc.calls.fcntl",
+    "rpc.calls.13",
+    "rpc.calls.14",
+    "rpc.calls.15",
+    "rpc.calls.atstart",
+};
+// clang-format on
+static_assert(sizeof(names) / sizeof(names[0]) == Counters::N_COUNTERS,
+              "Every counter needs a name");
+
+// 线程退出后其计数器仍需计入总数，所以计数器块从不释放
+MutexLock registryLock;
+std::vector<Counters::PerThread*> registry;
+
+} // namespace {
+
+namespace Counters {
+
+__thread PerThread* thisThread = nullptr;
+
+PerThread*
+registerThisThread()
+{
+    // C++11 的 new 不保证 alignas(64)
+    void* mem = nullptr;
+    if (posix_memalign(&mem, alignof(PerThread), sizeof(PerThread)) != 0)
+        throw std::bad_alloc();
+
+    PerThread* p = new (mem) PerThread;
+    for (auto& v : p->values)
+        v.store(0, std::memory_order_relaxed);
+
+    {
+        MutexLockGuard l(registryLock);
+        registry.push_back(p);
+    }
+    thisThread = p;
+    return p;
+}
+
+int64_t
+value(Id id)
+{
+    MutexLockGuard l(registryLock);
+
+    int64_t sum = 0;
+    for (PerThread* p : registry)
+        sum += p->values[id].load(std::memory_order_relaxed);
+    return sum;
+}
+
+std::string
+dumpText()
+{
+    std::ostringstream oss;
+    for (int i = 0; i < N_COUNTERS; ++i) {
+        int64_t v = value(Id(i));
+        // 没用到的 RPC 调用类型就不输出了
+        if (i >= RPC_CALLS && v == 0)
+            continue;
+        oss << names[i] << " " << v << "\n";
+    }
+    return oss.str();
+}
+
+std::string
+dumpJson()
+{
+    std::ostringstream oss;
+    oss << "{";
+    const char* sep = "\n";
+    for (int i = 0; i < N_COUNTERS; ++i) {
+        int64_t v = value(Id(i));
+        if (i >= RPC_CALLS && v == 0)
+            continue;
+        oss << sep << "  \"" << names[i] << "\": " << v;
+        sep = ",\n";
+    }
+    oss << "\n}\n";
+    return oss.str();
+}
+
+} // namespace Counters {
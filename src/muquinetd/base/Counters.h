@@ -0,0 +1,111 @@
+/*
+ * muQuinet, an userspace TCP/IP network stack.
+ * Copyright (C) 2018 rtdarwin
+ *
+ * This program is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+
+ * You should have received a copy of the GNU General Public
+ * License along with this program.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef MUQUINETD_BASE_COUNTERS_H
+#define MUQUINETD_BASE_COUNTERS_H
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+/** Per-thread packet/byte/drop counters
+ *
+ * 每个线程第一次计数时分配一块自己的计数器（按 cache line 对齐），
+ * 之后的计数只是对本线程计数器的一次 relaxed load + store，没有原子 RMW，
+ * 也没有 cache line 在线程间来回传递，可以在生产环境中一直开着。
+ *
+ * 读取（dump）时把所有线程的计数器加起来。队列深度之类的值也用计数器表示：
+ * 入队的线程 +1，出队的线程 -1，加总即当前深度。
+ */
+namespace Counters {
+
+enum Id
+{
+    /*  Interface */
+    IF_RX_PACKETS,
+    IF_RX_BYTES,
+    IF_TX_PACKETS,
+    IF_TX_BYTES,
+    IF_TXQ_DEPTH,
+    IF_TX_DROP_NO_ROOM, // device tx ring/buffers full for too long
+
+    /*  IP */
+    IP_RX_PACKETS,
+    IP_RX_DROP_NOT_IPV4,
+    IP_RX_DROP_BAD_HEADER, // too short, bad checksum
+    IP_RX_FRAGMENTS,
+    IP_RX_REASSEMBLED,
+    IP_RXQ_DEPTH,
+    IP_DEFRAG_BACKLOG,
+    IP_TX_PACKETS,
+    IP_TX_BYTES,
+
+    /*  TCP/UDP */
+    TCP_RX_PACKETS,
+    TCP_RX_DROP_NO_RECEIVER,
+    UDP_RX_PACKETS,
+    UDP_RX_DROP_NO_RECEIVER,
+
+    /*  Socket */
+    SOCKET_RECVQ_ENQUEUED,
+    SOCKET_RECVQ_DROP_FULL,
+    SOCKET_RECVQ_DEPTH,
+    SOCKET_RECVQ_PREFETCHED,
+
+    /*  RPC */
+    RPC_REQUESTS,
+    // RPC_CALLS + Request::calling_case()
+    RPC_CALLS,
+    RPC_CALLS_END = RPC_CALLS + 17,
+
+    N_COUNTERS = RPC_CALLS_END
+};
+
+struct alignas(64) PerThread
+{
+    std::atomic<int64_t> values[N_COUNTERS];
+};
+
+extern __thread PerThread* thisThread;
+PerThread* registerThisThread();
+
+inline void
+add(Id id, int64_t n = 1)
+{
+    PerThread* p = thisThread;
+    if (!p)
+        p = registerThisThread();
+
+    // 只有本线程写，不需要 fetch_add
+    std::atomic<int64_t>& v = p->values[id];
+    v.store(v.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+}
+
+// Sum over all threads
+int64_t value(Id);
+
+// "name value" per line
+std::string dumpText();
+// { "name": value, ... }
+std::string dumpJson();
+
+} // namespace Counters {
+
+#endif // MUQUINETD_BASE_COUNTERS_H
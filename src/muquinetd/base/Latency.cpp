@@ -0,0 +1,191 @@
+/*
+ * muQuinet, an userspace TCP/IP network stack.
+ * Copyright (C) 2018 rtdarwin
+ *
+ * This program is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+
+ * You should have received a copy of the GNU General Public
+ * License along with this program.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+
+#include "muquinetd/base/Latency.h"
+
+#include <stdlib.h>
+
+#include <new>
+#include <sstream>
+#include <vector>
+
+#include "muquinetd/base/MutexLock.h"
+
+namespace {
+
+// clang-format off
+const char* const names[] = {
+    // field numbers of Request.calling (see rpc/proto/request.proto)
+    "rpc.unknown",
+    "rpc.socket",
+    "rpc.connect",
+    "rpc.close",
+    "rpc.recvfrom",
+    "rpc.sendto",
+    "rpc.poll",
+    "rpc.select",
+    "rpc.getpeername",
+    "rpc.getsockname",
+    "rpc.getsockopt",
+    "rpc.setsockopt",
+    "rpc.fcntl",
+    "rpc.13",
+    "rpc.14",
+    "rpc.15",
+    "rpc.atstart",
+
+    "recvfrom_wakeup.udp",
+    "recvfrom_wakeup.tcp",
+};
+// clang-format on
+static_assert(sizeof(names) / sizeof(names[0]) == Latency::N_HISTOGRAMS,
+              "Every histogram needs a name");
+
+// 线程退出后其记录仍需计入，所以从不释放
+MutexLock registryLock;
+std::vector<Latency::PerThread*> registry;
+
+// 桶的上界（含），即该桶中任何值都不超过它
+uint64_t
+bucketUpperBound(int idx)
+{
+    using namespace Latency;
+
+    if (idx < subBuckets)
+        return idx;
+
+    int msb = idx / subBuckets + subBucketBits - 1;
+    uint64_t sub = idx % subBuckets;
+    int shift = msb - subBucketBits;
+    return ((subBuckets + sub + 1) << shift) - 1;
+}
+
+struct Summary
+{
+    uint64_t count = 0;
+    uint64_t p50 = 0, p90 = 0, p99 = 0, p999 = 0, max = 0;
+};
+
+Summary
+summarize(Latency::Id id)
+{
+    using namespace Latency;
+
+    std::vector<uint64_t> sum(nBuckets, 0);
+    Summary s;
+    {
+        MutexLockGuard l(registryLock);
+        for (PerThread* p : registry) {
+            for (int i = 0; i < nBuckets; ++i) {
+                uint64_t v = p->buckets[id][i].load(std::memory_order_relaxed);
+                sum[i] += v;
+                s.count += v;
+            }
+        }
+    }
+    if (s.count == 0)
+        return s;
+
+    struct
+    {
+        double q;
+        uint64_t* out;
+    } wanted[] = {
+        { 0.5, &s.p50 }, { 0.9, &s.p90 }, { 0.99, &s.p99 }, { 0.999, &s.p999 },
+    };
+
+    uint64_t seen = 0;
+    int w = 0;
+    for (int i = 0; i < nBuckets; ++i) {
+        if (sum[i] == 0)
+            continue;
+        seen += sum[i];
+        while (w < 4 && seen >= wanted[w].q * s.count) {
+            *wanted[w].out = bucketUpperBound(i);
+            ++w;
+        }
+        s.max = bucketUpperBound(i);
+    }
+    return s;
+}
+
+} // namespace {
+
+namespace Latency {
+
+__thread PerThread* thisThread = nullptr;
+
+PerThread*
+registerThisThread()
+{
+    // C++11 的 new 不保证 alignas(64)
+    void* mem = nullptr;
+    if (posix_memalign(&mem, alignof(PerThread), sizeof(PerThread)) != 0)
+        throw std::bad_alloc();
+
+    PerThread* p = new (mem) PerThread;
+    for (auto& h : p->buckets)
+        for (auto& b : h)
+            b.store(0, std::memory_order_relaxed);
+
+    {
+        MutexLockGuard l(registryLock);
+        registry.push_back(p);
+    }
+    thisThread = p;
+    return p;
+}
+
+std::string
+dumpText()
+{
+    std::ostringstream oss;
+    for (int i = 0; i < N_HISTOGRAMS; ++i) {
+        Summary s = summarize(Id(i));
+        if (s.count == 0)
+            continue;
+        oss << "latency." << names[i] << " count=" << s.count
+            << " p50=" << s.p50 << " p90=" << s.p90 << " p99=" << s.p99
+            << " p999=" << s.p999 << " max=" << s.max << " (ns)\n";
+    }
+    return oss.str();
+}
+
+std::string
+dumpJson()
+{
+    std::ostringstream oss;
+    oss << "{";
+    const char* sep = "\n";
+    for (int i = 0; i < N_HISTOGRAMS; ++i) {
+        Summary s = summarize(Id(i));
+        if (s.count == 0)
+            continue;
+        oss << sep << "  \"" << names[i] << "\": {\"count\": " << s.count
+            << ", \"p50_ns\": " << s.p50 << ", \"p90_ns\": " << s.p90
+            << ", \"p99_ns\": " << s.p99 << ", \"p999_ns\": " << s.p999
+            << ", \"max_ns\": " << s.max << "}";
+        sep = ",\n";
+    }
+    oss << "\n}\n";
+    return oss.str();
+}
+
+} // namespace Latency {
@@ -0,0 +1,102 @@
+/*
+ * muQuinet, an userspace TCP/IP network stack.
+ * Copyright (C) 2018 rtdarwin
+ *
+ * This program is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+
+ * You should have received a copy of the GNU General Public
+ * License along with this program.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef MUQUINETD_BASE_LATENCY_H
+#define MUQUINETD_BASE_LATENCY_H
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <time.h>
+
+/** Per-thread latency histograms
+ *
+ * HDR 风格的 log-linear 桶：每个 2 的幂区间再线性分成 16 个子桶，
+ * 相对误差 < 1/16，覆盖 [0, 2^40) ns。和 Counters 一样，每个线程记录到
+ * 自己的桶里（relaxed load + store），dump 时加总后再算分位数。
+ */
+namespace Latency {
+
+enum Id
+{
+    // RPC_CALLS + Request::calling_case(): RequestHandler::handleRequest()
+    RPC_CALLS,
+    RPC_CALLS_END = RPC_CALLS + 17,
+
+    // packet arrived at Interface -> waiting recvfrom answered
+    RECVFROM_WAKEUP_UDP = RPC_CALLS_END,
+    RECVFROM_WAKEUP_TCP,
+
+    N_HISTOGRAMS
+};
+
+const int subBucketBits = 4;
+const int subBuckets = 1 << subBucketBits;
+const int maxValueBits = 40;
+const int nBuckets = (maxValueBits - subBucketBits + 1) * subBuckets;
+
+struct alignas(64) PerThread
+{
+    std::atomic<uint64_t> buckets[N_HISTOGRAMS][nBuckets];
+};
+
+extern __thread PerThread* thisThread;
+PerThread* registerThisThread();
+
+inline uint64_t
+now()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+inline int
+bucketOf(uint64_t ns)
+{
+    if (ns < (uint64_t)subBuckets)
+        return (int)ns;
+    if (ns >= (1ull << maxValueBits))
+        return nBuckets - 1;
+
+    int msb = 63 - __builtin_clzll(ns); // >= subBucketBits
+    int sub = (ns >> (msb - subBucketBits)) & (subBuckets - 1);
+    return (msb - subBucketBits + 1) * subBuckets + sub;
+}
+
+inline void
+record(Id id, uint64_t ns)
+{
+    PerThread* p = thisThread;
+    if (!p)
+        p = registerThisThread();
+
+    std::atomic<uint64_t>& b = p->buckets[id][bucketOf(ns)];
+    b.store(b.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+}
+
+// "name count=N p50=.. p90=.. p99=.. p999=.. max=.." (ns) per line
+std::string dumpText();
+// { "name": { "count": N, "p50": .., ... }, ... }
+std::string dumpJson();
+
+} // namespace Latency {
+
+#endif // MUQUINETD_BASE_LATENCY_H
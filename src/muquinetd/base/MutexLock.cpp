@@ -34,17 +34,21 @@ void
 MutexLock::lock()
 {
     pthread_mutex_lock(&_mutex);
+    _holder = pthread_self();
 }
 
 void
 MutexLock::tryLock()
 {
-    pthread_mutex_trylock(&_mutex);
+    if (pthread_mutex_trylock(&_mutex) == 0) {
+        _holder = pthread_self();
+    }
 }
 
 void
 MutexLock::unlock()
 {
+    _holder = 0;
     pthread_mutex_unlock(&_mutex);
 }
 
@@ -0,0 +1,75 @@
+/*
+ * muQuinet, an userspace TCP/IP network stack.
+ * Copyright (C) 2018 rtdarwin
+ *
+ * This program is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+
+ * You should have received a copy of the GNU General Public
+ * License along with this program.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef MUQUINETD_BASE_PROBES_H
+#define MUQUINETD_BASE_PROBES_H
+
+/** USDT probes (provider "muquinetd") for perf/bpftrace
+ *
+ * Built with -DUSE_USDT_PROBES=ON (needs <sys/sdt.h>, systemtap-sdt-dev).
+ * A probe site is a single nop until a tracer attaches, e.g.
+ *
+ *   bpftrace -e 'usdt:./muquinetd:rpc_start { @t[tid] = nsecs; }
+ *                usdt:./muquinetd:rpc_finish /@t[tid]/ {
+ *                    @ns[arg1] = hist(nsecs - @t[tid]); delete(@t[tid]); }'
+ *
+ * Without USE_USDT_PROBES the macros expand to nothing (arguments are
+ * not evaluated).
+ *
+ * Probes (args):
+ *   netdev_rx        (skb, len)
+ *   netdev_tx        (npackets, bytes)
+ *   tcp_state        (pcb, old state, new state)
+ *   tcp_out_of_order (pcb, seq, expected seq)
+ *   socket_enqueue   (socket, skb, queued: 0 = dropped)
+ *   socket_dequeue   (socket, skb)
+ *   rpc_start        (fd, calling case)
+ *   rpc_finish       (fd, calling case, returning case)
+ *   eventloop_wakeup (nactive channels)
+ */
+
+#ifdef MUQUINETD_USDT_PROBES
+
+#include <sys/sdt.h>
+
+#define MUQUINETD_PROBE1(name, a) DTRACE_PROBE1(muquinetd, name, a)
+#define MUQUINETD_PROBE2(name, a, b) DTRACE_PROBE2(muquinetd, name, a, b)
+#define MUQUINETD_PROBE3(name, a, b, c) DTRACE_PROBE3(muquinetd, name, a, b, c)
+#define MUQUINETD_PROBE4(name, a, b, c, d)                                   \
+    DTRACE_PROBE4(muquinetd, name, a, b, c, d)
+
+#else
+
+#define MUQUINETD_PROBE1(name, a)                                            \
+    do {                                                                     \
+    } while (0)
+#define MUQUINETD_PROBE2(name, a, b)                                         \
+    do {                                                                     \
+    } while (0)
+#define MUQUINETD_PROBE3(name, a, b, c)                                      \
+    do {                                                                     \
+    } while (0)
+#define MUQUINETD_PROBE4(name, a, b, c, d)                                   \
+    do {                                                                     \
+    } while (0)
+
+#endif // MUQUINETD_USDT_PROBES
+
+#endif // MUQUINETD_BASE_PROBES_H
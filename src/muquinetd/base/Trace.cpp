@@ -0,0 +1,135 @@
+/*
+ * muQuinet, an userspace TCP/IP network stack.
+ * Copyright (C) 2018 rtdarwin
+ *
+ * This program is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+
+ * You should have received a copy of the GNU General Public
+ * License along with this program.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+
+#include "muquinetd/base/Trace.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/prctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <cstring>
+#include <new>
+
+namespace {
+
+Trace::File* file = nullptr;
+
+// 环用完了的线程记到这里（不会被 dump 出来）
+Trace::Ring overflowRing;
+
+} // namespace {
+
+namespace Trace {
+
+bool enabled = false;
+__thread Ring* thisRing = nullptr;
+
+const char*
+eventName(uint32_t e)
+{
+    // clang-format off
+    static const char* const names[] = {
+        "none",
+        "netdev_rx",
+        "ip_enrxq",
+        "ip_defrag",
+        "tcp_rx",
+        "udp_rx",
+        "socket_putrecvq",
+        "rpc_write",
+        "interface_tx",
+    };
+    // clang-format on
+    static_assert(sizeof(names) / sizeof(names[0]) == N_EVENTS,
+                  "Every event needs a name");
+
+    return e < N_EVENTS ? names[e] : "?";
+}
+
+Ring*
+claimRing()
+{
+    uint32_t idx = file->hdr.ringsUsed.fetch_add(1);
+    Ring* r = idx < (uint32_t)maxRings ? &file->rings[idx] : &overflowRing;
+
+    r->tid = (uint32_t)syscall(SYS_gettid);
+    prctl(PR_GET_NAME, r->threadName, 0, 0, 0);
+
+    thisRing = r;
+    return r;
+}
+
+bool
+init(const std::string& path)
+{
+    /*  1. 保留上一次运行（可能是崩溃）留下的 trace */
+
+    std::string old = path + ".old";
+    ::rename(path.c_str(), old.c_str());
+
+    /*  2. 创建并映射 trace 文件 */
+
+    int fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd == -1)
+        return false;
+    if (::ftruncate(fd, sizeof(File)) == -1) {
+        ::close(fd);
+        return false;
+    }
+    void* addr =
+        ::mmap(NULL, sizeof(File), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (addr == MAP_FAILED)
+        return false;
+
+    // 文件刚 truncate 过，全是 0
+    file = new (addr) File;
+
+    /*  3. TSC 校准 */
+
+    struct timespec ts0, ts1, rt;
+    clock_gettime(CLOCK_MONOTONIC, &ts0);
+    uint64_t tsc0 = tsc();
+    clock_gettime(CLOCK_REALTIME, &rt);
+    usleep(20 * 1000);
+    clock_gettime(CLOCK_MONOTONIC, &ts1);
+    uint64_t tsc1 = tsc();
+
+    uint64_t ns = (ts1.tv_sec - ts0.tv_sec) * 1000000000ull + ts1.tv_nsec -
+                  ts0.tv_nsec;
+
+    FileHeader& hdr = file->hdr;
+    hdr.ringEntries = ringEntries;
+    hdr.maxRings = maxRings;
+    hdr.pid = getpid();
+    hdr.tscAtInit = tsc0;
+    hdr.realtimeNsAtInit = rt.tv_sec * 1000000000ull + rt.tv_nsec;
+    hdr.tscPerNs = (double)(tsc1 - tsc0) / ns;
+    // magic last: the dump tool ignores a file that is not ready
+    std::atomic_thread_fence(std::memory_order_release);
+    memcpy(hdr.magic, MUQUINETD_TRACE_MAGIC, sizeof(hdr.magic));
+
+    enabled = true;
+    return true;
+}
+
+} // namespace Trace {
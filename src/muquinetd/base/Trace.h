@@ -0,0 +1,144 @@
+/*
+ * muQuinet, an userspace TCP/IP network stack.
+ * Copyright (C) 2018 rtdarwin
+ *
+ * This program is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+
+ * You should have received a copy of the GNU General Public
+ * License along with this program.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef MUQUINETD_BASE_TRACE_H
+#define MUQUINETD_BASE_TRACE_H
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <time.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+/** Binary packet-path trace rings (flight recorder)
+ *
+ * 每个线程一个固定大小的环，记录 {TSC, 事件, skb, 两个参数}，满了就覆盖
+ * 最旧的。所有环都在一个 mmap(MAP_SHARED) 的文件里，所以：
+ *   - 运行时可以随时用 muquinetd-trace-dump 读出来（不需要和 daemon 通信）
+ *   - daemon 崩溃后文件还在，下次启动时被改名为 trace.buf.old
+ *
+ * 关闭时（默认）record() 只是一次分支判断。
+ */
+namespace Trace {
+
+enum Event : uint32_t
+{
+    NONE,
+    NETDEV_RX,        // arg0: length
+    IP_ENRXQ,         // arg0: length
+    IP_DEFRAG,        // arg0: frag offset(8n) | MF << 16, arg1: reassembled
+    TCP_RX,           // arg0: sport << 16 | dport, arg1: seq
+    UDP_RX,           // arg0: sport << 16 | dport, arg1: length
+    SOCKET_PUTRECVQ,  // arg0: queued (0 = dropped)
+    RPC_WRITE,        // arg0: returning case, arg1: bytes
+    INTERFACE_TX,     // arg0: burst size
+
+    N_EVENTS
+};
+
+const char* eventName(uint32_t);
+
+struct Record
+{
+    uint64_t tsc;
+    uint64_t skb; // SocketBuffer address, 0 if none
+    uint32_t event;
+    uint32_t arg0;
+    uint64_t arg1;
+};
+
+const int ringEntries = 8192; // power of 2
+const int maxRings = 32;
+
+struct Ring
+{
+    alignas(64) std::atomic<uint64_t> head; // records written, ever
+    uint32_t tid;
+    char threadName[16];
+    Record records[ringEntries];
+};
+
+#define MUQUINETD_TRACE_MAGIC "MQTRACE1"
+#define MUQUINETD_TRACE_FILE_NAME "trace.buf"
+
+struct FileHeader
+{
+    char magic[8];
+    uint32_t ringEntries;
+    uint32_t maxRings;
+    std::atomic<uint32_t> ringsUsed;
+    uint32_t pid;
+    // TSC -> wall clock: ns = realtimeNsAtInit + (tsc - tscAtInit) / tscPerNs
+    uint64_t tscAtInit;
+    uint64_t realtimeNsAtInit;
+    double tscPerNs;
+};
+
+struct File
+{
+    FileHeader hdr;
+    Ring rings[maxRings];
+};
+
+extern bool enabled;
+extern __thread Ring* thisRing;
+Ring* claimRing();
+
+// Map (creating) the trace file, and enable tracing
+bool init(const std::string& path);
+
+inline uint64_t
+tsc()
+{
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+#endif
+}
+
+inline void
+record(Event e, const void* skb, uint32_t arg0 = 0, uint64_t arg1 = 0)
+{
+    if (!enabled)
+        return;
+
+    Ring* r = thisRing;
+    if (!r)
+        r = claimRing();
+
+    uint64_t h = r->head.load(std::memory_order_relaxed);
+    Record& rec = r->records[h & (ringEntries - 1)];
+    rec.tsc = tsc();
+    rec.skb = (uint64_t)(uintptr_t)skb;
+    rec.event = e;
+    rec.arg0 = arg0;
+    rec.arg1 = arg1;
+    r->head.store(h + 1, std::memory_order_release);
+}
+
+} // namespace Trace {
+
+#endif // MUQUINETD_BASE_TRACE_H
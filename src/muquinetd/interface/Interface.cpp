@@ -22,22 +22,39 @@
 #include <boost/thread/thread.hpp>
 #include <memory>
 
+#include "muquinetd/Conf.h"
 #include "muquinetd/Ip.h"
 #include "muquinetd/Logging.h"
 #include "muquinetd/SocketBuffer.h"
+#include "muquinetd/base/Counters.h"
+#include "muquinetd/base/Latency.h"
+#include "muquinetd/base/Probes.h"
+#include "muquinetd/base/Trace.h"
+#include "muquinetd/interface/LoopbackDevice.h"
 #include "muquinetd/interface/NetDev.h"
+#include "muquinetd/interface/PacketRingDevice.h"
+#include "muquinetd/interface/PcapDevice.h"
 #include "muquinetd/interface/TunDevice.h"
+#include "muquinetd/interface/UringTunDevice.h"
+#include "muquinetd/interface/XdpDevice.h"
+#include "third-party/concurrentqueue/blockingconcurrentqueue.h"
 
 using std::unique_ptr;
-using std::shared_ptr;
-using std::make_shared;
 using boost::thread;
+using moodycamel::BlockingConcurrentQueue;
+using moodycamel::details::mpmc_sema::LightweightSemaphore;
 
 struct Interface::Impl
 {
     bool stopflag = false;
 
-    unique_ptr<NetDev> tunDev;
+    unique_ptr<NetDev> netDev;
+
+    // 发送队列：任意线程 tx() 入队，tx_flush_thread 成批取出交给 NetDev
+    BlockingConcurrentQueue<SocketBufferPtr> txQ;
+    // 发送队列剩余空位，用尽时 tx() 阻塞等待 (backpressure)
+    LightweightSemaphore txSlots;
+    static const int txBurstSize = 64;
 };
 
 // Reason that defaulted ctor/dtor definitions here:
@@ -52,29 +69,92 @@ Interface::~Interface() = default;
 void
 Interface::init()
 {
-    auto tun = new TunDevice();
-    tun->init();
-    _pImpl->tunDev.reset(tun);
+    NetDev* dev;
+    if (Conf::get()->loopback.enabled) {
+        dev = new LoopbackDevice();
+    } else if (!Conf::get()->pcapdev.replay.empty()) {
+        dev = new PcapDevice();
+    } else if (!Conf::get()->pktdev.ifname.empty()) {
+        if (Conf::get()->pktdev.engine == "af_xdp") {
+            dev = new XdpDevice();
+        } else {
+            dev = new PacketRingDevice();
+        }
+    } else if (Conf::get()->tundev.io_engine == "sync") {
+        dev = new TunDevice();
+    } else {
+        dev = new UringTunDevice(); // fall back to sync on its own
+    }
+    dev->init();
+    _pImpl->netDev.reset(dev);
+
+    _pImpl->txSlots.signal(Conf::get()->tundev.txqlen);
 }
 
 void
 Interface::start()
 {
-    MUQUINETD_LOG(debug) << "Starting TUN device rx_loop_thread";
+    MUQUINETD_LOG(debug) << "Starting NetDev rx_loop_thread";
     thread rxLoop([this]() {
         LoggingThreadInitializer i;
         i.run();
 
-        MUQUINETD_LOG(info) << "TUN device rx_loop_thread begins to work";
+        MUQUINETD_LOG(info) << "NetDev rx_loop_thread begins to work";
         while (!this->_pImpl->stopflag) {
-            shared_ptr<SocketBuffer> skbuf = make_shared<SocketBuffer>();
-            this->_pImpl->tunDev->rx(skbuf);
-            MUQUINETD_LOG(info) << "Interface Layer received a packet from TUN "
+            SocketBufferPtr skbuf = this->_pImpl->netDev->rx();
+            if (!skbuf)
+                continue;
+
+            skbuf->rxTimestamp = Latency::now();
+            Trace::record(Trace::NETDEV_RX, skbuf.get(),
+                          skbuf->user_payload_end - skbuf->hdrs_begin);
+            MUQUINETD_PROBE2(netdev_rx, skbuf.get(),
+                             skbuf->user_payload_end - skbuf->hdrs_begin);
+            Counters::add(Counters::IF_RX_PACKETS);
+            Counters::add(Counters::IF_RX_BYTES,
+                          skbuf->user_payload_end - skbuf->hdrs_begin);
+            MUQUINETD_LOG(info) << "Interface Layer received a packet from "
                                    "device, passing it to IP Layer";
-            Ip::get()->enRxQue(skbuf);
+            Ip::get()->enRxQue(std::move(skbuf));
+        }
+    });
+    MUQUINETD_LOG(debug) << "Started NetDev rx_loop_thread";
+
+    MUQUINETD_LOG(debug) << "Starting NetDev tx_flush_thread";
+    thread txFlush([this]() {
+        LoggingThreadInitializer i;
+        i.run();
+
+        MUQUINETD_LOG(info) << "NetDev tx_flush_thread begins to work";
+        SocketBufferPtr burst[Impl::txBurstSize];
+        while (!this->_pImpl->stopflag) {
+            // Timed, so that stop() is noticed on an idle interface
+            int n = _pImpl->txQ.wait_dequeue_bulk_timed(
+                burst, Impl::txBurstSize, 100 * 1000);
+            if (n == 0)
+                continue;
+
+            _pImpl->txSlots.signal(n);
+
+            int64_t bytes = 0;
+            for (int i = 0; i < n; ++i) {
+                for (SocketBuffer* s = burst[i].get(); s; s = s->next.get()) {
+                    bytes += (s->hdrs_end - s->hdrs_begin) +
+                             (s->user_payload_end - s->user_payload_begin);
+                }
+            }
+            Counters::add(Counters::IF_TXQ_DEPTH, -n);
+            Counters::add(Counters::IF_TX_PACKETS, n);
+            Counters::add(Counters::IF_TX_BYTES, bytes);
+            Trace::record(Trace::INTERFACE_TX, nullptr, n, bytes);
+            MUQUINETD_PROBE2(netdev_tx, n, bytes);
+
+            MUQUINETD_LOG(debug) << "Interface Layer flushing " << n
+                                 << " packet(s) to NetDev";
+            _pImpl->netDev->txBurst(burst, n);
         }
     });
-    MUQUINETD_LOG(debug) << "Started TUN device rx_loop_thread";
+    MUQUINETD_LOG(debug) << "Started NetDev tx_flush_thread";
 }
 
 void
@@ -85,7 +165,20 @@ Interface::stop()
 }
 
 void
-Interface::tx(const shared_ptr<SocketBuffer>& skbuf)
+Interface::tx(SocketBufferPtr skbuf)
+{
+    // backpressure: 发送队列满时等待 tx_flush_thread 腾出空位
+    if (!_pImpl->txSlots.tryWait()) {
+        MUQUINETD_LOG(debug) << "Interface txQ is full, waiting for flusher";
+        _pImpl->txSlots.wait();
+    }
+
+    _pImpl->txQ.enqueue(std::move(skbuf));
+    Counters::add(Counters::IF_TXQ_DEPTH);
+}
+
+int
+Interface::mtu()
 {
-    _pImpl->tunDev->tx(skbuf);
+    return _pImpl->netDev->mtu();
 }
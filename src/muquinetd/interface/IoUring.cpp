@@ -0,0 +1,191 @@
+/*
+ * muQuinet, an userspace TCP/IP network stack.
+ * Copyright (C) 2018 rtdarwin
+ *
+ * This program is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+
+ * You should have received a copy of the GNU General Public
+ * License along with this program.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#include "IoUring.h"
+
+#include <errno.h>
+#include <linux/io_uring.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace {
+
+int
+io_uring_setup(unsigned entries, struct io_uring_params* p)
+{
+    return (int)::syscall(__NR_io_uring_setup, entries, p);
+}
+
+int
+io_uring_enter(int fd, unsigned to_submit, unsigned min_complete,
+               unsigned flags)
+{
+    return (int)::syscall(__NR_io_uring_enter, fd, to_submit, min_complete,
+                          flags, nullptr, 0);
+}
+
+int
+io_uring_register(int fd, unsigned opcode, const void* arg, unsigned nr_args)
+{
+    return (int)::syscall(__NR_io_uring_register, fd, opcode, arg, nr_args);
+}
+
+} // namespace {
+
+IoUring::~IoUring()
+{
+    if (_sqes) {
+        ::munmap(_sqes, _sqesSize);
+    }
+    if (_cqRing && _cqRing != _sqRing) {
+        ::munmap(_cqRing, _cqRingSize);
+    }
+    if (_sqRing) {
+        ::munmap(_sqRing, _sqRingSize);
+    }
+    if (_fd >= 0) {
+        ::close(_fd);
+    }
+}
+
+bool
+IoUring::init(unsigned entries)
+{
+    struct io_uring_params p;
+    memset(&p, 0, sizeof(p));
+
+    /*  1. setup */
+
+    _fd = io_uring_setup(entries, &p);
+    if (_fd < 0) {
+        return false;
+    }
+
+    // IORING_OP_READ/WRITE and poll-armed reads on TUN (Linux 5.7+)
+    if (!(p.features & IORING_FEAT_FAST_POLL)) {
+        return false;
+    }
+
+    /*  2. mmap SQ/CQ rings and SQE array */
+
+    _sqRingSize = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    _cqRingSize = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    bool single_mmap = p.features & IORING_FEAT_SINGLE_MMAP;
+    if (single_mmap && _cqRingSize > _sqRingSize) {
+        _sqRingSize = _cqRingSize;
+    }
+
+    void* ptr = ::mmap(nullptr, _sqRingSize, PROT_READ | PROT_WRITE,
+                       MAP_SHARED | MAP_POPULATE, _fd, IORING_OFF_SQ_RING);
+    if (ptr == MAP_FAILED) {
+        return false;
+    }
+    _sqRing = ptr;
+
+    if (single_mmap) {
+        _cqRing = _sqRing;
+    } else {
+        ptr = ::mmap(nullptr, _cqRingSize, PROT_READ | PROT_WRITE,
+                     MAP_SHARED | MAP_POPULATE, _fd, IORING_OFF_CQ_RING);
+        if (ptr == MAP_FAILED) {
+            return false;
+        }
+        _cqRing = ptr;
+    }
+
+    _sqesSize = p.sq_entries * sizeof(struct io_uring_sqe);
+    ptr = ::mmap(nullptr, _sqesSize, PROT_READ | PROT_WRITE,
+                 MAP_SHARED | MAP_POPULATE, _fd, IORING_OFF_SQES);
+    if (ptr == MAP_FAILED) {
+        return false;
+    }
+    _sqes = (struct io_uring_sqe*)ptr;
+
+    /*  3. ring pointers */
+
+    char* sq = (char*)_sqRing;
+    _sqHead = (unsigned*)(sq + p.sq_off.head);
+    _sqTail = (unsigned*)(sq + p.sq_off.tail);
+    _sqMask = *(unsigned*)(sq + p.sq_off.ring_mask);
+    _sqEntries = p.sq_entries;
+    _sqArray = (unsigned*)(sq + p.sq_off.array);
+    _sqeTail = *_sqTail;
+
+    char* cq = (char*)_cqRing;
+    _cqHead = (unsigned*)(cq + p.cq_off.head);
+    _cqTail = (unsigned*)(cq + p.cq_off.tail);
+    _cqMask = *(unsigned*)(cq + p.cq_off.ring_mask);
+    _cqes = (struct io_uring_cqe*)(cq + p.cq_off.cqes);
+
+    return true;
+}
+
+bool
+IoUring::registerFiles(const int* fds, unsigned nfds)
+{
+    return io_uring_register(_fd, IORING_REGISTER_FILES, fds, nfds) == 0;
+}
+
+struct io_uring_sqe*
+IoUring::getSqe()
+{
+    unsigned head = __atomic_load_n(_sqHead, __ATOMIC_ACQUIRE);
+    if (_sqeTail - head >= _sqEntries) {
+        return nullptr;
+    }
+
+    unsigned idx = _sqeTail & _sqMask;
+    struct io_uring_sqe* sqe = &_sqes[idx];
+    _sqArray[idx] = idx;
+    ++_sqeTail;
+
+    memset(sqe, 0, sizeof(*sqe));
+    return sqe;
+}
+
+int
+IoUring::submitAndWait(unsigned waitNr)
+{
+    // We are the only one who moves SQ tail
+    unsigned to_submit = _sqeTail - *_sqTail;
+    __atomic_store_n(_sqTail, _sqeTail, __ATOMIC_RELEASE);
+
+    unsigned flags = waitNr ? IORING_ENTER_GETEVENTS : 0;
+    int rc = io_uring_enter(_fd, to_submit, waitNr, flags);
+    return rc < 0 ? -errno : rc;
+}
+
+struct io_uring_cqe*
+IoUring::peekCqe()
+{
+    unsigned head = *_cqHead;
+    unsigned tail = __atomic_load_n(_cqTail, __ATOMIC_ACQUIRE);
+    if (head == tail) {
+        return nullptr;
+    }
+    return &_cqes[head & _cqMask];
+}
+
+void
+IoUring::cqeSeen()
+{
+    __atomic_store_n(_cqHead, *_cqHead + 1, __ATOMIC_RELEASE);
+}
@@ -0,0 +1,78 @@
+/*
+ * muQuinet, an userspace TCP/IP network stack.
+ * Copyright (C) 2018 rtdarwin
+ *
+ * This program is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+
+ * You should have received a copy of the GNU General Public
+ * License along with this program.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef MUQUINETD_INTERFACE_IOURING_H
+#define MUQUINETD_INTERFACE_IOURING_H
+
+struct io_uring_sqe;
+struct io_uring_cqe;
+
+/** A minimal io_uring, on top of the raw syscalls (no liburing)
+ *
+ * Not thread-safe: use one IoUring per thread.
+ */
+class IoUring
+{
+public:
+    IoUring() = default;
+    ~IoUring();
+    // Non-copyable, Non-moveable
+    IoUring(const IoUring&) = delete;
+    IoUring& operator=(const IoUring&) = delete;
+    IoUring(IoUring&&) = delete;
+    IoUring& operator=(IoUring&&) = delete;
+
+    // Return false if io_uring is not available (old kernel, seccomp...)
+    bool init(unsigned entries);
+    // Register fds, later referred by index with IOSQE_FIXED_FILE
+    bool registerFiles(const int* fds, unsigned nfds);
+
+    // Next free SQE (zeroed), nullptr if SQ is full
+    struct io_uring_sqe* getSqe();
+    // Submit all pending SQEs and wait for at least waitNr CQEs
+    //   return number of SQEs submitted, or -errno
+    int submitAndWait(unsigned waitNr);
+    // First unseen CQE, nullptr if none
+    struct io_uring_cqe* peekCqe();
+    void cqeSeen();
+
+private:
+    int _fd = -1;
+
+    void* _sqRing = nullptr;
+    unsigned _sqRingSize = 0;
+    void* _cqRing = nullptr;
+    unsigned _cqRingSize = 0;
+    struct io_uring_sqe* _sqes = nullptr;
+    unsigned _sqesSize = 0;
+
+    unsigned* _sqHead = nullptr;
+    unsigned* _sqTail = nullptr;
+    unsigned _sqMask = 0;
+    unsigned _sqEntries = 0;
+    unsigned* _sqArray = nullptr;
+    unsigned _sqeTail = 0; // SQEs handed out, maybe not yet submitted
+
+    unsigned* _cqHead = nullptr;
+    unsigned* _cqTail = nullptr;
+    unsigned _cqMask = 0;
+    struct io_uring_cqe* _cqes = nullptr;
+};
+
+#endif // MUQUINETD_INTERFACE_IOURING_H
@@ -0,0 +1,236 @@
+/*
+ * muQuinet, an userspace TCP/IP network stack.
+ * Copyright (C) 2018 rtdarwin
+ *
+ * This program is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+
+ * You should have received a copy of the GNU General Public
+ * License along with this program.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#include "LoopbackDevice.h"
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <string.h>
+
+#include <map>
+#include <utility>
+
+#include "muquinetd/IpHeaderOverlay.h"
+#include "muquinetd/Logging.h"
+#include "muquinetd/SocketBuffer.h"
+#include "muquinetd/base/InternetChecksum.h"
+#include "muquinetd/ip/IpHeader.h"
+#include "muquinetd/tcp/TcpHeader.h"
+#include "third-party/concurrentqueue/blockingconcurrentqueue.h"
+
+using moodycamel::BlockingConcurrentQueue;
+
+namespace {
+
+// {saddr, daddr} x {sport, dport}, as seen on packets from the stack
+using FlowKey = std::pair<uint64_t, uint32_t>;
+
+FlowKey
+flowKeyOf(const IpHeader* iphdr, const TcpHeader* tcphdr)
+{
+    return FlowKey(((uint64_t)iphdr->saddr << 32) | iphdr->daddr,
+                   ((uint32_t)tcphdr->source << 16) | tcphdr->dest);
+}
+
+void
+swapAddrs(IpHeader* iphdr)
+{
+    __be32 addr = iphdr->saddr;
+    iphdr->saddr = iphdr->daddr;
+    iphdr->daddr = addr;
+}
+
+void
+swapPorts(__be16* ports)
+{
+    __be16 port = ports[0];
+    ports[0] = ports[1];
+    ports[1] = port;
+}
+
+} // namespace {
+
+struct LoopbackDevice::Impl
+{
+    BlockingConcurrentQueue<SocketBufferPtr> rxQ;
+
+    // The peer's snd_nxt of every TCP flow. Only touched by tx().
+    std::map<FlowKey, uint32_t> tcpPeers;
+    static const uint32_t peerIss = 1000;
+};
+
+LoopbackDevice::LoopbackDevice()
+{
+    _pImpl.reset(new LoopbackDevice::Impl);
+}
+
+LoopbackDevice::~LoopbackDevice() = default;
+
+SocketBufferPtr
+LoopbackDevice::rx()
+{
+    SocketBufferPtr skbuf;
+    _pImpl->rxQ.wait_dequeue(skbuf);
+
+    MUQUINETD_LOG(info) << "Loopback device received a packet";
+    return skbuf;
+}
+
+void
+LoopbackDevice::tx(SocketBufferPtr skbuf_head)
+{
+    /*  1. flatten into a fresh SocketBuffer, as a real device would do */
+
+    int len = 0;
+    SocketBuffer* curr_skbuf;
+    for (curr_skbuf = skbuf_head.get(); curr_skbuf;
+         curr_skbuf = curr_skbuf->next.get()) {
+        len += curr_skbuf->hdrs_end - curr_skbuf->hdrs_begin;
+        len += curr_skbuf->user_payload_end - curr_skbuf->user_payload_begin;
+    }
+
+    SocketBufferPtr packet = SocketBuffers::alloc(len);
+    char* p = packet->rawBytes;
+    for (curr_skbuf = skbuf_head.get(); curr_skbuf;
+         curr_skbuf = curr_skbuf->next.get()) {
+        int hdrs_len = curr_skbuf->hdrs_end - curr_skbuf->hdrs_begin;
+        int payload_len =
+            curr_skbuf->user_payload_end - curr_skbuf->user_payload_begin;
+        memcpy(p, curr_skbuf->hdrs_begin, hdrs_len);
+        p += hdrs_len;
+        memcpy(p, curr_skbuf->user_payload_begin, payload_len);
+        p += payload_len;
+    }
+    skbuf_head.reset();
+
+    packet->network_hdr = packet->rawBytes;
+    packet->hdrs_begin = packet->rawBytes;
+    packet->user_payload_end = packet->rawBytes + len;
+
+    /*  2. reflect it
+     *
+     * Swapping addresses/ports keeps every checksum valid, only the TCP
+     * peer has to recompute them.
+     */
+
+    IpHeader* iphdr = (IpHeader*)packet->network_hdr;
+    __be16* ports = (__be16*)(packet->network_hdr + iphdr->ihl * 4);
+
+    switch (iphdr->protocol) {
+        case IPPROTO_TCP:
+            if (!reflectTcp(packet)) {
+                return;
+            }
+            break;
+        case IPPROTO_UDP:
+            swapAddrs(iphdr);
+            swapPorts(ports);
+            break;
+        default:
+            swapAddrs(iphdr);
+            break;
+    }
+
+    _pImpl->rxQ.enqueue(std::move(packet));
+    MUQUINETD_LOG(info) << "Loopback device reflected a packet";
+}
+
+bool
+LoopbackDevice::reflectTcp(const SocketBufferPtr& packet)
+{
+    IpHeader* iphdr = (IpHeader*)packet->network_hdr;
+    TcpHeader* tcphdr = (TcpHeader*)(packet->network_hdr + iphdr->ihl * 4);
+    char* payload = (char*)tcphdr + tcphdr->doff * 4;
+    int payload_len = packet->user_payload_end - payload;
+
+    FlowKey key = flowKeyOf(iphdr, tcphdr);
+    uint32_t seq = ntohl(tcphdr->seq);
+    uint32_t peer_seq;
+    uint32_t peer_ack;
+    bool syn = false;
+
+    /*  1. what the peer answers */
+
+    if (tcphdr->syn && !tcphdr->ack) {
+        peer_seq = Impl::peerIss;
+        peer_ack = seq + 1;
+        _pImpl->tcpPeers[key] = Impl::peerIss + 1;
+        syn = true;
+        payload_len = 0;
+    } else if (tcphdr->fin || tcphdr->rst) {
+        peer_seq = _pImpl->tcpPeers[key];
+        peer_ack = seq + payload_len + 1;
+        _pImpl->tcpPeers.erase(key);
+        payload_len = 0;
+    } else if (payload_len > 0) {
+        uint32_t& snd_nxt = _pImpl->tcpPeers[key];
+        peer_seq = snd_nxt;
+        peer_ack = seq + payload_len;
+        snd_nxt += payload_len; // echo the data back
+    } else {
+        return false; // pure ACK
+    }
+
+    /*  2. rewrite the segment in place (the payload, if any, stays) */
+
+    swapAddrs(iphdr);
+    swapPorts(&tcphdr->source);
+
+    memset((char*)tcphdr + 12, 0, 2); // doff & flags
+    tcphdr->doff = 5;
+    tcphdr->syn = syn;
+    tcphdr->ack = 1;
+    tcphdr->psh = payload_len > 0;
+    tcphdr->seq = htonl(peer_seq);
+    tcphdr->ack_seq = htonl(peer_ack);
+    tcphdr->window = htons(65535);
+    tcphdr->urg_ptr = 0;
+    tcphdr->check = 0;
+
+    char* new_payload = (char*)tcphdr + 20;
+    if (payload != new_payload) {
+        memmove(new_payload, payload, payload_len);
+    }
+
+    iphdr->tot_len = htons(iphdr->ihl * 4 + 20 + payload_len);
+    iphdr->check = 0;
+    iphdr->check = InternetChecksum::checksum(iphdr, iphdr->ihl * 4, 0);
+    packet->user_payload_end = new_payload + payload_len;
+
+    /*  3. TCP checksum over the pseudo header */
+
+    uint32_t sum = 0;
+    {
+        IpHeaderOverlay ovly;
+        memset(&ovly, 0, sizeof(ovly));
+        ovly.protocol = IPPROTO_TCP;
+        ovly.protocol_len = htons(20 + payload_len);
+        ovly.saddr = iphdr->saddr;
+        ovly.daddr = iphdr->daddr;
+
+        uint16_t* ptr = (uint16_t*)&ovly;
+        for (size_t i = 0; i < sizeof(ovly) / 2; ++i) {
+            sum += ptr[i];
+        }
+    }
+    tcphdr->check =
+        InternetChecksum::checksum(tcphdr, 20 + payload_len, sum);
+
+    return true;
+}
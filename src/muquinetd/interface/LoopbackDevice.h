@@ -0,0 +1,55 @@
+/*
+ * muQuinet, an userspace TCP/IP network stack.
+ * Copyright (C) 2018 rtdarwin
+ *
+ * This program is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+
+ * You should have received a copy of the GNU General Public
+ * License along with this program.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef MUQUINETD_INTERFACE_LOOPBACKDEVICE_H
+#define MUQUINETD_INTERFACE_LOOPBACKDEVICE_H
+
+#include <memory>
+
+#include "NetDev.h"
+
+class SocketBufferPtr;
+
+/** In-memory NetDev playing an echo peer, for tests and benchmarks
+ *
+ * Every transmitted packet comes back on rx as if the destination had
+ * echoed it:
+ *  - UDP, ICMP...: addresses (and ports) swapped
+ *  - TCP: a minimal peer answers SYN with SYN|ACK, echoes data segments
+ *         (acking them), ACKs FIN/RST and ignores pure ACKs
+ *
+ * No root, TUN device or `ip` command needed.
+ */
+class LoopbackDevice : public NetDev
+{
+public:
+    LoopbackDevice();
+    virtual ~LoopbackDevice() override;
+
+    virtual SocketBufferPtr rx() override;
+    virtual void tx(SocketBufferPtr skbuf) override;
+
+private:
+    bool reflectTcp(const SocketBufferPtr& packet);
+
+    struct Impl; // pimpl forward declaration
+    std::unique_ptr<Impl> _pImpl;
+};
+
+#endif // MUQUINETD_INTERFACE_LOOPBACKDEVICE_H
@@ -21,7 +21,8 @@
 
 #include <exception>
 
-using std::shared_ptr;
+#include "muquinetd/Conf.h"
+#include "muquinetd/SocketBuffer.h"
 
 NetDev::~NetDev()
 {
@@ -37,16 +38,32 @@ NetDev::init()
 {
 }
 
-void NetDev::rx(shared_ptr<SocketBuffer>)
+SocketBufferPtr
+NetDev::rx()
 {
+    return SocketBufferPtr();
 }
 
 void
-NetDev::tx(const shared_ptr<SocketBuffer>&)
+NetDev::tx(SocketBufferPtr)
 {
 }
 
+void
+NetDev::txBurst(SocketBufferPtr* skbufs, int n)
+{
+    for (int i = 0; i < n; ++i) {
+        this->tx(std::move(skbufs[i]));
+    }
+}
+
 void
 NetDev::close()
 {
 }
+
+int
+NetDev::mtu()
+{
+    return Conf::get()->tundev.mtu;
+}
@@ -23,7 +23,7 @@
 #include <functional>
 #include <memory>
 
-class SocketBuffer;
+class SocketBufferPtr;
 
 class NetDev
 {
@@ -37,9 +37,14 @@ public:
     NetDev& operator=(NetDev*) = delete;
 
     virtual void init();
-    virtual void rx(std::shared_ptr<SocketBuffer> skbuf);
-    virtual void tx(const std::shared_ptr<SocketBuffer>& skbuf);
+    // Block until a packet arrives, return it
+    virtual SocketBufferPtr rx();
+    virtual void tx(SocketBufferPtr skbuf);
+    // Transmit n packets at once. The default is tx() for each.
+    virtual void txBurst(SocketBufferPtr* skbufs, int n);
     virtual void close();
+    // Largest IP packet it sends. The default is the configured MTU.
+    virtual int mtu();
 };
 
 #endif // MUQUINETD_INTERFACE_NETDEV_H
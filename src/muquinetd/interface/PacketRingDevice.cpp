@@ -0,0 +1,482 @@
+/*
+ * muQuinet, an userspace TCP/IP network stack.
+ * Copyright (C) 2018 rtdarwin
+ *
+ * This program is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+
+ * You should have received a copy of the GNU General Public
+ * License along with this program.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#include "PacketRingDevice.h"
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <linux/if_packet.h>
+#include <net/ethernet.h>
+#include <net/if.h>
+#include <poll.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <exception>
+#include <string>
+
+#include "muquinetd/Conf.h"
+#include "muquinetd/Logging.h"
+#include "muquinetd/SocketBuffer.h"
+#include "muquinetd/base/CmdRunner.h"
+#include "muquinetd/base/MutexLock.h"
+#include "muquinetd/link/EthernetLink.h"
+#include "muquinetd/muQuinetd.h"
+
+namespace {
+
+void
+fatalErrno(const char* what)
+{
+    int errno_ = errno;
+    MUQUINETD_LOG(fatal) << what << ": " << std::string(strerror(errno_));
+    muQuinetd::get()->stop();
+    muQuinetd::get()->exit(muQuinetd::exit_status::FAILURE);
+}
+
+// A TPACKET_V3 rx block
+struct RxBlock
+{
+    struct tpacket_block_desc* desc = nullptr;
+};
+
+void
+rxBlockRelease(RxBlock& block)
+{
+    __atomic_store_n(&block.desc->hdr.bh1.block_status, TP_STATUS_KERNEL,
+                     __ATOMIC_RELEASE);
+}
+
+} // namespace {
+
+struct PacketRingDevice::Impl
+{
+    int ifindex = 0;
+    unsigned char mac[ETH_ALEN];
+
+    /*  rx: TPACKET_V3 */
+
+    int rxFd = -1;
+    struct tpacket_req3 rxReq;
+    char* rxRing = nullptr;
+    std::unique_ptr<RxBlock[]> rxBlocks;
+    unsigned rxCurBlock = 0;
+    bool rxWalking = false; // rx() is walking rxCurBlock
+    int rxPktsLeft = 0;
+    char* rxNextPkt = nullptr;
+
+    /*  tx: TPACKET_V2 */
+
+    int txFd = -1;
+    struct tpacket_req txReq;
+    char* txRing = nullptr;
+    unsigned txCurFrame = 0;
+    int txQueued = 0;
+    MutexLock txLock; // tx flush thread vs. ARP replies from rx thread
+
+    std::unique_ptr<EthernetLink> link;
+
+    ~Impl();
+};
+
+PacketRingDevice::Impl::~Impl()
+{
+    if (rxRing) {
+        ::munmap(rxRing, rxReq.tp_block_size * rxReq.tp_block_nr);
+    }
+    if (txRing) {
+        ::munmap(txRing, txReq.tp_block_size * txReq.tp_block_nr);
+    }
+    if (rxFd >= 0) {
+        ::close(rxFd);
+    }
+    if (txFd >= 0) {
+        ::close(txFd);
+    }
+}
+
+PacketRingDevice::PacketRingDevice()
+{
+    _pImpl.reset(new PacketRingDevice::Impl);
+}
+
+PacketRingDevice::~PacketRingDevice() = default;
+
+void
+PacketRingDevice::init()
+{
+    NetDev::init();
+
+    openSockets();
+    setupRxRing();
+    setupTxRing();
+    setIfUp();
+
+    _pImpl->link.reset(
+        new EthernetLink(_pImpl->mac, [this](SocketBufferPtr frame) {
+            auto& impl = *this->_pImpl;
+            if (impl.txLock.isLockedByThisThread()) {
+                // inside txBurst(), flushed at its end
+                this->queueFrame(std::move(frame));
+            } else {
+                MutexLockGuard l(impl.txLock);
+                this->queueFrame(std::move(frame));
+                this->flushFrames();
+            }
+        }));
+
+    MUQUINETD_LOG(info) << "AF_PACKET device on "
+                        << Conf::get()->pktdev.ifname << " is ready";
+}
+
+void
+PacketRingDevice::openSockets()
+{
+    auto& impl = *_pImpl;
+    const char* ifname = Conf::get()->pktdev.ifname.c_str();
+
+    /*  1. interface index & MAC address */
+
+    impl.ifindex = if_nametoindex(ifname);
+    if (impl.ifindex == 0) {
+        fatalErrno("Failed to find network interface for AF_PACKET device");
+    }
+
+    /*  2. rx socket (bound after the ring is set up), tx socket
+     *     (protocol 0: never receives anything)
+     */
+
+    impl.rxFd = ::socket(AF_PACKET, SOCK_RAW, 0);
+    impl.txFd = ::socket(AF_PACKET, SOCK_RAW, 0);
+    if (impl.rxFd < 0 || impl.txFd < 0) {
+        fatalErrno("Failed to open AF_PACKET socket");
+    }
+
+    struct ifreq ifr;
+    memset(&ifr, 0, sizeof(ifr));
+    strncpy(ifr.ifr_name, ifname, IFNAMSIZ - 1);
+    if (ioctl(impl.rxFd, SIOCGIFHWADDR, &ifr) < 0) {
+        fatalErrno("Failed to get MAC address for AF_PACKET device");
+    }
+    memcpy(impl.mac, ifr.ifr_hwaddr.sa_data, ETH_ALEN);
+}
+
+void
+PacketRingDevice::setupRxRing()
+{
+    auto& impl = *_pImpl;
+
+    /*  1. TPACKET_V3 ring: 64 blocks of 256K */
+
+    int version = TPACKET_V3;
+    if (setsockopt(impl.rxFd, SOL_PACKET, PACKET_VERSION, &version,
+                   sizeof(version)) < 0) {
+        fatalErrno("Failed to set TPACKET_V3 on AF_PACKET rx socket");
+    }
+
+    struct tpacket_req3& req = impl.rxReq;
+    memset(&req, 0, sizeof(req));
+    req.tp_block_size = 1 << 18;
+    req.tp_block_nr = 64;
+    req.tp_frame_size = 1 << 11; // only a hint for V3
+    req.tp_frame_nr = req.tp_block_size / req.tp_frame_size * req.tp_block_nr;
+    req.tp_retire_blk_tov = 1; // ms, latency bound of a partly filled block
+    if (setsockopt(impl.rxFd, SOL_PACKET, PACKET_RX_RING, &req, sizeof(req)) <
+        0) {
+        fatalErrno("Failed to set up AF_PACKET rx ring");
+    }
+
+    void* ring = ::mmap(nullptr, req.tp_block_size * req.tp_block_nr,
+                        PROT_READ | PROT_WRITE, MAP_SHARED | MAP_LOCKED,
+                        impl.rxFd, 0);
+    if (ring == MAP_FAILED) {
+        fatalErrno("Failed to mmap AF_PACKET rx ring");
+    }
+    impl.rxRing = (char*)ring;
+
+    impl.rxBlocks.reset(new RxBlock[req.tp_block_nr]);
+    for (unsigned i = 0; i < req.tp_block_nr; ++i) {
+        impl.rxBlocks[i].desc =
+            (struct tpacket_block_desc*)(impl.rxRing + i * req.tp_block_size);
+    }
+
+    /*  2. start receiving */
+
+    struct sockaddr_ll sll;
+    memset(&sll, 0, sizeof(sll));
+    sll.sll_family = AF_PACKET;
+    sll.sll_protocol = htons(ETH_P_ALL);
+    sll.sll_ifindex = impl.ifindex;
+    if (bind(impl.rxFd, (struct sockaddr*)&sll, sizeof(sll)) < 0) {
+        fatalErrno("Failed to bind AF_PACKET rx socket");
+    }
+}
+
+void
+PacketRingDevice::setupTxRing()
+{
+    auto& impl = *_pImpl;
+
+    /*  1. TPACKET_V2 ring: frames big enough for an MTU-sized packet */
+
+    int version = TPACKET_V2;
+    if (setsockopt(impl.txFd, SOL_PACKET, PACKET_VERSION, &version,
+                   sizeof(version)) < 0) {
+        fatalErrno("Failed to set TPACKET_V2 on AF_PACKET tx socket");
+    }
+
+    // 格式不对的帧由内核跳过（置回 AVAILABLE），否则发送停在那一帧上。
+    // 须在 PACKET_TX_RING 之前设置
+    int loss = 1;
+    if (setsockopt(impl.txFd, SOL_PACKET, PACKET_LOSS, &loss, sizeof(loss)) <
+        0) {
+        MUQUINETD_LOG(warning) << "AF_PACKET tx PACKET_LOSS is not available";
+    }
+
+    unsigned frame_size = 1 << 11;
+    while (frame_size < TPACKET2_HDRLEN + ETH_HLEN + Conf::get()->tundev.mtu) {
+        frame_size <<= 1;
+    }
+
+    struct tpacket_req& req = impl.txReq;
+    memset(&req, 0, sizeof(req));
+    req.tp_frame_size = frame_size;
+    req.tp_block_size = frame_size * 8;
+    req.tp_block_nr = 32;
+    req.tp_frame_nr = req.tp_block_nr * 8;
+    if (setsockopt(impl.txFd, SOL_PACKET, PACKET_TX_RING, &req, sizeof(req)) <
+        0) {
+        fatalErrno("Failed to set up AF_PACKET tx ring");
+    }
+
+    void* ring = ::mmap(nullptr, req.tp_block_size * req.tp_block_nr,
+                        PROT_READ | PROT_WRITE, MAP_SHARED | MAP_LOCKED,
+                        impl.txFd, 0);
+    if (ring == MAP_FAILED) {
+        fatalErrno("Failed to mmap AF_PACKET tx ring");
+    }
+    impl.txRing = (char*)ring;
+
+    // Optional: skip the qdisc layer (Linux 3.14+)
+    int one = 1;
+    setsockopt(impl.txFd, SOL_PACKET, PACKET_QDISC_BYPASS, &one, sizeof(one));
+
+    /*  2. bind to the interface */
+
+    struct sockaddr_ll sll;
+    memset(&sll, 0, sizeof(sll));
+    sll.sll_family = AF_PACKET;
+    sll.sll_protocol = 0;
+    sll.sll_ifindex = impl.ifindex;
+    if (bind(impl.txFd, (struct sockaddr*)&sll, sizeof(sll)) < 0) {
+        fatalErrno("Failed to bind AF_PACKET tx socket");
+    }
+}
+
+void
+PacketRingDevice::setIfUp()
+{
+    try {
+        CmdRunner r("ip link set dev %s up", Conf::get()->pktdev.ifname.c_str());
+        r.run();
+    } catch (std::exception& e) {
+        MUQUINETD_LOG(fatal)
+            << "Failed to set AF_PACKET device up: " << std::string(e.what());
+        muQuinetd::get()->stop();
+        muQuinetd::get()->exit(muQuinetd::exit_status::FAILURE);
+    }
+}
+
+SocketBufferPtr
+PacketRingDevice::rx()
+{
+    auto& impl = *_pImpl;
+
+    for (;;) {
+        /*  1. current block exhausted: give it up, wait for the next one */
+
+        if (impl.rxPktsLeft == 0) {
+            if (impl.rxWalking) {
+                rxBlockRelease(impl.rxBlocks[impl.rxCurBlock]);
+                impl.rxCurBlock = (impl.rxCurBlock + 1) % impl.rxReq.tp_block_nr;
+                impl.rxWalking = false;
+            }
+
+            RxBlock& block = impl.rxBlocks[impl.rxCurBlock];
+            if (!(__atomic_load_n(&block.desc->hdr.bh1.block_status,
+                                  __ATOMIC_ACQUIRE) &
+                  TP_STATUS_USER)) {
+                struct pollfd pfd;
+                pfd.fd = impl.rxFd;
+                pfd.events = POLLIN | POLLERR;
+                pfd.revents = 0;
+                if (poll(&pfd, 1, -1) < 0 && errno != EINTR) {
+                    fatalErrno("Error when polling AF_PACKET rx socket");
+                }
+                continue;
+            }
+
+            impl.rxWalking = true;
+            impl.rxPktsLeft = block.desc->hdr.bh1.num_pkts;
+            impl.rxNextPkt =
+                (char*)block.desc + block.desc->hdr.bh1.offset_to_first_pkt;
+            continue;
+        }
+
+        /*  2. next frame of the block */
+
+        struct tpacket3_hdr* ppd = (struct tpacket3_hdr*)impl.rxNextPkt;
+        impl.rxNextPkt += ppd->tp_next_offset;
+        --impl.rxPktsLeft;
+
+        struct sockaddr_ll* sll =
+            (struct sockaddr_ll*)((char*)ppd +
+                                  TPACKET_ALIGN(sizeof(struct tpacket3_hdr)));
+        if (sll->sll_pkttype == PACKET_OUTGOING) {
+            continue; // our own tx
+        }
+
+        // 拷出到池化的 SocketBuffer：帧可能在 recvQ / 分片重组队列里停留
+        // 任意长时间，若直接引用 ring 内存会钉住整个 block，拖死收包
+        SocketBufferPtr frame = SocketBuffers::alloc(ppd->tp_snaplen);
+        memcpy(frame->rawBytes, (char*)ppd + ppd->tp_mac, ppd->tp_snaplen);
+        frame->hdrs_begin = frame->rawBytes;
+        frame->user_payload_end = frame->rawBytes + ppd->tp_snaplen;
+
+        SocketBufferPtr skbuf = impl.link->input(std::move(frame));
+        if (skbuf) {
+            MUQUINETD_LOG(info) << "AF_PACKET device received a packet";
+            return skbuf;
+        }
+    }
+}
+
+void
+PacketRingDevice::tx(SocketBufferPtr skbuf)
+{
+    this->txBurst(&skbuf, 1);
+}
+
+void
+PacketRingDevice::txBurst(SocketBufferPtr* skbufs, int n)
+{
+    MutexLockGuard l(_pImpl->txLock);
+
+    for (int i = 0; i < n; ++i) {
+        _pImpl->link->output(std::move(skbufs[i]));
+    }
+    this->flushFrames();
+}
+
+void
+PacketRingDevice::queueFrame(SocketBufferPtr frame)
+{
+    auto& impl = *_pImpl;
+    unsigned frame_size = impl.txReq.tp_frame_size;
+
+    char* base = impl.txRing + impl.txCurFrame * frame_size;
+    struct tpacket2_hdr* hdr = (struct tpacket2_hdr*)base;
+
+    /*  1. wait for the ring frame to be free */
+
+    unsigned status;
+    while ((status = __atomic_load_n(&hdr->tp_status, __ATOMIC_ACQUIRE)) !=
+           TP_STATUS_AVAILABLE) {
+        if (status == TP_STATUS_WRONG_FORMAT) {
+            // without PACKET_LOSS: the kernel refused the frame we put
+            // there, it is dropped and the ring frame reset
+            MUQUINETD_LOG(error) << "AF_PACKET tx ring frame in wrong format";
+            __atomic_store_n(&hdr->tp_status, TP_STATUS_AVAILABLE,
+                             __ATOMIC_RELEASE);
+            continue;
+        }
+        if (impl.txQueued) {
+            this->flushFrames();
+        } else {
+            usleep(100); // still being sent by the kernel
+        }
+    }
+
+    /*  2. copy the frame in */
+
+    char* data = base + TPACKET2_HDRLEN - sizeof(struct sockaddr_ll);
+    char* data_end = base + frame_size;
+    char* p = data;
+
+    SocketBuffer* curr_skbuf;
+    for (curr_skbuf = frame.get(); curr_skbuf;
+         curr_skbuf = curr_skbuf->next.get()) {
+        int hdrs_len = curr_skbuf->hdrs_end - curr_skbuf->hdrs_begin;
+        int payload_len =
+            curr_skbuf->user_payload_end - curr_skbuf->user_payload_begin;
+        if (p + hdrs_len + payload_len > data_end) {
+            MUQUINETD_LOG(error) << "Frame too large for AF_PACKET tx ring";
+            return;
+        }
+        memcpy(p, curr_skbuf->hdrs_begin, hdrs_len);
+        p += hdrs_len;
+        memcpy(p, curr_skbuf->user_payload_begin, payload_len);
+        p += payload_len;
+    }
+
+    hdr->tp_len = p - data;
+    __atomic_store_n(&hdr->tp_status, TP_STATUS_SEND_REQUEST, __ATOMIC_RELEASE);
+
+    impl.txCurFrame = (impl.txCurFrame + 1) % impl.txReq.tp_frame_nr;
+    ++impl.txQueued;
+}
+
+void
+PacketRingDevice::flushFrames()
+{
+    auto& impl = *_pImpl;
+    if (impl.txQueued == 0) {
+        return;
+    }
+
+    // Blocking send(): returns after the kernel has sent every queued frame
+    if (::send(impl.txFd, nullptr, 0, 0) < 0) {
+        int errno_ = errno;
+        MUQUINETD_LOG(error) << "Error when flushing AF_PACKET tx ring: "
+                             << std::string(strerror(errno_));
+    } else {
+        MUQUINETD_LOG(info) << "AF_PACKET device transmited "
+                            << impl.txQueued << " frame(s)";
+    }
+    impl.txQueued = 0;
+}
+
+void
+PacketRingDevice::close()
+{
+    // Rings stay mapped until destruction, received frames may still be
+    // referenced up the stack
+    auto& impl = *_pImpl;
+    if (impl.rxFd >= 0) {
+        ::close(impl.rxFd);
+        impl.rxFd = -1;
+    }
+    if (impl.txFd >= 0) {
+        ::close(impl.txFd);
+        impl.txFd = -1;
+    }
+}
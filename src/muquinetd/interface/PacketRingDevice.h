@@ -0,0 +1,71 @@
+/*
+ * muQuinet, an userspace TCP/IP network stack.
+ * Copyright (C) 2018 rtdarwin
+ *
+ * This program is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+
+ * You should have received a copy of the GNU General Public
+ * License along with this program.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef MUQUINETD_INTERFACE_PACKETRINGDEVICE_H
+#define MUQUINETD_INTERFACE_PACKETRINGDEVICE_H
+
+#include <memory>
+
+#include "NetDev.h"
+
+class SocketBufferPtr;
+
+/** AF_PACKET mmap'ed rings on an existing Ethernet interface (e.g. veth)
+ *
+ *  - rx: TPACKET_V3 ring. The kernel fills whole blocks of frames, which
+ *        are walked without any syscall; each frame is handed up in place
+ *        (zero-copy) and a block goes back to the kernel once every
+ *        frame in it has been released.
+ *  - tx: TPACKET_V2 ring. A burst is copied into ring frames and kicked
+ *        with a single send().
+ *
+ * Ethernet framing and ARP are done by an EthernetLink.
+ *
+ * Setup, e.g.:
+ *     ip link add mq0 type veth peer name mq1
+ *     ip addr add 192.168.168.8/24 dev mq1 && ip link set mq1 up
+ *     muquinetd --pktdev-ifname mq0 --stack-addr 192.168.168.10
+ */
+class PacketRingDevice : public NetDev
+{
+public:
+    PacketRingDevice();
+    virtual ~PacketRingDevice() override;
+
+    virtual void init() override;
+    virtual SocketBufferPtr rx() override;
+    virtual void tx(SocketBufferPtr skbuf) override;
+    virtual void txBurst(SocketBufferPtr* skbufs, int n) override;
+    virtual void close() override;
+
+private:
+    void openSockets();
+    void setupRxRing();
+    void setupTxRing();
+    void setIfUp();
+
+    // For EthernetLink use, with tx ring lock held
+    void queueFrame(SocketBufferPtr frame);
+    void flushFrames();
+
+    struct Impl; // pimpl forward declaration
+    std::unique_ptr<Impl> _pImpl;
+};
+
+#endif // MUQUINETD_INTERFACE_PACKETRINGDEVICE_H
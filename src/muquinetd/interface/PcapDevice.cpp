@@ -0,0 +1,174 @@
+/*
+ * muQuinet, an userspace TCP/IP network stack.
+ * Copyright (C) 2018 rtdarwin
+ *
+ * This program is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+
+ * You should have received a copy of the GNU General Public
+ * License along with this program.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+
+#include "PcapDevice.h"
+
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "PcapFile.h"
+#include "muquinetd/Conf.h"
+#include "muquinetd/Logging.h"
+#include "muquinetd/SocketBuffer.h"
+#include "muquinetd/muQuinetd.h"
+
+namespace {
+
+uint64_t
+monotonicNs()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+} // namespace {
+
+struct PcapDevice::Impl
+{
+    PcapReader reader;
+    std::unique_ptr<PcapWriter> capture;
+
+    bool originalTiming = false;
+    // original timing: the clock time replaying started, and
+    // the timestamp of the first packet in the file
+    uint64_t replayBegin = 0;
+    uint64_t fileBegin = 0;
+
+    bool eof = false;
+};
+
+PcapDevice::PcapDevice()
+{
+    _pImpl.reset(new PcapDevice::Impl);
+}
+
+PcapDevice::~PcapDevice() = default;
+
+void
+PcapDevice::init()
+{
+    NetDev::init();
+
+    auto& impl = *_pImpl;
+    const auto& conf = Conf::get()->pcapdev;
+
+    if (!impl.reader.open(conf.replay)) {
+        int errno_ = errno;
+        MUQUINETD_LOG(fatal) << "Failed to open pcap file " << conf.replay
+                             << ": " << std::string(strerror(errno_));
+        muQuinetd::get()->stop();
+        muQuinetd::get()->exit(muQuinetd::exit_status::FAILURE);
+    }
+    impl.originalTiming = conf.timing == "original";
+
+    if (!conf.capture.empty()) {
+        impl.capture.reset(new PcapWriter);
+        if (!impl.capture->open(conf.capture)) {
+            int errno_ = errno;
+            MUQUINETD_LOG(fatal) << "Failed to create pcap file "
+                                 << conf.capture << ": "
+                                 << std::string(strerror(errno_));
+            muQuinetd::get()->stop();
+            muQuinetd::get()->exit(muQuinetd::exit_status::FAILURE);
+        }
+    }
+
+    MUQUINETD_LOG(info) << "Pcap device replaying " << conf.replay
+                        << " {timing = " << conf.timing
+                        << ", loop = " << conf.loop << "}";
+}
+
+SocketBufferPtr
+PcapDevice::rx()
+{
+    auto& impl = *_pImpl;
+
+    /*  1. next packet of the file */
+
+    const char* packet;
+    int len;
+    uint64_t ts;
+    bool got = !impl.eof && impl.reader.next(&packet, &len, &ts);
+    if (!got && !impl.eof && Conf::get()->pcapdev.loop) {
+        impl.reader.rewind();
+        impl.replayBegin = 0;
+        got = impl.reader.next(&packet, &len, &ts);
+    }
+    if (!got) {
+        if (!impl.eof) {
+            impl.eof = true;
+            MUQUINETD_LOG(info) << "Pcap device replayed the whole file";
+        }
+        // Nothing left, but the rx loop has to notice stop() still
+        usleep(100 * 1000);
+        return SocketBufferPtr();
+    }
+
+    /*  2. wait for its time */
+
+    if (impl.originalTiming) {
+        uint64_t now = monotonicNs();
+        if (impl.replayBegin == 0) {
+            impl.replayBegin = now;
+            impl.fileBegin = ts;
+        }
+        // timestamps going backwards (merged captures) are sent at once
+        if (ts > impl.fileBegin) {
+            uint64_t due = impl.replayBegin + (ts - impl.fileBegin);
+            if (due > now) {
+                struct timespec delay;
+                delay.tv_sec = (due - now) / 1000000000;
+                delay.tv_nsec = (due - now) % 1000000000;
+                nanosleep(&delay, NULL);
+            }
+        }
+    }
+
+    /*  3. copy it out, the stack rewrites headers in place */
+
+    SocketBufferPtr skbuf = SocketBuffers::alloc(len);
+    memcpy(skbuf->rawBytes, packet, len);
+
+    skbuf->network_hdr = skbuf->rawBytes;
+    skbuf->hdrs_begin = skbuf->rawBytes;
+    skbuf->user_payload_end = skbuf->hdrs_begin + len;
+
+    MUQUINETD_LOG(info) << "Pcap device received a packet";
+    return skbuf;
+}
+
+void
+PcapDevice::tx(SocketBufferPtr skbuf)
+{
+    if (_pImpl->capture) {
+        _pImpl->capture->write(skbuf.get());
+    }
+    MUQUINETD_LOG(info) << "Pcap device transmited a packet";
+}
+
+void
+PcapDevice::close()
+{
+    if (_pImpl->capture) {
+        _pImpl->capture->flush();
+    }
+}
@@ -0,0 +1,53 @@
+/*
+ * muQuinet, an userspace TCP/IP network stack.
+ * Copyright (C) 2018 rtdarwin
+ *
+ * This program is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+
+ * You should have received a copy of the GNU General Public
+ * License along with this program.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef MUQUINETD_INTERFACE_PCAPDEVICE_H
+#define MUQUINETD_INTERFACE_PCAPDEVICE_H
+
+#include <memory>
+
+#include "NetDev.h"
+
+class SocketBufferPtr;
+
+/** NetDev replaying a pcap file, for reproducing bugs and benchmarks
+ *
+ *  - rx: the IPv4 packets of Conf::pcapdev.replay, either as fast as the
+ *        stack takes them (line_rate) or spaced as they were captured
+ *        (original)
+ *  - tx: written into Conf::pcapdev.capture, or dropped
+ */
+class PcapDevice : public NetDev
+{
+public:
+    PcapDevice();
+    virtual ~PcapDevice() override;
+
+    virtual void init() override;
+    virtual SocketBufferPtr rx() override;
+    virtual void tx(SocketBufferPtr skbuf) override;
+    virtual void close() override;
+
+private:
+    struct Impl; // pimpl forward declaration
+    std::unique_ptr<Impl> _pImpl;
+};
+
+#endif // MUQUINETD_INTERFACE_PCAPDEVICE_H
@@ -0,0 +1,354 @@
+/*
+ * muQuinet, an userspace TCP/IP network stack.
+ * Copyright (C) 2018 rtdarwin
+ *
+ * This program is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+
+ * You should have received a copy of the GNU General Public
+ * License along with this program.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+
+#include "PcapFile.h"
+
+#include <byteswap.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "muquinetd/SocketBuffer.h"
+#include "muquinetd/base/MutexLock.h"
+
+namespace {
+
+const uint32_t magicUs = 0xa1b2c3d4;
+const uint32_t magicNs = 0xa1b23c4d;
+
+// clang-format off
+enum LinkType
+{
+    LINKTYPE_ETHERNET  = 1,
+    LINKTYPE_RAW       = 101,
+    LINKTYPE_LINUX_SLL = 113,
+    LINKTYPE_IPV4      = 228,
+    LINKTYPE_LINUX_SLL2 = 276,
+};
+// clang-format on
+
+struct FileHeader
+{
+    uint32_t magic;
+    uint16_t versionMajor;
+    uint16_t versionMinor;
+    int32_t thiszone;
+    uint32_t sigfigs;
+    uint32_t snaplen;
+    uint32_t linktype;
+};
+
+struct RecordHeader
+{
+    uint32_t tsSec;
+    uint32_t tsFrac; // us or ns, by magic
+    uint32_t inclLen;
+    uint32_t origLen;
+};
+
+const uint32_t snaplen = 65535;
+
+} // namespace {
+
+/*  PcapWriter */
+
+struct PcapWriter::Impl
+{
+    MutexLock lock;
+    FILE* fp = nullptr;
+    std::string path;
+    size_t rotateBytes = 0;
+    size_t written = 0;
+
+    bool openFile();
+};
+
+PcapWriter::PcapWriter()
+{
+    _pImpl.reset(new PcapWriter::Impl);
+}
+
+PcapWriter::~PcapWriter()
+{
+    if (_pImpl->fp) {
+        fclose(_pImpl->fp);
+    }
+}
+
+bool
+PcapWriter::Impl::openFile()
+{
+    fp = fopen(path.c_str(), "we");
+    if (!fp)
+        return false;
+
+    // 每个包一次 fwrite 太贵，用大缓冲区
+    setvbuf(fp, NULL, _IOFBF, 1 << 20);
+
+    FileHeader hdr = { magicNs, 2, 4, 0, 0, snaplen, LINKTYPE_RAW };
+    fwrite(&hdr, sizeof(hdr), 1, fp);
+    written = sizeof(hdr);
+    return true;
+}
+
+bool
+PcapWriter::open(const std::string& path, size_t rotateBytes)
+{
+    MutexLockGuard l(_pImpl->lock);
+
+    _pImpl->path = path;
+    _pImpl->rotateBytes = rotateBytes;
+    return _pImpl->openFile();
+}
+
+void
+PcapWriter::write(const SocketBuffer* skbuf)
+{
+    /*  1. 收集分段 */
+
+    struct
+    {
+        const char* base;
+        size_t len;
+    } segs[32];
+    int nsegs = 0;
+    size_t total = 0;
+
+    if (!skbuf->hdrs_end) {
+        // received: one contiguous packet
+        segs[nsegs++] = { skbuf->hdrs_begin,
+                          (size_t)(skbuf->user_payload_end - skbuf->hdrs_begin) };
+    } else {
+        for (const SocketBuffer* s = skbuf; s && nsegs + 2 <= 32;
+             s = s->next.get()) {
+            segs[nsegs++] = { s->hdrs_begin,
+                              (size_t)(s->hdrs_end - s->hdrs_begin) };
+            if (s->user_payload_begin) {
+                segs[nsegs++] = {
+                    s->user_payload_begin,
+                    (size_t)(s->user_payload_end - s->user_payload_begin)
+                };
+            }
+        }
+    }
+    for (int i = 0; i < nsegs; ++i)
+        total += segs[i].len;
+
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    uint32_t incl = total < snaplen ? total : snaplen;
+    RecordHeader rec = { (uint32_t)ts.tv_sec, (uint32_t)ts.tv_nsec, incl,
+                         (uint32_t)total };
+
+    /*  2. 写入（必要时轮转） */
+
+    MutexLockGuard l(_pImpl->lock);
+    if (!_pImpl->fp)
+        return;
+
+    if (_pImpl->rotateBytes && _pImpl->written >= _pImpl->rotateBytes) {
+        fclose(_pImpl->fp);
+        std::string older = _pImpl->path + ".1";
+        ::rename(_pImpl->path.c_str(), older.c_str());
+        if (!_pImpl->openFile())
+            return;
+    }
+
+    fwrite(&rec, sizeof(rec), 1, _pImpl->fp);
+    size_t left = incl;
+    for (int i = 0; i < nsegs && left > 0; ++i) {
+        size_t n = segs[i].len < left ? segs[i].len : left;
+        fwrite(segs[i].base, 1, n, _pImpl->fp);
+        left -= n;
+    }
+    _pImpl->written += sizeof(rec) + incl;
+}
+
+void
+PcapWriter::flush()
+{
+    MutexLockGuard l(_pImpl->lock);
+    if (_pImpl->fp)
+        fflush(_pImpl->fp);
+}
+
+/*  PcapReader */
+
+struct PcapReader::Impl
+{
+    const char* data = nullptr;
+    size_t size = 0;
+    size_t off = 0;
+
+    bool swapped = false;
+    bool nanos = false;
+    uint32_t linktype = 0;
+
+    uint32_t u32(uint32_t v) const { return swapped ? bswap_32(v) : v; }
+    uint16_t u16(uint16_t v) const { return swapped ? bswap_16(v) : v; }
+
+    // Strip the link layer header, false if not IPv4
+    bool ipv4Of(const char** p, int* len) const;
+};
+
+PcapReader::PcapReader()
+{
+    _pImpl.reset(new PcapReader::Impl);
+}
+
+PcapReader::~PcapReader()
+{
+    if (_pImpl->data) {
+        munmap((void*)_pImpl->data, _pImpl->size);
+    }
+}
+
+bool
+PcapReader::open(const std::string& path)
+{
+    auto& impl = *_pImpl;
+
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd == -1)
+        return false;
+
+    struct stat st;
+    if (fstat(fd, &st) == -1 || (size_t)st.st_size < sizeof(FileHeader)) {
+        ::close(fd);
+        errno = EINVAL;
+        return false;
+    }
+
+    void* addr = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (addr == MAP_FAILED)
+        return false;
+    madvise(addr, st.st_size, MADV_SEQUENTIAL);
+
+    impl.data = (const char*)addr;
+    impl.size = st.st_size;
+
+    FileHeader hdr;
+    memcpy(&hdr, impl.data, sizeof(hdr));
+    if (hdr.magic == magicUs || hdr.magic == magicNs) {
+        impl.swapped = false;
+    } else if (bswap_32(hdr.magic) == magicUs ||
+               bswap_32(hdr.magic) == magicNs) {
+        impl.swapped = true;
+    } else {
+        errno = EINVAL; // pcapng is not supported
+        return false;
+    }
+    impl.nanos = impl.u32(hdr.magic) == magicNs;
+    impl.linktype = impl.u32(hdr.linktype) & 0xffff;
+    impl.off = sizeof(FileHeader);
+
+    switch (impl.linktype) {
+        case LINKTYPE_ETHERNET:
+        case LINKTYPE_RAW:
+        case LINKTYPE_LINUX_SLL:
+        case LINKTYPE_IPV4:
+        case LINKTYPE_LINUX_SLL2:
+            return true;
+        default:
+            errno = EPROTONOSUPPORT;
+            return false;
+    }
+}
+
+bool
+PcapReader::Impl::ipv4Of(const char** p, int* len) const
+{
+    const unsigned char* b = (const unsigned char*)*p;
+    int hlen = 0;
+    uint16_t proto = 0x0800;
+
+    switch (linktype) {
+        case LINKTYPE_ETHERNET:
+            hlen = 14;
+            if (*len < hlen)
+                return false;
+            proto = b[12] << 8 | b[13];
+            if (proto == 0x8100 && *len >= 18) { // 802.1Q
+                hlen = 18;
+                proto = b[16] << 8 | b[17];
+            }
+            break;
+        case LINKTYPE_LINUX_SLL:
+            hlen = 16;
+            if (*len < hlen)
+                return false;
+            proto = b[14] << 8 | b[15];
+            break;
+        case LINKTYPE_LINUX_SLL2:
+            hlen = 20;
+            if (*len < hlen)
+                return false;
+            proto = b[0] << 8 | b[1];
+            break;
+        default: // RAW, IPV4
+            break;
+    }
+
+    if (proto != 0x0800 || *len - hlen < 20 || (b[hlen] >> 4) != 4)
+        return false;
+
+    *p += hlen;
+    *len -= hlen;
+    return true;
+}
+
+bool
+PcapReader::next(const char** packet, int* len, uint64_t* timestampNs)
+{
+    auto& impl = *_pImpl;
+
+    while (impl.off + sizeof(RecordHeader) <= impl.size) {
+        RecordHeader rec;
+        memcpy(&rec, impl.data + impl.off, sizeof(rec));
+        uint32_t incl = impl.u32(rec.inclLen);
+        const char* p = impl.data + impl.off + sizeof(rec);
+        if (impl.off + sizeof(rec) + incl > impl.size)
+            return false; // truncated file
+
+        impl.off += sizeof(rec) + incl;
+
+        int l = incl;
+        if (!impl.ipv4Of(&p, &l))
+            continue;
+
+        *packet = p;
+        *len = l;
+        *timestampNs = impl.u32(rec.tsSec) * 1000000000ull +
+                       impl.u32(rec.tsFrac) * (impl.nanos ? 1 : 1000);
+        return true;
+    }
+    return false;
+}
+
+void
+PcapReader::rewind()
+{
+    _pImpl->off = sizeof(FileHeader);
+}
@@ -0,0 +1,87 @@
+/*
+ * muQuinet, an userspace TCP/IP network stack.
+ * Copyright (C) 2018 rtdarwin
+ *
+ * This program is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+
+ * You should have received a copy of the GNU General Public
+ * License along with this program.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef MUQUINETD_INTERFACE_PCAPFILE_H
+#define MUQUINETD_INTERFACE_PCAPFILE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+class SocketBuffer;
+
+/** Classic libpcap files, without depending on libpcap
+ *
+ * PcapWriter writes raw IPv4 packets (LINKTYPE_RAW) with nanosecond
+ * timestamps. PcapReader reads what tcpdump/wireshark write: us or ns
+ * timestamps, either byte order, RAW/IPV4, Ethernet (w/ VLAN) and Linux
+ * cooked (SLL/SLL2) link types; everything but IPv4 is skipped.
+ */
+class PcapWriter
+{
+public:
+    PcapWriter();
+    ~PcapWriter();
+    // Non-copyable, Non-moveable
+    PcapWriter(const PcapWriter&) = delete;
+    PcapWriter& operator=(const PcapWriter&) = delete;
+    PcapWriter(PcapWriter&&) = delete;
+    PcapWriter& operator=(PcapWriter&&) = delete;
+
+    // rotateBytes != 0 makes a capture ring on disk: once `path' grows
+    // past rotateBytes it becomes `path.1' (replacing the older one) and a
+    // new `path' is started, so at most ~2 * rotateBytes are kept.
+    bool open(const std::string& path, size_t rotateBytes = 0);
+
+    // A whole packet: a received one ([hdrs_begin, user_payload_end)) or
+    // a SocketBuffer chain to transmit. Thread-safe.
+    void write(const SocketBuffer* skbuf);
+    void flush();
+
+private:
+    struct Impl;
+    std::unique_ptr<Impl> _pImpl;
+};
+
+class PcapReader
+{
+public:
+    PcapReader();
+    ~PcapReader();
+    // Non-copyable, Non-moveable
+    PcapReader(const PcapReader&) = delete;
+    PcapReader& operator=(const PcapReader&) = delete;
+    PcapReader(PcapReader&&) = delete;
+    PcapReader& operator=(PcapReader&&) = delete;
+
+    bool open(const std::string& path);
+
+    // Next IPv4 packet, pointing into the (mmap'ed) file.
+    // false at the end of the file.
+    bool next(const char** packet, int* len, uint64_t* timestampNs);
+    void rewind();
+
+private:
+    struct Impl;
+    std::unique_ptr<Impl> _pImpl;
+};
+
+#endif // MUQUINETD_INTERFACE_PCAPFILE_H
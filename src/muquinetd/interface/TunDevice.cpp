@@ -32,6 +32,7 @@
 #include <exception>
 #include <memory>
 
+#include "PcapFile.h"
 #include "muquinetd/Conf.h"
 #include "muquinetd/Logging.h"
 #include "muquinetd/SocketBuffer.h"
@@ -39,7 +40,8 @@
 #include "muquinetd/muQuinetd.h"
 
 using std::exception;
-using std::shared_ptr;
+
+TunDevice::TunDevice() = default;
 
 TunDevice::~TunDevice()
 {
@@ -56,17 +58,35 @@ TunDevice::init()
     NetDev::init();
 
     allocateTun();
+    setIfMtu();
     setIfUp();
     setIfAddr();
+
+    const auto& conf = Conf::get()->tundev;
+    if (!conf.mirror.empty()) {
+        _mirror.reset(new PcapWriter);
+        if (!_mirror->open(conf.mirror,
+                           (size_t)conf.mirror_size_mb << 20)) {
+            int errno_ = errno;
+            MUQUINETD_LOG(fatal) << "Failed to create TUN mirror file "
+                                 << conf.mirror << ": "
+                                 << std::string(strerror(errno_));
+            muQuinetd::get()->stop();
+            muQuinetd::get()->exit(muQuinetd::exit_status::FAILURE);
+        }
+        MUQUINETD_LOG(info) << "TUN device mirrored into " << conf.mirror;
+    }
 }
 
-void
-TunDevice::rx(shared_ptr<SocketBuffer> skbuf)
+SocketBufferPtr
+TunDevice::rx()
 {
     int rc = 0;
     int errno_ = 0;
 
-    rc = ::read(_fd, skbuf->rawBytes, skbuf->maxRawBytesSize);
+    SocketBufferPtr skbuf = SocketBuffers::alloc(Conf::get()->tundev.mtu);
+
+    rc = ::read(_fd, skbuf->rawBytes, skbuf->rawBytesSize);
     if (rc == -1) {
         errno_ = errno;
         MUQUINETD_LOG(fatal) << "Error when reading from TUN device: "
@@ -78,20 +98,23 @@ TunDevice::rx(shared_ptr<SocketBuffer> skbuf)
     skbuf->network_hdr = skbuf->rawBytes;
     skbuf->hdrs_begin = skbuf->rawBytes;
     skbuf->user_payload_end = skbuf->hdrs_begin + rc;
+    this->mirror(skbuf.get());
 
     MUQUINETD_LOG(info) << "TUN device received a packet";
+    return skbuf;
 }
 
 void
-TunDevice::tx(const shared_ptr<SocketBuffer>& skbuf_head)
+TunDevice::tx(SocketBufferPtr skbuf_head)
 {
     struct iovec buffers[32]; // 32 is enough, maybe...
     int idx = 0;
     int n2written = 0;
     int nwritten = 0;
 
-    shared_ptr<SocketBuffer> curr_skbuf;
-    for (curr_skbuf = skbuf_head; curr_skbuf; curr_skbuf = curr_skbuf->next) {
+    SocketBuffer* curr_skbuf;
+    for (curr_skbuf = skbuf_head.get(); curr_skbuf;
+         curr_skbuf = curr_skbuf->next.get()) {
         assert(curr_skbuf->hdrs_begin && curr_skbuf->hdrs_end &&
                curr_skbuf->user_payload_begin && curr_skbuf->user_payload_end);
 
@@ -107,6 +130,7 @@ TunDevice::tx(const shared_ptr<SocketBuffer>& skbuf_head)
         ++idx;
     }
 
+    this->mirror(skbuf_head.get());
     nwritten = writev(_fd, buffers, idx);
     {
         if (nwritten == -1) {
@@ -127,6 +151,17 @@ TunDevice::close()
     if (_fd != 0) {
         ::close(_fd);
     }
+    if (_mirror) {
+        _mirror->flush();
+    }
+}
+
+void
+TunDevice::mirror(const SocketBuffer* skbuf)
+{
+    if (_mirror) {
+        _mirror->write(skbuf);
+    }
 }
 
 void
@@ -177,6 +212,21 @@ TunDevice::allocateTun()
     _fd = fd;
 }
 
+void
+TunDevice::setIfMtu()
+{
+    try {
+        CmdRunner r("ip link set dev %s mtu %d", _devname,
+                    Conf::get()->tundev.mtu);
+        r.run();
+    } catch (std::exception& e) {
+        MUQUINETD_LOG(fatal)
+            << "Failed to set TUN device MTU: " << std::string(e.what());
+        muQuinetd::get()->stop();
+        muQuinetd::get()->exit(muQuinetd::exit_status::FAILURE);
+    }
+}
+
 void
 TunDevice::setIfUp()
 {
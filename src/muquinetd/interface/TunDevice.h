@@ -24,26 +24,34 @@
 
 #include "NetDev.h"
 
+class PcapWriter;
 class SocketBuffer;
+class SocketBufferPtr;
 
 class TunDevice : public NetDev
 {
 public:
-    TunDevice() = default;
+    TunDevice();
     virtual ~TunDevice() override;
 
     virtual void init() override;
-    virtual void rx(std::shared_ptr<SocketBuffer> skbuf) override;
-    virtual void tx(const std::shared_ptr<SocketBuffer>& skbuf) override;
+    virtual SocketBufferPtr rx() override;
+    virtual void tx(SocketBufferPtr skbuf) override;
     virtual void close() override;
 
 private:
     void allocateTun();
+    void setIfMtu();
     void setIfUp();
     void setIfAddr();
 
+protected:
+    // Conf::tundev.mirror, packets are written as they are rx'ed / tx'ed
+    void mirror(const SocketBuffer* skbuf);
+
     char* _devname = nullptr;
     int _fd = 0;
+    std::unique_ptr<PcapWriter> _mirror;
 };
 
 #endif // MUQUINETD_INTERFACE_TUNDEVICE_H
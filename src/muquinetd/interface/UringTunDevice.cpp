@@ -0,0 +1,294 @@
+/*
+ * muQuinet, an userspace TCP/IP network stack.
+ * Copyright (C) 2018 rtdarwin
+ *
+ * This program is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+
+ * You should have received a copy of the GNU General Public
+ * License along with this program.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#include "UringTunDevice.h"
+
+#include <errno.h>
+#include <linux/io_uring.h>
+#include <string.h>
+#include <sys/uio.h>
+
+#include <algorithm>
+#include <string>
+
+#include "muquinetd/Conf.h"
+#include "muquinetd/Logging.h"
+#include "muquinetd/SocketBuffer.h"
+#include "muquinetd/interface/IoUring.h"
+#include "muquinetd/muQuinetd.h"
+
+namespace {
+
+// Non-empty headers/payloads of a SocketBuffer chain, iovecs it takes
+int
+iovsOf(const SocketBuffer* skbuf, int* len)
+{
+    int n = 0;
+    *len = 0;
+    for (; skbuf; skbuf = skbuf->next.get()) {
+        int hdrs_len = skbuf->hdrs_end - skbuf->hdrs_begin;
+        int payload_len = skbuf->user_payload_end - skbuf->user_payload_begin;
+        n += (hdrs_len > 0) + (payload_len > 0);
+        *len += hdrs_len + payload_len;
+    }
+    return n;
+}
+
+// The chain copied into a single SocketBuffer (as headers)
+SocketBufferPtr
+flatten(const SocketBuffer* skbuf, int len)
+{
+    SocketBufferPtr flat = SocketBuffers::alloc(len);
+    flat->reserve(0);
+    for (; skbuf; skbuf = skbuf->next.get()) {
+        int hdrs_len = skbuf->hdrs_end - skbuf->hdrs_begin;
+        int payload_len = skbuf->user_payload_end - skbuf->user_payload_begin;
+        memcpy(flat->put(hdrs_len), skbuf->hdrs_begin, hdrs_len);
+        memcpy(flat->put(payload_len), skbuf->user_payload_begin, payload_len);
+    }
+    flat->user_payload_begin = flat->user_payload_end = flat->hdrs_end;
+    return flat;
+}
+
+} // namespace {
+
+struct UringTunDevice::Impl
+{
+    bool enabled = false;
+
+    // rx: one posted read per slot, user_data = slot
+    static const int rxDepth = 32;
+    SocketBufferPtr rxSlots[rxDepth];
+
+    // tx: one writev per slot
+    static const int txDepth = 64;
+    static const int txMaxIovs = 32;
+    struct TxSlot
+    {
+        SocketBufferPtr skbuf;
+        struct iovec iovs[txMaxIovs];
+    } txSlots[txDepth];
+
+    // rx() and txBurst() run in different threads, one ring each.
+    // Declared last so that the rings go away before the buffers.
+    IoUring rxRing;
+    IoUring txRing;
+};
+
+UringTunDevice::UringTunDevice()
+{
+    _pImpl.reset(new UringTunDevice::Impl);
+}
+
+UringTunDevice::~UringTunDevice() = default;
+
+void
+UringTunDevice::init()
+{
+    TunDevice::init();
+
+    auto& impl = *_pImpl;
+    if (!impl.rxRing.init(Impl::rxDepth) || !impl.txRing.init(Impl::txDepth) ||
+        !impl.rxRing.registerFiles(&_fd, 1) ||
+        !impl.txRing.registerFiles(&_fd, 1)) {
+        MUQUINETD_LOG(warning) << "io_uring is not available, TUN device "
+                                  "falls back to read()/writev()";
+        return;
+    }
+
+    for (int slot = 0; slot < Impl::rxDepth; ++slot) {
+        this->postRead(slot);
+    }
+    impl.enabled = true;
+
+    MUQUINETD_LOG(info) << "TUN device uses io_uring {rx depth = "
+                        << Impl::rxDepth << ", tx depth = " << Impl::txDepth
+                        << "}";
+}
+
+void
+UringTunDevice::postRead(int slot)
+{
+    auto& impl = *_pImpl;
+
+    impl.rxSlots[slot] = SocketBuffers::alloc(Conf::get()->tundev.mtu);
+    SocketBuffer* skbuf = impl.rxSlots[slot].get();
+
+    // Never fails: each slot has at most one read in flight
+    struct io_uring_sqe* sqe = impl.rxRing.getSqe();
+    sqe->opcode = IORING_OP_READ;
+    sqe->flags = IOSQE_FIXED_FILE;
+    sqe->fd = 0; // index into registered files
+    sqe->addr = (unsigned long)skbuf->rawBytes;
+    sqe->len = skbuf->rawBytesSize;
+    sqe->off = (__u64)-1; // current file position, TUN ignores it
+    sqe->user_data = slot;
+}
+
+SocketBufferPtr
+UringTunDevice::rx()
+{
+    auto& impl = *_pImpl;
+    if (!impl.enabled) {
+        return TunDevice::rx();
+    }
+
+    for (;;) {
+        /*  1. wait for a completed read (submitting re-posted ones) */
+
+        struct io_uring_cqe* cqe;
+        while (!(cqe = impl.rxRing.peekCqe())) {
+            int rc = impl.rxRing.submitAndWait(1);
+            if (rc < 0 && rc != -EINTR && rc != -EAGAIN && rc != -EBUSY) {
+                MUQUINETD_LOG(fatal) << "Error when waiting on TUN rx ring: "
+                                     << std::string(strerror(-rc));
+                muQuinetd::get()->stop();
+                muQuinetd::get()->exit(muQuinetd::exit_status::FAILURE);
+            }
+        }
+
+        int slot = (int)cqe->user_data;
+        int res = cqe->res;
+        impl.rxRing.cqeSeen();
+
+        /*  2. hand the SocketBuffer up, re-post the slot */
+
+        if (res < 0) {
+            if (res != -EINTR && res != -EAGAIN) {
+                MUQUINETD_LOG(fatal) << "Error when reading from TUN device: "
+                                     << std::string(strerror(-res));
+                muQuinetd::get()->stop();
+                muQuinetd::get()->exit(muQuinetd::exit_status::FAILURE);
+            }
+            this->postRead(slot);
+            continue;
+        }
+
+        SocketBufferPtr skbuf = std::move(impl.rxSlots[slot]);
+        this->postRead(slot);
+
+        skbuf->network_hdr = skbuf->rawBytes;
+        skbuf->hdrs_begin = skbuf->rawBytes;
+        skbuf->user_payload_end = skbuf->hdrs_begin + res;
+        this->mirror(skbuf.get());
+
+        MUQUINETD_LOG(info) << "TUN device received a packet";
+        return skbuf;
+    }
+}
+
+void
+UringTunDevice::tx(SocketBufferPtr skbuf)
+{
+    this->txBurst(&skbuf, 1);
+}
+
+void
+UringTunDevice::txBurst(SocketBufferPtr* skbufs, int n)
+{
+    auto& impl = *_pImpl;
+    if (!impl.enabled) {
+        for (int i = 0; i < n; ++i) {
+            TunDevice::tx(std::move(skbufs[i]));
+        }
+        return;
+    }
+
+    while (n > 0) {
+        int m = std::min(n, (int)Impl::txDepth);
+
+        /*  1. one writev SQE per packet */
+
+        for (int i = 0; i < m; ++i) {
+            auto& slot = impl.txSlots[i];
+            slot.skbuf = std::move(skbufs[i]);
+            this->mirror(slot.skbuf.get());
+
+            // 一个 writev 就是一个包，拆不开：iovec 不够的链先拷成一块
+            int len;
+            if (iovsOf(slot.skbuf.get(), &len) > Impl::txMaxIovs) {
+                slot.skbuf = flatten(slot.skbuf.get(), len);
+            }
+
+            int idx = 0;
+            SocketBuffer* curr_skbuf;
+            for (curr_skbuf = slot.skbuf.get(); curr_skbuf;
+                 curr_skbuf = curr_skbuf->next.get()) {
+                if (curr_skbuf->hdrs_end > curr_skbuf->hdrs_begin) {
+                    slot.iovs[idx].iov_base = curr_skbuf->hdrs_begin;
+                    slot.iovs[idx].iov_len =
+                        curr_skbuf->hdrs_end - curr_skbuf->hdrs_begin;
+                    ++idx;
+                }
+                if (curr_skbuf->user_payload_end >
+                    curr_skbuf->user_payload_begin) {
+                    slot.iovs[idx].iov_base = curr_skbuf->user_payload_begin;
+                    slot.iovs[idx].iov_len = curr_skbuf->user_payload_end -
+                                             curr_skbuf->user_payload_begin;
+                    ++idx;
+                }
+            }
+
+            struct io_uring_sqe* sqe = impl.txRing.getSqe();
+            sqe->opcode = IORING_OP_WRITEV;
+            sqe->flags = IOSQE_FIXED_FILE;
+            sqe->fd = 0; // index into registered files
+            sqe->addr = (unsigned long)slot.iovs;
+            sqe->len = idx;
+            sqe->off = (__u64)-1;
+            sqe->user_data = i;
+        }
+
+        /*  2. submit all, wait for all */
+
+        int ncompleted = 0;
+        int nfailed = 0;
+        while (ncompleted < m) {
+            struct io_uring_cqe* cqe = impl.txRing.peekCqe();
+            if (!cqe) {
+                int rc = impl.txRing.submitAndWait(m - ncompleted);
+                if (rc < 0 && rc != -EINTR && rc != -EAGAIN && rc != -EBUSY) {
+                    // no CQE will ever come: fatal, like on the rx ring
+                    MUQUINETD_LOG(fatal) << "Error when submitting to TUN tx "
+                                            "ring: "
+                                         << std::string(strerror(-rc));
+                    muQuinetd::get()->stop();
+                    muQuinetd::get()->exit(muQuinetd::exit_status::FAILURE);
+                    return;
+                }
+                continue;
+            }
+
+            if (cqe->res < 0) {
+                ++nfailed;
+                MUQUINETD_LOG(error) << "Error when Writing to TunDevice: "
+                                     << std::string(strerror(-cqe->res));
+            }
+            impl.txSlots[cqe->user_data].skbuf.reset();
+            impl.txRing.cqeSeen();
+            ++ncompleted;
+        }
+
+        MUQUINETD_LOG(info) << "TunDevice transmited " << m - nfailed
+                            << " packet(s) in one submission";
+
+        skbufs += m;
+        n -= m;
+    }
+}
@@ -0,0 +1,55 @@
+/*
+ * muQuinet, an userspace TCP/IP network stack.
+ * Copyright (C) 2018 rtdarwin
+ *
+ * This program is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+
+ * You should have received a copy of the GNU General Public
+ * License along with this program.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef MUQUINETD_INTERFACE_URINGTUNDEVICE_H
+#define MUQUINETD_INTERFACE_URINGTUNDEVICE_H
+
+#include <memory>
+
+#include "TunDevice.h"
+
+class SocketBufferPtr;
+
+/** TUN device driven by io_uring
+ *
+ *  - rx: a batch of reads is kept posted, each into its own SocketBuffer;
+ *        a completed one is handed up and replaced by a fresh SocketBuffer
+ *  - tx: a whole burst is submitted with a single io_uring_enter()
+ *
+ * Falls back to TunDevice's read()/writev() when io_uring is not available.
+ */
+class UringTunDevice : public TunDevice
+{
+public:
+    UringTunDevice();
+    virtual ~UringTunDevice() override;
+
+    virtual void init() override;
+    virtual SocketBufferPtr rx() override;
+    virtual void tx(SocketBufferPtr skbuf) override;
+    virtual void txBurst(SocketBufferPtr* skbufs, int n) override;
+
+private:
+    void postRead(int slot);
+
+    struct Impl; // pimpl forward declaration
+    std::unique_ptr<Impl> _pImpl;
+};
+
+#endif // MUQUINETD_INTERFACE_URINGTUNDEVICE_H
@@ -0,0 +1,650 @@
+/*
+ * muQuinet, an userspace TCP/IP network stack.
+ * Copyright (C) 2018 rtdarwin
+ *
+ * This program is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+
+ * You should have received a copy of the GNU General Public
+ * License along with this program.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#include "XdpDevice.h"
+
+#include <errno.h>
+#include <linux/bpf.h>
+#include <linux/if_ether.h>
+#include <linux/if_link.h>
+#include <linux/if_xdp.h>
+#include <net/if.h>
+#include <poll.h>
+#include <stddef.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <exception>
+#include <string>
+#include <vector>
+
+#include "muquinetd/Conf.h"
+#include "muquinetd/Logging.h"
+#include "muquinetd/SocketBuffer.h"
+#include "muquinetd/base/CmdRunner.h"
+#include "muquinetd/base/Counters.h"
+#include "muquinetd/base/MutexLock.h"
+#include "muquinetd/link/EthernetLink.h"
+#include "muquinetd/muQuinetd.h"
+#include "third-party/concurrentqueue/concurrentqueue.h"
+
+#ifndef AF_XDP
+#define AF_XDP 44
+#endif
+#ifndef SOL_XDP
+#define SOL_XDP 283
+#endif
+#ifndef SO_PREFER_BUSY_POLL
+#define SO_PREFER_BUSY_POLL 69
+#endif
+#ifndef SO_BUSY_POLL_BUDGET
+#define SO_BUSY_POLL_BUDGET 70
+#endif
+
+using moodycamel::ConcurrentQueue;
+
+namespace {
+
+void
+fatalErrno(const char* what)
+{
+    int errno_ = errno;
+    MUQUINETD_LOG(fatal) << what << ": " << std::string(strerror(errno_));
+    muQuinetd::get()->stop();
+    muQuinetd::get()->exit(muQuinetd::exit_status::FAILURE);
+}
+
+int
+sys_bpf(int cmd, union bpf_attr* attr)
+{
+    return (int)::syscall(__NR_bpf, cmd, attr, sizeof(*attr));
+}
+
+// One of the four single-producer/single-consumer rings shared with the
+// kernel: fill & completion (UMEM frame addresses), rx & tx (xdp_desc)
+struct XskRing
+{
+    __u32* producer = nullptr;
+    __u32* consumer = nullptr;
+    void* descs = nullptr;
+    __u32 size = 0;
+
+    void* map = nullptr;
+    size_t mapSize = 0;
+
+    __u64& addrAt(__u32 idx) { return ((__u64*)descs)[idx & (size - 1)]; }
+    struct xdp_desc& descAt(__u32 idx)
+    {
+        return ((struct xdp_desc*)descs)[idx & (size - 1)];
+    }
+
+    __u32 loadProducer() { return __atomic_load_n(producer, __ATOMIC_ACQUIRE); }
+    __u32 loadConsumer() { return __atomic_load_n(consumer, __ATOMIC_ACQUIRE); }
+    void storeProducer(__u32 v) { __atomic_store_n(producer, v, __ATOMIC_RELEASE); }
+    void storeConsumer(__u32 v) { __atomic_store_n(consumer, v, __ATOMIC_RELEASE); }
+};
+
+void
+mapRing(int fd, XskRing& ring, const struct xdp_ring_offset& off, __u32 size,
+        size_t desc_size, off_t pgoff)
+{
+    ring.mapSize = off.desc + size * desc_size;
+    void* ptr = ::mmap(nullptr, ring.mapSize, PROT_READ | PROT_WRITE,
+                       MAP_SHARED | MAP_POPULATE, fd, pgoff);
+    if (ptr == MAP_FAILED) {
+        fatalErrno("Failed to mmap AF_XDP ring");
+    }
+
+    ring.map = ptr;
+    ring.producer = (__u32*)((char*)ptr + off.producer);
+    ring.consumer = (__u32*)((char*)ptr + off.consumer);
+    ring.descs = (char*)ptr + off.desc;
+    ring.size = size;
+}
+
+// UMEM area carved into frames: the first nRxFrames for rx, the others
+// for tx. Received frames may be held up the stack (e.g. in a receive
+// queue nobody reads) for any time, so tx has frames of its own.
+struct Umem
+{
+    static const int frameSize = 2048;
+    static const int nFrames = 4096;
+    static const int nRxFrames = 3072;
+
+    char* area = nullptr;
+    // Rx frames owned by nobody. Released rx SocketBuffers (any thread)
+    // put their frame back here.
+    ConcurrentQueue<__u64> freeFrames;
+    // Tx frames owned by nobody, with txLock held
+    std::vector<__u64> freeTxFrames;
+};
+
+// SocketBuffers::attach() release hook: the frame goes back to the pool
+void
+umemFrameRelease(void* ctx, char* rawBytes)
+{
+    Umem* umem = (Umem*)ctx;
+    __u64 addr = (rawBytes - umem->area) & ~(__u64)(Umem::frameSize - 1);
+    umem->freeFrames.enqueue(addr);
+}
+
+// queueFrame() gives up (drops the frame) after that many kicks
+const int txWaitRounds = 100;
+
+} // namespace {
+
+struct XdpDevice::Impl
+{
+    static const __u32 ringSize = 2048;
+    static const int fillBatch = 64;
+
+    int ifindex = 0;
+    unsigned char mac[ETH_ALEN];
+    bool busyPoll = false;
+
+    int xskFd = -1;
+    int xskMapFd = -1;
+    int progFd = -1;
+    int linkFd = -1; // closing it detaches the XDP program
+
+    Umem umem;
+
+    XskRing fillRing; // rx thread
+    XskRing rxRing;   // rx thread
+    XskRing txRing;   // with txLock held
+    XskRing compRing; // with txLock held
+    int txQueued = 0;
+    MutexLock txLock; // tx flush thread vs. ARP replies from rx thread
+
+    std::unique_ptr<EthernetLink> link;
+
+    ~Impl();
+};
+
+XdpDevice::Impl::~Impl()
+{
+    if (linkFd >= 0) {
+        ::close(linkFd);
+    }
+    if (progFd >= 0) {
+        ::close(progFd);
+    }
+    if (xskMapFd >= 0) {
+        ::close(xskMapFd);
+    }
+    XskRing* rings[] = { &fillRing, &rxRing, &txRing, &compRing };
+    for (XskRing* ring : rings) {
+        if (ring->map) {
+            ::munmap(ring->map, ring->mapSize);
+        }
+    }
+    if (xskFd >= 0) {
+        ::close(xskFd);
+    }
+    if (umem.area) {
+        ::munmap(umem.area, (size_t)Umem::frameSize * Umem::nFrames);
+    }
+}
+
+XdpDevice::XdpDevice()
+{
+    _pImpl.reset(new XdpDevice::Impl);
+}
+
+XdpDevice::~XdpDevice() = default;
+
+void
+XdpDevice::init()
+{
+    NetDev::init();
+
+    auto& impl = *_pImpl;
+    const char* ifname = Conf::get()->pktdev.ifname.c_str();
+    impl.busyPoll = Conf::get()->pktdev.busy_poll;
+
+    impl.ifindex = if_nametoindex(ifname);
+    if (impl.ifindex == 0) {
+        fatalErrno("Failed to find network interface for AF_XDP device");
+    }
+
+    setIfUp();
+    setupUmem();
+    setupSocket();
+    attachXdpProgram();
+    refillFillRing();
+
+    impl.link.reset(
+        new EthernetLink(impl.mac, [this](SocketBufferPtr frame) {
+            auto& impl = *this->_pImpl;
+            if (impl.txLock.isLockedByThisThread()) {
+                // inside txBurst(), flushed at its end
+                this->queueFrame(std::move(frame));
+            } else {
+                MutexLockGuard l(impl.txLock);
+                this->queueFrame(std::move(frame));
+                this->flushFrames();
+            }
+        }));
+
+    MUQUINETD_LOG(info) << "AF_XDP device on " << ifname
+                        << " is ready {busy poll = " << impl.busyPoll << "}";
+}
+
+void
+XdpDevice::setupUmem()
+{
+    auto& impl = *_pImpl;
+
+    /*  1. UMEM area, all frames free */
+
+    size_t len = (size_t)Umem::frameSize * Umem::nFrames;
+    void* ptr = ::mmap(nullptr, len, PROT_READ | PROT_WRITE,
+                       MAP_PRIVATE | MAP_ANONYMOUS | MAP_POPULATE, -1, 0);
+    if (ptr == MAP_FAILED) {
+        fatalErrno("Failed to allocate AF_XDP UMEM");
+    }
+    impl.umem.area = (char*)ptr;
+
+    for (int i = 0; i < Umem::nRxFrames; ++i) {
+        impl.umem.freeFrames.enqueue((__u64)i * Umem::frameSize);
+    }
+    for (int i = Umem::nRxFrames; i < Umem::nFrames; ++i) {
+        impl.umem.freeTxFrames.push_back((__u64)i * Umem::frameSize);
+    }
+
+    /*  2. register it */
+
+    impl.xskFd = ::socket(AF_XDP, SOCK_RAW, 0);
+    if (impl.xskFd < 0) {
+        fatalErrno("Failed to open AF_XDP socket");
+    }
+
+    struct xdp_umem_reg mr;
+    memset(&mr, 0, sizeof(mr));
+    mr.addr = (__u64)impl.umem.area;
+    mr.len = len;
+    mr.chunk_size = Umem::frameSize;
+    mr.headroom = 0;
+    if (setsockopt(impl.xskFd, SOL_XDP, XDP_UMEM_REG, &mr, sizeof(mr)) < 0) {
+        fatalErrno("Failed to register AF_XDP UMEM");
+    }
+}
+
+void
+XdpDevice::setupSocket()
+{
+    auto& impl = *_pImpl;
+    int fd = impl.xskFd;
+
+    /*  1. rings */
+
+    __u32 size = Impl::ringSize;
+    if (setsockopt(fd, SOL_XDP, XDP_UMEM_FILL_RING, &size, sizeof(size)) < 0 ||
+        setsockopt(fd, SOL_XDP, XDP_UMEM_COMPLETION_RING, &size,
+                   sizeof(size)) < 0 ||
+        setsockopt(fd, SOL_XDP, XDP_RX_RING, &size, sizeof(size)) < 0 ||
+        setsockopt(fd, SOL_XDP, XDP_TX_RING, &size, sizeof(size)) < 0) {
+        fatalErrno("Failed to set up AF_XDP rings");
+    }
+
+    struct xdp_mmap_offsets off;
+    socklen_t optlen = sizeof(off);
+    if (getsockopt(fd, SOL_XDP, XDP_MMAP_OFFSETS, &off, &optlen) < 0) {
+        fatalErrno("Failed to get AF_XDP ring offsets");
+    }
+
+    mapRing(fd, impl.fillRing, off.fr, size, sizeof(__u64),
+            XDP_UMEM_PGOFF_FILL_RING);
+    mapRing(fd, impl.compRing, off.cr, size, sizeof(__u64),
+            XDP_UMEM_PGOFF_COMPLETION_RING);
+    mapRing(fd, impl.rxRing, off.rx, size, sizeof(struct xdp_desc),
+            XDP_PGOFF_RX_RING);
+    mapRing(fd, impl.txRing, off.tx, size, sizeof(struct xdp_desc),
+            XDP_PGOFF_TX_RING);
+
+    /*  2. busy poll (Linux 5.11+), optional */
+
+    if (impl.busyPoll) {
+        int one = 1, usecs = 20, budget = Impl::fillBatch;
+        if (setsockopt(fd, SOL_SOCKET, SO_PREFER_BUSY_POLL, &one,
+                       sizeof(one)) < 0 ||
+            setsockopt(fd, SOL_SOCKET, SO_BUSY_POLL, &usecs, sizeof(usecs)) <
+                0 ||
+            setsockopt(fd, SOL_SOCKET, SO_BUSY_POLL_BUDGET, &budget,
+                       sizeof(budget)) < 0) {
+            MUQUINETD_LOG(warning) << "AF_XDP busy poll is not available";
+        }
+    }
+
+    /*  3. bind to queue 0, copy mode (generic XDP) */
+
+    struct sockaddr_xdp sxdp;
+    memset(&sxdp, 0, sizeof(sxdp));
+    sxdp.sxdp_family = AF_XDP;
+    sxdp.sxdp_flags = XDP_COPY;
+    sxdp.sxdp_ifindex = impl.ifindex;
+    sxdp.sxdp_queue_id = 0;
+    if (bind(fd, (struct sockaddr*)&sxdp, sizeof(sxdp)) < 0) {
+        fatalErrno("Failed to bind AF_XDP socket");
+    }
+
+    /*  4. MAC address */
+
+    struct ifreq ifr;
+    memset(&ifr, 0, sizeof(ifr));
+    strncpy(ifr.ifr_name, Conf::get()->pktdev.ifname.c_str(), IFNAMSIZ - 1);
+    int sockfd = ::socket(AF_INET, SOCK_DGRAM, 0);
+    if (sockfd < 0 || ioctl(sockfd, SIOCGIFHWADDR, &ifr) < 0) {
+        fatalErrno("Failed to get MAC address for AF_XDP device");
+    }
+    ::close(sockfd);
+    memcpy(impl.mac, ifr.ifr_hwaddr.sa_data, ETH_ALEN);
+}
+
+void
+XdpDevice::attachXdpProgram()
+{
+    auto& impl = *_pImpl;
+    union bpf_attr attr;
+
+    /*  1. XSKMAP { queue 0 -> our socket } */
+
+    memset(&attr, 0, sizeof(attr));
+    attr.map_type = BPF_MAP_TYPE_XSKMAP;
+    attr.key_size = sizeof(__u32);
+    attr.value_size = sizeof(int);
+    attr.max_entries = 1;
+    impl.xskMapFd = sys_bpf(BPF_MAP_CREATE, &attr);
+    if (impl.xskMapFd < 0) {
+        fatalErrno("Failed to create XSKMAP");
+    }
+
+    __u32 key = 0;
+    int value = impl.xskFd;
+    memset(&attr, 0, sizeof(attr));
+    attr.map_fd = impl.xskMapFd;
+    attr.key = (__u64)&key;
+    attr.value = (__u64)&value;
+    if (sys_bpf(BPF_MAP_UPDATE_ELEM, &attr) < 0) {
+        fatalErrno("Failed to put AF_XDP socket into XSKMAP");
+    }
+
+    /*  2. the program:
+     *
+     *      return bpf_redirect_map(&xskmap, ctx->rx_queue_index, XDP_PASS);
+     *
+     *  Packets of other queues (none on veth) go on to the kernel stack.
+     */
+
+    // clang-format off
+    struct bpf_insn insns[] = {
+        // r2 = ctx->rx_queue_index
+        { BPF_LDX | BPF_MEM | BPF_W, BPF_REG_2, BPF_REG_1,
+          offsetof(struct xdp_md, rx_queue_index), 0 },
+        // r1 = &xskmap (ld_imm64, 2 insns)
+        { BPF_LD | BPF_DW | BPF_IMM, BPF_REG_1, BPF_PSEUDO_MAP_FD, 0,
+          impl.xskMapFd },
+        { 0, 0, 0, 0, 0 },
+        // r3 = XDP_PASS
+        { BPF_ALU64 | BPF_MOV | BPF_K, BPF_REG_3, 0, 0, XDP_PASS },
+        // r0 = bpf_redirect_map(r1, r2, r3)
+        { BPF_JMP | BPF_CALL, 0, 0, 0, BPF_FUNC_redirect_map },
+        { BPF_JMP | BPF_EXIT, 0, 0, 0, 0 },
+    };
+    // clang-format on
+    static const char license[] = "GPL";
+
+    memset(&attr, 0, sizeof(attr));
+    attr.prog_type = BPF_PROG_TYPE_XDP;
+    attr.insns = (__u64)insns;
+    attr.insn_cnt = sizeof(insns) / sizeof(insns[0]);
+    attr.license = (__u64)license;
+    impl.progFd = sys_bpf(BPF_PROG_LOAD, &attr);
+    if (impl.progFd < 0) {
+        fatalErrno("Failed to load XDP program");
+    }
+
+    /*  3. attach in generic (SKB) mode (Linux 5.9+ bpf_link) */
+
+    memset(&attr, 0, sizeof(attr));
+    attr.link_create.prog_fd = impl.progFd;
+    attr.link_create.target_ifindex = impl.ifindex;
+    attr.link_create.attach_type = BPF_XDP;
+    attr.link_create.flags = XDP_FLAGS_SKB_MODE;
+    impl.linkFd = sys_bpf(BPF_LINK_CREATE, &attr);
+    if (impl.linkFd < 0) {
+        fatalErrno("Failed to attach XDP program");
+    }
+}
+
+void
+XdpDevice::setIfUp()
+{
+    try {
+        CmdRunner r("ip link set dev %s up", Conf::get()->pktdev.ifname.c_str());
+        r.run();
+    } catch (std::exception& e) {
+        MUQUINETD_LOG(fatal)
+            << "Failed to set AF_XDP device up: " << std::string(e.what());
+        muQuinetd::get()->stop();
+        muQuinetd::get()->exit(muQuinetd::exit_status::FAILURE);
+    }
+}
+
+void
+XdpDevice::refillFillRing()
+{
+    auto& impl = *_pImpl;
+    XskRing& ring = impl.fillRing;
+
+    __u32 prod = *ring.producer;
+    __u32 room = ring.size - (prod - ring.loadConsumer());
+    if (room < (__u32)Impl::fillBatch) {
+        return; // not worth it yet
+    }
+
+    __u64 addrs[Impl::fillBatch];
+    size_t n = impl.umem.freeFrames.try_dequeue_bulk(addrs, Impl::fillBatch);
+    for (size_t i = 0; i < n; ++i) {
+        ring.addrAt(prod + i) = addrs[i];
+    }
+    ring.storeProducer(prod + n);
+}
+
+SocketBufferPtr
+XdpDevice::rx()
+{
+    auto& impl = *_pImpl;
+    XskRing& ring = impl.rxRing;
+
+    for (;;) {
+        /*  1. keep the kernel supplied with free frames */
+
+        refillFillRing();
+
+        /*  2. wait for a frame */
+
+        __u32 cons = *ring.consumer;
+        if (cons == ring.loadProducer()) {
+            if (impl.busyPoll) {
+                // drives NAPI busy polling, returns at once
+                ::recvfrom(impl.xskFd, nullptr, 0, MSG_DONTWAIT, nullptr,
+                           nullptr);
+            } else {
+                struct pollfd pfd;
+                pfd.fd = impl.xskFd;
+                pfd.events = POLLIN;
+                pfd.revents = 0;
+                if (poll(&pfd, 1, -1) < 0 && errno != EINTR) {
+                    fatalErrno("Error when polling AF_XDP socket");
+                }
+            }
+            continue;
+        }
+
+        /*  3. hand it up in place */
+
+        struct xdp_desc desc = ring.descAt(cons);
+        ring.storeConsumer(cons + 1);
+
+        SocketBufferPtr frame = SocketBuffers::attach(
+            impl.umem.area + desc.addr, desc.len, umemFrameRelease, &impl.umem);
+        frame->hdrs_begin = frame->rawBytes;
+        frame->user_payload_end = frame->rawBytes + desc.len;
+
+        SocketBufferPtr skbuf = impl.link->input(std::move(frame));
+        if (skbuf) {
+            MUQUINETD_LOG(info) << "AF_XDP device received a packet";
+            return skbuf;
+        }
+    }
+}
+
+void
+XdpDevice::tx(SocketBufferPtr skbuf)
+{
+    this->txBurst(&skbuf, 1);
+}
+
+void
+XdpDevice::txBurst(SocketBufferPtr* skbufs, int n)
+{
+    MutexLockGuard l(_pImpl->txLock);
+
+    for (int i = 0; i < n; ++i) {
+        _pImpl->link->output(std::move(skbufs[i]));
+    }
+    this->flushFrames();
+}
+
+void
+XdpDevice::reclaimCompletions()
+{
+    auto& impl = *_pImpl;
+    XskRing& ring = impl.compRing;
+
+    __u32 cons = *ring.consumer;
+    __u32 prod = ring.loadProducer();
+    for (; cons != prod; ++cons) {
+        impl.umem.freeTxFrames.push_back(ring.addrAt(cons));
+    }
+    ring.storeConsumer(cons);
+}
+
+void
+XdpDevice::queueFrame(SocketBufferPtr frame)
+{
+    auto& impl = *_pImpl;
+    XskRing& ring = impl.txRing;
+
+    /*  1. a free tx frame and a free tx ring slot, or drop it */
+
+    auto& freeTxFrames = impl.umem.freeTxFrames;
+    __u32 prod = *ring.producer;
+    for (int round = 0;; ++round) {
+        reclaimCompletions();
+        if (prod - ring.loadConsumer() < ring.size && !freeTxFrames.empty()) {
+            break;
+        }
+        if (round == txWaitRounds) {
+            MUQUINETD_LOG(warning) << "AF_XDP tx ring full, frame dropped";
+            Counters::add(Counters::IF_TX_DROP_NO_ROOM);
+            return;
+        }
+        // kick the kernel to send (and complete) what is queued
+        this->flushFrames();
+        usleep(10);
+    }
+    __u64 addr = freeTxFrames.back();
+    freeTxFrames.pop_back();
+
+    /*  2. copy the frame in */
+
+    char* data = impl.umem.area + addr;
+    char* p = data;
+
+    SocketBuffer* curr_skbuf;
+    for (curr_skbuf = frame.get(); curr_skbuf;
+         curr_skbuf = curr_skbuf->next.get()) {
+        int hdrs_len = curr_skbuf->hdrs_end - curr_skbuf->hdrs_begin;
+        int payload_len =
+            curr_skbuf->user_payload_end - curr_skbuf->user_payload_begin;
+        if (p + hdrs_len + payload_len > data + Umem::frameSize) {
+            MUQUINETD_LOG(error) << "Frame too large for AF_XDP UMEM frame";
+            freeTxFrames.push_back(addr);
+            return;
+        }
+        memcpy(p, curr_skbuf->hdrs_begin, hdrs_len);
+        p += hdrs_len;
+        memcpy(p, curr_skbuf->user_payload_begin, payload_len);
+        p += payload_len;
+    }
+
+    struct xdp_desc& desc = ring.descAt(prod);
+    desc.addr = addr;
+    desc.len = p - data;
+    desc.options = 0;
+    ring.storeProducer(prod + 1);
+    ++impl.txQueued;
+}
+
+void
+XdpDevice::flushFrames()
+{
+    auto& impl = *_pImpl;
+    if (impl.txQueued == 0) {
+        return;
+    }
+
+    // Copy mode always needs a kick
+    if (::sendto(impl.xskFd, nullptr, 0, MSG_DONTWAIT, nullptr, 0) < 0 &&
+        errno != EAGAIN && errno != EBUSY && errno != ENOBUFS) {
+        int errno_ = errno;
+        MUQUINETD_LOG(error) << "Error when kicking AF_XDP tx ring: "
+                             << std::string(strerror(errno_));
+    } else {
+        MUQUINETD_LOG(info) << "AF_XDP device transmited " << impl.txQueued
+                            << " frame(s)";
+    }
+    impl.txQueued = 0;
+    reclaimCompletions();
+}
+
+int
+XdpDevice::mtu()
+{
+    return std::min(NetDev::mtu(), Umem::frameSize - ETH_HLEN);
+}
+
+void
+XdpDevice::close()
+{
+    // UMEM stays mapped until destruction, received frames may still be
+    // referenced up the stack. Detach the XDP program first.
+    auto& impl = *_pImpl;
+    if (impl.linkFd >= 0) {
+        ::close(impl.linkFd);
+        impl.linkFd = -1;
+    }
+}
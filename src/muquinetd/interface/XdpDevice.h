@@ -0,0 +1,77 @@
+/*
+ * muQuinet, an userspace TCP/IP network stack.
+ * Copyright (C) 2018 rtdarwin
+ *
+ * This program is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+
+ * You should have received a copy of the GNU General Public
+ * License along with this program.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef MUQUINETD_INTERFACE_XDPDEVICE_H
+#define MUQUINETD_INTERFACE_XDPDEVICE_H
+
+#include <memory>
+
+#include "NetDev.h"
+
+class SocketBufferPtr;
+
+/** AF_XDP socket on an existing Ethernet interface (e.g. veth)
+ *
+ * A UMEM region is carved into fixed-size frames:
+ *  - rx: free frames are posted on the fill ring; a received frame is
+ *        handed up in place as a SocketBuffer (zero-copy), and goes back
+ *        to the free frames when released
+ *  - tx: a frame is copied into a free frame of a separate tx pool and
+ *        put on the tx ring; the completion ring gives it back. When
+ *        none frees up within a bounded wait the frame is dropped
+ *        (counted as interface.tx_drop_no_room)
+ *
+ * A tiny XDP program, redirecting every packet of queue 0 to the socket,
+ * is loaded with the raw bpf() syscall and attached in generic (SKB)
+ * mode, so that it runs on any driver, veth included.
+ *
+ * Ethernet framing and ARP are done by an EthernetLink.
+ */
+class XdpDevice : public NetDev
+{
+public:
+    XdpDevice();
+    virtual ~XdpDevice() override;
+
+    virtual void init() override;
+    virtual SocketBufferPtr rx() override;
+    virtual void tx(SocketBufferPtr skbuf) override;
+    virtual void txBurst(SocketBufferPtr* skbufs, int n) override;
+    virtual void close() override;
+    // no more than a UMEM frame holds
+    virtual int mtu() override;
+
+private:
+    void setupUmem();
+    void setupSocket();
+    void attachXdpProgram();
+    void setIfUp();
+
+    void refillFillRing();
+    void reclaimCompletions();
+
+    // For EthernetLink use, with tx lock held
+    void queueFrame(SocketBufferPtr frame);
+    void flushFrames();
+
+    struct Impl; // pimpl forward declaration
+    std::unique_ptr<Impl> _pImpl;
+};
+
+#endif // MUQUINETD_INTERFACE_XDPDEVICE_H
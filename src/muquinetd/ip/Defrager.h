@@ -35,7 +35,9 @@ public:
     Defrager& operator=(const Defrager&) = delete;
     Defrager& operator=(Defrager&&) = delete;
 
-    std::shared_ptr<SocketBuffer> defrag(const std::shared_ptr<SocketBuffer>&);
+    // Take a fragment, return the reassembled packet once all fragments
+    // arrived, or an empty SocketBufferPtr
+    SocketBufferPtr defrag(SocketBufferPtr);
 
 private:
     struct Impl;
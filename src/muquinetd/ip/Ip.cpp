@@ -22,26 +22,28 @@
 #include <arpa/inet.h>
 #include <boost/thread/thread.hpp>
 #include <memory>
+#include <string.h>
 
 #include "muquinetd/Interface.h"
 #include "muquinetd/Logging.h"
+#include "muquinetd/SocketBuffer.h"
 // #include "muquinetd/base/ConcurrentDeque.h"
 #include "muquinetd/Tcp.h"
 #include "muquinetd/Udp.h"
+#include "muquinetd/base/Counters.h"
 #include "muquinetd/base/InternetChecksum.h"
+#include "muquinetd/base/Trace.h"
 #include "muquinetd/ip/Defrager.h"
 #include "muquinetd/ip/IpHeader.h"
 #include "third-party/concurrentqueue/blockingconcurrentqueue.h"
 
 using std::unique_ptr;
-using std::make_shared;
-using std::shared_ptr;
 using boost::thread;
 using moodycamel::BlockingConcurrentQueue;
 
 struct Ip::Impl
 {
-    BlockingConcurrentQueue<shared_ptr<SocketBuffer>> rxQ;
+    BlockingConcurrentQueue<SocketBufferPtr> rxQ;
     static const int qSizeLimit = 2048;
     bool stopflag = false;
 
@@ -77,7 +79,7 @@ Ip::start()
         char daddr_p[INET_ADDRSTRLEN + 1] = { 0 };
 
         MUQUINETD_LOG(info) << "IP Layer rx_loop_thread begins to work";
-        shared_ptr<SocketBuffer> skbuf;
+        SocketBufferPtr skbuf;
         IpHeader* iphdr = nullptr;
         while (!this->_pImpl->stopflag) {
             _pImpl->rxQ.wait_dequeue(skbuf);
@@ -85,6 +87,9 @@ Ip::start()
             if (!skbuf)
                 continue;
 
+            Counters::add(Counters::IP_RXQ_DEPTH, -1);
+            Counters::add(Counters::IP_RX_PACKETS);
+
             {
                 MUQUINETD_LOG(info) << "IP Layer take a packet from IP rxQ";
             }
@@ -94,16 +99,16 @@ Ip::start()
 
             /*  1. checksum */
 
+            iphdr = (IpHeader*)skbuf->network_hdr;
             if (skbuf->user_payload_end - skbuf->hdrs_begin < 20 ||
                 !IpHeaders::checksum(iphdr)) {
-                // FIXME: drop this packet
+                Counters::add(Counters::IP_RX_DROP_BAD_HEADER);
+                skbuf.reset();
                 continue;
             }
 
             /*  2. defrag */
 
-            iphdr = (IpHeader*)skbuf->network_hdr;
-
             {
                 inet_ntop(AF_INET, (void*)&iphdr->saddr, saddr_p,
                           INET_ADDRSTRLEN);
@@ -121,7 +126,10 @@ Ip::start()
                         << "New IP packet is a fragment, we will defrag it. "
                         << "{frag offset(8n) = 8*" << off << "}";
                 }
-                skbuf = _pImpl->defrager->defrag(skbuf);
+                Counters::add(Counters::IP_RX_FRAGMENTS);
+                skbuf = _pImpl->defrager->defrag(std::move(skbuf));
+                if (skbuf)
+                    Counters::add(Counters::IP_RX_REASSEMBLED);
             }
 
             /*  3. demultiplex */
@@ -129,6 +137,7 @@ Ip::start()
             if (!skbuf)
                 continue;
 
+            iphdr = (IpHeader*)skbuf->network_hdr;
             int trans_hdr_offset = iphdr->ihl * 4;
             skbuf->transport_hdr = skbuf->network_hdr + trans_hdr_offset;
 
@@ -147,12 +156,12 @@ Ip::start()
                 case ProtoX::UDP:
                     MUQUINETD_LOG(info) << "New IP packet is a UDP packet, "
                                            "passing it to UDP Layer...";
-                    Udp::get()->rx(skbuf);
+                    Udp::get()->rx(std::move(skbuf));
                     break;
                 case ProtoX::TCP:
                     MUQUINETD_LOG(info) << "New IP packet is a TCP packet, "
                                            "passing it to TCP Layer...";
-                    Tcp::get()->rx(skbuf);
+                    Tcp::get()->rx(std::move(skbuf));
                     break;
             }
 
@@ -171,25 +180,46 @@ Ip::stop()
 }
 
 void
-Ip::enRxQue(const std::shared_ptr<SocketBuffer>& skbuf)
+Ip::enRxQue(SocketBufferPtr skbuf)
 {
     IpHeader* iphdr = (IpHeader*)skbuf->network_hdr;
     if (iphdr->version != 4) {
         MUQUINETD_LOG(warning) << "IPv6 not implemented!";
+        Counters::add(Counters::IP_RX_DROP_NOT_IPV4);
         return;
     }
 
-    _pImpl->rxQ.enqueue(skbuf);
+    Trace::record(Trace::IP_ENRXQ, skbuf.get(), __be16_to_cpu(iphdr->tot_len));
+    _pImpl->rxQ.enqueue(std::move(skbuf));
+    Counters::add(Counters::IP_RXQ_DEPTH);
     MUQUINETD_LOG(info) << "Ip Layer received a packet, put it into rxQ";
     MUQUINETD_LOG(debug) << "Ip rxQue size = " << _pImpl->rxQ.size_approx();
 }
 
 void
-Ip::tx(const std::shared_ptr<SocketBuffer>& skbuf_head,
-       const std::string& user_payload)
+Ip::tx(SocketBufferPtr skbuf_head, const std::string& user_payload)
 {
     assert(skbuf_head->hdrs_begin && skbuf_head->hdrs_end);
 
+    // Interface 层异步发送，user_payload 在此之后可能已被释放，
+    // 所以拷贝到 SocketBuffer 的 tailroom 中
+    assert(skbuf_head->tailroom() >= (int)user_payload.length());
+    skbuf_head->user_payload_begin = skbuf_head->hdrs_end;
+    skbuf_head->user_payload_end =
+        skbuf_head->user_payload_begin + user_payload.length();
+    memcpy(skbuf_head->user_payload_begin, user_payload.data(),
+           user_payload.length());
+
+    tx(std::move(skbuf_head));
+}
+
+void
+Ip::tx(SocketBufferPtr skbuf_head)
+{
+    assert(skbuf_head->hdrs_begin && skbuf_head->hdrs_end);
+    int payload_len =
+        skbuf_head->user_payload_end - skbuf_head->user_payload_begin;
+
     /*  options */
     // TODO
 
@@ -201,14 +231,14 @@ Ip::tx(const std::shared_ptr<SocketBuffer>& skbuf_head,
     iphdr->id = _pImpl->idgenerator->next();
     iphdr->check = InternetChecksum::checksum(iphdr, iphdr->ihl * 4, 0);
 
-    skbuf_head->user_payload_begin = (char*)user_payload.c_str();
-    skbuf_head->user_payload_end =
-        (char*)user_payload.c_str() + user_payload.length();
-
     /*  后续 SocketBuffer（分片） */
     // TODO
 
     MUQUINETD_LOG(info) << "Fraging (if needed) finished, passing packet(s) to "
                            "Interface Layer...";
-    Interface::get()->tx(skbuf_head);
+    Counters::add(Counters::IP_TX_PACKETS);
+    Counters::add(Counters::IP_TX_BYTES,
+                  (skbuf_head->hdrs_end - skbuf_head->hdrs_begin) +
+                      payload_len);
+    Interface::get()->tx(std::move(skbuf_head));
 }
@@ -23,9 +23,8 @@
 #include <asm/byteorder.h>
 #include <cstdint>
 #include <ev.h>
-#include <memory>
 
-class SocketBuffer;
+#include "muquinetd/SocketBuffer.h"
 
 struct DefragContext
 {
@@ -37,8 +36,7 @@ struct DefragContext
     __be32 ip_saddr;
     __be32 ip_daddr;
 
-    std::shared_ptr<SocketBuffer> first;
-    // std::shared_ptr<SocketBuffer> last;
+    SocketBufferPtr first;
 };
 
 #endif // MUQUINETD_IP_DEFRAG_DEFRAGCONTEXT_H
@@ -25,11 +25,12 @@
 
 #include "muquinetd/Logging.h"
 #include "muquinetd/SocketBuffer.h"
+#include "muquinetd/base/Counters.h"
 #include "muquinetd/base/MutexLock.h"
+#include "muquinetd/base/Trace.h"
 #include "muquinetd/ip/IpHeader.h"
 #include "muquinetd/ip/frag/DefragContext.h"
 
-using std::shared_ptr;
 using std::unique_ptr;
 
 namespace {
@@ -54,6 +55,7 @@ timeout_cb(EV_P_ ev_timer* w, int /* unused */ revents)
     //  由于 timeout 与 分片到齐 的情况可能并发的发生，到这个地方的时候，
     //  ctx 可能刚好从列表中移除，所以这时我们不能假定 ctx 一定还存在于列表中
     DefragContext* ctx = (DefragContext*)(w - offsetof(DefragContext, timer));
+    size_t before = ctxList->size();
     ctxList->remove_if([ctx](const DefragContext& cToPred) {
         if (&cToPred == ctx) {
             return true;
@@ -61,6 +63,8 @@ timeout_cb(EV_P_ ev_timer* w, int /* unused */ revents)
             return false;
         }
     });
+    Counters::add(Counters::IP_DEFRAG_BACKLOG,
+                  (int64_t)ctxList->size() - (int64_t)before);
 }
 } // namespace {
 
@@ -79,14 +83,16 @@ Defrager::Defrager()
 
 Defrager::~Defrager() = default;
 
-shared_ptr<SocketBuffer>
-Defrager::defrag(const std::shared_ptr<SocketBuffer>& skbuf)
+SocketBufferPtr
+Defrager::defrag(SocketBufferPtr skbuf)
 {
     MUQUINETD_LOG(info) << "defragging";
 
-    shared_ptr<SocketBuffer> packet;
+    SocketBufferPtr packet;
     DefragContext* ctx = nullptr;
     IpHeader* iphdr = (IpHeader*)skbuf->network_hdr;
+    const SocketBuffer* traced = skbuf.get();
+    uint32_t tracedFragOff = __be16_to_cpu(iphdr->frag_off);
 
     MutexLockGuard l(_pImpl->lock);
 
@@ -106,6 +112,7 @@ Defrager::defrag(const std::shared_ptr<SocketBuffer>& skbuf)
         MUQUINETD_LOG(debug) << "Add one DefragContext to DefragContextList";
         _pImpl->defragCtxList.emplace_back();
         ctx = &_pImpl->defragCtxList.back();
+        Counters::add(Counters::IP_DEFRAG_BACKLOG);
 
         ctx->ip_id = iphdr->id;
         ctx->ip_protocol = iphdr->protocol;
@@ -121,43 +128,33 @@ Defrager::defrag(const std::shared_ptr<SocketBuffer>& skbuf)
     /*  3. 插入到分组中 */
 
     // clang-format off
-    if (!ctx->first
-        || ( __be16_to_cpu(((IpHeader*)ctx->first->network_hdr)->frag_off)
-             & IP_OFF_MASK )
-           > ( __be16_to_cpu(iphdr->frag_off) & IP_OFF_MASK))
     {
-        skbuf->next = ctx->first;
-        ctx->first = skbuf;
-    }
-    else
-    {
-        shared_ptr<SocketBuffer> prev;
-        shared_ptr<SocketBuffer> curr = ctx->first;
+        int ours_off = __be16_to_cpu(iphdr->frag_off) & IP_OFF_MASK;
 
-        int ours_off = iphdr->frag_off & IP_OFF_MASK;
-        while (curr &&
-               ours_off > (__be16_to_cpu(((IpHeader*)curr->network_hdr)->frag_off)
+        // 找到第一个片偏移不小于我们的分片，插到它前面
+        SocketBufferPtr* link = &ctx->first;
+        while (*link &&
+               ours_off > (__be16_to_cpu(((IpHeader*)(*link)->network_hdr)->frag_off)
                            & IP_OFF_MASK)) {
-            prev = curr;
-            curr = curr->next;
+            link = &(*link)->next;
         }
 
-        prev->next = skbuf;
-        skbuf->next = curr;
+        skbuf->next = std::move(*link);
+        *link = std::move(skbuf);
     }
     // clang-format on
 
     /*  4. 分组的分片齐了吗？
      */
 
-    shared_ptr<SocketBuffer> curr = ctx->first;
+    SocketBuffer* curr = ctx->first.get();
     iphdr = nullptr;
     __le16 frag_off;
     int expectedOff = 0;
     __le16 payloadlen = 0;
 
     // 判断 第一个分片到最后一个分片 每个分片中的片偏移是否连续
-    for (curr = ctx->first; curr; curr = curr->next) {
+    for (curr = ctx->first.get(); curr; curr = curr->next.get()) {
         iphdr = (IpHeader*)curr->network_hdr;
         int currOff = (__be16_to_cpu((iphdr->frag_off)) & IP_OFF_MASK) * 8;
         if (currOff != expectedOff)
@@ -167,7 +164,7 @@ Defrager::defrag(const std::shared_ptr<SocketBuffer>& skbuf)
     }
 
     // 判断 最后一个分片 MF 是否为 0
-    for (curr = ctx->first; curr->next; curr = curr->next)
+    for (curr = ctx->first.get(); curr->next; curr = curr->next.get())
         ;
     iphdr = (IpHeader*)curr->network_hdr;
     frag_off = __be16_to_cpu(iphdr->frag_off);
@@ -184,16 +181,16 @@ Defrager::defrag(const std::shared_ptr<SocketBuffer>& skbuf)
     /*  5. 重装分组 后 删除重装上下文 */
 
     // 调整第一个分片
-    packet = ctx->first;
+    packet = std::move(ctx->first);
     iphdr = (IpHeader*)packet->network_hdr;
     iphdr->tot_len = __cpu_to_be16(payloadlen + iphdr->ihl * 4);
 
     // 调整后续的分片
-    for (curr = ctx->first->next; curr; curr = curr->next) {
+    for (curr = packet->next.get(); curr; curr = curr->next.get()) {
         iphdr = (IpHeader*)curr->network_hdr;
-        int iphdrlen = iphdr->ihl;
+        int iphdrlen = iphdr->ihl * 4;
+        curr->user_payload_begin = curr->network_hdr + iphdrlen;
         curr->network_hdr = nullptr;
-        curr->user_payload_begin = curr->rawBytes + iphdrlen;
     }
 
     {
@@ -202,6 +199,11 @@ Defrager::defrag(const std::shared_ptr<SocketBuffer>& skbuf)
             << payloadlen << "}";
     }
 
+    {
+        // 分组已重装，超时定时器不再需要（ctx 马上被销毁）
+        struct ev_loop* loop = EV_DEFAULT;
+        ev_timer_stop(EV_A_ & ctx->timer);
+    }
     ctxList->remove_if([ctx](const DefragContext& cToPred) {
         if (&cToPred == ctx) {
             MUQUINETD_LOG(debug)
@@ -211,9 +213,15 @@ Defrager::defrag(const std::shared_ptr<SocketBuffer>& skbuf)
             return false;
         }
     });
+    Counters::add(Counters::IP_DEFRAG_BACKLOG, -1);
 
 packet_not_ready:
 
+    Trace::record(Trace::IP_DEFRAG, traced,
+                  (tracedFragOff & IP_OFF_MASK) |
+                      (tracedFragOff & IP_MF_MASK ? 1 << 16 : 0),
+                  packet ? 1 : 0);
+
     MUQUINETD_LOG(debug) << "DefragContextList.size = "
                          << _pImpl->defragCtxList.size();
 
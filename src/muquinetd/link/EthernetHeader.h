@@ -0,0 +1,40 @@
+/*
+ * muQuinet, an userspace TCP/IP network stack.
+ * Copyright (C) 2018 rtdarwin
+ *
+ * This program is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+
+ * You should have received a copy of the GNU General Public
+ * License along with this program.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef MUQUINETD_LINK_ETHERNETHEADER_H
+#define MUQUINETD_LINK_ETHERNETHEADER_H
+
+#include <cstdint>
+
+// Let's just steal from linux
+#include <linux/if_arp.h>   // for arphdr, ARPOP_*
+#include <linux/if_ether.h> // for ethhdr, ETH_*
+using EthernetHeader = ::ethhdr;
+
+// ARP for IPv4 over Ethernet (RFC 826)
+struct ArpHeader
+{
+    struct arphdr hdr;
+    unsigned char ar_sha[ETH_ALEN]; // sender hardware address
+    __be32 ar_sip;                  // sender IP address
+    unsigned char ar_tha[ETH_ALEN]; // target hardware address
+    __be32 ar_tip;                  // target IP address
+} __attribute__((packed));
+
+#endif // MUQUINETD_LINK_ETHERNETHEADER_H
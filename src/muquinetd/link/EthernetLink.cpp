@@ -0,0 +1,318 @@
+/*
+ * muQuinet, an userspace TCP/IP network stack.
+ * Copyright (C) 2018 rtdarwin
+ *
+ * This program is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+
+ * You should have received a copy of the GNU General Public
+ * License along with this program.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#include "muquinetd/link/EthernetLink.h"
+
+#include <arpa/inet.h>
+#include <assert.h>
+#include <string.h>
+#include <time.h>
+
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "muquinetd/Conf.h"
+#include "muquinetd/Logging.h"
+#include "muquinetd/SocketBuffer.h"
+#include "muquinetd/base/MutexLock.h"
+#include "muquinetd/ip/IpHeader.h"
+#include "muquinetd/link/EthernetHeader.h"
+
+namespace {
+
+const unsigned char broadcastMac[ETH_ALEN] = { 0xff, 0xff, 0xff,
+                                               0xff, 0xff, 0xff };
+
+// ARP cache entry
+struct MacAddr
+{
+    unsigned char bytes[ETH_ALEN];
+    time_t updated = 0; // last reply (or request) from it
+    time_t lastRequest = 0;
+    int requests = 0; // unanswered since it went stale
+};
+
+// Packets waiting for an ARP reply
+struct ArpPending
+{
+    std::vector<SocketBufferPtr> packets;
+    time_t lastRequest = 0;
+    int requests = 0;
+};
+
+// An entry is used as is for arpCacheTtl seconds, then while refreshing
+// it. Both the refresh and a resolution give up after maxArpRequests
+// unanswered requests, one per second: the entry goes, the packets
+// waiting are dropped.
+const time_t arpCacheTtl = 60;
+const int maxArpRequests = 3;
+
+} // namespace {
+
+struct EthernetLink::Impl
+{
+    unsigned char mac[ETH_ALEN];
+    __be32 ipaddr;
+    XmitFn xmit;
+
+    MutexLock lock; // guards arpCache & arpPending
+    std::unordered_map<__be32, MacAddr> arpCache;
+    std::unordered_map<__be32, ArpPending> arpPending;
+    static const int maxPendingPerHop = 16;
+    time_t lastExpiry = 0;
+
+public:
+    // with lock held, at most once a second
+    void expirePending(time_t now);
+    void arpInput(SocketBufferPtr frame);
+    void arpSend(__u16 op, const unsigned char* tha, __be32 tip);
+    void pushEthernetHeader(const SocketBufferPtr& skbuf,
+                            const unsigned char* dest);
+};
+
+EthernetLink::EthernetLink(const unsigned char* mac, const XmitFn& xmit)
+{
+    _pImpl.reset(new EthernetLink::Impl);
+    memcpy(_pImpl->mac, mac, ETH_ALEN);
+    inet_pton(AF_INET, Conf::get()->stack.addr.c_str(), &_pImpl->ipaddr);
+    _pImpl->xmit = xmit;
+}
+
+EthernetLink::~EthernetLink() = default;
+
+SocketBufferPtr
+EthernetLink::input(SocketBufferPtr frame)
+{
+    if (frame->user_payload_end - frame->hdrs_begin < ETH_HLEN) {
+        return SocketBufferPtr();
+    }
+
+    EthernetHeader* ethhdr = (EthernetHeader*)frame->hdrs_begin;
+    if (memcmp(ethhdr->h_dest, _pImpl->mac, ETH_ALEN) != 0 &&
+        memcmp(ethhdr->h_dest, broadcastMac, ETH_ALEN) != 0) {
+        return SocketBufferPtr(); // not for us
+    }
+
+    switch (ntohs(ethhdr->h_proto)) {
+        case ETH_P_IP: {
+            frame->network_hdr = frame->hdrs_begin + ETH_HLEN;
+            frame->hdrs_begin = frame->network_hdr;
+
+            // 以太网把短帧填充到 60 字节，按 tot_len 去掉填充，
+            // 否则填充会被当成 TCP/UDP payload
+            int avail = frame->user_payload_end - frame->network_hdr;
+            if (avail < (int)sizeof(IpHeader)) {
+                return SocketBufferPtr();
+            }
+            int tot_len = ntohs(((IpHeader*)frame->network_hdr)->tot_len);
+            if (tot_len < (int)sizeof(IpHeader) || tot_len > avail) {
+                return SocketBufferPtr();
+            }
+            frame->user_payload_end = frame->network_hdr + tot_len;
+            return frame;
+        }
+        case ETH_P_ARP:
+            _pImpl->arpInput(std::move(frame));
+            return SocketBufferPtr();
+        default:
+            return SocketBufferPtr();
+    }
+}
+
+void
+EthernetLink::output(SocketBufferPtr packet)
+{
+    IpHeader* iphdr = (IpHeader*)packet->network_hdr;
+    __be32 nexthop = iphdr->daddr; // on-link only, no gateway yet
+
+    bool resolved = false;
+    bool need_request = false;
+    {
+        MutexLockGuard l(_pImpl->lock);
+        time_t now = time(nullptr);
+        if (now != _pImpl->lastExpiry) {
+            _pImpl->expirePending(now);
+        }
+
+        /*  1. ARP cache hit: a stale entry is still used while refreshed */
+
+        auto it = _pImpl->arpCache.find(nexthop);
+        if (it != _pImpl->arpCache.end() &&
+            now - it->second.updated >= arpCacheTtl) {
+            MacAddr& entry = it->second;
+            if (entry.requests == maxArpRequests &&
+                now != entry.lastRequest) {
+                MUQUINETD_LOG(info) << "ARP cache entry expired";
+                _pImpl->arpCache.erase(it);
+                it = _pImpl->arpCache.end();
+            } else if (now != entry.lastRequest) {
+                entry.lastRequest = now;
+                ++entry.requests;
+                need_request = true;
+            }
+        }
+        if (it != _pImpl->arpCache.end()) {
+            _pImpl->pushEthernetHeader(packet, it->second.bytes);
+            resolved = true;
+        }
+
+        /*  2. ARP cache miss: park the packet, ask who-has (at most 1/s) */
+
+        if (!resolved) {
+            ArpPending& pending = _pImpl->arpPending[nexthop];
+            if ((int)pending.packets.size() < Impl::maxPendingPerHop) {
+                pending.packets.push_back(std::move(packet));
+            }
+            if (now != pending.lastRequest) {
+                pending.lastRequest = now;
+                ++pending.requests;
+                need_request = true;
+            }
+        }
+    }
+
+    if (need_request) {
+        _pImpl->arpSend(ARPOP_REQUEST, nullptr, nexthop);
+    }
+    if (resolved) {
+        _pImpl->xmit(std::move(packet));
+    }
+}
+
+void
+EthernetLink::Impl::expirePending(time_t now)
+{
+    lastExpiry = now;
+    for (auto it = arpPending.begin(); it != arpPending.end();) {
+        const ArpPending& pending = it->second;
+        if (pending.requests >= maxArpRequests &&
+            now - pending.lastRequest >= 1) {
+            MUQUINETD_LOG(warning) << "No ARP reply, dropping "
+                                   << pending.packets.size()
+                                   << " packet(s) waiting for it";
+            it = arpPending.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
+void
+EthernetLink::Impl::arpInput(SocketBufferPtr frame)
+{
+    char* arp_begin = frame->hdrs_begin + ETH_HLEN;
+    if (frame->user_payload_end - arp_begin < (int)sizeof(ArpHeader)) {
+        return;
+    }
+
+    ArpHeader* arphdr = (ArpHeader*)arp_begin;
+    if (ntohs(arphdr->hdr.ar_hrd) != ARPHRD_ETHER ||
+        ntohs(arphdr->hdr.ar_pro) != ETH_P_IP ||
+        arphdr->hdr.ar_hln != ETH_ALEN || arphdr->hdr.ar_pln != 4) {
+        return;
+    }
+
+    __be32 sip = arphdr->ar_sip;
+    bool for_us = arphdr->ar_tip == this->ipaddr;
+    std::vector<SocketBufferPtr> ready;
+
+    /*  1. learn sender's address, take packets waiting for it */
+
+    {
+        MutexLockGuard l(this->lock);
+        auto it = arpCache.find(sip);
+        if (it != arpCache.end() || for_us) {
+            MacAddr& entry = arpCache[sip];
+            memcpy(entry.bytes, arphdr->ar_sha, ETH_ALEN);
+            entry.updated = time(nullptr);
+            entry.requests = 0;
+        }
+
+        auto pending = arpPending.find(sip);
+        if (pending != arpPending.end()) {
+            ready.swap(pending->second.packets);
+            arpPending.erase(pending);
+            for (auto& packet : ready) {
+                pushEthernetHeader(packet, arphdr->ar_sha);
+            }
+        }
+    }
+
+    /*  2. reply to who-has us */
+
+    if (for_us && ntohs(arphdr->hdr.ar_op) == ARPOP_REQUEST) {
+        MUQUINETD_LOG(debug) << "Link Layer replying to an ARP request";
+        arpSend(ARPOP_REPLY, arphdr->ar_sha, sip);
+    }
+
+    /*  3. send packets that were waiting */
+
+    for (auto& packet : ready) {
+        xmit(std::move(packet));
+    }
+}
+
+void
+EthernetLink::Impl::arpSend(__u16 op, const unsigned char* tha, __be32 tip)
+{
+    SocketBufferPtr skbuf =
+        SocketBuffers::alloc(ETH_HLEN + (int)sizeof(ArpHeader));
+    skbuf->reserve(0);
+    skbuf->put(ETH_HLEN + sizeof(ArpHeader));
+    skbuf->user_payload_begin = skbuf->user_payload_end = skbuf->hdrs_end;
+    bzero(skbuf->hdrs_begin, ETH_HLEN + sizeof(ArpHeader));
+
+    EthernetHeader* ethhdr = (EthernetHeader*)skbuf->hdrs_begin;
+    {
+        memcpy(ethhdr->h_dest, tha ? tha : broadcastMac, ETH_ALEN);
+        memcpy(ethhdr->h_source, this->mac, ETH_ALEN);
+        ethhdr->h_proto = htons(ETH_P_ARP);
+    }
+
+    ArpHeader* arphdr = (ArpHeader*)(skbuf->hdrs_begin + ETH_HLEN);
+    {
+        arphdr->hdr.ar_hrd = htons(ARPHRD_ETHER);
+        arphdr->hdr.ar_pro = htons(ETH_P_IP);
+        arphdr->hdr.ar_hln = ETH_ALEN;
+        arphdr->hdr.ar_pln = 4;
+        arphdr->hdr.ar_op = htons(op);
+        memcpy(arphdr->ar_sha, this->mac, ETH_ALEN);
+        arphdr->ar_sip = this->ipaddr;
+        if (tha) {
+            memcpy(arphdr->ar_tha, tha, ETH_ALEN);
+        }
+        arphdr->ar_tip = tip;
+    }
+
+    xmit(std::move(skbuf));
+}
+
+void
+EthernetLink::Impl::pushEthernetHeader(const SocketBufferPtr& skbuf,
+                                       const unsigned char* dest)
+{
+    // SocketBuffer::maxHdrsSize reserves room for it
+    assert(skbuf->headroom() >= ETH_HLEN);
+
+    EthernetHeader* ethhdr = (EthernetHeader*)skbuf->push(ETH_HLEN);
+    memcpy(ethhdr->h_dest, dest, ETH_ALEN);
+    memcpy(ethhdr->h_source, this->mac, ETH_ALEN);
+    ethhdr->h_proto = htons(ETH_P_IP);
+}
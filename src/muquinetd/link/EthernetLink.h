@@ -0,0 +1,61 @@
+/*
+ * muQuinet, an userspace TCP/IP network stack.
+ * Copyright (C) 2018 rtdarwin
+ *
+ * This program is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+
+ * You should have received a copy of the GNU General Public
+ * License along with this program.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef MUQUINETD_LINK_ETHERNETLINK_H
+#define MUQUINETD_LINK_ETHERNETLINK_H
+
+#include <functional>
+#include <memory>
+
+class SocketBufferPtr;
+
+/** Ethernet framing and ARP, for NetDevs carrying Ethernet frames
+ *
+ * One EthernetLink per NetDev. The Ip layer only ever sees IP packets,
+ * just like with a TUN device.
+ */
+class EthernetLink
+{
+public:
+    // xmit puts a complete Ethernet frame on the wire
+    using XmitFn = std::function<void(SocketBufferPtr)>;
+
+    EthernetLink(const unsigned char* mac, const XmitFn& xmit);
+    ~EthernetLink();
+    // Non-copyable, Non-moveable
+    EthernetLink(const EthernetLink&) = delete;
+    EthernetLink& operator=(const EthernetLink&) = delete;
+    EthernetLink(EthernetLink&&) = delete;
+    EthernetLink& operator=(EthernetLink&&) = delete;
+
+    // Received frame -> IP packet (Ethernet header stripped)
+    //   return an empty SocketBufferPtr if the frame was consumed (ARP)
+    //   or dropped (not for us, not IPv4)
+    SocketBufferPtr input(SocketBufferPtr frame);
+
+    // IP packet -> frame, prepending the Ethernet header into headroom.
+    // Packets whose next hop is not resolved yet wait for the ARP reply.
+    void output(SocketBufferPtr packet);
+
+private:
+    struct Impl; // pimpl forward declaration
+    std::unique_ptr<Impl> _pImpl;
+};
+
+#endif // MUQUINETD_LINK_ETHERNETLINK_H
@@ -20,16 +20,24 @@
 #include "muQuinetd.h"
 
 #include <bits/exception.h>
+#include <string.h>
+#include <sys/stat.h>
+
 #include <cstdlib>
 #include <iostream>
+#include <string>
 
+#include "muquinetd/Conf.h"
 #include "muquinetd/ConfReader.h"
 #include "muquinetd/Interface.h"
 #include "muquinetd/Ip.h"
 #include "muquinetd/Logging.h"
 #include "muquinetd/Mux.h"
+#include "muquinetd/Stats.h"
 #include "muquinetd/Tcp.h"
 #include "muquinetd/Udp.h"
+#include "muquinetd/base/Trace.h"
+#include "rpc/rpc.h"
 
 using std::cout;
 using std::exception;
@@ -53,12 +61,14 @@ muQuinetd::init(int argc, char* argv[])
 
     initSignalActions();
     initLogging();
+    initTrace();
 
     Interface::get()->init();
     Ip::get()->init();
     Tcp::get()->init();
     Udp::get()->init();
     Mux::get()->init();
+    Stats::get()->init();
 }
 
 void
@@ -71,6 +81,7 @@ muQuinetd::run()
     Tcp::get()->start();
     Udp::get()->start();
     Mux::get()->start();
+    Stats::get()->start();
 
     // FIXME: this thread will wait for user signals
     pthread_exit(NULL);
@@ -84,6 +95,7 @@ muQuinetd::stop()
     Tcp::get()->stop();
     Udp::get()->stop();
     Mux::get()->stop();
+    Stats::get()->stop();
 
     _pImpl->running = false;
 }
@@ -125,6 +137,26 @@ muQuinetd::initSignalActions()
     // SIGINT  - close gracefully
 }
 
+void
+muQuinetd::initTrace()
+{
+    if (!Conf::get()->trace.enabled)
+        return;
+
+    std::string path = std::string(rpc_master_listener_socket_dir()) + "/" +
+                       MUQUINETD_TRACE_FILE_NAME;
+    ::mkdir(rpc_master_listener_socket_dir(),
+            S_IRWXU | S_IRWXG | S_IROTH | S_IXOTH);
+    if (!Trace::init(path)) {
+        int errno_ = errno;
+        MUQUINETD_LOG(error) << "Failed to create trace file " << path << ": "
+                             << std::string(strerror(errno_))
+                             << ". Tracing disabled";
+        return;
+    }
+    MUQUINETD_LOG(info) << "Tracing packet path into " << path;
+}
+
 void
 muQuinetd::initLogging()
 {
@@ -50,6 +50,7 @@ private:
     void readConf(int argc, char* argv[]);
     void initSignalActions();
     void initLogging();
+    void initTrace();
 
 private:
     struct Impl;
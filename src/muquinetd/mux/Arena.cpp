@@ -0,0 +1,141 @@
+/*
+ * muQuinet, an userspace TCP/IP network stack.
+ * Copyright (C) 2018 rtdarwin
+ *
+ * This program is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+
+ * You should have received a copy of the GNU General Public
+ * License along with this program.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#include "Arena.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <map>
+#include <string>
+
+#include "muquinetd/Logging.h"
+#include "muquinetd/base/MutexLock.h"
+#include "muquinetd/mux/RpcFields.h"
+#include "rpc/arena.h"
+
+using std::shared_ptr;
+using std::weak_ptr;
+
+namespace {
+
+// pid -> Arena, entries expire with the interceptor's sockets
+MutexLock registryLock;
+std::map<pid_t, weak_ptr<Arena>> registry;
+
+} // namespace {
+
+struct Arena::Impl
+{
+    char* base = nullptr;
+    size_t size = 0;
+};
+
+Arena::Arena(int memfd)
+{
+    _pImpl.reset(new Arena::Impl);
+
+    struct stat st;
+    if (fstat(memfd, &st) == -1 || st.st_size < RPC_ARENA_SIZE) {
+        MUQUINETD_LOG(warning) << "Arena memfd too small, ignored";
+        ::close(memfd);
+        return;
+    }
+    // 没封住的 memfd 可被对方缩小，访问映射时 SIGBUS
+    int seals = fcntl(memfd, F_GET_SEALS);
+    if (seals == -1 || (seals & RPC_ARENA_SEALS) != RPC_ARENA_SEALS) {
+        MUQUINETD_LOG(warning) << "Arena memfd not sealed, ignored";
+        ::close(memfd);
+        return;
+    }
+
+    void* addr = mmap(NULL, RPC_ARENA_SIZE, PROT_READ | PROT_WRITE,
+                      MAP_SHARED, memfd, 0);
+    ::close(memfd);
+    if (addr == MAP_FAILED) {
+        int errno_ = errno;
+        MUQUINETD_LOG(warning) << "Failed to map arena memfd: "
+                               << std::string(strerror(errno_));
+        return;
+    }
+    _pImpl->base = (char*)addr;
+    _pImpl->size = RPC_ARENA_SIZE;
+}
+
+Arena::~Arena()
+{
+    if (_pImpl->base) {
+        munmap(_pImpl->base, _pImpl->size);
+    }
+}
+
+bool
+Arena::valid()
+{
+    return _pImpl->base != nullptr;
+}
+
+size_t
+Arena::size()
+{
+    return _pImpl->size;
+}
+
+char*
+Arena::at(uint64_t offset, uint64_t length)
+{
+    if (offset > _pImpl->size || length > _pImpl->size - offset)
+        return nullptr;
+    return _pImpl->base + offset;
+}
+
+bool
+Arena::refOf(const google::protobuf::UnknownFieldSet& fields,
+             uint64_t* offset, uint64_t* length)
+{
+    return RpcFields::varintOf(fields, RPC_ARENA_OFFSET, offset) &&
+           RpcFields::varintOf(fields, RPC_ARENA_LENGTH, length);
+}
+
+void
+Arena::add(pid_t pid, const shared_ptr<Arena>& a)
+{
+    MutexLockGuard l(registryLock);
+
+    for (auto it = registry.begin(); it != registry.end();) {
+        if (it->second.expired())
+            it = registry.erase(it);
+        else
+            ++it;
+    }
+    registry[pid] = a;
+}
+
+shared_ptr<Arena>
+Arena::ofPid(pid_t pid)
+{
+    MutexLockGuard l(registryLock);
+
+    auto it = registry.find(pid);
+    return it == registry.end() ? nullptr : it->second.lock();
+}
@@ -0,0 +1,73 @@
+/*
+ * muQuinet, an userspace TCP/IP network stack.
+ * Copyright (C) 2018 rtdarwin
+ *
+ * This program is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+
+ * You should have received a copy of the GNU General Public
+ * License along with this program.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef MUQUINETD_MUX_ARENA_H
+#define MUQUINETD_MUX_ARENA_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#include <memory>
+
+namespace google {
+namespace protobuf {
+class UnknownFieldSet;
+}
+}
+
+/** Payload arena of one interceptor process (see rpc/arena.h)
+ *
+ * Created from the memfd passed with the interceptor's Atstart, then
+ * found by pid when its Sockets are created. Every Socket of the process
+ * keeps the Arena alive.
+ */
+class Arena
+{
+public:
+    // Takes the ownership of memfd
+    explicit Arena(int memfd);
+    ~Arena();
+    // Non-copyable, Non-moveable
+    Arena(const Arena&) = delete;
+    Arena& operator=(const Arena&) = delete;
+    Arena(Arena&&) = delete;
+    Arena& operator=(Arena&&) = delete;
+
+    // false if the memfd can't be mapped
+    bool valid();
+    size_t size();
+
+    // nullptr unless [offset, offset + length) lies in the arena
+    char* at(uint64_t offset, uint64_t length);
+
+    // {RPC_ARENA_OFFSET, RPC_ARENA_LENGTH} of a message, false if absent
+    static bool refOf(const google::protobuf::UnknownFieldSet&,
+                      uint64_t* offset, uint64_t* length);
+
+    // keyed by the SO_PEERCRED pid, as Readiness::add()
+    static void add(pid_t, const std::shared_ptr<Arena>&);
+    static std::shared_ptr<Arena> ofPid(pid_t);
+
+private:
+    struct Impl;
+    std::unique_ptr<Impl> _pImpl;
+};
+
+#endif // MUQUINETD_MUX_ARENA_H
@@ -0,0 +1,114 @@
+/*
+ * muQuinet, an userspace TCP/IP network stack.
+ * Copyright (C) 2018 rtdarwin
+ *
+ * This program is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+
+ * You should have received a copy of the GNU General Public
+ * License along with this program.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#include "MessagePool.h"
+
+#include <google/protobuf/arena.h>
+
+#include <vector>
+
+#include "rpc/cpp_out/request.pb.h"
+#include "rpc/cpp_out/response.pb.h"
+
+namespace {
+
+// A message up to this size is never allocated from the heap. Bulk
+// payloads go through the interceptor's arena (rpc/arena.h) anyway.
+const size_t blockSize = 4096;
+// Beyond that many messages in use, new ones are not recycled
+const size_t poolSize = 64;
+
+template <typename M>
+struct Slot
+{
+    google::protobuf::Arena arena;
+    M* msg = nullptr;
+    char block[blockSize];
+
+    Slot()
+      : arena(block, sizeof(block))
+    {
+    }
+};
+
+template <typename M>
+struct Pool
+{
+    std::vector<std::shared_ptr<Slot<M>>> slots;
+    size_t next = 0; // slot to look at first
+};
+
+template <typename M>
+std::shared_ptr<M>
+get(Pool<M>*& pool)
+{
+    if (!pool) {
+        pool = new Pool<M>;
+        pool->slots.reserve(poolSize);
+    }
+
+    /*  1. a slot nobody else refers to any more */
+
+    std::shared_ptr<Slot<M>> slot;
+    size_t n = pool->slots.size();
+    for (size_t k = 0; k < n; ++k) {
+        size_t i = (pool->next + k) % n;
+        if (pool->slots[i].use_count() == 1) {
+            slot = pool->slots[i];
+            pool->next = (i + 1) % n;
+            break;
+        }
+    }
+
+    /*  2. or a new one, kept while the pool is not full */
+
+    if (!slot) {
+        slot = std::make_shared<Slot<M>>();
+        if (n < poolSize) {
+            pool->slots.push_back(slot);
+        }
+    }
+
+    /*  3. the message shares the slot's reference count */
+
+    slot->arena.Reset();
+    slot->msg = google::protobuf::Arena::CreateMessage<M>(&slot->arena);
+    return std::shared_ptr<M>(slot, slot->msg);
+}
+
+__thread Pool<Request>* requests = nullptr;
+__thread Pool<Response>* responses = nullptr;
+
+} // namespace {
+
+namespace MessagePool {
+
+std::shared_ptr<Request>
+newRequest()
+{
+    return get(requests);
+}
+
+std::shared_ptr<Response>
+newResponse()
+{
+    return get(responses);
+}
+
+} // namespace MessagePool
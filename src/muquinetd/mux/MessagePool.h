@@ -0,0 +1,42 @@
+/*
+ * muQuinet, an userspace TCP/IP network stack.
+ * Copyright (C) 2018 rtdarwin
+ *
+ * This program is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+
+ * You should have received a copy of the GNU General Public
+ * License along with this program.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef MUQUINETD_MUX_MESSAGEPOOL_H
+#define MUQUINETD_MUX_MESSAGEPOOL_H
+
+#include <memory>
+
+class Request;
+class Response;
+
+/** Requests and Responses of the RPC path, recycled per thread
+ *
+ * Each message lives on its own google::protobuf::Arena, whose first
+ * block is kept across uses: once the last shared_ptr to a message is
+ * gone, the next get() resets the arena and builds a new message in it,
+ * without going to the allocator. Only used from the Mux thread(s).
+ */
+namespace MessagePool {
+
+std::shared_ptr<Request> newRequest();
+std::shared_ptr<Response> newResponse();
+
+} // namespace MessagePool
+
+#endif // MUQUINETD_MUX_MESSAGEPOOL_H
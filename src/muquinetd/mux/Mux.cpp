@@ -139,9 +139,16 @@ Mux::addRRChannel(const std::shared_ptr<ReqRespChannel>& ch)
 void
 Mux::removeRRChannel(const std::shared_ptr<ReqRespChannel>& ch)
 {
+    // the shared sockets of a process go with its process channel, i.e.
+    // the one it sent Atstart on (rpc/rpc.h)
+    bool procChannel = ch->fdRangeCount() > 0;
+    pid_t pid = ch->peerPid();
+
     _pImpl->rrChannels.remove_if(
-        [&ch](const std::shared_ptr<ReqRespChannel>& chToPred) -> bool {
-            if (chToPred.get() == ch.get()) {
+        [&](const std::shared_ptr<ReqRespChannel>& chToPred) -> bool {
+            if (chToPred.get() == ch.get() ||
+                (procChannel && chToPred->socketId() &&
+                 chToPred->peerPid() == pid)) {
                 MUQUINETD_LOG(debug) << "Removing a RRChannel";
                 return true;
             }
@@ -0,0 +1,329 @@
+/*
+ * muQuinet, an userspace TCP/IP network stack.
+ * Copyright (C) 2018 rtdarwin
+ *
+ * This program is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+
+ * You should have received a copy of the GNU General Public
+ * License along with this program.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+
+#include "Readiness.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "muquinetd/Logging.h"
+#include "muquinetd/base/MutexLock.h"
+#include "rpc/readiness.h"
+
+using std::shared_ptr;
+using std::weak_ptr;
+
+namespace {
+
+// pid -> Readiness, entries expire with the interceptor's sockets
+MutexLock registryLock;
+std::map<pid_t, weak_ptr<Readiness>> registry;
+
+} // namespace {
+
+struct Readiness::Impl
+{
+    int eventfd = -1;
+    struct rpc_readiness* shm = nullptr;
+
+    MutexLock slotsLock;
+    std::vector<int> freeSlots;
+    int nextSlot = 0;
+    std::vector<int> freeRings;
+    int nextRing = 0;
+    // ring + 1 of each slot, 0 for none. shm->prefetch only publishes it:
+    // the interceptor can write there, it is never read back
+    std::unique_ptr<std::atomic<int>[]> rings{
+        new std::atomic<int>[RPC_READINESS_SLOTS]()
+    };
+
+    std::atomic<uint32_t>* events(int slot)
+    {
+        return reinterpret_cast<std::atomic<uint32_t>*>(&shm->events[slot]);
+    }
+    std::atomic<uint32_t>* gens(int slot)
+    {
+        return reinterpret_cast<std::atomic<uint32_t>*>(&shm->gens[slot]);
+    }
+    std::atomic<int32_t>* credits(int slot)
+    {
+        return reinterpret_cast<std::atomic<int32_t>*>(&shm->credits[slot]);
+    }
+    std::atomic<int32_t>* errors(int slot)
+    {
+        return reinterpret_cast<std::atomic<int32_t>*>(&shm->errors[slot]);
+    }
+    std::atomic<int32_t>* prefetch(int slot)
+    {
+        return reinterpret_cast<std::atomic<int32_t>*>(&shm->prefetch[slot]);
+    }
+    struct rpc_prefetch* ring(int slot)
+    {
+        int r = rings[slot].load() - 1;
+        return r < 0 ? nullptr : &shm->rings[r];
+    }
+    std::atomic<uint32_t>* waiters()
+    {
+        return reinterpret_cast<std::atomic<uint32_t>*>(&shm->waiters);
+    }
+    std::atomic<uint32_t>* edgeWaiters()
+    {
+        return reinterpret_cast<std::atomic<uint32_t>*>(&shm->edge_waiters);
+    }
+};
+
+Readiness::Readiness(int memfd, int eventfd)
+{
+    _pImpl.reset(new Readiness::Impl);
+    _pImpl->eventfd = eventfd;
+
+    struct stat st;
+    if (fstat(memfd, &st) == -1 ||
+        (size_t)st.st_size < sizeof(struct rpc_readiness)) {
+        MUQUINETD_LOG(warning) << "Readiness memfd too small, ignored";
+        ::close(memfd);
+        return;
+    }
+    // 没封住的 memfd 可被对方缩小，访问映射时 SIGBUS
+    int seals = fcntl(memfd, F_GET_SEALS);
+    if (seals == -1 ||
+        (seals & RPC_READINESS_SEALS) != RPC_READINESS_SEALS) {
+        MUQUINETD_LOG(warning) << "Readiness memfd not sealed, ignored";
+        ::close(memfd);
+        return;
+    }
+
+    void* addr = mmap(NULL, sizeof(struct rpc_readiness),
+                      PROT_READ | PROT_WRITE, MAP_SHARED, memfd, 0);
+    ::close(memfd);
+    if (addr == MAP_FAILED) {
+        int errno_ = errno;
+        MUQUINETD_LOG(warning) << "Failed to map readiness memfd: "
+                               << std::string(strerror(errno_));
+        return;
+    }
+    _pImpl->shm = (struct rpc_readiness*)addr;
+}
+
+Readiness::~Readiness()
+{
+    if (_pImpl->shm) {
+        munmap(_pImpl->shm, sizeof(struct rpc_readiness));
+    }
+    if (_pImpl->eventfd != -1) {
+        ::close(_pImpl->eventfd);
+    }
+}
+
+bool
+Readiness::valid()
+{
+    return _pImpl->shm != nullptr;
+}
+
+int
+Readiness::allocSlot()
+{
+    MutexLockGuard l(_pImpl->slotsLock);
+
+    int slot;
+    if (!_pImpl->freeSlots.empty()) {
+        slot = _pImpl->freeSlots.back();
+        _pImpl->freeSlots.pop_back();
+    } else if (_pImpl->nextSlot < RPC_READINESS_SLOTS) {
+        slot = _pImpl->nextSlot++;
+    } else {
+        return -1;
+    }
+
+    _pImpl->events(slot)->store(0);
+    _pImpl->credits(slot)->store(0);
+    _pImpl->errors(slot)->store(0);
+    _pImpl->prefetch(slot)->store(0);
+    _pImpl->rings[slot].store(0);
+    return slot;
+}
+
+void
+Readiness::freeSlot(int slot)
+{
+    _pImpl->events(slot)->store(0);
+    _pImpl->prefetch(slot)->store(0);
+    int ring = _pImpl->rings[slot].exchange(0) - 1;
+
+    MutexLockGuard l(_pImpl->slotsLock);
+    _pImpl->freeSlots.push_back(slot);
+    if (ring >= 0) {
+        _pImpl->freeRings.push_back(ring);
+    }
+}
+
+void
+Readiness::set(int slot, uint32_t events)
+{
+    uint32_t old = _pImpl->events(slot)->fetch_or(events);
+    // 先置位再 ++gen：interceptor 先读 gen，交错时只会多报一次边沿
+    _pImpl->gens(slot)->fetch_add(1);
+
+    // 新置位、且有线程在等时唤醒；已置位的再置一次（如又来一个包）
+    // 只有等边沿（EPOLLET）的线程在意
+    if (((old & events) != events && _pImpl->waiters()->load() != 0) ||
+        _pImpl->edgeWaiters()->load() != 0) {
+        uint64_t one = 1;
+        ssize_t n = ::write(_pImpl->eventfd, &one, sizeof(one));
+        (void)n; // EAGAIN: the counter is already non-zero
+    }
+}
+
+void
+Readiness::clear(int slot, uint32_t events)
+{
+    _pImpl->events(slot)->fetch_and(~events);
+}
+
+uint32_t
+Readiness::get(int slot)
+{
+    return _pImpl->events(slot)->load();
+}
+
+void
+Readiness::addCredits(int slot, int32_t bytes)
+{
+    _pImpl->credits(slot)->fetch_add(bytes);
+}
+
+void
+Readiness::setError(int slot, int errno_)
+{
+    int32_t none = 0;
+    _pImpl->errors(slot)->compare_exchange_strong(none, errno_);
+}
+
+bool
+Readiness::allocRing(int slot)
+{
+    MutexLockGuard l(_pImpl->slotsLock);
+
+    int ring;
+    if (!_pImpl->freeRings.empty()) {
+        ring = _pImpl->freeRings.back();
+        _pImpl->freeRings.pop_back();
+    } else if (_pImpl->nextRing < RPC_PREFETCH_RINGS) {
+        ring = _pImpl->nextRing++;
+    } else {
+        return false;
+    }
+
+    struct rpc_prefetch* r = &_pImpl->shm->rings[ring];
+    r->head = 0;
+    r->tail = 0;
+    _pImpl->rings[slot].store(ring + 1);
+    _pImpl->prefetch(slot)->store(ring + 1);
+    return true;
+}
+
+bool
+Readiness::putRecord(int slot, uint32_t budget, const struct sockaddr_in& addr,
+                     const struct iovec* iov, int iovcnt)
+{
+    struct rpc_prefetch* r = _pImpl->ring(slot);
+    if (!r)
+        return false;
+
+    auto* head = reinterpret_cast<std::atomic<uint32_t>*>(&r->head);
+    auto* tail = reinterpret_cast<std::atomic<uint32_t>*>(&r->tail);
+
+    struct rpc_prefetch_record rec;
+    bzero(&rec, sizeof(rec));
+    for (int i = 0; i < iovcnt; ++i) {
+        rec.len += iov[i].iov_len;
+    }
+    rec.addr = addr;
+
+    uint32_t h = head->load(std::memory_order_relaxed);
+    uint32_t used = h - tail->load(std::memory_order_acquire);
+    uint64_t need = sizeof(rec) + (uint64_t)rec.len;
+    if (used + need > std::min<uint32_t>(budget, RPC_PREFETCH_SIZE))
+        return false;
+
+    // 按环形拷贝，head 最后才发布
+    auto copy = [r](uint32_t pos, const void* src, size_t n) {
+        uint32_t at = pos & (RPC_PREFETCH_SIZE - 1);
+        size_t first = std::min<size_t>(n, RPC_PREFETCH_SIZE - at);
+        memcpy(r->data + at, src, first);
+        memcpy(r->data, (const char*)src + first, n - first);
+    };
+    uint32_t pos = h;
+    copy(pos, &rec, sizeof(rec));
+    pos += sizeof(rec);
+    for (int i = 0; i < iovcnt; ++i) {
+        copy(pos, iov[i].iov_base, iov[i].iov_len);
+        pos += iov[i].iov_len;
+    }
+    head->store(pos, std::memory_order_release);
+    return true;
+}
+
+bool
+Readiness::prefetched(int slot)
+{
+    struct rpc_prefetch* r = _pImpl->ring(slot);
+    if (!r)
+        return false;
+
+    auto* head = reinterpret_cast<std::atomic<uint32_t>*>(&r->head);
+    auto* tail = reinterpret_cast<std::atomic<uint32_t>*>(&r->tail);
+    return head->load() != tail->load();
+}
+
+void
+Readiness::add(pid_t pid, const shared_ptr<Readiness>& r)
+{
+    MutexLockGuard l(registryLock);
+
+    for (auto it = registry.begin(); it != registry.end();) {
+        if (it->second.expired())
+            it = registry.erase(it);
+        else
+            ++it;
+    }
+    registry[pid] = r;
+}
+
+shared_ptr<Readiness>
+Readiness::ofPid(pid_t pid)
+{
+    MutexLockGuard l(registryLock);
+
+    auto it = registry.find(pid);
+    return it == registry.end() ? nullptr : it->second.lock();
+}
@@ -0,0 +1,84 @@
+/*
+ * muQuinet, an userspace TCP/IP network stack.
+ * Copyright (C) 2018 rtdarwin
+ *
+ * This program is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+
+ * You should have received a copy of the GNU General Public
+ * License along with this program.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef MUQUINETD_MUX_READINESS_H
+#define MUQUINETD_MUX_READINESS_H
+
+#include <netinet/in.h>
+#include <stdint.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+
+#include <memory>
+
+/** Readiness region of one interceptor process (see rpc/readiness.h)
+ *
+ * Created from the memfd/eventfd passed with the interceptor's Atstart,
+ * then found by pid when its Sockets are created. Every Socket owning a
+ * slot keeps the Readiness alive.
+ */
+class Readiness
+{
+public:
+    // Takes the ownership of both fds
+    Readiness(int memfd, int eventfd);
+    ~Readiness();
+    // Non-copyable, Non-moveable
+    Readiness(const Readiness&) = delete;
+    Readiness& operator=(const Readiness&) = delete;
+    Readiness(Readiness&&) = delete;
+    Readiness& operator=(Readiness&&) = delete;
+
+    // false if the memfd can't be mapped
+    bool valid();
+
+    // -1 when all are used
+    int allocSlot();
+    void freeSlot(int slot);
+
+    // Thread-safe, from any layer
+    void set(int slot, uint32_t events);
+    void clear(int slot, uint32_t events);
+    uint32_t get(int slot);
+
+    // Asynchronous sends: credits given back, and the first failure
+    void addCredits(int slot, int32_t bytes);
+    void setError(int slot, int errno_);
+
+    // Prefetch ring of the slot, freed with it. false when all are used.
+    bool allocRing(int slot);
+    // Appends a record if it fits in `budget' bytes of the ring, from the
+    // EventLoop only
+    bool putRecord(int slot, uint32_t budget, const struct sockaddr_in&,
+                   const struct iovec*, int iovcnt);
+    // false if the interceptor consumed every record
+    bool prefetched(int slot);
+
+    // keyed by the peerPid() (SO_PEERCRED) of the process channel that
+    // passed it, never by the pid a Request claims
+    static void add(pid_t, const std::shared_ptr<Readiness>&);
+    static std::shared_ptr<Readiness> ofPid(pid_t);
+
+private:
+    struct Impl;
+    std::unique_ptr<Impl> _pImpl;
+};
+
+#endif // MUQUINETD_MUX_READINESS_H
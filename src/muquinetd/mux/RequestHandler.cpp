@@ -24,32 +24,153 @@
 #include <sys/socket.h>
 #include <unistd.h>
 
+#include <algorithm>
 #include <memory>
 #include <string>
+#include <vector>
 
+#include "muquinetd/Conf.h"
+#include "muquinetd/Interface.h"
 #include "muquinetd/Logging.h"
 #include "muquinetd/Mux.h"
 #include "muquinetd/Pcb.h"
 #include "muquinetd/SocketBuffer.h"
 #include "muquinetd/Tcp.h"
 #include "muquinetd/Udp.h"
+#include "muquinetd/base/Latency.h"
+#include "muquinetd/mux/Arena.h"
 #include "muquinetd/mux/EventLoop.h"
+#include "muquinetd/mux/MessagePool.h"
+#include "muquinetd/mux/Readiness.h"
+#include "muquinetd/mux/RpcFields.h"
 #include "muquinetd/mux/SelectableChannel.h"
 #include "muquinetd/mux/Socket.h"
 #include "muquinetd/mux/req-resp-channel/ReqRespChannel.h"
 #include "rpc/cpp_out/request.pb.h"
 #include "rpc/cpp_out/response.pb.h"
+#include "rpc/arena.h"
+#include "rpc/readiness.h"
 #include "rpc/rpc.h"
+#include "rpc/splice.h"
 
 using std::shared_ptr;
 using std::weak_ptr;
 using std::make_shared;
 
+namespace {
+
+// UDP payload of one IPv4 packet, that of TCP is tcpPayloadMax()
+const size_t udpPayloadMax = 65535 - 20 - 8;
+
+// TCP payload of one segment the device can send (IP and TCP headers
+// without options): larger ones would be dropped on the way out
+size_t
+tcpPayloadMax()
+{
+    return Interface::get()->mtu() - 20 - 20;
+}
+
+// The region of the interceptor's arena a call refers to, see rpc/arena.h
+char*
+arenaRegionOf(const shared_ptr<Socket>& socket, uint64_t offset,
+              uint64_t length)
+{
+    const auto& arena = socket->arena();
+    return arena && length ? arena->at(offset, length) : nullptr;
+}
+
+// Response.Sendto of a send that should have written sendLen bytes: ret,
+// and errno_ if ret < 0. Every return of sendtoCall() goes through it.
+//
+// 异步 send 没有人等 Response：归还 payloadLen 的 credits，失败留到
+// interceptor 的下一次调用。没发全也是失败：如 TcpPcb 在 SYN_SENT 等状态
+// 下不发 payload，返回 0
+void
+setSendtoRet(const shared_ptr<Response>& resp, const shared_ptr<Socket>& so,
+             bool async, size_t payloadLen, size_t sendLen, int ret,
+             int errno_)
+{
+    resp->set_retcode(Response::RetCode::Response_RetCode_OK);
+    auto* callRet = resp->mutable_sendtocall();
+    callRet->set_ret(ret);
+    if (ret < 0) {
+        callRet->set_errno_(errno_);
+    }
+
+    if (async) {
+        if (ret < 0) {
+            so->setSendError(errno_);
+        } else if ((size_t)ret != sendLen) {
+            so->setSendError(ENOTCONN);
+        }
+        so->addSendCredits(payloadLen);
+    }
+}
+
+// At most how many bytes of payload a Recvfrom returns: its arena region
+// if any, its len (and what fits in one RPC message) otherwise.
+uint64_t
+recvfromCapacity(int64_t len, char* region, uint64_t arenaLength)
+{
+    if (region) {
+        return arenaLength;
+    }
+    return std::min<uint64_t>(std::max<int64_t>(len, 0),
+                              RPC_MESSAGE_BUF_MAX_SIZE);
+}
+
+// The payload of a SocketBuffer chain taken from so goes to the arena
+// region if any, to Response.Recvfrom.buf otherwise, at most capacity
+// bytes (recvfromCapacity()). Returns its length.
+//
+// 流式 socket 没读完的部分放回接收队列，留给下一次 recv；
+// 数据报放不下的部分丢弃，并标上 RPC_RECV_TRUNC
+int
+setRecvfromPayload(Response_Recvfrom* callRet, const shared_ptr<Socket>& so,
+                   const sockaddr_in& peeraddr, SocketBufferPtr skbuf,
+                   char* region, uint64_t capacity)
+{
+    std::string* buf = region ? nullptr : callRet->mutable_buf();
+
+    uint64_t copied = 0;
+    while (skbuf && copied < capacity) {
+        uint64_t len = std::min<uint64_t>(
+            skbuf->user_payload_end - skbuf->user_payload_begin,
+            capacity - copied);
+        if (region) {
+            memcpy(region + copied, skbuf->user_payload_begin, len);
+        } else {
+            buf->append(skbuf->user_payload_begin, len);
+        }
+        copied += len;
+
+        skbuf->user_payload_begin += len;
+        if (skbuf->user_payload_begin == skbuf->user_payload_end) {
+            SocketBufferPtr next = std::move(skbuf->next);
+            skbuf = std::move(next);
+        }
+    }
+
+    while (skbuf && skbuf->user_payload_begin == skbuf->user_payload_end) {
+        SocketBufferPtr next = std::move(skbuf->next);
+        skbuf = std::move(next);
+    }
+    if (skbuf && so->type() == Socket::Type::TCP) {
+        so->putBackToRecvQ(peeraddr, std::move(skbuf));
+    } else if (skbuf) {
+        callRet->mutable_unknown_fields()->AddVarint(RPC_RECV_TRUNC, 1);
+    }
+    return copied;
+}
+
+} // namespace {
+
 shared_ptr<Response>
 RequestHandler::handleRequest(const shared_ptr<ReqRespChannel>& rrChannel,
                               const shared_ptr<const Request>& req)
 {
-    auto resp = make_shared<Response>();
+    uint64_t begin = Latency::now();
+    auto resp = MessagePool::newResponse();
 
     switch (req->calling_case()) {
         case Request::kSocketCall: // DONE
@@ -104,7 +225,13 @@ RequestHandler::handleRequest(const shared_ptr<ReqRespChannel>& rrChannel,
             break;
     }
 
-    return resp;
+    if (Latency::RPC_CALLS + req->calling_case() < Latency::RPC_CALLS_END) {
+        Latency::record(Latency::Id(Latency::RPC_CALLS + req->calling_case()),
+                        Latency::now() - begin);
+    }
+
+    // 异步 send 没有 Response
+    return RpcFields::isAsyncSend(*req) ? nullptr : resp;
 }
 
 void
@@ -160,12 +287,38 @@ RequestHandler::socketCall(const shared_ptr<ReqRespChannel>& rrChannel,
         sChannel->setOwnerEventLoop(eventloop);
     }
 
-    /*  5. 返回信息给 Interceptor */
+    /*  5. 分配 readiness slot，interceptor 凭它 poll，不用再发 Request */
+
+    // 按 SO_PEERCRED 的 pid 找：那是传来这些 fd 的进程自己的 region
+    int slot = -1;
+    shared_ptr<Readiness> readiness = Readiness::ofPid(rrChannel->peerPid());
+    if (readiness) {
+        slot = readiness->allocSlot();
+        if (slot != -1) {
+            so->setReadiness(readiness, slot);
+            so->addSendCredits(Conf::get()->mux.send_credits_kb * 1024);
+            // 流式 socket 的记录会被小于它的 recv 拆开，只 prefetch UDP
+            if (Conf::get()->mux.prefetch_kb > 0 &&
+                so->type() == Socket::Type::UDP) {
+                so->enablePrefetch(Conf::get()->mux.prefetch_kb * 1024);
+            }
+        }
+    }
+
+    /*  6. payload 经 interceptor 进程的 arena 传递 */
+
+    so->setArena(Arena::ofPid(rrChannel->peerPid()));
+
+    /*  7. 返回信息给 Interceptor */
 
     resp->set_retcode(Response::RetCode::Response_RetCode_OK);
 
     auto* callRet = resp->mutable_socketcall();
-    callRet->set_ret(0);
+    callRet->set_ret(slot + 1); // see rpc/readiness.h
+    if (rrChannel->socketId()) {
+        callRet->mutable_unknown_fields()->AddVarint(RPC_SOCKET_ID,
+                                                     rrChannel->socketId());
+    }
 }
 
 void
@@ -231,9 +384,11 @@ tcp_wait_estab:;
         const auto& pcb = socket->pcb();
 
         std::weak_ptr<ReqRespChannel> rrChannel_weak = rrChannel;
-        pcb->setOnConnEstabCB([rrChannel_weak]() {
+        std::weak_ptr<ReqRespChannel> carrier_weak = rrChannel->carrier();
+        pcb->setOnConnEstabCB([rrChannel_weak, carrier_weak]() {
             shared_ptr<ReqRespChannel> rrChannel = rrChannel_weak.lock();
-            if (!rrChannel)
+            shared_ptr<ReqRespChannel> carrier = carrier_weak.lock();
+            if (!rrChannel || !carrier)
                 return;
 
             rrChannel->socket()
@@ -241,13 +396,13 @@ tcp_wait_estab:;
                 ->getConnEstabNotifyChannel()
                 ->unregisterSelf();
 
-            auto resp = make_shared<Response>();
+            auto resp = MessagePool::newResponse();
             auto* callRet = resp->mutable_connectcall();
 
             resp->set_retcode(Response::RetCode::Response_RetCode_OK);
             callRet->set_ret(0);
 
-            rrChannel->write(resp);
+            carrier->write(resp);
         });
         pcb->connect(destAddr.sin_addr, destAddr.sin_port);
     }
@@ -275,6 +430,11 @@ RequestHandler::closeCall(const shared_ptr<ReqRespChannel>& rrChannel,
 
     auto* callRet = resp->mutable_closecall();
     callRet->set_ret(0);
+
+    // 共享 channel 上的 socket 没有自己的连接可以关，在这里销毁
+    if (rrChannel->socketId()) {
+        Mux::get()->removeRRChannel(rrChannel);
+    }
 }
 
 void
@@ -283,14 +443,81 @@ RequestHandler::sendtoCall(const shared_ptr<ReqRespChannel>& rrChannel,
                            const shared_ptr<Response>& resp)
 {
     const auto& call = req->sendtocall();
-    const std::string& buf = call.buf();
     // int32_t flags = call.flags(); // unused
     bool hasAddr = call.has_addr();
+    bool async = RpcFields::isAsyncSend(*req);
 
     const auto& socket = rrChannel->socket();
     const auto& pcb = socket->pcb();
     int nwritten = 0;
 
+    // payload in a pipe the interceptor vmspliced it into (rpc/splice.h):
+    // read straight into the SocketBuffer by TcpPcb
+    uint64_t splicedLength;
+    if (RpcFields::varintOf(call.unknown_fields(), RPC_SPLICE_LENGTH,
+                            &splicedLength)) {
+        std::vector<int> fds = rrChannel->takePassedFds();
+        int errno_ = EINVAL;
+        // 只读一个 segment 的量（short write），pipe 里余下的由 interceptor
+        // 丢弃
+        size_t sendLen = splicedLength;
+        if (socket->type() == Socket::Type::TCP) {
+            sendLen = std::min(sendLen, tcpPayloadMax());
+        }
+        if (fds.size() == 1 && splicedLength <= RPC_SPLICE_MAX) {
+            struct sockaddr_in destAddr;
+            bzero(&destAddr, sizeof(struct sockaddr_in));
+            if (hasAddr) {
+                memcpy(&destAddr, call.addr().c_str(),
+                       sizeof(struct sockaddr_in));
+            }
+            nwritten = pcb->sendFromPipe(fds[0], sendLen,
+                                         hasAddr ? &destAddr : nullptr);
+            errno_ = EIO;
+        } else {
+            nwritten = -1;
+        }
+        for (int fd : fds) {
+            ::close(fd);
+        }
+
+        setSendtoRet(resp, socket, async, splicedLength, sendLen, nwritten,
+                     errno_);
+        return;
+    }
+
+    // payload: inline, or in the interceptor's arena
+    uint64_t offset, length;
+    bool inArena = Arena::refOf(call.unknown_fields(), &offset, &length);
+    const char* region = nullptr;
+    if (inArena) {
+        region = arenaRegionOf(socket, offset, length);
+        if (!region) {
+            setSendtoRet(resp, socket, async, length, length, -1, EFAULT);
+            return;
+        }
+    }
+    size_t payloadLen = inArena ? length : call.buf().length();
+
+    // 一次最多发一个 IP 包：TCP 只发一个 segment（short write，余下的由
+    // 应用再 send），放不下的 UDP 数据报 EMSGSIZE。
+    // 异步 send 没有人接 short write，TCP 分成几个 segment 全发出去
+    bool tcp = socket->type() == Socket::Type::TCP;
+    size_t segmentMax = tcp ? tcpPayloadMax() : udpPayloadMax;
+    size_t packetMax = tcp && async ? payloadLen : segmentMax;
+    if (payloadLen > packetMax && !tcp) {
+        setSendtoRet(resp, socket, async, payloadLen, payloadLen, -1,
+                     EMSGSIZE);
+        return;
+    }
+    std::string payload;
+    if (inArena) {
+        payload.assign(region, std::min<size_t>(payloadLen, packetMax));
+    } else if (payloadLen > packetMax) {
+        payload.assign(call.buf(), 0, packetMax);
+    }
+    const std::string& buf = payload.empty() ? call.buf() : payload;
+
     {
         if (socket->type() == Socket::Type::UDP) {
             MUQUINETD_LOG(info) << "It's an UDP send request, passing it to "
@@ -308,16 +535,21 @@ RequestHandler::sendtoCall(const shared_ptr<ReqRespChannel>& rrChannel,
         } else if (socket->type() == Socket::Type::TCP) {
             MUQUINETD_LOG(info) << "It's a TCP send request, passing it to "
                                    "corresponding TcpPcb...";
-            nwritten = pcb->send(buf);
+            nwritten = pcb->send(buf.length() <= segmentMax
+                                     ? buf
+                                     : buf.substr(0, segmentMax));
+            // only asynchronous sends are longer than a segment
+            for (size_t off = segmentMax;
+                 off < buf.length() && nwritten == (int)off;
+                 off += segmentMax) {
+                int n = pcb->send(buf.substr(off, segmentMax));
+                nwritten = n < 0 ? n : nwritten + n;
+            }
         }
     }
 
-    {
-        resp->set_retcode(Response::RetCode::Response_RetCode_OK);
-
-        auto* callRet = resp->mutable_sendtocall();
-        callRet->set_ret(nwritten);
-    }
+    setSendtoRet(resp, socket, async, payloadLen, buf.length(), nwritten,
+                 EIO);
 }
 
 void
@@ -327,15 +559,29 @@ RequestHandler::recvfromCall(const shared_ptr<ReqRespChannel>& rrChannel,
 {
     const auto& call = req->recvfromcall();
     const auto& socket = rrChannel->socket();
-    // int32_t flags = call.flags(); // ignored
+    // MSG_DONTWAIT only, the other flags are ignored
+    int32_t flags = call.flags();
     bool require_addr = call.requireaddr();
+    // payload region in the interceptor's arena, if any
+    uint64_t arenaOffset = 0, arenaLength = 0;
+    Arena::refOf(call.unknown_fields(), &arenaOffset, &arenaLength);
 
     sockaddr_in peeraddr;
     bzero(&peeraddr, sizeof(sockaddr_in));
-    shared_ptr<SocketBuffer> skbuf_head;
+    SocketBufferPtr skbuf_head;
+
+    // prefetched records come first, see rpc/readiness.h
+    if (socket->prefetched()) {
+        resp->set_retcode(Response::RetCode::Response_RetCode_OK);
+
+        auto* callRet = resp->mutable_recvfromcall();
+        callRet->set_ret(0);
+        callRet->mutable_unknown_fields()->AddVarint(RPC_RECV_PREFETCHED, 1);
+        return;
+    }
 
     {
-        if (socket->nonblocking()) {
+        if (socket->nonblocking() || (flags & MSG_DONTWAIT)) {
             if (socket->try_takeFromRecvQ(peeraddr, skbuf_head)) {
                 // happy path
                 // fall through
@@ -359,16 +605,12 @@ RequestHandler::recvfromCall(const shared_ptr<ReqRespChannel>& rrChannel,
         resp->set_retcode(Response::RetCode::Response_RetCode_OK);
 
         auto* callRet = resp->mutable_recvfromcall();
-        std::string* buf = callRet->mutable_buf();
 
         // buf (userpayload)
-        shared_ptr<SocketBuffer> curr_skbuf;
-        for (curr_skbuf = skbuf_head; curr_skbuf;
-             curr_skbuf = curr_skbuf->next) {
-            int len =
-                curr_skbuf->user_payload_end - curr_skbuf->user_payload_begin;
-            buf->append(curr_skbuf->user_payload_begin, len);
-        }
+        char* region = arenaRegionOf(socket, arenaOffset, arenaLength);
+        int len = setRecvfromPayload(
+            callRet, socket, peeraddr, std::move(skbuf_head), region,
+            recvfromCapacity(call.len(), region, arenaLength));
 
         if (require_addr) {
             // UDP only
@@ -376,7 +618,8 @@ RequestHandler::recvfromCall(const shared_ptr<ReqRespChannel>& rrChannel,
                 std::string{ (char*)&peeraddr, sizeof(sockaddr_in) });
         }
 
-        callRet->set_ret(buf->length());
+        callRet->set_ret(len);
+        socket->prefetch();
         return;
     }
 
@@ -385,7 +628,8 @@ e_again:;
         resp->set_retcode(Response::RetCode::Response_RetCode_OK);
 
         auto callRet = resp->mutable_recvfromcall();
-        callRet->set_ret(EAGAIN);
+        callRet->set_ret(-1);
+        callRet->set_errno_(EAGAIN);
         return;
     }
 
@@ -413,15 +657,19 @@ wait_next:;
         //   相互持有 shared_ptr 的局面
         // 这样会导致 ReqRespChannel 与 Socket 谁都不会被释放 --> 内存泄漏
         weak_ptr<ReqRespChannel> ch = rrChannel;
+        // shared socket 的 Response 须回到发起这次调用的 channel
+        weak_ptr<ReqRespChannel> carrier = rrChannel->carrier();
         switch (socket->type()) {
             case Socket::Type::UDP:
                 socket->setOnAsyncNewPacketCB(
                     std::bind(&RequestHandler::onAsyncNewUdpPacket, this, ch,
-                              require_addr));
+                              carrier, require_addr, call.len(), arenaOffset,
+                              arenaLength));
                 break;
             case Socket::Type::TCP:
                 socket->setOnAsyncNewPacketCB(
-                    std::bind(&RequestHandler::onAsyncNewTcpPacket, this, ch));
+                    std::bind(&RequestHandler::onAsyncNewTcpPacket, this, ch,
+                              carrier, call.len(), arenaOffset, arenaLength));
                 break;
         }
         socket->setWaiting(true);
@@ -435,6 +683,7 @@ RequestHandler::pollCall(const std::shared_ptr<ReqRespChannel>& rrChannel,
                          const std::shared_ptr<const Request>&,
                          const std::shared_ptr<Response>&)
 {
+    // Not sent: the interceptor polls its readiness region (Readiness.h)
 }
 
 void
@@ -442,6 +691,7 @@ RequestHandler::selectCall(const std::shared_ptr<ReqRespChannel>& rrChannel,
                            const std::shared_ptr<const Request>&,
                            const std::shared_ptr<Response>&)
 {
+    // Not sent: the interceptor polls its readiness region (Readiness.h)
 }
 
 void
@@ -540,33 +790,80 @@ RequestHandler::atstartAction(const shared_ptr<ReqRespChannel>& rrChannel,
 {
     const auto& call = req->atstartaction();
     const std::string& progname = call.progname();
-    pid_t pid = req->pid();
+    // SO_PEERCRED: req->pid() is whatever the peer wrote
+    pid_t pid = rrChannel->peerPid();
 
     /*  1. 保存 peer 信息 */
 
     rrChannel->setPeerName(progname);
-    rrChannel->setPeerPid(pid);
 
-    /*  2. 返回信息给 Interceptor */
+    // 第一次 Atstart 带着 readiness memfd 与 eventfd，以及 arena memfd
+    // （rpc/readiness.h, rpc/arena.h）
+    std::vector<int> fds = rrChannel->takePassedFds();
+    shared_ptr<Arena> arena;
+    if (fds.size() == 2 || fds.size() == 3) {
+        auto readiness = make_shared<Readiness>(fds[0], fds[1]);
+        if (readiness->valid()) {
+            rrChannel->setReadiness(readiness);
+            Readiness::add(pid, readiness);
+        }
+    }
+    if (fds.size() == 1 || fds.size() == 3) {
+        arena = make_shared<Arena>(fds.back());
+        if (arena->valid()) {
+            rrChannel->setArena(arena);
+            Arena::add(pid, arena);
+        } else {
+            arena.reset();
+        }
+    }
+    if (fds.size() > 3) {
+        for (int fd : fds) {
+            ::close(fd);
+        }
+    }
+
+    /*  2. 分配 fd 区间
+     *
+     * 同一 channel 上再次 Atstart，说明 interceptor 的 fd 用完了，
+     * 区间翻倍（起点不变，interceptor 只需预留新增的部分）
+     */
+
+    int count = rrChannel->fdRangeCount();
+    count = count == 0 ? RPC_FD_RANGE_INITIAL
+                       : std::min(count * 2, RPC_FD_RANGE_MAX);
+    rrChannel->setFdRangeCount(count);
+
+    MUQUINETD_LOG(info) << "fd range of " << progname << "[" << pid
+                        << "]: " << RPC_FD_RANGE_START << "+" << count;
+
+    /*  3. 返回信息给 Interceptor */
 
     resp->set_retcode(Response::RetCode::Response_RetCode_OK);
 
     auto atstart = resp->mutable_atstartaction();
-    atstart->set_startfd(4096);
-    atstart->set_count(1024);
+    atstart->set_startfd(RPC_FD_RANGE_START);
+    atstart->set_count(count);
+    if (arena) {
+        atstart->mutable_unknown_fields()->AddVarint(RPC_ARENA_LENGTH,
+                                                     arena->size());
+    }
 }
 
 void
 RequestHandler::onAsyncNewUdpPacket(
-    const weak_ptr<ReqRespChannel>& rrChannel_weak, bool require_addr)
+    const weak_ptr<ReqRespChannel>& rrChannel_weak,
+    const weak_ptr<ReqRespChannel>& carrier_weak, bool require_addr,
+    int64_t len, uint64_t arenaOffset, uint64_t arenaLength)
 {
     shared_ptr<ReqRespChannel> rrChannel = rrChannel_weak.lock();
-    if (!rrChannel)
+    shared_ptr<ReqRespChannel> carrier = carrier_weak.lock();
+    if (!rrChannel || !carrier)
         return;
 
     const auto& so = rrChannel->socket();
 
-    shared_ptr<SocketBuffer> skbuf_head;
+    SocketBufferPtr skbuf_head;
     sockaddr_in peeraddr;
     bzero(&peeraddr, sizeof(sockaddr_in));
 
@@ -574,16 +871,15 @@ RequestHandler::onAsyncNewUdpPacket(
     so->takeFromRecvQ(peeraddr, skbuf_head);
 
     // prepare Response
-    auto resp = make_shared<Response>();
+    auto resp = MessagePool::newResponse();
     auto* callRet = resp->mutable_recvfromcall();
-    std::string* buf = callRet->mutable_buf();
 
     // buf (userpayload)
-    shared_ptr<SocketBuffer> curr_skbuf;
-    for (curr_skbuf = skbuf_head; curr_skbuf; curr_skbuf = curr_skbuf->next) {
-        int len = curr_skbuf->user_payload_end - curr_skbuf->user_payload_begin;
-        buf->append(curr_skbuf->user_payload_begin, len);
-    }
+    uint64_t rxTimestamp = skbuf_head ? skbuf_head->rxTimestamp : 0;
+    char* region = arenaRegionOf(so, arenaOffset, arenaLength);
+    int ret = setRecvfromPayload(callRet, so, peeraddr, std::move(skbuf_head),
+                                 region,
+                                 recvfromCapacity(len, region, arenaLength));
 
     // addr
     if (require_addr) {
@@ -591,40 +887,52 @@ RequestHandler::onAsyncNewUdpPacket(
     }
 
     resp->set_retcode(Response::RetCode::Response_RetCode_OK);
-    callRet->set_ret(buf->length());
-    rrChannel->write(resp);
+    callRet->set_ret(ret);
+    carrier->write(resp);
+
+    if (rxTimestamp) {
+        Latency::record(Latency::RECVFROM_WAKEUP_UDP,
+                        Latency::now() - rxTimestamp);
+    }
 }
 
 void
 RequestHandler::onAsyncNewTcpPacket(
-    const weak_ptr<ReqRespChannel>& rrChannel_weak)
+    const weak_ptr<ReqRespChannel>& rrChannel_weak,
+    const weak_ptr<ReqRespChannel>& carrier_weak, int64_t len,
+    uint64_t arenaOffset, uint64_t arenaLength)
 {
     // TODO
     shared_ptr<ReqRespChannel> rrChannel = rrChannel_weak.lock();
-    if (!rrChannel)
+    shared_ptr<ReqRespChannel> carrier = carrier_weak.lock();
+    if (!rrChannel || !carrier)
         return;
 
     const auto& so = rrChannel->socket();
 
-    shared_ptr<SocketBuffer> skbuf_head;
+    SocketBufferPtr skbuf_head;
     sockaddr_in peeraddr; // just a placeholder
 
     // take packet
     so->takeFromRecvQ(peeraddr, skbuf_head);
 
     // prepare Response
-    auto resp = make_shared<Response>();
+    auto resp = MessagePool::newResponse();
     auto* callRet = resp->mutable_recvfromcall();
-    std::string* buf = callRet->mutable_buf();
 
     // buf (userpayload)
-    shared_ptr<SocketBuffer> curr_skbuf;
-    for (curr_skbuf = skbuf_head; curr_skbuf; curr_skbuf = curr_skbuf->next) {
-        int len = curr_skbuf->user_payload_end - curr_skbuf->user_payload_begin;
-        buf->append(curr_skbuf->user_payload_begin, len);
-    }
+    uint64_t rxTimestamp = skbuf_head ? skbuf_head->rxTimestamp : 0;
+    char* region = arenaRegionOf(so, arenaOffset, arenaLength);
+    int ret = setRecvfromPayload(callRet, so, peeraddr, std::move(skbuf_head),
+                                 region,
+                                 recvfromCapacity(len, region, arenaLength));
 
     resp->set_retcode(Response::RetCode::Response_RetCode_OK);
-    callRet->set_ret(buf->length());
-    rrChannel->write(resp);
+    callRet->set_ret(ret);
+    carrier->write(resp);
+
+    if (rxTimestamp) {
+        Latency::record(Latency::RECVFROM_WAKEUP_TCP,
+                        Latency::now() - rxTimestamp);
+    }
 }
@@ -21,6 +21,7 @@
 #define MUQUINETD_MUX_REQRESPCHANNEL_REQUESTHANDLER_H
 
 #include <memory>
+#include <stdint.h>
 
 class Request;
 class Response;
@@ -100,8 +101,16 @@ private:
     // clang-format on
 
     // weak_ptr rather than shared_ptr is essential
+    // len: that of Request.Recvfrom
+    // arenaOffset/arenaLength: the region the payload goes to, see
+    // rpc/arena.h (arenaLength 0 for none)
+    // the second ReqRespChannel carries the Response, see carrier()
     void onAsyncNewUdpPacket(const std::weak_ptr<ReqRespChannel>&,
-                             bool require_addr);
-    void onAsyncNewTcpPacket(const std::weak_ptr<ReqRespChannel>&);
+                             const std::weak_ptr<ReqRespChannel>&,
+                             bool require_addr, int64_t len,
+                             uint64_t arenaOffset, uint64_t arenaLength);
+    void onAsyncNewTcpPacket(const std::weak_ptr<ReqRespChannel>&,
+                             const std::weak_ptr<ReqRespChannel>&, int64_t len,
+                             uint64_t arenaOffset, uint64_t arenaLength);
 };
 #endif
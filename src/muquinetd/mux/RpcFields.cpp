@@ -0,0 +1,55 @@
+/*
+ * muQuinet, an userspace TCP/IP network stack.
+ * Copyright (C) 2018 rtdarwin
+ *
+ * This program is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+
+ * You should have received a copy of the GNU General Public
+ * License along with this program.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#include "RpcFields.h"
+
+#include <google/protobuf/unknown_field_set.h>
+
+#include "rpc/cpp_out/request.pb.h"
+#include "rpc/readiness.h"
+
+namespace RpcFields {
+
+bool
+varintOf(const google::protobuf::UnknownFieldSet& fields, int number,
+         uint64_t* value)
+{
+    using google::protobuf::UnknownField;
+
+    for (int i = 0; i < fields.field_count(); ++i) {
+        const UnknownField& f = fields.field(i);
+        if (f.number() == number && f.type() == UnknownField::TYPE_VARINT) {
+            *value = f.varint();
+            return true;
+        }
+    }
+    return false;
+}
+
+bool
+isAsyncSend(const Request& req)
+{
+    uint64_t async;
+    return req.has_sendtocall() &&
+           varintOf(req.sendtocall().unknown_fields(), RPC_SEND_ASYNC,
+                    &async) &&
+           async;
+}
+
+} // namespace RpcFields
@@ -0,0 +1,49 @@
+/*
+ * muQuinet, an userspace TCP/IP network stack.
+ * Copyright (C) 2018 rtdarwin
+ *
+ * This program is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+
+ * You should have received a copy of the GNU General Public
+ * License along with this program.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef MUQUINETD_MUX_RPCFIELDS_H
+#define MUQUINETD_MUX_RPCFIELDS_H
+
+#include <stdint.h>
+
+namespace google {
+namespace protobuf {
+class UnknownFieldSet;
+}
+}
+
+class Request;
+
+/** RPC fields outside of the .proto files (see rpc/rpc.h)
+ *
+ * They are varint unknown fields to the generated code. Added with
+ * UnknownFieldSet::AddVarint(), looked up here.
+ */
+namespace RpcFields {
+
+// false if there is no varint field `number'
+bool varintOf(const google::protobuf::UnknownFieldSet&, int number,
+              uint64_t* value);
+
+// A Sendto the interceptor does not wait for, see rpc/readiness.h
+bool isAsyncSend(const Request&);
+
+} // namespace RpcFields
+
+#endif // MUQUINETD_MUX_RPCFIELDS_H
@@ -26,13 +26,21 @@
 #include <assert.h>
 #include <fcntl.h>
 #include <netinet/in.h>
+#include <poll.h>
 #include <strings.h>
 #include <unistd.h>
 
 #include <functional>
 #include <utility>
+#include <vector>
 
 #include "muquinetd/Logging.h"
+#include "muquinetd/SocketBuffer.h"
+#include "muquinetd/base/Counters.h"
+#include "muquinetd/base/Probes.h"
+#include "muquinetd/base/Trace.h"
+#include "muquinetd/mux/Arena.h"
+#include "muquinetd/mux/Readiness.h"
 #include "muquinetd/mux/SelectableChannel.h"
 #include "muquinetd/mux/req-resp-channel/ReqRespChannel.h"
 #include "third-party/concurrentqueue/blockingconcurrentqueue.h"
@@ -57,15 +65,27 @@ struct Socket::Impl
     std::weak_ptr<ReqRespChannel> rrChannel;
     std::shared_ptr<Pcb> pcb;
 
+    std::shared_ptr<Readiness> readiness;
+    int readinessSlot = -1;
+    std::shared_ptr<Arena> arena;
+    uint32_t prefetchBudget = 0;
+
     typedef BlockingConcurrentQueue<
-        std::pair<struct sockaddr_in, shared_ptr<SocketBuffer>>>
+        std::pair<struct sockaddr_in, SocketBufferPtr>>
         RecvQType;
     RecvQType recvQ;
     static const int recvQlimit = 128;
+    // head of recvQ taken by prefetch() that did not fit in the ring,
+    // EventLoop only
+    std::pair<struct sockaddr_in, SocketBufferPtr> held;
+    bool holding = false;
 
 public:
+    bool takeHeld(struct sockaddr_in&, SocketBufferPtr&);
+    void prefetch();
     void markSChannelAsReadable();
     void sChannelReadCb();
+    void updateReadable();
 };
 
 Socket::Socket(enum Type t, bool isnonblocking)
@@ -92,6 +112,10 @@ Socket::Socket(enum Type t, bool isnonblocking)
 Socket::~Socket()
 {
     MUQUINETD_LOG(debug) << "Destroy Socket";
+
+    if (_pImpl->readiness) {
+        _pImpl->readiness->freeSlot(_pImpl->readinessSlot);
+    }
 }
 
 enum Socket::Type
@@ -137,34 +161,129 @@ Socket::setOnAsyncNewPacketCB(std::function<void()> cb)
 }
 
 void
-Socket::putToRecvQ(struct sockaddr_in& peeraddr,
-                   const std::shared_ptr<SocketBuffer>& skbuf)
+Socket::putToRecvQ(struct sockaddr_in& peeraddr, SocketBufferPtr skbuf)
 {
     auto& q = _pImpl->recvQ;
 
-    if (q.size_approx() > Socket::Impl::recvQlimit)
+    if (q.size_approx() > Socket::Impl::recvQlimit) {
+        Counters::add(Counters::SOCKET_RECVQ_DROP_FULL);
+        Trace::record(Trace::SOCKET_PUTRECVQ, skbuf.get(), 0);
+        MUQUINETD_PROBE3(socket_enqueue, this, skbuf.get(), 0);
         return;
+    }
+
+    Trace::record(Trace::SOCKET_PUTRECVQ, skbuf.get(), 1);
+    MUQUINETD_PROBE3(socket_enqueue, this, skbuf.get(), 1);
 
-    q.enqueue(std::make_pair(peeraddr, skbuf));
+    q.enqueue(std::make_pair(peeraddr, std::move(skbuf)));
+    Counters::add(Counters::SOCKET_RECVQ_ENQUEUED);
+    Counters::add(Counters::SOCKET_RECVQ_DEPTH);
+    if (_pImpl->readiness) {
+        _pImpl->readiness->set(_pImpl->readinessSlot, POLLIN);
+    }
     _pImpl->markSChannelAsReadable();
 }
 
 void
-Socket::takeFromRecvQ(struct sockaddr_in& addr,
-                      std::shared_ptr<SocketBuffer>& skbuf)
+Socket::takeFromRecvQ(struct sockaddr_in& addr, SocketBufferPtr& skbuf)
 {
+    if (_pImpl->takeHeld(addr, skbuf))
+        return;
+
     auto pairToPopulate = std::make_pair(std::ref(addr), std::ref(skbuf));
 
     _pImpl->recvQ.wait_dequeue(pairToPopulate);
+    Counters::add(Counters::SOCKET_RECVQ_DEPTH, -1);
+    MUQUINETD_PROBE2(socket_dequeue, this, skbuf.get());
+    _pImpl->updateReadable();
 }
 
 bool
-Socket::try_takeFromRecvQ(struct sockaddr_in& addr,
-                          std::shared_ptr<SocketBuffer>& skbuf)
+Socket::try_takeFromRecvQ(struct sockaddr_in& addr, SocketBufferPtr& skbuf)
 {
+    if (_pImpl->takeHeld(addr, skbuf))
+        return true;
+
     auto pairToPopulate = std::make_pair(std::ref(addr), std::ref(skbuf));
 
-    return _pImpl->recvQ.try_dequeue(pairToPopulate);
+    if (!_pImpl->recvQ.try_dequeue(pairToPopulate))
+        return false;
+
+    Counters::add(Counters::SOCKET_RECVQ_DEPTH, -1);
+    MUQUINETD_PROBE2(socket_dequeue, this, skbuf.get());
+    _pImpl->updateReadable();
+    return true;
+}
+
+void
+Socket::putBackToRecvQ(const struct sockaddr_in& addr, SocketBufferPtr skbuf)
+{
+    assert(!_pImpl->holding);
+
+    _pImpl->held.first = addr;
+    _pImpl->held.second = std::move(skbuf);
+    _pImpl->holding = true;
+    _pImpl->updateReadable();
+}
+
+void
+Socket::setReadiness(const std::shared_ptr<Readiness>& r, int slot)
+{
+    _pImpl->readiness = r;
+    _pImpl->readinessSlot = slot;
+
+    // sending never blocks on a muQuinet socket
+    r->set(slot, POLLOUT);
+}
+
+void
+Socket::addSendCredits(int bytes)
+{
+    if (_pImpl->readiness) {
+        _pImpl->readiness->addCredits(_pImpl->readinessSlot, bytes);
+    }
+}
+
+void
+Socket::setSendError(int errno_)
+{
+    if (_pImpl->readiness) {
+        _pImpl->readiness->setError(_pImpl->readinessSlot, errno_);
+    }
+}
+
+void
+Socket::enablePrefetch(uint32_t budget)
+{
+    if (_pImpl->readiness &&
+        _pImpl->readiness->allocRing(_pImpl->readinessSlot)) {
+        _pImpl->prefetchBudget = budget;
+    }
+}
+
+bool
+Socket::prefetched()
+{
+    return _pImpl->prefetchBudget &&
+           _pImpl->readiness->prefetched(_pImpl->readinessSlot);
+}
+
+void
+Socket::prefetch()
+{
+    _pImpl->prefetch();
+}
+
+shared_ptr<Arena>
+Socket::arena()
+{
+    return _pImpl->arena;
+}
+
+void
+Socket::setArena(const std::shared_ptr<Arena>& a)
+{
+    _pImpl->arena = a;
 }
 
 weak_ptr<ReqRespChannel>
@@ -193,12 +312,72 @@ Socket::setPcb(const std::shared_ptr<Pcb>& p)
     _pImpl->pcb = p;
 }
 
+bool
+Socket::Impl::takeHeld(struct sockaddr_in& addr, SocketBufferPtr& skbuf)
+{
+    if (!holding)
+        return false;
+
+    addr = held.first;
+    skbuf = std::move(held.second);
+    holding = false;
+    updateReadable();
+    return true;
+}
+
+void
+Socket::Impl::prefetch()
+{
+    // 有 recv 在等时，新包直接交给它
+    if (!prefetchBudget || waiting)
+        return;
+
+    std::vector<struct iovec> iov;
+    for (;;) {
+        if (!holding) {
+            if (!recvQ.try_dequeue(held))
+                break;
+            holding = true;
+            Counters::add(Counters::SOCKET_RECVQ_DEPTH, -1);
+        }
+
+        iov.clear();
+        for (auto* skbuf = held.second.get(); skbuf; skbuf = skbuf->next.get()) {
+            iov.push_back({ skbuf->user_payload_begin,
+                            (size_t)(skbuf->user_payload_end -
+                                     skbuf->user_payload_begin) });
+        }
+        if (!readiness->putRecord(readinessSlot, prefetchBudget, held.first,
+                                  iov.data(), iov.size())) {
+            break;
+        }
+        held.second.reset();
+        holding = false;
+        Counters::add(Counters::SOCKET_RECVQ_PREFETCHED);
+    }
+
+    updateReadable();
+}
+
 void
 Socket::Impl::markSChannelAsReadable()
 {
     write(new_packet_notify_pipe[1], "1", 1);
 }
 
+void
+Socket::Impl::updateReadable()
+{
+    if (!readiness)
+        return;
+
+    // 先清再查：与 putToRecvQ 的 "先入队再置位" 交错时不会丢掉 POLLIN
+    readiness->clear(readinessSlot, POLLIN);
+    if (holding || recvQ.size_approx() > 0) {
+        readiness->set(readinessSlot, POLLIN);
+    }
+}
+
 void
 Socket::Impl::sChannelReadCb()
 {
@@ -208,6 +387,7 @@ Socket::Impl::sChannelReadCb()
         ;
 
     if (!this->waiting) {
+        prefetch();
         return;
     }
 
@@ -221,4 +401,5 @@ Socket::Impl::sChannelReadCb()
     }
 
     this->waiting = false;
+    prefetch();
 }
@@ -24,8 +24,10 @@
 #include <memory>
 #include <netinet/in.h>
 
+class Arena;
+class Readiness;
 class ReqRespChannel;
-class SocketBuffer;
+class SocketBufferPtr;
 class SelectableChannel;
 class Pcb;
 
@@ -54,9 +56,30 @@ public:
     void setOnAsyncNewPacketCB(std::function<void()>);
     SelectableChannel* getAsyncNewPacketNotifyChannel();
 
-    void putToRecvQ(struct sockaddr_in&, const std::shared_ptr<SocketBuffer>&);
-    void takeFromRecvQ(struct sockaddr_in&, std::shared_ptr<SocketBuffer>&);
-    bool try_takeFromRecvQ(struct sockaddr_in&, std::shared_ptr<SocketBuffer>&);
+    void putToRecvQ(struct sockaddr_in&, SocketBufferPtr);
+    void takeFromRecvQ(struct sockaddr_in&, SocketBufferPtr&);
+    bool try_takeFromRecvQ(struct sockaddr_in&, SocketBufferPtr&);
+    // The unread rest of what was just taken, taken first next time.
+    // Stream sockets only, which are never prefetched.
+    void putBackToRecvQ(const struct sockaddr_in&, SocketBufferPtr);
+
+    // readiness slot of the interceptor process, kept up to date with the
+    // receive queue. Freed with the Socket.
+    void setReadiness(const std::shared_ptr<Readiness>&, int slot);
+    // asynchronous sends of the interceptor (rpc/readiness.h)
+    void addSendCredits(int bytes);
+    void setSendError(int errno_);
+    // 接收队列提前推给 interceptor 的 prefetch ring (rpc/readiness.h),
+    // at most `budget' bytes at a time. After setReadiness().
+    void enablePrefetch(uint32_t budget);
+    // Records the interceptor still has to take, that come before the
+    // receive queue
+    bool prefetched();
+    // Moves what fits of the receive queue to the ring
+    void prefetch();
+    // payload arena of the interceptor process, nullptr if none
+    std::shared_ptr<Arena> arena();
+    void setArena(const std::shared_ptr<Arena>&);
 
     // 上接 ReqRespChannel （其生命周期被 ReqRespChannel 管理）
     std::weak_ptr<ReqRespChannel> reqRespChannel();
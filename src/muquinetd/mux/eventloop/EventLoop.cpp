@@ -23,6 +23,7 @@
 #include <vector>
 
 #include "muquinetd/Logging.h"
+#include "muquinetd/base/Probes.h"
 #include "muquinetd/mux/SelectableChannel.h"
 #include "muquinetd/mux/eventloop/Poller.h"
 
@@ -115,6 +116,7 @@ EventLoop::loop()
         auto actives = _pImpl->activeChannels;
         actives.clear();
         _pImpl->poller->poll(_pImpl->pollTimeoutMs, actives);
+        MUQUINETD_PROBE1(eventloop_wakeup, actives.size());
 
         _pImpl->handingEvents = true;
         for (const auto& c : actives) {
@@ -103,7 +103,7 @@ SelectableChannel::enableReading()
 void
 SelectableChannel::disableReading()
 {
-    _pImpl->eventsInterested &= EventMasks::noneEvent;
+    _pImpl->eventsInterested &= ~(EventMasks::readEvent);
     if (_pImpl->ownerLoop) {
         _pImpl->ownerLoop->updateChannel(this);
     }
@@ -49,18 +49,17 @@ MasterListener::MasterListener()
 
     /*  1. 准备 创建/绑定 UNIX socket 所需的数据 */
 
-    const char* socketPath =
-        RPC_MASTER_LISTENER_SOCKET_DIR "/" RPC_MASTER_LISTENER_SOCKET_NAME;
-
     struct sockaddr_un sa;
     memset(&sa, 0, sizeof(struct sockaddr_un));
     sa.sun_family = AF_UNIX;
-    strncpy(sa.sun_path, socketPath, sizeof(sa.sun_path) - 1);
+    snprintf(sa.sun_path, sizeof(sa.sun_path), "%s/%s",
+             rpc_master_listener_socket_dir(), RPC_MASTER_LISTENER_SOCKET_NAME);
+    const char* socketPath = sa.sun_path;
 
     /*  2. 创建/绑定 UNIX socket */
 
     // 保证父目录存在 & 删除可能存在的遗留文件
-    ::mkdir(RPC_MASTER_LISTENER_SOCKET_DIR,
+    ::mkdir(rpc_master_listener_socket_dir(),
             S_IRWXU | S_IRWXG | S_IROTH | S_IXOTH);
     unlink(socketPath);
 
@@ -90,8 +89,10 @@ MasterListener::MasterListener()
 MasterListener::~MasterListener()
 {
     ::close(_pImpl->fd);
-    ::unlink(RPC_MASTER_LISTENER_SOCKET_DIR
-             "/" RPC_MASTER_LISTENER_SOCKET_NAME);
+    struct sockaddr_un sa;
+    snprintf(sa.sun_path, sizeof(sa.sun_path), "%s/%s",
+             rpc_master_listener_socket_dir(), RPC_MASTER_LISTENER_SOCKET_NAME);
+    ::unlink(sa.sun_path);
 }
 
 void
@@ -128,7 +129,9 @@ MasterListener::Impl::onReadReady()
     /*  1. accept */
 
     int connfd;
-    while ((connfd = ::accept(listenfd, NULL, NULL)) != -1) {
+    // ReqRespChannel never blocks the EventLoop on its connection
+    while ((connfd = ::accept4(listenfd, NULL, NULL,
+                               SOCK_NONBLOCK | SOCK_CLOEXEC)) != -1) {
         if (callback) {
             callback(connfd);
         }
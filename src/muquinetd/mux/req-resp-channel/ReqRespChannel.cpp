@@ -19,13 +19,26 @@
 
 #include "ReqRespChannel.h"
 
+#include <google/protobuf/io/coded_stream.h>
 #include <google/protobuf/util/json_util.h>
+#include <algorithm>
+#include <deque>
+#include <map>
 #include <string>
+#include <sys/socket.h>
 #include <sys/un.h>
 #include <unistd.h>
 
 #include "muquinetd/Logging.h"
 #include "muquinetd/Mux.h"
+#include "muquinetd/base/Counters.h"
+#include "muquinetd/base/MutexLock.h"
+#include "muquinetd/base/Probes.h"
+#include "muquinetd/base/Trace.h"
+#include "muquinetd/mux/Arena.h"
+#include "muquinetd/mux/MessagePool.h"
+#include "muquinetd/mux/RpcFields.h"
+#include "muquinetd/mux/Readiness.h"
 #include "muquinetd/mux/SelectableChannel.h"
 #include "rpc/cpp_out/request.pb.h"
 #include "rpc/cpp_out/response.pb.h"
@@ -40,6 +53,29 @@ using std::vector;
 
 class Connection;
 
+namespace {
+
+// socket id -> shared ReqRespChannel, see rpc/rpc.h
+MutexLock sharedLock;
+std::map<uint64_t, weak_ptr<ReqRespChannel>> sharedChannels;
+uint64_t nextSocketId = 1;
+
+// Streams a message as JSON, only converted when the log record is kept
+struct JsonOf
+{
+    const google::protobuf::Message& msg;
+};
+
+std::ostream&
+operator<<(std::ostream& os, const JsonOf& json)
+{
+    string jsonStr;
+    google::protobuf::util::MessageToJsonString(json.msg, &jsonStr);
+    return os << jsonStr;
+}
+
+} // namespace {
+
 struct ReqRespChannel::Impl
 {
     /*  Data members */
@@ -47,8 +83,16 @@ struct ReqRespChannel::Impl
     int fd;
     unique_ptr<SelectableChannel> sChannel; // For EventLoop use
 
+    // shared: 没有 fd，carrier 只在处理 Request 期间指向带来它的 channel
+    uint64_t socketId = 0;
+    weak_ptr<ReqRespChannel> carrier;
+
     string peer; // Name of peer interceptor
-    pid_t peerPid;
+    pid_t peerPid = -1;
+    int fdRangeCount = 0;
+    std::vector<int> passedFds;
+    shared_ptr<Readiness> readiness;
+    shared_ptr<Arena> arena;
 
     shared_ptr<Socket> socket;
 
@@ -63,8 +107,28 @@ struct ReqRespChannel::Impl
      > onNewRequestFunc;
     // clang-format on
     void write(const shared_ptr<Response>&);
+    void writeBatch(const vector<shared_ptr<Response>>&);
+    void writeBytes(const char* buf, int needwr, int returningCase);
+
+    shared_ptr<Response> handle(const shared_ptr<ReqRespChannel>&,
+                                const shared_ptr<Request>&, int nbytes);
+    void onBatch(const shared_ptr<ReqRespChannel>&, const char* bytes,
+                 int nbytes);
+
+    static shared_ptr<Response> badSocketResponse(const Request&);
+
+    // Responses the peer was not ready to take, oldest first
+    std::deque<string> outQ;
+    // Messages of the batch being handled
+    vector<shared_ptr<Request>> batchReqs;
+    vector<shared_ptr<Response>> batchResps;
+    static const size_t outQHighWater = 256;
+    static const int maxReadsPerWakeup = 64;
 
     void onReadReady(const shared_ptr<ReqRespChannel>&);
+    // false once there is nothing more to read now
+    bool readOne(const shared_ptr<ReqRespChannel>&);
+    void onWriteReady();
     void onPeerWritingClose(const shared_ptr<ReqRespChannel>&);
 };
 
@@ -76,6 +140,20 @@ ReqRespChannel::ReqRespChannel(int fd)
 
     _pImpl.reset(new ReqRespChannel::Impl);
     _pImpl->fd = fd;
+    if (fd == -1) {
+        return;
+    }
+
+    // 对端 pid 以内核给的为准，不信 Request 里的 pid
+    struct ucred cred;
+    socklen_t credlen = sizeof(cred);
+    if (getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &cred, &credlen) == 0) {
+        _pImpl->peerPid = cred.pid;
+    } else {
+        int errno_ = errno;
+        MUQUINETD_LOG(warning) << "getsockopt SO_PEERCRED "
+                               << string(strerror(errno_));
+    }
 
     /*  1. SelectableChannel for EventLoop */
 
@@ -84,6 +162,7 @@ ReqRespChannel::ReqRespChannel(int fd)
     sChannel->enableReading();
     sChannel->setOnReadCB(
         [this]() { this->_pImpl->onReadReady(this->shared_from_this()); });
+    sChannel->setOnWriteCB([this]() { this->_pImpl->onWriteReady(); });
     sChannel->setOnCloseCB([this]() {
         this->_pImpl->onPeerWritingClose(this->shared_from_this());
     });
@@ -91,8 +170,14 @@ ReqRespChannel::ReqRespChannel(int fd)
 
 ReqRespChannel::~ReqRespChannel()
 {
-    _pImpl->sChannel->unregisterSelf();
-    ::close(_pImpl->fd);
+    if (_pImpl->socketId) {
+        MutexLockGuard l(sharedLock);
+        sharedChannels.erase(_pImpl->socketId);
+    }
+    if (_pImpl->sChannel) {
+        _pImpl->sChannel->unregisterSelf();
+        ::close(_pImpl->fd);
+    }
 
     {
         MUQUINETD_LOG(debug) << "Destroy ReqRespChannel";
@@ -111,6 +196,17 @@ ReqRespChannel::setOnNewRequestCB(const std::function<shared_ptr<Response>(
 void
 ReqRespChannel::write(const std::shared_ptr<Response>& resp)
 {
+    if (_pImpl->socketId) {
+        auto c = carrier();
+        if (!c) {
+            MUQUINETD_LOG(warning) << "Response of shared socket "
+                                   << _pImpl->socketId
+                                   << " dropped, no channel to carry it";
+            return;
+        }
+        c->write(resp);
+        return;
+    }
     _pImpl->write(resp);
 }
 
@@ -132,12 +228,55 @@ ReqRespChannel::setPeerPid(pid_t p)
     _pImpl->peerPid = p;
 }
 
+pid_t
+ReqRespChannel::peerPid()
+{
+    return _pImpl->peerPid;
+}
+
 const std::string&
 ReqRespChannel::peerName()
 {
     return _pImpl->peer;
 }
 
+int
+ReqRespChannel::fdRangeCount()
+{
+    return _pImpl->fdRangeCount;
+}
+
+void
+ReqRespChannel::setFdRangeCount(int c)
+{
+    _pImpl->fdRangeCount = c;
+}
+
+std::vector<int>
+ReqRespChannel::takePassedFds()
+{
+    // those of a shared socket's Request came with its carrier
+    if (_pImpl->socketId) {
+        auto c = carrier();
+        return c ? c->takePassedFds() : std::vector<int>();
+    }
+    std::vector<int> fds;
+    fds.swap(_pImpl->passedFds);
+    return fds;
+}
+
+void
+ReqRespChannel::setReadiness(const std::shared_ptr<Readiness>& r)
+{
+    _pImpl->readiness = r;
+}
+
+void
+ReqRespChannel::setArena(const std::shared_ptr<Arena>& a)
+{
+    _pImpl->arena = a;
+}
+
 shared_ptr<Socket>
 ReqRespChannel::socket()
 {
@@ -150,63 +289,339 @@ ReqRespChannel::setSocket(const std::shared_ptr<Socket>& s)
     _pImpl->socket = s;
 }
 
+shared_ptr<ReqRespChannel>
+ReqRespChannel::newShared(pid_t pid)
+{
+    auto ch = make_shared<ReqRespChannel>(-1);
+    ch->setPeerPid(pid);
+    {
+        MutexLockGuard l(sharedLock);
+        ch->_pImpl->socketId = nextSocketId++;
+        sharedChannels[ch->_pImpl->socketId] = ch;
+    }
+    Mux::get()->addRRChannel(ch);
+    return ch;
+}
+
+shared_ptr<ReqRespChannel>
+ReqRespChannel::ofSocketId(uint64_t id)
+{
+    MutexLockGuard l(sharedLock);
+
+    auto it = sharedChannels.find(id);
+    return it == sharedChannels.end() ? nullptr : it->second.lock();
+}
+
+uint64_t
+ReqRespChannel::socketId()
+{
+    return _pImpl->socketId;
+}
+
+shared_ptr<ReqRespChannel>
+ReqRespChannel::carrier()
+{
+    if (_pImpl->socketId) {
+        return _pImpl->carrier.lock();
+    }
+    return shared_from_this();
+}
+
 void
 ReqRespChannel::Impl::onReadReady(const shared_ptr<ReqRespChannel>& rrChannel)
+{
+    // 防止本函数运行过程中 rrChannel 被销毁（不这么做的话，确实会）
+    shared_ptr<ReqRespChannel> holdit{ rrChannel };
+
+    // 一次唤醒把已到的 Request 都处理掉，但有上限，免得饿死别的 channel；
+    // 积压的 Response 太多（对端不读）时也不再读
+    for (int i = 0; i < maxReadsPerWakeup && outQ.size() < outQHighWater;
+         ++i) {
+        if (!readOne(rrChannel))
+            return;
+    }
+}
+
+bool
+ReqRespChannel::Impl::readOne(const shared_ptr<ReqRespChannel>& rrChannel)
 {
     // 每线程一个 rdbuf (从 unix socket 读取数据)
     // （这么做可能有点违反对象编程直觉，但可以极大减少存储空间消耗）
     static __thread char rdbuf[RPC_MESSAGE_MAX_SIZE];
 
-    // 防止本函数运行过程中 rrChannel 被销毁（不这么做的话，确实会）
-    shared_ptr<ReqRespChannel> holdit{ rrChannel };
-
-    shared_ptr<Request> req = make_shared<Request>();
+    shared_ptr<Request> req = MessagePool::newRequest();
     shared_ptr<Response> resp;
 
     /*  1. read the message */
 
-    memset(rdbuf, 0, sizeof(rdbuf));
-    int nread = ::read(fd, rdbuf, sizeof(rdbuf));
+    // the interceptor may pass fds along (see rpc/readiness.h)
+    union
+    {
+        char buf[CMSG_SPACE(sizeof(int) * 4)];
+        struct cmsghdr align;
+    } cmsgbuf;
+    struct iovec iov = { rdbuf, sizeof(rdbuf) };
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = cmsgbuf.buf;
+    msg.msg_controllen = sizeof(cmsgbuf.buf);
+
+    // 不论 fd 是否 nonblocking，读空了都要返回
+    int nread = ::recvmsg(fd, &msg, MSG_CMSG_CLOEXEC | MSG_DONTWAIT);
+    if (nread > 0) {
+        for (struct cmsghdr* c = CMSG_FIRSTHDR(&msg); c;
+             c = CMSG_NXTHDR(&msg, c)) {
+            if (c->cmsg_level != SOL_SOCKET || c->cmsg_type != SCM_RIGHTS)
+                continue;
+            int n = (c->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+            int* fds = (int*)CMSG_DATA(c);
+            passedFds.insert(passedFds.end(), fds, fds + n);
+        }
+    }
     if (nread == -1) {
         int errno_ = errno;
 
         if (errno_ == EAGAIN || errno_ == EWOULDBLOCK) {
-            return;
+            return false;
+        }
+        if (errno_ == EINTR) {
+            return true;
         }
 
-        // MUQUINETD_LOG(error) << "::read " << string(strerror(errno_))
-        //                      << ". This channel will be closed";
+        MUQUINETD_LOG(error) << "::recvmsg " << string(strerror(errno_));
         // sChannel->unregisterSelf();
-        // return;
+        return false;
     } else if (nread == 0) {
         MUQUINETD_LOG(info) << "::read EOF"
                              << ". This channel will be closed";
         Mux::get()->removeRRChannel(rrChannel);
-        return;
+        return false;
     } else if (nread == RPC_MESSAGE_MAX_SIZE) {
         MUQUINETD_LOG(warning) << "::read call get RPC_MESSAGE_MAX_SIZE bytes";
     }
 
-    /*  2. parse the message */
+    /*  2. parse the message, handle it, write the response */
+
+    if (nread > 0 && rdbuf[0] == RPC_BATCH_MARKER) {
+        onBatch(rrChannel, rdbuf + 1, nread - 1);
+    } else {
+        req->ParseFromArray(rdbuf, nread);
+        resp = handle(rrChannel, req, nread);
+        // asynchronous sends get no Response, see rpc/readiness.h
+        if (resp) {
+            write(resp);
+        }
+        MUQUINETD_PROBE3(rpc_finish, fd, req->calling_case(),
+                         resp ? resp->returning_case() : 0);
+    }
+
+    for (int passed : passedFds) {
+        ::close(passed);
+    }
+    passedFds.clear();
+    return true;
+}
 
-    req->ParseFromArray(rdbuf, nread);
+// EBADF：借反射设置。Response 中各 call 的字段号与 Request 的相同，
+// 且 ret 均为 1 号字段、errno_ 均为 2 号字段
+shared_ptr<Response>
+ReqRespChannel::Impl::badSocketResponse(const Request& req)
+{
+    using google::protobuf::FieldDescriptor;
+    using google::protobuf::Message;
 
-    {
-        // For DEBUG
-        string jsonStr;
-        google::protobuf::util::MessageToJsonString(*req, &jsonStr);
-        MUQUINETD_LOG(debug)
-            << "Recv " << nread << " bytes, request message: " << jsonStr;
+    auto resp = MessagePool::newResponse();
+    resp->set_retcode(Response::RetCode::Response_RetCode_OK);
+
+    const FieldDescriptor* callField =
+        Response::descriptor()->FindFieldByNumber(req.calling_case());
+    if (!callField) {
+        return resp;
+    }
+    Message* call =
+        resp->GetReflection()->MutableMessage(resp.get(), callField);
+    const auto* ret = call->GetDescriptor()->FindFieldByNumber(1);
+    const auto* errno_ = call->GetDescriptor()->FindFieldByNumber(2);
+    if (ret) {
+        call->GetReflection()->SetInt32(call, ret, -1);
+    }
+    if (errno_) {
+        call->GetReflection()->SetInt32(call, errno_, EBADF);
     }
+    return resp;
+}
 
-    /*  3. handle the request message, generate response message */
+shared_ptr<Response>
+ReqRespChannel::Impl::handle(const shared_ptr<ReqRespChannel>& rrChannel,
+                             const shared_ptr<Request>& req, int nbytes)
+{
+    MUQUINETD_PROBE2(rpc_start, fd, req->calling_case());
+    Counters::add(Counters::RPC_REQUESTS);
+    if (Counters::RPC_CALLS + req->calling_case() < Counters::RPC_CALLS_END) {
+        Counters::add(Counters::Id(Counters::RPC_CALLS + req->calling_case()));
+    }
+
+    MUQUINETD_LOG(debug) << "Recv " << nbytes
+                         << " bytes, request message: " << JsonOf{ *req };
+
+    // a Request for a shared socket is handled by its own ReqRespChannel
+    shared_ptr<ReqRespChannel> target = rrChannel;
+    uint64_t socketId;
+    if (RpcFields::varintOf(req->unknown_fields(), RPC_SOCKET_ID,
+                            &socketId)) {
+        target = socketId ? ofSocketId(socketId)
+                          : newShared(rrChannel->peerPid());
+        // 只有创建它的进程可以用它
+        if (target && target->peerPid() != rrChannel->peerPid()) {
+            MUQUINETD_LOG(warning) << "Request from pid "
+                                   << rrChannel->peerPid()
+                                   << " for shared socket " << socketId
+                                   << " of pid " << target->peerPid();
+            target.reset();
+        }
+        if (!target) {
+            MUQUINETD_LOG(error) << "Request for unknown shared socket "
+                                 << socketId;
+            // 异步 send 没有人等 Response，多写一个会错位后续调用的 Response；
+            // socket 已不在，错误也无处可记，只能丢弃
+            if (RpcFields::isAsyncSend(*req)) {
+                return nullptr;
+            }
+            return badSocketResponse(*req);
+        }
+    }
 
     assert(onNewRequestFunc);
-    resp = onNewRequestFunc(rrChannel, req);
+    if (target == rrChannel) {
+        return onNewRequestFunc(target, req);
+    }
+
+    // 同一 shared socket 的 Request 可能来自不同线程的 channel，
+    // 延后的 Response 由 RequestHandler 自行记下 carrier()
+    target->_pImpl->carrier = rrChannel;
+    auto resp = onNewRequestFunc(target, req);
+    target->_pImpl->carrier.reset();
+    return resp;
+}
 
-    /*  4. write the message */
+namespace {
 
-    write(resp);
+// Batched calls are Sendto and Recvfrom only
+bool
+batchedCallFailed(const Response& resp)
+{
+    switch (resp.returning_case()) {
+        case Response::kSendtoCall:
+            return resp.sendtocall().ret() < 0;
+        case Response::kRecvfromCall:
+            return resp.recvfromcall().ret() < 0;
+        default:
+            return false;
+    }
+}
+
+shared_ptr<Response>
+canceledResponse(const Request& req)
+{
+    auto resp = MessagePool::newResponse();
+    resp->set_retcode(Response::RetCode::Response_RetCode_OK);
+    switch (req.calling_case()) {
+        case Request::kSendtoCall:
+            resp->mutable_sendtocall()->set_ret(-1);
+            resp->mutable_sendtocall()->set_errno_(ECANCELED);
+            break;
+        case Request::kRecvfromCall:
+            resp->mutable_recvfromcall()->set_ret(-1);
+            resp->mutable_recvfromcall()->set_errno_(ECANCELED);
+            break;
+        default:
+            return nullptr;
+    }
+    return resp;
+}
+
+// Room kept in a batched reply for each Response (canceled ones
+// included) besides a Recvfrom's payload: length, ret, errno_, addr
+const size_t batchReplyOverhead = 64;
+
+} // namespace {
+
+void
+ReqRespChannel::Impl::onBatch(const shared_ptr<ReqRespChannel>& rrChannel,
+                              const char* bytes, int nbytes)
+{
+    google::protobuf::io::CodedInputStream in((const uint8_t*)bytes, nbytes);
+    // kept across batches for their capacity, see the end
+    vector<shared_ptr<Request>>& reqs = batchReqs;
+    vector<shared_ptr<Response>>& resps = batchResps;
+    bool failed = false;
+    // 回复须装进一条 RPC_MESSAGE_MAX_SIZE 的消息，后面的（哪怕被取消）也要留位置
+    size_t used = 1 + RPC_BATCH_MAX * batchReplyOverhead;
+
+    uint32_t msglen;
+    while (in.ReadVarint32(&msglen)) {
+        shared_ptr<Request> req = MessagePool::newRequest();
+        auto limit = in.PushLimit(msglen);
+        if (!req->ParseFromCodedStream(&in)) {
+            MUQUINETD_LOG(error) << "Malformed request in a batch";
+            break;
+        }
+        in.PopLimit(limit);
+
+        // once a call failed, the ones after it are not run
+        shared_ptr<Response> resp;
+        if (failed) {
+            resp = canceledResponse(*req);
+        }
+        // a Recvfrom the rest of the reply has no room for is not run
+        // either, unless it comes first: that one is cut to fit
+        if (!resp && req->has_recvfromcall()) {
+            auto* call = req->mutable_recvfromcall();
+            int64_t room = RPC_MESSAGE_MAX_SIZE - used;
+            int64_t wanted = std::min<int64_t>(call->len(),
+                                               RPC_MESSAGE_BUF_MAX_SIZE);
+            if (wanted > room && !resps.empty()) {
+                resp = canceledResponse(*req);
+                failed = true;
+            } else {
+                call->set_len(std::min(wanted, room));
+            }
+        }
+        if (!resp) {
+            // batched calls never wait
+            if (req->has_recvfromcall()) {
+                auto* call = req->mutable_recvfromcall();
+                call->set_flags(call->flags() | MSG_DONTWAIT);
+            }
+            resp = handle(rrChannel, req, msglen);
+            if (!resp) {
+                MUQUINETD_LOG(error) << "An asynchronous send in a batch";
+                resp = canceledResponse(*req);
+            }
+            failed = failed || batchedCallFailed(*resp);
+
+            // its own overhead was counted already
+            size_t size = resp->ByteSize() + 5;
+            used += size > batchReplyOverhead ? size - batchReplyOverhead : 0;
+        }
+        if (resp->retcode() == Response::RetCode::Response_RetCode_WAIT_NEXT) {
+            MUQUINETD_LOG(error) << "A batched call is waiting";
+        }
+
+        reqs.push_back(req);
+        resps.push_back(resp);
+    }
+
+    writeBatch(resps);
+    for (size_t i = 0; i < resps.size(); ++i) {
+        MUQUINETD_PROBE3(rpc_finish, fd, reqs[i]->calling_case(),
+                         resps[i]->returning_case());
+    }
+    // the messages go back to MessagePool
+    reqs.clear();
+    resps.clear();
 }
 
 void
@@ -220,32 +635,105 @@ ReqRespChannel::Impl::write(const std::shared_ptr<Response>& resp)
 {
     static __thread char wrbuf[RPC_MESSAGE_MAX_SIZE];
 
-    {
-        // For DEBUG
-        string jsonStr;
-        google::protobuf::util::MessageToJsonString(*resp.get(), &jsonStr);
-        MUQUINETD_LOG(debug) << "Send response message: " << jsonStr;
-    }
+    MUQUINETD_LOG(debug) << "Send response message: " << JsonOf{ *resp };
 
     assert(resp->IsInitialized());
     int needwr = resp->ByteSize();
-    assert(needwr <= RPC_MESSAGE_MAX_SIZE);
-    // if (needwr > RPC_MESSAGE_MAX_SIZE) {
-    //     MUQUINETD_LOG(error)
-    //         << "Serialized message size exceeds RPC_MESSAGE_MAX_SIZE";
-    // }
+    if (needwr > RPC_MESSAGE_MAX_SIZE) {
+        MUQUINETD_LOG(error)
+            << "Serialized message size exceeds RPC_MESSAGE_MAX_SIZE"
+            << ". This channel will be closed";
+        // the peer would wait for it forever: EOF ends the channel instead
+        ::shutdown(fd, SHUT_RDWR);
+        return;
+    }
     resp->SerializeToArray(wrbuf, RPC_MESSAGE_MAX_SIZE);
-    int nwritten = ::write(fd, wrbuf, needwr);
-    if (nwritten == -1) {
+    writeBytes(wrbuf, needwr, resp->returning_case());
+}
+
+void
+ReqRespChannel::Impl::writeBatch(const vector<shared_ptr<Response>>& resps)
+{
+    using google::protobuf::io::CodedOutputStream;
+
+    static __thread char wrbuf[RPC_MESSAGE_MAX_SIZE];
+
+    uint8_t* p = (uint8_t*)wrbuf;
+    uint8_t* end = (uint8_t*)wrbuf + RPC_MESSAGE_MAX_SIZE;
+    *p++ = RPC_BATCH_MARKER;
+    for (const auto& resp : resps) {
+        assert(resp->IsInitialized());
+        int len = resp->ByteSize();
+        // onBatch() keeps them within bounds: never expected
+        if (len + 5 > end - p) {
+            MUQUINETD_LOG(error) << "Batched reply exceeds "
+                                    "RPC_MESSAGE_MAX_SIZE. This channel will "
+                                    "be closed";
+            ::shutdown(fd, SHUT_RDWR);
+            return;
+        }
+        p = CodedOutputStream::WriteVarint32ToArray(len, p);
+        p = resp->SerializeWithCachedSizesToArray(p);
+    }
+    writeBytes(wrbuf, p - (uint8_t*)wrbuf, 0);
+}
+
+void
+ReqRespChannel::Impl::writeBytes(const char* buf, int needwr,
+                                 int returningCase)
+{
+    Trace::record(Trace::RPC_WRITE, nullptr, returningCase, needwr);
+
+    // keep the order behind what is queued already
+    if (outQ.empty()) {
+        // SOCK_SEQPACKET: the whole message or nothing
+        int nwritten = ::send(fd, buf, needwr, MSG_DONTWAIT | MSG_NOSIGNAL);
+        if (nwritten == needwr) {
+            return;
+        }
         int errno_ = errno;
-        MUQUINETD_LOG(error) << "::write " << string(strerror(errno_))
-                             << ". This channel will be closed";
-        sChannel->unregisterSelf();
-        return;
-    } else if (nwritten < needwr) {
-        MUQUINETD_LOG(error)
-            << "::write <<" << nwritten << " bytes, which less than" << needwr
-            << " bytes to write";
-        // FIXME: just like shadowsocks-libev, use a channel for write event ?
+        if (nwritten == -1 && errno_ != EAGAIN && errno_ != EWOULDBLOCK) {
+            MUQUINETD_LOG(error) << "::write " << string(strerror(errno_))
+                                 << ". This channel will be closed";
+            sChannel->unregisterSelf();
+            return;
+        }
+    }
+
+    /*  the peer is slow: queue it, flush on POLLOUT */
+
+    outQ.emplace_back(buf, needwr);
+    if (outQ.size() == 1) {
+        sChannel->enableWriting();
     }
+    if (outQ.size() == outQHighWater) {
+        MUQUINETD_LOG(warning) << "Peer of channel {fd = " << fd
+                               << "} is not reading, stop reading it";
+        sChannel->disableReading();
+    }
+}
+
+void
+ReqRespChannel::Impl::onWriteReady()
+{
+    while (!outQ.empty()) {
+        const string& msg = outQ.front();
+        int nwritten =
+            ::send(fd, msg.data(), msg.size(), MSG_DONTWAIT | MSG_NOSIGNAL);
+        if (nwritten == -1) {
+            int errno_ = errno;
+            if (errno_ == EAGAIN || errno_ == EWOULDBLOCK) {
+                return;
+            }
+            MUQUINETD_LOG(error) << "::write " << string(strerror(errno_))
+                                 << ". This channel will be closed";
+            outQ.clear();
+            sChannel->unregisterSelf();
+            return;
+        }
+        outQ.pop_front();
+    }
+
+    sChannel->disableWriting();
+    sChannel->enableReading();
 }
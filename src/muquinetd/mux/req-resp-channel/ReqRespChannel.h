@@ -20,10 +20,15 @@
 #ifndef MUQUINETD_MUX_REQRESPCHANNEL_H
 #define MUQUINETD_MUX_REQRESPCHANNEL_H
 
+#include <stdint.h>
+#include <sys/types.h>
+
 #include <functional>
 #include <memory>
 #include <vector>
 
+class Arena;
+class Readiness;
 class Socket;
 class Request;
 class Response;
@@ -33,6 +38,7 @@ class ReqRespChannel : public std::enable_shared_from_this<ReqRespChannel>
 {
 public:
     // ReqRespChannel 拥有 fd，并负责在自己销毁时 close(fd)
+    // -1: a socket on shared channels, see newShared()
     ReqRespChannel(int fd);
     ~ReqRespChannel();
     // Non-copyable, Non-moveable
@@ -76,12 +82,38 @@ public:
     // process information
     void setPeerName(const std::string&);
     const std::string& peerName();
+    // SO_PEERCRED of the connection, that given to newShared() if shared
     void setPeerPid(pid_t);
+    pid_t peerPid();
+    // fds given to the peer interceptor, 0 until its Atstart
+    int fdRangeCount();
+    void setFdRangeCount(int);
+    // fds passed (SCM_RIGHTS) with the Request being handled, the caller
+    // owns them. Those not taken are closed once the Request is handled.
+    std::vector<int> takePassedFds();
+    // the readiness region of the peer process lives as long as its
+    // process channel
+    void setReadiness(const std::shared_ptr<Readiness>&);
+    // so does its payload arena
+    void setArena(const std::shared_ptr<Arena>&);
 
     // 下接 Socket
     std::shared_ptr<Socket> socket();
     void setSocket(const std::shared_ptr<Socket>&);
 
+    // A socket on the shared channels of a process (RPC_SOCKET_ID, see
+    // rpc/rpc.h): it has no fd, Requests carrying its id are handled as
+    // its own and go back on the channel they came in on.
+    // Kept by Mux like the others.
+    static std::shared_ptr<ReqRespChannel> newShared(pid_t);
+    static std::shared_ptr<ReqRespChannel> ofSocketId(uint64_t);
+    // 0 unless shared
+    uint64_t socketId();
+    // The channel the Request being handled came in on (itself unless
+    // shared, nullptr outside a Request). WAIT_NEXT Responses are
+    // written to it later.
+    std::shared_ptr<ReqRespChannel> carrier();
+
 private:
     struct Impl;
     std::unique_ptr<Impl> _pImpl;
@@ -0,0 +1,165 @@
+/*
+ * muQuinet, an userspace TCP/IP network stack.
+ * Copyright (C) 2018 rtdarwin
+ *
+ * This program is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+
+ * You should have received a copy of the GNU General Public
+ * License along with this program.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+
+#include "muquinetd/Stats.h"
+
+#include <boost/thread/thread.hpp>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <string>
+
+#include "muquinetd/Logging.h"
+#include "muquinetd/base/Counters.h"
+#include "muquinetd/base/Latency.h"
+#include "muquinetd/muQuinetd.h"
+#include "rpc/rpc.h"
+
+using boost::thread;
+using std::string;
+
+struct Stats::Impl
+{
+    int listenfd = -1;
+    bool stopflag = false;
+    string socketPath;
+
+    void serve(int connfd);
+};
+
+// Reason that defaulted ctor/dtor definitions here:
+//  https://stackoverflow.com/questions/9954518/stdunique-ptr-with-an-incomplete-type-wont-compile/32269374
+Stats::Stats()
+{
+    _pImpl.reset(new Stats::Impl);
+}
+
+Stats::~Stats()
+{
+    if (_pImpl->listenfd != -1) {
+        ::close(_pImpl->listenfd);
+        ::unlink(_pImpl->socketPath.c_str());
+    }
+}
+
+void
+Stats::init()
+{
+    /*  1. 准备 socket 路径 */
+
+    struct sockaddr_un sa;
+    memset(&sa, 0, sizeof(struct sockaddr_un));
+    sa.sun_family = AF_UNIX;
+    snprintf(sa.sun_path, sizeof(sa.sun_path), "%s/%s",
+             rpc_master_listener_socket_dir(), MUQUINETD_STATS_SOCKET_NAME);
+    _pImpl->socketPath = sa.sun_path;
+
+    /*  2. 创建/绑定/监听 UNIX socket */
+
+    ::mkdir(rpc_master_listener_socket_dir(),
+            S_IRWXU | S_IRWXG | S_IROTH | S_IXOTH);
+    ::unlink(sa.sun_path);
+
+    int fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd == -1 ||
+        ::bind(fd, (const struct sockaddr*)&sa, sizeof(sa)) == -1 ||
+        ::listen(fd, 8) == -1) {
+        int errno_ = errno;
+        MUQUINETD_LOG(fatal) << "Failed to create stats socket: "
+                             << string(strerror(errno_));
+        muQuinetd::get()->stop();
+        muQuinetd::get()->exit(muQuinetd::exit_status::FAILURE);
+    }
+    _pImpl->listenfd = fd;
+
+    MUQUINETD_LOG(info) << "Stats exported at " << _pImpl->socketPath;
+}
+
+void
+Stats::start()
+{
+    MUQUINETD_LOG(debug) << "Starting stats_thread";
+    thread statsThread([this]() {
+        LoggingThreadInitializer i;
+        i.run();
+
+        while (!this->_pImpl->stopflag) {
+            int connfd = ::accept4(_pImpl->listenfd, NULL, NULL, SOCK_CLOEXEC);
+            if (connfd == -1) {
+                if (errno != EINTR && !this->_pImpl->stopflag) {
+                    int errno_ = errno;
+                    MUQUINETD_LOG(error) << "Stats ::accept "
+                                         << string(strerror(errno_));
+                }
+                continue;
+            }
+            _pImpl->serve(connfd);
+            ::close(connfd);
+        }
+    });
+    MUQUINETD_LOG(debug) << "Started stats_thread";
+}
+
+void
+Stats::stop()
+{
+    MUQUINETD_LOG(info) << "Stopping Stats";
+    _pImpl->stopflag = true;
+    // wake up accept()
+    ::shutdown(_pImpl->listenfd, SHUT_RDWR);
+}
+
+void
+Stats::Impl::serve(int connfd)
+{
+    /*  1. 读取格式（可选），不让客户端卡住我们 */
+
+    struct timeval tv = { 0, 200 * 1000 };
+    ::setsockopt(connfd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    ::setsockopt(connfd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+
+    char cmd[16] = { 0 };
+    ::read(connfd, cmd, sizeof(cmd) - 1);
+
+    /*  2. dump */
+
+    string dump;
+    if (strncmp(cmd, "json", 4) == 0) {
+        dump = "{\n\"counters\": " + Counters::dumpJson() +
+               ",\n\"latency\": " + Latency::dumpJson() + "}\n";
+    } else {
+        dump = Counters::dumpText() + Latency::dumpText();
+    }
+
+    const char* p = dump.data();
+    size_t left = dump.size();
+    while (left > 0) {
+        // the client may be gone already (`| head -1'): no SIGPIPE
+        ssize_t n = ::send(connfd, p, left, MSG_NOSIGNAL);
+        if (n <= 0)
+            break;
+        p += n;
+        left -= n;
+    }
+}
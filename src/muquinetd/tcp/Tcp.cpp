@@ -29,6 +29,8 @@
 #include "muquinetd/Logging.h"
 #include "muquinetd/Pcb.h"
 #include "muquinetd/SocketBuffer.h"
+#include "muquinetd/base/Counters.h"
+#include "muquinetd/base/Trace.h"
 #include "muquinetd/mux/Socket.h"
 #include "muquinetd/tcp/TcpPcb.h"
 
@@ -82,8 +84,10 @@ Tcp::removePcb(const std::shared_ptr<const Pcb>& pcb)
 }
 
 void
-Tcp::rx(const shared_ptr<SocketBuffer>& skbuf_head)
+Tcp::rx(SocketBufferPtr skbuf_head)
 {
+    Counters::add(Counters::TCP_RX_PACKETS);
+
     /*  1. len & checksum */
 
     // TODO
@@ -103,6 +107,9 @@ Tcp::rx(const shared_ptr<SocketBuffer>& skbuf_head)
     fport = tcphdr->source;
     lport = tcphdr->dest;
 
+    Trace::record(Trace::TCP_RX, skbuf_head.get(),
+                  ntohs(fport) << 16 | ntohs(lport), ntohl(tcphdr->seq));
+
     shared_ptr<Pcb> pcb;
     pcb = Pcbs::find(_pImpl->pcbs, faddr, fport, laddr, lport);
     if (!pcb) {
@@ -115,13 +122,14 @@ Tcp::rx(const shared_ptr<SocketBuffer>& skbuf_head)
                                 << ", dest port = " << __be16_to_cpu(lport)
                                 << "} will be droped ";
         }
+        Counters::add(Counters::TCP_RX_DROP_NO_RECEIVER);
         return;
     }
 
-    pcb->recv(skbuf_head);
+    pcb->recv(std::move(skbuf_head));
     {
         MUQUINETD_LOG(info) << "TCP Layer Delivered a TCP packet {sport = "
-                            << ntohs(tcphdr->source)
-                            << ", dport = " << ntohs(tcphdr->dest) << "}";
+                            << ntohs(fport) << ", dport = " << ntohs(lport)
+                            << "}";
     }
 }
@@ -30,13 +30,13 @@
 #include "muquinetd/Mux.h"
 #include "muquinetd/SocketBuffer.h"
 #include "muquinetd/base/InternetChecksum.h"
+#include "muquinetd/base/Probes.h"
 #include "muquinetd/mux/EventLoop.h"
 #include "muquinetd/mux/Socket.h"
 #include "muquinetd/tcp/TcpHeader.h"
 #include "muquinetd/tcp/TcpTimers.h"
 
 using std::shared_ptr;
-using std::make_shared;
 using std::string;
 
 namespace {
@@ -112,7 +112,30 @@ TcpPcb::send(const std::string& buf)
     // Super class first
     Pcb::send(buf);
 
-    shared_ptr<SocketBuffer> skbuf_head = this->socketBufferOfTcpTempl();
+    // Interface 层异步发送，payload 拷贝到 SocketBuffer 的 tailroom 中
+    SocketBufferPtr skbuf_head = this->socketBufferOfTcpTempl(buf.length());
+    memcpy(skbuf_head->hdrs_end, buf.data(), buf.length());
+    return this->txPayload(std::move(skbuf_head), buf.length());
+}
+
+int
+TcpPcb::sendFromPipe(int pipefd, int len, const struct sockaddr_in*)
+{
+    // Super class first
+    Pcb::send(string());
+
+    // 由内核从 interceptor vmsplice 进来的页直接拷贝到 tailroom，
+    // 用户态不再经手 payload
+    SocketBufferPtr skbuf_head = this->socketBufferOfTcpTempl(len);
+    if (!readPipe(pipefd, skbuf_head->hdrs_end, len)) {
+        return -1;
+    }
+    return this->txPayload(std::move(skbuf_head), len);
+}
+
+int
+TcpPcb::txPayload(SocketBufferPtr skbuf_head, int len)
+{
     TcpHeader* tcphdr = (TcpHeader*)skbuf_head->transport_hdr;
 
     /*  1. 不同 TCP 状态发不同类型的 TCP 报文 */
@@ -123,11 +146,12 @@ TcpPcb::send(const std::string& buf)
             tcphdr->seq = htonl(send_next), ++send_next;
             tcphdr->syn = 1;
 
+            MUQUINETD_PROBE3(tcp_state, this, conn_state, TCP_STATE__SYN_SENT);
             this->conn_state = TCP_STATE__SYN_SENT; //
             break;
         case TcpState::TCP_STATE__ESTABLISHED:
             tcphdr->seq = htonl(send_next);
-            send_next += buf.length();
+            send_next += len;
             tcphdr->ack = 1;
             tcphdr->ack_seq = htonl(recv_next);
             break;
@@ -139,15 +163,17 @@ TcpPcb::send(const std::string& buf)
             return 0;
     }
 
-    this->prepareBeforeIpTx(skbuf_head, buf);
-    Ip::get()->tx(skbuf_head, buf);
+    skbuf_head->user_payload_begin = skbuf_head->hdrs_end;
+    skbuf_head->user_payload_end = skbuf_head->hdrs_end + len;
+    this->prepareBeforeIpTx(skbuf_head, skbuf_head->user_payload_begin, len);
+    Ip::get()->tx(std::move(skbuf_head));
 
     // 假装没有错误发生
-    return buf.length();
+    return len;
 }
 
 void
-TcpPcb::recv(const std::shared_ptr<SocketBuffer>& skbuf)
+TcpPcb::recv(SocketBufferPtr skbuf)
 {
     TcpHeader* tcphdr = (TcpHeader*)skbuf->transport_hdr;
 
@@ -160,6 +186,8 @@ TcpPcb::recv(const std::shared_ptr<SocketBuffer>& skbuf)
             this->irs = ntohl(tcphdr->seq);
             this->recv_next = irs + 1;
             ++this->send_unack;
+            MUQUINETD_PROBE3(tcp_state, this, conn_state,
+                             TCP_STATE__ESTABLISHED);
             this->conn_state = TCP_STATE__ESTABLISHED;
 
             /*  2. sent ACK */
@@ -182,17 +210,23 @@ TcpPcb::recv(const std::shared_ptr<SocketBuffer>& skbuf)
             }
             skbuf->user_payload_begin = skbuf->transport_hdr + tcphdr->doff * 4;
             if (skbuf->user_payload_end - skbuf->user_payload_begin) {
+                // skbuf 交给 Socket 之后不能再访问
+                tcp_seq seq = ntohl(tcphdr->seq);
+                int payload_len =
+                    skbuf->user_payload_end - skbuf->user_payload_begin;
+
                 // Save to Socket buffer
                 struct sockaddr_in peer_addr;
                 shared_ptr<Socket> so = this->socket().lock();
-                so->putToRecvQ(peer_addr, skbuf);
+                so->putToRecvQ(peer_addr, std::move(skbuf));
 
                 // Send ACK
-                if (tcphdr->seq != this->recv_next) {
+                if (seq != this->recv_next) {
+                    MUQUINETD_PROBE3(tcp_out_of_order, this, seq,
+                                     this->recv_next);
                     MUQUINETD_LOG(warning) << "Out-of-order TCP segment...";
                 }
-                this->recv_next = ntohl(tcphdr->seq) + skbuf->user_payload_end -
-                                  skbuf->user_payload_begin;
+                this->recv_next = seq + payload_len;
                 this->ack2peer(this->recv_next);
             } else {
                 // do nothing
@@ -207,26 +241,25 @@ TcpPcb::recv(const std::shared_ptr<SocketBuffer>& skbuf)
     }
 }
 
-shared_ptr<SocketBuffer>
-TcpPcb::socketBufferOfTcpTempl()
+SocketBufferPtr
+TcpPcb::socketBufferOfTcpTempl(int payload_len)
 {
     /*  1. SocketBuffer */
 
     /*  SocketBuffer 链中第一个 SocketBuffer
      *   -  SocketBuffer 链中剩余部分由 IP 层分片时组建，此时
      *      只组建第一个 SocketBuffer 即可
+     *   -  tailroom 放得下 user payload（Ip 层会把它拷贝进来）
      */
 
-    const auto& skbuf_head = make_shared<SocketBuffer>();
+    SocketBufferPtr skbuf_head =
+        SocketBuffers::alloc(SocketBuffer::maxHdrsSize + payload_len);
     // SocketBuffer 内各 Header 指针
     {
-        bzero(skbuf_head->rawBytes, 120); // IP 60 + TCP 60
-
-        skbuf_head->hdrs_begin =
-            skbuf_head->rawBytes + 40; // 40 reserved for IP options
-        skbuf_head->network_hdr = skbuf_head->hdrs_begin;
-        skbuf_head->transport_hdr = skbuf_head->network_hdr + 20;
-        skbuf_head->hdrs_end = skbuf_head->transport_hdr + 20;
+        skbuf_head->reserve(SocketBuffer::maxHdrsSize);
+        skbuf_head->transport_hdr = skbuf_head->push(20);
+        skbuf_head->network_hdr = skbuf_head->push(20);
+        bzero(skbuf_head->hdrs_begin, 40); // IP 20 + TCP 20
     }
 
     /*  2. 通用的 TCP 和 IP 首部 */
@@ -243,8 +276,8 @@ TcpPcb::socketBufferOfTcpTempl()
 }
 
 void
-TcpPcb::prepareBeforeIpTx(const std::shared_ptr<SocketBuffer>& skbuf_head,
-                          const string& buf)
+TcpPcb::prepareBeforeIpTx(const SocketBufferPtr& skbuf_head,
+                          const char* payload, int len)
 {
     IpHeaderOverlay* ipovly = (IpHeaderOverlay*)skbuf_head->network_hdr;
     TcpHeader* tcphdr = (TcpHeader*)skbuf_head->transport_hdr;
@@ -252,7 +285,7 @@ TcpPcb::prepareBeforeIpTx(const std::shared_ptr<SocketBuffer>& skbuf_head,
     // 传输层设置的 ``与计算 TCP checksum 有关的'' IP Header
     {
         ipovly->protocol = 6; // 6 stands for TCP
-        ipovly->protocol_len = htons(buf.length() + 20);
+        ipovly->protocol_len = htons(len + 20);
         memcpy(&ipovly->saddr, &this->laddr, sizeof(__be32));
         memcpy(&ipovly->daddr, &this->faddr, sizeof(__be32));
     }
@@ -270,10 +303,10 @@ TcpPcb::prepareBeforeIpTx(const std::shared_ptr<SocketBuffer>& skbuf_head,
         // }
 
         uint32_t sum = 0;
-        if (buf.length()) {
-            int count = buf.length();
+        if (len) {
+            int count = len;
 
-            uint16_t* ptr = (uint16_t*)buf.c_str();
+            uint16_t* ptr = (uint16_t*)payload;
             while (count > 1) {
                 /*  This is the inner loop */
                 sum += *ptr++;
@@ -293,7 +326,7 @@ TcpPcb::prepareBeforeIpTx(const std::shared_ptr<SocketBuffer>& skbuf_head,
     {
         ipovly->ttl = 64;
         ipovly->tos = 0;
-        ipovly->len = htons(buf.length() + 40);
+        ipovly->len = htons(len + 40);
         ipovly->protocol_len = 0; // don't forget this (iphdr->checksum)
     }
 
@@ -314,7 +347,7 @@ TcpPcb::prepareBeforeIpTx(const std::shared_ptr<SocketBuffer>& skbuf_head,
 void
 TcpPcb::ack2peer(tcp_seq value)
 {
-    shared_ptr<SocketBuffer> skbuf_head = this->socketBufferOfTcpTempl();
+    SocketBufferPtr skbuf_head = this->socketBufferOfTcpTempl();
     TcpHeader* tcphdr = (TcpHeader*)skbuf_head->transport_hdr;
 
     tcphdr->ack = 1;
@@ -323,5 +356,5 @@ TcpPcb::ack2peer(tcp_seq value)
 
     prepareBeforeIpTx(skbuf_head);
     string empty;
-    Ip::get()->tx(skbuf_head, empty);
+    Ip::get()->tx(std::move(skbuf_head), empty);
 }
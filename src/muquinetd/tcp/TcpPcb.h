@@ -38,14 +38,18 @@ public:
     virtual SelectableChannel* getConnEstabNotifyChannel() override;
     virtual void disconnect() override;
     virtual int send(const std::string& buf) override;
-    virtual void recv(const std::shared_ptr<SocketBuffer>&) override;
+    virtual int sendFromPipe(int pipefd, int len,
+                             const struct sockaddr_in* dest) override;
+    virtual void recv(SocketBufferPtr) override;
 
     virtual __be16 nextAvailLocalPort() override;
 
 private:
-    std::shared_ptr<SocketBuffer> socketBufferOfTcpTempl();
-    void prepareBeforeIpTx(const std::shared_ptr<SocketBuffer>&,
-                           const std::string& buf = std::string());
+    SocketBufferPtr socketBufferOfTcpTempl(int payload_len = 0);
+    // payload of len bytes already in the tailroom
+    int txPayload(SocketBufferPtr, int len);
+    void prepareBeforeIpTx(const SocketBufferPtr&,
+                           const char* payload = nullptr, int len = 0);
     void ack2peer(tcp_seq);
 
 private:
@@ -0,0 +1,184 @@
+/*
+ * muQuinet, an userspace TCP/IP network stack.
+ * Copyright (C) 2018 rtdarwin
+ *
+ * This program is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+
+ * You should have received a copy of the GNU General Public
+ * License along with this program.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+
+/* muquinetd-trace-dump: print the packet-path trace rings of muquinetd
+ *
+ * usage: muquinetd-trace-dump [-n LAST] [TRACE_FILE]
+ *
+ * TRACE_FILE defaults to <run dir>/trace.buf; use trace.buf.old for the
+ * previous (e.g. crashed) run. Reads the file directly, so it works
+ * whether the daemon is running, hung or dead. Records being written
+ * while we read may come out torn.
+ */
+
+#include <fcntl.h>
+#include <getopt.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "muquinetd/base/Trace.h"
+#include "rpc/rpc.h"
+
+using Trace::Record;
+
+namespace {
+
+struct Entry
+{
+    Record rec;
+    const Trace::Ring* ring;
+};
+
+void
+printArgs(const Record& r)
+{
+    switch (r.event) {
+        case Trace::NETDEV_RX:
+        case Trace::IP_ENRXQ:
+            printf("len=%u", r.arg0);
+            break;
+        case Trace::IP_DEFRAG:
+            printf("off=%u mf=%u reassembled=%llu", (r.arg0 & 0xffff) * 8,
+                   r.arg0 >> 16, (unsigned long long)r.arg1);
+            break;
+        case Trace::TCP_RX:
+            printf("sport=%u dport=%u seq=%llu", r.arg0 >> 16, r.arg0 & 0xffff,
+                   (unsigned long long)r.arg1);
+            break;
+        case Trace::UDP_RX:
+            printf("sport=%u dport=%u len=%llu", r.arg0 >> 16, r.arg0 & 0xffff,
+                   (unsigned long long)r.arg1);
+            break;
+        case Trace::SOCKET_PUTRECVQ:
+            printf("%s", r.arg0 ? "queued" : "dropped");
+            break;
+        case Trace::RPC_WRITE:
+            printf("returning=%u bytes=%llu", r.arg0,
+                   (unsigned long long)r.arg1);
+            break;
+        case Trace::INTERFACE_TX:
+            printf("burst=%u", r.arg0);
+            break;
+        default:
+            printf("arg0=%u arg1=%llu", r.arg0, (unsigned long long)r.arg1);
+            break;
+    }
+}
+
+} // namespace {
+
+int
+main(int argc, char* argv[])
+{
+    long last = 0; // 0: all
+
+    int opt;
+    while ((opt = getopt(argc, argv, "n:h")) != -1) {
+        switch (opt) {
+            case 'n':
+                last = atol(optarg);
+                break;
+            default:
+                fprintf(stderr, "usage: %s [-n LAST] [TRACE_FILE]\n", argv[0]);
+                return 1;
+        }
+    }
+
+    std::string path = optind < argc
+                           ? std::string(argv[optind])
+                           : std::string(rpc_master_listener_socket_dir()) +
+                                 "/" + MUQUINETD_TRACE_FILE_NAME;
+
+    /*  1. 映射 trace 文件（只读） */
+
+    int fd = ::open(path.c_str(), O_RDONLY);
+    struct stat st;
+    if (fd == -1 || fstat(fd, &st) == -1) {
+        perror(path.c_str());
+        return 1;
+    }
+    if ((size_t)st.st_size < sizeof(Trace::File)) {
+        fprintf(stderr, "%s: not a muquinetd trace file\n", path.c_str());
+        return 1;
+    }
+    void* addr = mmap(NULL, sizeof(Trace::File), PROT_READ, MAP_SHARED, fd, 0);
+    if (addr == MAP_FAILED) {
+        perror("mmap");
+        return 1;
+    }
+    const Trace::File* file = (const Trace::File*)addr;
+    const Trace::FileHeader& hdr = file->hdr;
+
+    if (memcmp(hdr.magic, MUQUINETD_TRACE_MAGIC, sizeof(hdr.magic)) != 0 ||
+        hdr.ringEntries != (uint32_t)Trace::ringEntries ||
+        hdr.maxRings != (uint32_t)Trace::maxRings) {
+        fprintf(stderr, "%s: not a muquinetd trace file (or another version)\n",
+                path.c_str());
+        return 1;
+    }
+
+    /*  2. 收集所有环里的记录，按 TSC 排序 */
+
+    std::vector<Entry> entries;
+    uint32_t nrings = std::min(hdr.ringsUsed.load(), hdr.maxRings);
+    for (uint32_t i = 0; i < nrings; ++i) {
+        const Trace::Ring& ring = file->rings[i];
+        uint64_t head = ring.head.load(std::memory_order_acquire);
+        uint64_t n = std::min<uint64_t>(head, Trace::ringEntries);
+        for (uint64_t k = head - n; k < head; ++k) {
+            entries.push_back(
+                { ring.records[k & (Trace::ringEntries - 1)], &ring });
+        }
+    }
+    std::sort(entries.begin(), entries.end(),
+              [](const Entry& a, const Entry& b) {
+                  return a.rec.tsc < b.rec.tsc;
+              });
+    if (last > 0 && entries.size() > (size_t)last) {
+        entries.erase(entries.begin(), entries.end() - last);
+    }
+
+    /*  3. 输出 */
+
+    printf("# muquinetd pid %u, %u thread(s), %zu record(s)\n", hdr.pid,
+           nrings, entries.size());
+    printf("# time(us, relative)  thread  event  skb  args\n");
+
+    uint64_t firstTsc = entries.empty() ? 0 : entries.front().rec.tsc;
+    for (const Entry& e : entries) {
+        double us = (e.rec.tsc - firstTsc) / hdr.tscPerNs / 1000.0;
+        printf("%14.3f  %u/%-15.15s  %-16s  ", us, e.ring->tid,
+               e.ring->threadName, Trace::eventName(e.rec.event));
+        if (e.rec.skb)
+            printf("skb=0x%llx  ", (unsigned long long)e.rec.skb);
+        printArgs(e.rec);
+        printf("\n");
+    }
+
+    return 0;
+}
@@ -30,6 +30,8 @@
 #include "muquinetd/Logging.h"
 #include "muquinetd/Pcb.h"
 #include "muquinetd/SocketBuffer.h"
+#include "muquinetd/base/Counters.h"
+#include "muquinetd/base/Trace.h"
 #include "muquinetd/udp/UdpHeader.h"
 #include "muquinetd/udp/UdpPcb.h"
 
@@ -86,8 +88,10 @@ Udp::removePcb(const std::shared_ptr<const Pcb>& pcb)
 }
 
 void
-Udp::rx(const shared_ptr<SocketBuffer>& skbuf_head)
+Udp::rx(SocketBufferPtr skbuf_head)
 {
+    Counters::add(Counters::UDP_RX_PACKETS);
+
     /*  1. len & checksum */
 
     // TODO
@@ -107,6 +111,9 @@ Udp::rx(const shared_ptr<SocketBuffer>& skbuf_head)
     fport = udphdr->source;
     lport = udphdr->dest;
 
+    Trace::record(Trace::UDP_RX, skbuf_head.get(),
+                  ntohs(fport) << 16 | ntohs(lport), ntohs(udphdr->len));
+
     shared_ptr<Pcb> pcb;
     pcb = Pcbs::find(_pImpl->pcbs, faddr, fport, laddr, lport);
     if (!pcb) {
@@ -119,6 +126,7 @@ Udp::rx(const shared_ptr<SocketBuffer>& skbuf_head)
                                 << ", dest port = " << __be16_to_cpu(lport)
                                 << "} will be droped ";
         }
+        Counters::add(Counters::UDP_RX_DROP_NO_RECEIVER);
         return;
     }
 
@@ -128,11 +136,11 @@ Udp::rx(const shared_ptr<SocketBuffer>& skbuf_head)
     peeraddr.sin_addr = *(struct in_addr*)&iphdr_ovly->saddr;
     peeraddr.sin_port = udphdr->source;
 
-    pcb->recv(peeraddr, skbuf_head);
+    pcb->recv(peeraddr, std::move(skbuf_head));
 
     {
         MUQUINETD_LOG(info) << "UDP Layer Delivered an UDP packet {sport = "
-                            << ntohs(udphdr->source)
-                            << ", dport = " << ntohs(udphdr->dest) << "}";
+                            << ntohs(fport) << ", dport = " << ntohs(lport)
+                            << "}";
     }
 }
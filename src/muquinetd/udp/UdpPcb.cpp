@@ -31,7 +31,6 @@
 #include "muquinetd/udp/UdpHeader.h"
 
 using std::shared_ptr;
-using std::make_shared;
 
 namespace {
 
@@ -63,17 +62,16 @@ UdpPcb::send(const std::string& buf)
      *      只组建第一个 SocketBuffer 即可
      */
 
-    const auto& skbuf_head = make_shared<SocketBuffer>();
+    // tailroom 放得下 user payload（Ip 层会把它拷贝进来）
+    SocketBufferPtr skbuf_head =
+        SocketBuffers::alloc(SocketBuffer::maxHdrsSize + buf.length());
 
     // SocketBuffer 内各 Header 指针
     {
-        bzero(skbuf_head->rawBytes, 68);
-
-        skbuf_head->hdrs_begin =
-            skbuf_head->rawBytes + 40; // 40 reserved for IP options
-        skbuf_head->network_hdr = skbuf_head->hdrs_begin;
-        skbuf_head->transport_hdr = skbuf_head->network_hdr + 20;
-        skbuf_head->hdrs_end = skbuf_head->hdrs_begin + 28;
+        skbuf_head->reserve(SocketBuffer::maxHdrsSize);
+        skbuf_head->transport_hdr = skbuf_head->push(8);
+        skbuf_head->network_hdr = skbuf_head->push(20);
+        bzero(skbuf_head->hdrs_begin, 28); // IP 20 + UDP 8
     }
 
     IpHeaderOverlay* ipovly = (IpHeaderOverlay*)skbuf_head->network_hdr;
@@ -116,7 +114,7 @@ UdpPcb::send(const std::string& buf)
     }
 
     ipovly->protocol_len = 0; // don't forget this (iphdr->checksum)
-    Ip::get()->tx(skbuf_head, buf);
+    Ip::get()->tx(std::move(skbuf_head), buf);
 
     // 假装没有错误发生
     return buf.length();
@@ -136,15 +134,11 @@ UdpPcb::send(const struct in_addr& faddr, __be16 fport, const std::string& buf)
 }
 
 void
-UdpPcb::recv(struct sockaddr_in& peeraddr,
-             const std::shared_ptr<SocketBuffer>& skbuf)
+UdpPcb::recv(struct sockaddr_in& peeraddr, SocketBufferPtr skbuf)
 {
-    // Super class first
-    Pcb::recv(peeraddr, skbuf);
-
     skbuf->user_payload_begin = skbuf->transport_hdr + 8;
 
     // FIXME: race condition with EventLoop thread
     shared_ptr<Socket> socket = this->socket().lock();
-    socket->putToRecvQ(peeraddr, skbuf);
+    socket->putToRecvQ(peeraddr, std::move(skbuf));
 }
@@ -22,7 +22,7 @@
 
 #include "muquinetd/Pcb.h"
 
-class SocketBuffer;
+class SocketBufferPtr;
 
 class UdpPcb : public Pcb
 {
@@ -33,8 +33,7 @@ public:
     virtual int send(const std::string& buf) override;
     virtual int send(const struct in_addr& faddr, __be16 fport,
                      const std::string& buf) override;
-    virtual void recv(struct sockaddr_in& peeraddr,
-                      const std::shared_ptr<SocketBuffer>&) override;
+    virtual void recv(struct sockaddr_in& peeraddr, SocketBufferPtr) override;
 
     virtual __be16 nextAvailLocalPort() override;
 };
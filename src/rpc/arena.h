@@ -0,0 +1,65 @@
+/*
+ * muQuinet, an userspace TCP/IP network stack.
+ * Copyright (C) 2018 rtdarwin
+ *
+ * This program is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+
+ * You should have received a copy of the GNU General Public
+ * License along with this program.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef MUQUINET_RPC_ARENA_H
+#define MUQUINET_RPC_ARENA_H
+
+/*
+ * Payload arena shared between muQuinetd and an interceptor, so that bulk
+ * payloads neither go through the channel nor are limited by
+ * RPC_MESSAGE_MAX_SIZE:
+ *
+ *  - the interceptor creates a memfd of RPC_ARENA_SIZE bytes, sealed with
+ *    RPC_ARENA_SEALS (the mapping can't be cut under muQuinetd), and passes
+ *    it (SCM_RIGHTS) along with its first Atstart Request, after the
+ *    readiness fds if any (rpc/readiness.h): 3 fds are readiness memfd,
+ *    eventfd and arena memfd, 1 fd is the arena memfd alone
+ *  - muQuinetd maps it and acknowledges it with an RPC_ARENA_LENGTH
+ *    field, the mapped size, in Response.atstartAction
+ *  - Request.Sendto then carries its payload as {RPC_ARENA_OFFSET,
+ *    RPC_ARENA_LENGTH} into the arena, with an empty buf
+ *  - Request.Recvfrom carries the region muQuinetd writes the payload
+ *    into, Response.Recvfrom.ret being the bytes written there (its buf
+ *    stays empty)
+ *
+ * The fields are varints outside of the .proto files: they travel as
+ * unknown fields of the messages, which both protobuf runtimes keep.
+ * Each interceptor thread owns one RPC_ARENA_CHUNK_SIZE chunk, the region
+ * of a call is only touched by muQuinetd while the call is pending.
+ */
+
+#define RPC_ARENA_SIZE (256 << 20)
+#define RPC_ARENA_CHUNK_SIZE (4 << 20)
+#define RPC_ARENA_CHUNKS (RPC_ARENA_SIZE / RPC_ARENA_CHUNK_SIZE)
+// smaller payloads stay inline
+#define RPC_ARENA_THRESHOLD 4096
+// A Sendto's payload is cut to this, muQuinetd sends one IPv4 packet at
+// most: a stream socket sends one segment of it (the device MTU less 40
+// bytes), a short write.
+// Just over what a packet holds, so that a datagram too large still fails
+// with EMSGSIZE instead of going out truncated.
+#define RPC_ARENA_SEND_MAX 65536
+
+// fcntl(F_ADD_SEALS) of the memfd, muQuinetd rejects it without them
+#define RPC_ARENA_SEALS (F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL)
+
+#define RPC_ARENA_OFFSET 100
+#define RPC_ARENA_LENGTH 101
+
+#endif // MUQUINET_RPC_ARENA_H
@@ -0,0 +1,114 @@
+/*
+ * muQuinet, an userspace TCP/IP network stack.
+ * Copyright (C) 2018 rtdarwin
+ *
+ * This program is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+
+ * You should have received a copy of the GNU General Public
+ * License along with this program.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef MUQUINET_RPC_READINESS_H
+#define MUQUINET_RPC_READINESS_H
+
+/*
+ * Socket readiness shared between muQuinetd and an interceptor, so that
+ * poll()/select()/epoll_wait() never need a Request:
+ *
+ *  - the interceptor creates a memfd holding struct rpc_readiness, sealed
+ *    with RPC_READINESS_SEALS, and an eventfd, and passes both
+ *    (SCM_RIGHTS, in this order) along with its first Atstart Request
+ *  - Response.socketCall.ret > 0 is then the readiness slot of the new
+ *    socket plus 1 (0: no slot, the socket is always reported ready)
+ *  - muQuinetd sets/clears POLL* bits of the slot as the socket's receive
+ *    queue fills/drains, and writes the eventfd when it sets a bit while
+ *    an interceptor thread is (about to be) blocked, i.e. waiters != 0
+ *
+ * Both sides use sequentially consistent atomics on `waiters' and
+ * `events', so a bit set right before a thread blocks is never missed.
+ *
+ * The slot also carries asynchronous sends: `credits' are the payload
+ * bytes the interceptor may still send on the socket without waiting for
+ * a Response. It takes them before sending a Sendto marked with an
+ * RPC_SEND_ASYNC field (an unknown field, like those of rpc/arena.h),
+ * which gets no Response. muQuinetd gives the bytes back once the stack
+ * took the payload, and leaves a failure in `errors', reported (and
+ * cleared) by the interceptor's next call on the socket.
+ *
+ * And received datagrams, pushed ahead of recv(): `prefetch' of a slot
+ * is one of the `rings' plus 1 (0: none). A record is taken whole, so
+ * stream sockets are never prefetched. muQuinetd appends a record per
+ * SocketBuffer of the receive queue, up to its prefetch budget, and only
+ * moves `head'; the interceptor serves recv() from the records and moves
+ * `tail'. Records always come before what is still queued in muQuinetd,
+ * so a Recvfrom reaching muQuinetd while the ring is not empty gets an
+ * empty Response.recvfromCall with an RPC_RECV_PREFETCHED field, telling
+ * the interceptor to read the ring again.
+ *
+ * Edges: `gens' of a slot is bumped after every set, even of bits that
+ * were set already (one more packet queued), so that the interceptor can
+ * tell something happened since it last looked (EPOLLET). Such a set also
+ * writes the eventfd while `edge_waiters' != 0, i.e. some of the waiters
+ * wait for edges.
+ */
+
+#include <netinet/in.h>
+#include <stdint.h>
+
+#include "rpc.h"
+
+#define RPC_READINESS_SLOTS RPC_FD_RANGE_MAX
+// fcntl(F_ADD_SEALS) of the memfd, muQuinetd rejects it without them
+#define RPC_READINESS_SEALS (F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL)
+
+#define RPC_SEND_ASYNC 102
+// larger payloads are always sent synchronously. One IPv4 packet's worth
+// of TCP payload: muQuinetd sends all of an asynchronous send, in as many
+// segments as the device MTU takes.
+#define RPC_SEND_ASYNC_MAX (65535 - 40)
+
+#define RPC_RECV_PREFETCHED 103
+#define RPC_PREFETCH_RINGS 1024
+#define RPC_PREFETCH_SIZE 65536 // power of 2
+
+// Followed by `len' bytes of payload. Records and payload wrap around.
+struct rpc_prefetch_record
+{
+    uint32_t len;
+    uint32_t reserved;
+    struct sockaddr_in addr;
+};
+
+struct rpc_prefetch
+{
+    uint32_t head; // bytes appended, by muQuinetd
+    uint32_t reserved1[15];
+    uint32_t tail; // bytes consumed, by the interceptor
+    uint32_t reserved2[15];
+    char data[RPC_PREFETCH_SIZE];
+};
+
+struct rpc_readiness
+{
+    uint32_t waiters;
+    uint32_t edge_waiters;
+    uint32_t reserved[14];
+    uint32_t events[RPC_READINESS_SLOTS]; // POLLIN | POLLOUT | ...
+    uint32_t gens[RPC_READINESS_SLOTS];   // bumped by every set
+    int32_t credits[RPC_READINESS_SLOTS];  // bytes
+    int32_t errors[RPC_READINESS_SLOTS];   // errno, 0 for none
+    int32_t prefetch[RPC_READINESS_SLOTS]; // ring + 1, 0 for none
+    struct rpc_prefetch rings[RPC_PREFETCH_RINGS];
+};
+
+#endif // MUQUINET_RPC_READINESS_H
@@ -25,5 +25,54 @@
 
 #define RPC_MASTER_LISTENER_SOCKET_DIR "/run/muquinetd"
 #define RPC_MASTER_LISTENER_SOCKET_NAME "master.socket"
+// Overrides RPC_MASTER_LISTENER_SOCKET_DIR, e.g. to run without root
+#define RPC_MASTER_LISTENER_SOCKET_DIR_ENV "MUQUINET_RUN_DIR"
+
+// fd range of an interceptor: [START, START + count). The first Atstart
+// gets INITIAL fds, each further Atstart on the same channel doubles them.
+#define RPC_FD_RANGE_START 4096
+#define RPC_FD_RANGE_INITIAL 1024
+#define RPC_FD_RANGE_MAX 65536
+
+// Several Requests (Responses) in one channel message: RPC_BATCH_MARKER,
+// then each message preceded by its varint length. 0 is never a valid
+// protobuf tag, so the first byte tells a batch from a single message.
+// Batched calls (Sendto and Recvfrom) never wait: muQuinetd handles their
+// Recvfrom as if MSG_DONTWAIT was given. Once one of them fails, the ones
+// after it are not run and fail with ECANCELED. So does a Recvfrom whose
+// len the rest of the reply (one RPC_MESSAGE_MAX_SIZE message) has no
+// room for; the first call of a batch returns what fits instead.
+#define RPC_BATCH_MARKER 0x00
+#define RPC_BATCH_MAX 64
+
+// Fields numbered from 100 (here and in rpc/arena.h, rpc/readiness.h,
+// rpc/splice.h) are not in the .proto files, so that the generated code
+// stays as is: they travel as varint unknown fields, read and written
+// through interceptor/rpc-field.h and muquinetd/mux/RpcFields.h.
+
+// Shared channels: instead of a channel of its own, a socket may use the
+// channel of whichever interceptor thread calls on it. Such Requests carry
+// an RPC_SOCKET_ID unknown field (varint) with the id muQuinetd returned
+// in the same field of Response.socketCall, the Socket call itself
+// carrying id 0. Calls are synchronous, so the Responses on a channel
+// still come in the order of its Requests. A shared socket lives until
+// its Close, or until the process channel of its process is closed: a
+// fork()ed child opens one of its own, sending Atstart until its fd range
+// is the one it inherited.
+#define RPC_SOCKET_ID 104
+
+// Response.recvfromCall carries an RPC_RECV_TRUNC unknown field (varint 1)
+// when the datagram was longer than what it returns (Request.recvfromCall
+// len, or the arena region): MSG_TRUNC for recvmsg.
+#define RPC_RECV_TRUNC 106
+
+#include <stdlib.h>
+
+static inline const char*
+rpc_master_listener_socket_dir(void)
+{
+    const char* dir = getenv(RPC_MASTER_LISTENER_SOCKET_DIR_ENV);
+    return (dir && *dir) ? dir : RPC_MASTER_LISTENER_SOCKET_DIR;
+}
 
 #endif // MUQUINET_RPC_H
@@ -0,0 +1,50 @@
+/*
+ * muQuinet, an userspace TCP/IP network stack.
+ * Copyright (C) 2018 rtdarwin
+ *
+ * This program is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+
+ * You should have received a copy of the GNU General Public
+ * License along with this program.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef MUQUINET_RPC_SPLICE_H
+#define MUQUINET_RPC_SPLICE_H
+
+/*
+ * Bulk sends through a pipe, so that their payload is never copied in
+ * user space:
+ *
+ *  - each interceptor thread owns a pipe. It vmsplice()s the pages of a
+ *    Sendto's payload into it, then passes the read end (SCM_RIGHTS)
+ *    along with the Request, whose buf is empty and which carries an
+ *    RPC_SPLICE_LENGTH field: the bytes now in the pipe
+ *  - muQuinetd reads up to that many bytes out of the pipe, straight
+ *    into the SocketBuffer of the TCP segment, before it answers
+ *
+ * The pipe refers to the application's own pages, which are only safe to
+ * modify again once muQuinetd read them: spliced sends are synchronous,
+ * never asynchronous ones (rpc/readiness.h). After a failed call the pipe
+ * or a short write the pipe may still hold payload, the interceptor
+ * replaces it.
+ */
+
+#define RPC_SPLICE_LENGTH 105
+// smaller payloads go inline or through the arena (rpc/arena.h)
+#define RPC_SPLICE_THRESHOLD 16384
+// what the pipe holds at most. muQuinetd only reads one segment's worth
+// of it (the device MTU less 40 bytes) and returns a short write, the
+// interceptor then drops the pipe with the rest.
+#define RPC_SPLICE_MAX (65535 - 40)
+
+#endif // MUQUINET_RPC_SPLICE_H
@@ -0,0 +1,106 @@
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+// Sends msg to an echo peer and waits for the echo to be reported
+static int
+echo_and_wait(int sockfd, int epfd, const struct sockaddr_in* remote,
+              const char* msg)
+{
+    struct epoll_event ev;
+
+    {
+        printf("sendto: %s\n", msg);
+    }
+    sendto(sockfd, msg, strlen(msg), 0, (const struct sockaddr*)remote,
+           sizeof(struct sockaddr_in));
+
+    int n = epoll_wait(epfd, &ev, 1, 1000);
+    {
+        printf("epoll_wait: %d {events = %#x}\n", n, n > 0 ? ev.events : 0);
+    }
+    return n;
+}
+
+int
+main(int argc, char* argv[])
+{
+    char* dest_ipaddr = argv[1];
+    short dest_port = atoi(argv[2]);
+    int failed = 0;
+
+    /* 1. socket, epoll (EPOLLET) */
+
+    {
+        printf("socket\n");
+    }
+    int sockfd = socket(AF_INET, SOCK_DGRAM, 0);
+    if (sockfd == -1) {
+        perror("sockfd");
+    }
+
+    int epfd = epoll_create1(0);
+    struct epoll_event ev;
+    ev.events = EPOLLIN | EPOLLET;
+    ev.data.fd = sockfd;
+    if (epoll_ctl(epfd, EPOLL_CTL_ADD, sockfd, &ev) == -1) {
+        perror("epoll_ctl");
+    }
+
+    struct sockaddr_in remote;
+    bzero(&remote, sizeof(struct sockaddr_in));
+    remote.sin_family = AF_INET;
+    inet_pton(AF_INET, dest_ipaddr, &remote.sin_addr);
+    remote.sin_port = htons(dest_port);
+
+    /* 2. an edge per datagram, even while the socket stays readable */
+
+    if (echo_and_wait(sockfd, epfd, &remote, "first") != 1) {
+        failed = 1;
+    }
+    // not read: the socket stays readable
+    if (echo_and_wait(sockfd, epfd, &remote, "second") != 1) {
+        printf("no edge for a datagram while readable\n");
+        failed = 1;
+    }
+
+    // no new datagram, no new edge
+    int n = epoll_wait(epfd, &ev, 1, 100);
+    {
+        printf("epoll_wait without a new datagram: %d\n", n);
+    }
+    if (n != 0) {
+        failed = 1;
+    }
+
+    /* 3. close: nothing of the socket (or of muQuinet) is reported */
+
+    close(sockfd);
+    n = epoll_wait(epfd, &ev, 1, 100);
+    {
+        printf("epoll_wait after close: %d\n", n);
+    }
+    if (n != 0) {
+        failed = 1;
+    }
+
+    /* - close */
+
+    close(epfd);
+
+    {
+        printf("%s\n", failed ? "FAILED" : "OK");
+    }
+    return failed;
+}
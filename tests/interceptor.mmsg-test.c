@@ -0,0 +1,122 @@
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#define NSEND 3
+#define VLEN 8
+
+int
+main(int argc, char* argv[])
+{
+    char* dest_ipaddr = argv[1];
+    short dest_port = atoi(argv[2]);
+    int failed = 0;
+
+    /* 1. socket */
+
+    {
+        printf("socket\n");
+    }
+    int sockfd = socket(AF_INET, SOCK_DGRAM, 0);
+    if (sockfd == -1) {
+        perror("sockfd");
+    }
+
+    struct sockaddr_in remote;
+    bzero(&remote, sizeof(struct sockaddr_in));
+    remote.sin_family = AF_INET;
+    inet_pton(AF_INET, dest_ipaddr, &remote.sin_addr);
+    remote.sin_port = htons(dest_port);
+
+    /* 2. sendmmsg NSEND datagrams to an echo peer */
+
+    const char* msgs[NSEND] = { "one", "two", "three" };
+    struct mmsghdr out[NSEND];
+    struct iovec out_iov[NSEND];
+    bzero(out, sizeof(out));
+    for (int i = 0; i < NSEND; ++i) {
+        out_iov[i].iov_base = (void*)msgs[i];
+        out_iov[i].iov_len = strlen(msgs[i]);
+        out[i].msg_hdr.msg_iov = &out_iov[i];
+        out[i].msg_hdr.msg_iovlen = 1;
+        out[i].msg_hdr.msg_name = &remote;
+        out[i].msg_hdr.msg_namelen = sizeof(struct sockaddr_in);
+    }
+    int n = sendmmsg(sockfd, out, NSEND, 0);
+    {
+        printf("sendmmsg: %d\n", n);
+    }
+    if (n != NSEND) {
+        failed = 1;
+    }
+    // let all the echoes come back
+    usleep(100 * 1000);
+
+    /* 3. recvmmsg of VLEN: only the NSEND queued come back */
+
+    char bufs[VLEN][256];
+    struct mmsghdr in[VLEN];
+    struct iovec in_iov[VLEN];
+    struct sockaddr_in from[VLEN];
+    bzero(in, sizeof(in));
+    for (int i = 0; i < VLEN; ++i) {
+        in_iov[i].iov_base = bufs[i];
+        in_iov[i].iov_len = sizeof(bufs[i]);
+        in[i].msg_hdr.msg_iov = &in_iov[i];
+        in[i].msg_hdr.msg_iovlen = 1;
+        in[i].msg_hdr.msg_name = &from[i];
+        in[i].msg_hdr.msg_namelen = sizeof(struct sockaddr_in);
+    }
+    n = recvmmsg(sockfd, in, VLEN, 0, NULL);
+    {
+        printf("recvmmsg: %d\n", n);
+    }
+    if (n != NSEND) {
+        failed = 1;
+    }
+    for (int i = 0; i < n && i < NSEND; ++i) {
+        {
+            printf("recvmmsg[%d]: %.*s\n", i, (int)in[i].msg_len, bufs[i]);
+        }
+        if (in[i].msg_len != strlen(msgs[i]) ||
+            memcmp(bufs[i], msgs[i], in[i].msg_len) != 0) {
+            failed = 1;
+        }
+    }
+
+    /* 4. a datagram longer than its buffer: cut, MSG_TRUNC */
+
+    const char* msg = "a datagram longer than 4 bytes";
+    sendto(sockfd, msg, strlen(msg), 0, &remote, sizeof(struct sockaddr_in));
+
+    in_iov[0].iov_len = 4;
+    in[0].msg_hdr.msg_namelen = sizeof(struct sockaddr_in);
+    n = recvmmsg(sockfd, in, 1, 0, NULL);
+    {
+        printf("recvmmsg: %d {msg_len = %u, MSG_TRUNC = %d}\n", n,
+               in[0].msg_len, !!(in[0].msg_hdr.msg_flags & MSG_TRUNC));
+    }
+    if (n != 1 || in[0].msg_len != 4 ||
+        !(in[0].msg_hdr.msg_flags & MSG_TRUNC)) {
+        failed = 1;
+    }
+
+    /* - close */
+
+    close(sockfd);
+
+    {
+        printf("%s\n", failed ? "FAILED" : "OK");
+    }
+    return failed;
+}
@@ -0,0 +1,109 @@
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/sendfile.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#define FILE_SIZE (256 * 1024)
+
+int
+main(int argc, char* argv[])
+{
+    char* dest_ipaddr = argv[1];
+    short dest_port = atoi(argv[2]);
+    int failed = 0;
+
+    /* 1. a file to send */
+
+    char path[] = "/tmp/muquinet-sendfile-XXXXXX";
+    int filefd = mkstemp(path);
+    if (filefd == -1) {
+        perror("mkstemp");
+        return 1;
+    }
+    unlink(path);
+
+    static char block[4096];
+    for (int i = 0; i < FILE_SIZE; i += sizeof(block)) {
+        memset(block, 'a' + (i / sizeof(block)) % 26, sizeof(block));
+        write(filefd, block, sizeof(block));
+    }
+
+    /* 2. socket, connect */
+
+    {
+        printf("socket\n");
+    }
+    int sockfd = socket(AF_INET, SOCK_STREAM, 0);
+    if (sockfd == -1) {
+        perror("sockfd");
+    }
+
+    struct sockaddr_in remote;
+    remote.sin_family = AF_INET;
+    inet_pton(AF_INET, dest_ipaddr, &remote.sin_addr);
+    remote.sin_port = htons(dest_port);
+
+    {
+        printf("connect\n");
+    }
+    if (connect(sockfd, &remote, sizeof(struct sockaddr_in)) == -1) {
+        perror("conncect");
+    }
+
+    /* 3. sendfile with an offset: short sends, *offset follows them */
+
+    off_t offset = 0;
+    int nshort = 0;
+    while (offset < FILE_SIZE) {
+        off_t before = offset;
+        ssize_t n = sendfile(sockfd, filefd, &offset, FILE_SIZE - offset);
+        if (n <= 0) {
+            perror("sendfile");
+            failed = 1;
+            break;
+        }
+        if (offset - before != n) {
+            printf("sendfile: %zd, but offset moved by %lld\n", n,
+                   (long long)(offset - before));
+            failed = 1;
+        }
+        if (n < FILE_SIZE - before) {
+            ++nshort;
+        }
+    }
+    {
+        printf("sendfile: %lld bytes, %d short send(s)\n", (long long)offset,
+               nshort);
+    }
+
+    /* 4. sendfile without: the file position follows them */
+
+    lseek(filefd, 0, SEEK_SET);
+    ssize_t n = sendfile(sockfd, filefd, NULL, FILE_SIZE);
+    off_t pos = lseek(filefd, 0, SEEK_CUR);
+    {
+        printf("sendfile: %zd, file position %lld\n", n, (long long)pos);
+    }
+    if (n <= 0 || pos != n) {
+        failed = 1;
+    }
+
+    /* - close */
+
+    close(sockfd);
+    close(filefd);
+
+    {
+        printf("%s\n", failed ? "FAILED" : "OK");
+    }
+    return failed;
+}